@@ -0,0 +1,1907 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * rdf_binary.c - RDF binary dump format parser and serializer
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ *
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <rdf_config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_rdf_config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include <redland.h>
+#include <rdf_types.h>
+
+
+/*
+ * Format
+ *
+ * A header of the 8 byte magic string, a 4 byte version and 4 bytes
+ * of flags, followed by blocks.  Each block has a 14 byte header:
+ *   type (1 byte) - 'D' for data, 'E' for the end
+ *   flags (1 byte) - LIBRDF_BINARY_BLOCK_DEFLATE if compressed
+ *   length of the data (4 bytes)
+ *   length of the data as stored (4 bytes)
+ *   CRC-32 of the data (4 bytes)
+ * All integers in headers are little endian.
+ *
+ * Data blocks hold records that start with a record type and are
+ * made of unsigned LEB128 variable length integers and strings
+ * (a length then the bytes):
+ *   URI:     string
+ *   blank:   string
+ *   literal: string, language string, datatype term ID or 0
+ *   triple:  subject, predicate and object term IDs
+ *   quad:    subject, predicate, object and context term IDs
+ * Terms are numbered from 1 in the order they appear.  The end block
+ * holds the number of terms and statements.
+ */
+
+#define LIBRDF_BINARY_SYNTAX_NAME "redland-binary"
+#define LIBRDF_BINARY_MIME_TYPE "application/x-redland-binary"
+
+#define LIBRDF_BINARY_MAGIC "LRDFBIN\n"
+#define LIBRDF_BINARY_MAGIC_LEN 8
+#define LIBRDF_BINARY_VERSION 1
+#define LIBRDF_BINARY_HEADER_LEN (LIBRDF_BINARY_MAGIC_LEN + 8)
+
+/* header flags */
+#define LIBRDF_BINARY_FLAG_CONTEXTS 1
+
+#define LIBRDF_BINARY_BLOCK_HEADER_LEN 14
+#define LIBRDF_BINARY_BLOCK_DATA 'D'
+#define LIBRDF_BINARY_BLOCK_END 'E'
+
+/* block flags */
+#define LIBRDF_BINARY_BLOCK_DEFLATE 1
+
+/* Data size at which the serializer ends a block */
+#define LIBRDF_BINARY_BLOCK_SIZE (1024 * 1024)
+
+/* Largest block accepted by the parser; the serializer ends a block
+ * early rather than let a record take it over this size */
+#define LIBRDF_BINARY_MAX_BLOCK_SIZE (64 * 1024 * 1024)
+
+/* Most bytes used by the numbers of a record other than string lengths */
+#define LIBRDF_BINARY_RECORD_NUMBERS_LEN (5 * 10)
+
+typedef enum {
+  LIBRDF_BINARY_RECORD_URI = 1,
+  LIBRDF_BINARY_RECORD_BLANK,
+  LIBRDF_BINARY_RECORD_LITERAL,
+  LIBRDF_BINARY_RECORD_TRIPLE,
+  LIBRDF_BINARY_RECORD_QUAD
+} librdf_binary_record_type;
+
+
+static void
+librdf_binary_crc32_init(u32* table)
+{
+  u32 i;
+
+  for(i = 0; i < 256; i++) {
+    u32 c = i;
+    int k;
+
+    for(k = 0; k < 8; k++)
+      c = (c & 1) ? (0xedb88320UL ^ (c >> 1)) : (c >> 1);
+    table[i] = c;
+  }
+}
+
+
+static u32
+librdf_binary_crc32(const u32* table, const unsigned char* data, size_t length)
+{
+  u32 crc = 0xffffffffUL;
+
+  while(length--)
+    crc = table[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+
+  return crc ^ 0xffffffffUL;
+}
+
+
+static void
+librdf_binary_put_u32(unsigned char* buffer, u32 value)
+{
+  buffer[0] = (unsigned char)(value & 0xff);
+  buffer[1] = (unsigned char)((value >> 8) & 0xff);
+  buffer[2] = (unsigned char)((value >> 16) & 0xff);
+  buffer[3] = (unsigned char)((value >> 24) & 0xff);
+}
+
+
+static u32
+librdf_binary_get_u32(const unsigned char* buffer)
+{
+  return (u32)buffer[0] | ((u32)buffer[1] << 8) |
+         ((u32)buffer[2] << 16) | ((u32)buffer[3] << 24);
+}
+
+
+
+/* Serializer */
+
+typedef struct librdf_binary_term_s {
+  struct librdf_binary_term_s* next;
+  u32 hash;
+  u64 id;
+  size_t length;
+  unsigned char key[1];         /* encoded node */
+} librdf_binary_term;
+
+
+typedef struct {
+  librdf_world* world;
+  raptor_iostream* iostr;
+  u32 crc_table[256];
+
+  /* terms seen: chains of power of two buckets */
+  librdf_binary_term** buckets;
+  u64 buckets_count;
+  u64 terms_count;
+  unsigned char* key;
+  size_t key_size;
+
+  u64 statements_count;
+
+  /* data block being built */
+  unsigned char* block;
+  size_t block_length;
+  size_t block_size;
+
+  unsigned char* stored;
+  size_t stored_size;
+} librdf_binary_writer;
+
+
+typedef struct {
+  librdf_serializer *serializer;
+} librdf_serializer_binary_context;
+
+
+static int
+librdf_binary_writer_reserve(librdf_binary_writer* writer, size_t length)
+{
+  unsigned char* block;
+  size_t size;
+
+  if(writer->block_length + length <= writer->block_size)
+    return 0;
+
+  size = writer->block_size ? writer->block_size : LIBRDF_BINARY_BLOCK_SIZE + 1024;
+  while(size < writer->block_length + length)
+    size *= 2;
+
+  block = LIBRDF_MALLOC(unsigned char*, size);
+  if(!block)
+    return 1;
+  if(writer->block) {
+    memcpy(block, writer->block, writer->block_length);
+    LIBRDF_FREE(char*, writer->block);
+  }
+  writer->block = block;
+  writer->block_size = size;
+
+  return 0;
+}
+
+
+static int
+librdf_binary_writer_put_number(librdf_binary_writer* writer, u64 value)
+{
+  if(librdf_binary_writer_reserve(writer, 10))
+    return 1;
+
+  while(value >= 0x80) {
+    writer->block[writer->block_length++] = (unsigned char)((value & 0x7f) | 0x80);
+    value >>= 7;
+  }
+  writer->block[writer->block_length++] = (unsigned char)value;
+
+  return 0;
+}
+
+
+static int
+librdf_binary_writer_put_string(librdf_binary_writer* writer,
+                                const unsigned char* string, size_t length)
+{
+  if(librdf_binary_writer_put_number(writer, (u64)length) ||
+     librdf_binary_writer_reserve(writer, length))
+    return 1;
+
+  if(length)
+    memcpy(writer->block + writer->block_length, string, length);
+  writer->block_length += length;
+
+  return 0;
+}
+
+
+/*
+ * librdf_binary_writer_write_block - Write a block of data
+ * @writer: writer
+ * @type: block type
+ * @data: data
+ * @length: data length
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_binary_writer_write_block(librdf_binary_writer* writer, int type,
+                                 const unsigned char* data, size_t length)
+{
+  unsigned char header[LIBRDF_BINARY_BLOCK_HEADER_LEN];
+  const unsigned char* stored = data;
+  size_t stored_length = length;
+  int flags = 0;
+
+#ifdef HAVE_ZLIB
+  if(length > 64) {
+    uLongf deflated_length = compressBound((uLong)length);
+
+    if(writer->stored_size < (size_t)deflated_length) {
+      if(writer->stored)
+        LIBRDF_FREE(char*, writer->stored);
+      writer->stored = LIBRDF_MALLOC(unsigned char*, (size_t)deflated_length);
+      if(!writer->stored) {
+        writer->stored_size = 0;
+        return 1;
+      }
+      writer->stored_size = (size_t)deflated_length;
+    }
+
+    /* Store the block as is unless compressing makes it smaller */
+    if(compress2(writer->stored, &deflated_length, data, (uLong)length,
+                 Z_BEST_SPEED) == Z_OK &&
+       (size_t)deflated_length < length) {
+      stored = writer->stored;
+      stored_length = (size_t)deflated_length;
+      flags |= LIBRDF_BINARY_BLOCK_DEFLATE;
+    }
+  }
+#endif
+
+  header[0] = (unsigned char)type;
+  header[1] = (unsigned char)flags;
+  librdf_binary_put_u32(header + 2, (u32)length);
+  librdf_binary_put_u32(header + 6, (u32)stored_length);
+  librdf_binary_put_u32(header + 10,
+                        librdf_binary_crc32(writer->crc_table, data, length));
+
+  if(raptor_iostream_write_bytes(header, 1, LIBRDF_BINARY_BLOCK_HEADER_LEN,
+                                 writer->iostr) != LIBRDF_BINARY_BLOCK_HEADER_LEN)
+    return 1;
+  if(stored_length &&
+     raptor_iostream_write_bytes(stored, 1, stored_length,
+                                 writer->iostr) != (int)stored_length)
+    return 1;
+
+  return 0;
+}
+
+
+static int
+librdf_binary_writer_flush(librdf_binary_writer* writer)
+{
+  int rc;
+
+  if(!writer->block_length)
+    return 0;
+
+  rc = librdf_binary_writer_write_block(writer, LIBRDF_BINARY_BLOCK_DATA,
+                                        writer->block, writer->block_length);
+  writer->block_length = 0;
+
+  return rc;
+}
+
+
+/*
+ * librdf_binary_writer_start_record - Make room for a record in the block
+ * @writer: writer
+ * @length: most bytes the record will use
+ *
+ * Records cannot span blocks, so the block being built is written
+ * first if the record would take it over the largest size a parser
+ * accepts.
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_binary_writer_start_record(librdf_binary_writer* writer, size_t length)
+{
+  if(length > LIBRDF_BINARY_MAX_BLOCK_SIZE) {
+    librdf_log(writer->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_SERIALIZER,
+               NULL, "Cannot write a term of %lu bytes, larger than a block",
+               (unsigned long)length);
+    return 1;
+  }
+
+  if(writer->block_length + length > LIBRDF_BINARY_MAX_BLOCK_SIZE)
+    return librdf_binary_writer_flush(writer);
+
+  return 0;
+}
+
+
+static int
+librdf_binary_writer_init(librdf_binary_writer* writer, librdf_world* world,
+                          raptor_iostream* iostr, int flags)
+{
+  unsigned char header[LIBRDF_BINARY_HEADER_LEN];
+
+  memset(writer, '\0', sizeof(*writer));
+  writer->world = world;
+  writer->iostr = iostr;
+  librdf_binary_crc32_init(writer->crc_table);
+
+  writer->buckets_count = 1024;
+  writer->buckets = LIBRDF_CALLOC(librdf_binary_term**,
+                                  (size_t)writer->buckets_count,
+                                  sizeof(librdf_binary_term*));
+  if(!writer->buckets)
+    return 1;
+
+  memcpy(header, LIBRDF_BINARY_MAGIC, LIBRDF_BINARY_MAGIC_LEN);
+  librdf_binary_put_u32(header + LIBRDF_BINARY_MAGIC_LEN,
+                        LIBRDF_BINARY_VERSION);
+  librdf_binary_put_u32(header + LIBRDF_BINARY_MAGIC_LEN + 4, (u32)flags);
+
+  if(raptor_iostream_write_bytes(header, 1, LIBRDF_BINARY_HEADER_LEN,
+                                 iostr) != LIBRDF_BINARY_HEADER_LEN)
+    return 1;
+
+  return 0;
+}
+
+
+static void
+librdf_binary_writer_finish(librdf_binary_writer* writer)
+{
+  u64 i;
+
+  if(writer->buckets) {
+    for(i = 0; i < writer->buckets_count; i++) {
+      librdf_binary_term* term = writer->buckets[i];
+
+      while(term) {
+        librdf_binary_term* next = term->next;
+
+        LIBRDF_FREE(librdf_binary_term, term);
+        term = next;
+      }
+    }
+    LIBRDF_FREE(librdf_binary_term**, writer->buckets);
+  }
+  if(writer->key)
+    LIBRDF_FREE(char*, writer->key);
+  if(writer->block)
+    LIBRDF_FREE(char*, writer->block);
+  if(writer->stored)
+    LIBRDF_FREE(char*, writer->stored);
+}
+
+
+/* Double the number of buckets when the chains get long */
+static int
+librdf_binary_writer_grow(librdf_binary_writer* writer)
+{
+  librdf_binary_term** buckets;
+  u64 count = writer->buckets_count * 2;
+  u64 i;
+
+  buckets = LIBRDF_CALLOC(librdf_binary_term**, (size_t)count,
+                          sizeof(librdf_binary_term*));
+  if(!buckets)
+    return 1;
+
+  for(i = 0; i < writer->buckets_count; i++) {
+    librdf_binary_term* term = writer->buckets[i];
+
+    while(term) {
+      librdf_binary_term* next = term->next;
+      u64 bucket = term->hash & (count - 1);
+
+      term->next = buckets[bucket];
+      buckets[bucket] = term;
+      term = next;
+    }
+  }
+
+  LIBRDF_FREE(librdf_binary_term**, writer->buckets);
+  writer->buckets = buckets;
+  writer->buckets_count = count;
+
+  return 0;
+}
+
+
+/*
+ * librdf_binary_writer_term - Get the ID of a term, writing it if new
+ * @writer: writer
+ * @node: node
+ *
+ * Return value: term ID or 0 on failure
+ */
+static u64
+librdf_binary_writer_term(librdf_binary_writer* writer, librdf_node* node)
+{
+  librdf_binary_term* term;
+  size_t length;
+  u32 hash = 2166136261UL;
+  u64 datatype_id = 0;
+  size_t i;
+  int rc = 0;
+
+  length = librdf_node_encode(node, NULL, 0);
+  if(!length)
+    return 0;
+  if(length > writer->key_size) {
+    if(writer->key)
+      LIBRDF_FREE(char*, writer->key);
+    writer->key_size = length + 256;
+    writer->key = LIBRDF_MALLOC(unsigned char*, writer->key_size);
+    if(!writer->key) {
+      writer->key_size = 0;
+      return 0;
+    }
+  }
+  librdf_node_encode(node, writer->key, length);
+
+  /* FNV-1a */
+  for(i = 0; i < length; i++)
+    hash = (hash ^ writer->key[i]) * 16777619UL;
+
+  for(term = writer->buckets[hash & (writer->buckets_count - 1)];
+      term; term = term->next) {
+    if(term->hash == hash && term->length == length &&
+       !memcmp(term->key, writer->key, length))
+      return term->id;
+  }
+
+  /* New term; a literal datatype is written first */
+  switch(librdf_node_get_type(node)) {
+    case LIBRDF_NODE_TYPE_RESOURCE:
+      {
+        size_t uri_length;
+        unsigned char* uri_string;
+
+        uri_string = librdf_uri_as_counted_string(librdf_node_get_uri(node),
+                                                  &uri_length);
+        rc = librdf_binary_writer_start_record(writer,
+                                               LIBRDF_BINARY_RECORD_NUMBERS_LEN + uri_length) ||
+             librdf_binary_writer_put_number(writer, LIBRDF_BINARY_RECORD_URI) ||
+             librdf_binary_writer_put_string(writer, uri_string, uri_length);
+      }
+      break;
+
+    case LIBRDF_NODE_TYPE_BLANK:
+      {
+        size_t id_length;
+        unsigned char* id;
+
+        id = librdf_node_get_counted_blank_identifier(node, &id_length);
+        rc = librdf_binary_writer_start_record(writer,
+                                               LIBRDF_BINARY_RECORD_NUMBERS_LEN + id_length) ||
+             librdf_binary_writer_put_number(writer, LIBRDF_BINARY_RECORD_BLANK) ||
+             librdf_binary_writer_put_string(writer, id, id_length);
+      }
+      break;
+
+    case LIBRDF_NODE_TYPE_LITERAL:
+      {
+        size_t value_length;
+        unsigned char* value;
+        const char* language;
+        librdf_uri* datatype;
+
+        datatype = librdf_node_get_literal_value_datatype_uri(node);
+        if(datatype) {
+          librdf_node* datatype_node;
+
+          datatype_node = librdf_new_node_from_uri(writer->world, datatype);
+          if(!datatype_node)
+            return 0;
+          datatype_id = librdf_binary_writer_term(writer, datatype_node);
+          librdf_free_node(datatype_node);
+          if(!datatype_id)
+            return 0;
+          /* the key buffer was reused; encode this node again */
+          librdf_node_encode(node, writer->key, length);
+        }
+
+        value = librdf_node_get_literal_value_as_counted_string(node,
+                                                                &value_length);
+        language = librdf_node_get_literal_value_language(node);
+        rc = librdf_binary_writer_start_record(writer,
+                                               LIBRDF_BINARY_RECORD_NUMBERS_LEN + value_length +
+                                               (language ? strlen(language) : 0)) ||
+             librdf_binary_writer_put_number(writer, LIBRDF_BINARY_RECORD_LITERAL) ||
+             librdf_binary_writer_put_string(writer, value, value_length) ||
+             librdf_binary_writer_put_string(writer,
+                                             (const unsigned char*)language,
+                                             language ? strlen(language) : 0) ||
+             librdf_binary_writer_put_number(writer, datatype_id);
+      }
+      break;
+
+    case LIBRDF_NODE_TYPE_UNKNOWN:
+    default:
+      librdf_log(writer->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_SERIALIZER,
+                 NULL, "Cannot write node type %d",
+                 librdf_node_get_type(node));
+      return 0;
+  }
+  if(rc)
+    return 0;
+
+  term = (librdf_binary_term*)LIBRDF_MALLOC(librdf_binary_term*,
+                                            sizeof(*term) + length);
+  if(!term)
+    return 0;
+  term->hash = hash;
+  term->length = length;
+  term->id = ++writer->terms_count;
+  memcpy(term->key, writer->key, length);
+  term->next = writer->buckets[hash & (writer->buckets_count - 1)];
+  writer->buckets[hash & (writer->buckets_count - 1)] = term;
+
+  if(writer->terms_count > writer->buckets_count * 2)
+    librdf_binary_writer_grow(writer);
+
+  return term->id;
+}
+
+
+static int
+librdf_binary_writer_statement(librdf_binary_writer* writer,
+                               librdf_statement* statement,
+                               librdf_node* context_node)
+{
+  u64 s, p, o, c = 0;
+
+  s = librdf_binary_writer_term(writer, librdf_statement_get_subject(statement));
+  p = librdf_binary_writer_term(writer, librdf_statement_get_predicate(statement));
+  o = librdf_binary_writer_term(writer, librdf_statement_get_object(statement));
+  if(context_node)
+    c = librdf_binary_writer_term(writer, context_node);
+  if(!s || !p || !o || (context_node && !c))
+    return 1;
+
+  if(librdf_binary_writer_start_record(writer,
+                                       LIBRDF_BINARY_RECORD_NUMBERS_LEN) ||
+     librdf_binary_writer_put_number(writer,
+                                     c ? LIBRDF_BINARY_RECORD_QUAD :
+                                         LIBRDF_BINARY_RECORD_TRIPLE) ||
+     librdf_binary_writer_put_number(writer, s) ||
+     librdf_binary_writer_put_number(writer, p) ||
+     librdf_binary_writer_put_number(writer, o) ||
+     (c && librdf_binary_writer_put_number(writer, c)))
+    return 1;
+
+  writer->statements_count++;
+
+  if(writer->block_length >= LIBRDF_BINARY_BLOCK_SIZE)
+    return librdf_binary_writer_flush(writer);
+
+  return 0;
+}
+
+
+/*
+ * librdf_serializer_binary_write_stream - Write a stream in the binary format
+ * @context: serializer context
+ * @stream: stream
+ * @iostr: iostream to write to (not freed)
+ * @flags: header flags
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_serializer_binary_write_stream(void* context, librdf_stream* stream,
+                                      raptor_iostream* iostr, int flags)
+{
+  librdf_serializer_binary_context* scontext=(librdf_serializer_binary_context*)context;
+  librdf_binary_writer writer;
+  unsigned char end[20];
+  size_t end_length = 0;
+  u64 value;
+  int i;
+  int rc;
+
+  rc = librdf_binary_writer_init(&writer, scontext->serializer->world, iostr,
+                                 flags);
+
+  while(!rc && !librdf_stream_end(stream)) {
+    librdf_statement *statement = librdf_stream_get_object(stream);
+    librdf_node *context_node = librdf_stream_get_context2(stream);
+
+    rc = librdf_binary_writer_statement(&writer, statement, context_node);
+    librdf_stream_next(stream);
+  }
+
+  if(!rc)
+    rc = librdf_binary_writer_flush(&writer);
+
+  if(!rc) {
+    /* end block: term count then statement count */
+    for(i = 0; i < 2; i++) {
+      value = i ? writer.statements_count : writer.terms_count;
+      while(value >= 0x80) {
+        end[end_length++] = (unsigned char)((value & 0x7f) | 0x80);
+        value >>= 7;
+      }
+      end[end_length++] = (unsigned char)value;
+    }
+    rc = librdf_binary_writer_write_block(&writer, LIBRDF_BINARY_BLOCK_END,
+                                          end, end_length);
+  }
+  if(!rc)
+    rc = raptor_iostream_write_end(iostr);
+
+  librdf_binary_writer_finish(&writer);
+
+  if(rc)
+    librdf_log(scontext->serializer->world, 0, LIBRDF_LOG_ERROR,
+               LIBRDF_FROM_SERIALIZER, NULL,
+               "Failed to write binary RDF");
+
+  return rc;
+}
+
+
+static int
+librdf_serializer_binary_init(librdf_serializer *serializer, void *context)
+{
+  librdf_serializer_binary_context* scontext=(librdf_serializer_binary_context*)context;
+
+  scontext->serializer = serializer;
+
+  return 0;
+}
+
+
+static void
+librdf_serializer_binary_terminate(void *context)
+{
+  /* nothing to do */
+}
+
+
+static librdf_node*
+librdf_serializer_binary_get_feature(void *context, librdf_uri* feature)
+{
+  return NULL;
+}
+
+
+static int
+librdf_serializer_binary_set_feature(void *context,
+                                     librdf_uri *feature, librdf_node* value)
+{
+  return 1;
+}
+
+
+static int
+librdf_serializer_binary_set_namespace(void* context,
+                                       librdf_uri *uri, const char *prefix)
+{
+  /* namespaces are not used */
+  return 0;
+}
+
+
+static int
+librdf_serializer_binary_serialize_stream_to_file_handle(void *context,
+                                                         FILE *handle,
+                                                         librdf_uri* base_uri,
+                                                         librdf_stream *stream)
+{
+  librdf_serializer_binary_context* scontext=(librdf_serializer_binary_context*)context;
+  raptor_iostream *iostr;
+  int rc;
+
+  if(!stream)
+    return 1;
+
+  iostr = raptor_new_iostream_to_file_handle(scontext->serializer->world->raptor_world_ptr,
+                                             handle);
+  if(!iostr)
+    return 1;
+
+  rc = librdf_serializer_binary_write_stream(context, stream, iostr,
+                                             LIBRDF_BINARY_FLAG_CONTEXTS);
+  raptor_free_iostream(iostr);
+
+  return rc;
+}
+
+
+/* Header flags for a model: contexts only if the model can have them */
+static int
+librdf_serializer_binary_model_flags(librdf_model* model)
+{
+  return librdf_model_supports_contexts(model) ? LIBRDF_BINARY_FLAG_CONTEXTS : 0;
+}
+
+
+static int
+librdf_serializer_binary_serialize_model_to_file_handle(void *context,
+                                                        FILE *handle,
+                                                        librdf_uri* base_uri,
+                                                        librdf_model *model)
+{
+  librdf_serializer_binary_context* scontext=(librdf_serializer_binary_context*)context;
+  raptor_iostream *iostr;
+  librdf_stream *stream;
+  int rc;
+
+  stream = librdf_model_as_stream(model);
+  if(!stream)
+    return 1;
+
+  iostr = raptor_new_iostream_to_file_handle(scontext->serializer->world->raptor_world_ptr,
+                                             handle);
+  if(!iostr) {
+    librdf_free_stream(stream);
+    return 1;
+  }
+
+  rc = librdf_serializer_binary_write_stream(context, stream, iostr,
+                                             librdf_serializer_binary_model_flags(model));
+  raptor_free_iostream(iostr);
+  librdf_free_stream(stream);
+
+  return rc;
+}
+
+
+static unsigned char*
+librdf_serializer_binary_write_to_counted_string(void *context,
+                                                 librdf_stream *stream,
+                                                 int flags,
+                                                 size_t* length_p)
+{
+  librdf_serializer_binary_context* scontext=(librdf_serializer_binary_context*)context;
+  raptor_iostream *iostr;
+  void *string = NULL;
+  size_t string_length = 0;
+  int rc;
+
+  iostr = raptor_new_iostream_to_string(scontext->serializer->world->raptor_world_ptr,
+                                        &string, &string_length, malloc);
+  if(!iostr)
+    return NULL;
+
+  rc = librdf_serializer_binary_write_stream(context, stream, iostr, flags);
+
+  /* sets string */
+  raptor_free_iostream(iostr);
+
+  if(rc) {
+    if(string)
+      raptor_free_memory(string);
+    return NULL;
+  }
+
+  if(length_p)
+    *length_p = string_length;
+
+  return (unsigned char*)string;
+}
+
+
+static unsigned char*
+librdf_serializer_binary_serialize_stream_to_counted_string(void *context,
+                                                            librdf_uri* base_uri,
+                                                            librdf_stream *stream,
+                                                            size_t* length_p)
+{
+  if(!stream)
+    return NULL;
+
+  return librdf_serializer_binary_write_to_counted_string(context, stream,
+                                                          LIBRDF_BINARY_FLAG_CONTEXTS,
+                                                          length_p);
+}
+
+
+static unsigned char*
+librdf_serializer_binary_serialize_model_to_counted_string(void *context,
+                                                           librdf_uri* base_uri,
+                                                           librdf_model *model,
+                                                           size_t* length_p)
+{
+  unsigned char *string;
+  librdf_stream *stream;
+
+  stream = librdf_model_as_stream(model);
+  if(!stream)
+    return NULL;
+
+  string = librdf_serializer_binary_write_to_counted_string(context, stream,
+                                                            librdf_serializer_binary_model_flags(model),
+                                                            length_p);
+  librdf_free_stream(stream);
+
+  return string;
+}
+
+
+static int
+librdf_serializer_binary_serialize_stream_to_iostream(void *context,
+                                                      librdf_uri* base_uri,
+                                                      librdf_stream *stream,
+                                                      raptor_iostream* iostr)
+{
+  int rc;
+
+  if(!iostr)
+    return 1;
+
+  if(!stream) {
+    raptor_free_iostream(iostr);
+    return 1;
+  }
+
+  rc = librdf_serializer_binary_write_stream(context, stream, iostr,
+                                             LIBRDF_BINARY_FLAG_CONTEXTS);
+
+  /* takes ownership of iostr */
+  raptor_free_iostream(iostr);
+
+  return rc;
+}
+
+
+static int
+librdf_serializer_binary_serialize_model_to_iostream(void *context,
+                                                     librdf_uri* base_uri,
+                                                     librdf_model *model,
+                                                     raptor_iostream* iostr)
+{
+  librdf_stream *stream;
+  int rc;
+
+  if(!iostr)
+    return 1;
+
+  stream = librdf_model_as_stream(model);
+  if(!stream) {
+    raptor_free_iostream(iostr);
+    return 1;
+  }
+
+  rc = librdf_serializer_binary_write_stream(context, stream, iostr,
+                                             librdf_serializer_binary_model_flags(model));
+  librdf_free_stream(stream);
+
+  /* takes ownership of iostr */
+  raptor_free_iostream(iostr);
+
+  return rc;
+}
+
+
+static void
+librdf_serializer_binary_register_factory(librdf_serializer_factory *factory)
+{
+  factory->context_length = sizeof(librdf_serializer_binary_context);
+
+  factory->init  = librdf_serializer_binary_init;
+  factory->terminate = librdf_serializer_binary_terminate;
+
+  factory->get_feature = librdf_serializer_binary_get_feature;
+  factory->set_feature = librdf_serializer_binary_set_feature;
+  factory->set_namespace = librdf_serializer_binary_set_namespace;
+
+  factory->serialize_stream_to_file_handle = librdf_serializer_binary_serialize_stream_to_file_handle;
+  factory->serialize_model_to_file_handle = librdf_serializer_binary_serialize_model_to_file_handle;
+  factory->serialize_stream_to_counted_string = librdf_serializer_binary_serialize_stream_to_counted_string;
+  factory->serialize_model_to_counted_string = librdf_serializer_binary_serialize_model_to_counted_string;
+  factory->serialize_stream_to_iostream = librdf_serializer_binary_serialize_stream_to_iostream;
+  factory->serialize_model_to_iostream = librdf_serializer_binary_serialize_model_to_iostream;
+}
+
+
+/**
+ * librdf_serializer_binary_constructor:
+ * @world: redland world object
+ *
+ * INTERNAL - Initialise the binary serializer module.
+ *
+ **/
+void
+librdf_serializer_binary_constructor(librdf_world *world)
+{
+  librdf_serializer_register_factory(world, LIBRDF_BINARY_SYNTAX_NAME,
+                                     "Redland binary RDF dump",
+                                     LIBRDF_BINARY_MIME_TYPE, NULL,
+                                     &librdf_serializer_binary_register_factory);
+}
+
+
+
+/* Parser */
+
+typedef struct {
+  librdf_world* world;
+  u32 crc_table[256];
+
+  /* one of these sources */
+  FILE *fh;
+  int close_fh;
+  raptor_iostream* iostr;
+  unsigned char* memory;        /* owned copy */
+  size_t memory_length;
+  size_t memory_offset;
+
+  int flags;
+
+  /* current data block */
+  unsigned char* block;
+  size_t block_size;
+  size_t block_length;
+  size_t block_offset;
+  unsigned char* stored;
+  size_t stored_size;
+
+  /* terms by ID - 1 */
+  librdf_node** terms;
+  u64 terms_count;
+  u64 terms_size;
+  u64 statements_count;
+
+  int finished;
+  int failed;
+
+  /* current statement and context */
+  librdf_statement* statement;
+  librdf_node* context_node;
+} librdf_binary_reader;
+
+
+typedef struct {
+  librdf_parser *parser;
+} librdf_parser_binary_context;
+
+
+static size_t
+librdf_binary_reader_read(librdf_binary_reader* reader,
+                          unsigned char* buffer, size_t length)
+{
+  if(reader->fh)
+    return fread(buffer, 1, length, reader->fh);
+
+  if(reader->iostr) {
+    int count = raptor_iostream_read_bytes(buffer, 1, length, reader->iostr);
+    return count < 0 ? 0 : (size_t)count;
+  }
+
+  if(length > reader->memory_length - reader->memory_offset)
+    length = reader->memory_length - reader->memory_offset;
+  memcpy(buffer, reader->memory + reader->memory_offset, length);
+  reader->memory_offset += length;
+
+  return length;
+}
+
+
+static void
+librdf_binary_reader_error(librdf_binary_reader* reader, const char* message)
+{
+  librdf_log(reader->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_PARSER, NULL,
+             "Bad binary RDF - %s", message);
+  reader->finished = 1;
+}
+
+
+static int
+librdf_binary_reader_get_number(librdf_binary_reader* reader, u64* value_p)
+{
+  u64 value = 0;
+  int shift = 0;
+
+  while(reader->block_offset < reader->block_length && shift < 64) {
+    unsigned char c = reader->block[reader->block_offset++];
+
+    value |= ((u64)(c & 0x7f)) << shift;
+    if(!(c & 0x80)) {
+      *value_p = value;
+      return 0;
+    }
+    shift += 7;
+  }
+
+  librdf_binary_reader_error(reader, "truncated number");
+  return 1;
+}
+
+
+static int
+librdf_binary_reader_get_string(librdf_binary_reader* reader,
+                                const unsigned char** string_p,
+                                size_t* length_p)
+{
+  u64 length;
+
+  if(librdf_binary_reader_get_number(reader, &length))
+    return 1;
+  if(length > (u64)(reader->block_length - reader->block_offset)) {
+    librdf_binary_reader_error(reader, "truncated string");
+    return 1;
+  }
+
+  *string_p = reader->block + reader->block_offset;
+  *length_p = (size_t)length;
+  reader->block_offset += (size_t)length;
+
+  return 0;
+}
+
+
+static librdf_node*
+librdf_binary_reader_get_term(librdf_binary_reader* reader)
+{
+  u64 id;
+
+  if(librdf_binary_reader_get_number(reader, &id))
+    return NULL;
+  if(!id || id > reader->terms_count) {
+    librdf_binary_reader_error(reader, "unknown term");
+    return NULL;
+  }
+
+  return reader->terms[id - 1];
+}
+
+
+/*
+ * librdf_binary_reader_load_block - Read and check the next block
+ * @reader: reader
+ *
+ * Return value: block type, 0 at the end of input or -1 on failure
+ */
+static int
+librdf_binary_reader_load_block(librdf_binary_reader* reader)
+{
+  unsigned char header[LIBRDF_BINARY_BLOCK_HEADER_LEN];
+  size_t length;
+  size_t stored_length;
+  size_t count;
+  int flags;
+
+  count = librdf_binary_reader_read(reader, header,
+                                    LIBRDF_BINARY_BLOCK_HEADER_LEN);
+  if(!count)
+    return 0;
+  if(count != LIBRDF_BINARY_BLOCK_HEADER_LEN) {
+    librdf_binary_reader_error(reader, "truncated block header");
+    return -1;
+  }
+
+  flags = header[1];
+  length = (size_t)librdf_binary_get_u32(header + 2);
+  stored_length = (size_t)librdf_binary_get_u32(header + 6);
+  if(length > LIBRDF_BINARY_MAX_BLOCK_SIZE ||
+     stored_length > LIBRDF_BINARY_MAX_BLOCK_SIZE ||
+     (!(flags & LIBRDF_BINARY_BLOCK_DEFLATE) && stored_length != length)) {
+    librdf_binary_reader_error(reader, "bad block size");
+    return -1;
+  }
+
+  if(length > reader->block_size) {
+    if(reader->block)
+      LIBRDF_FREE(char*, reader->block);
+    reader->block = LIBRDF_MALLOC(unsigned char*, length);
+    if(!reader->block) {
+      reader->block_size = 0;
+      return -1;
+    }
+    reader->block_size = length;
+  }
+
+  if(flags & LIBRDF_BINARY_BLOCK_DEFLATE) {
+#ifdef HAVE_ZLIB
+    uLongf inflated_length = (uLongf)length;
+
+    if(stored_length > reader->stored_size) {
+      if(reader->stored)
+        LIBRDF_FREE(char*, reader->stored);
+      reader->stored = LIBRDF_MALLOC(unsigned char*, stored_length);
+      if(!reader->stored) {
+        reader->stored_size = 0;
+        return -1;
+      }
+      reader->stored_size = stored_length;
+    }
+    if(librdf_binary_reader_read(reader, reader->stored,
+                                 stored_length) != stored_length) {
+      librdf_binary_reader_error(reader, "truncated block");
+      return -1;
+    }
+    if(uncompress(reader->block, &inflated_length, reader->stored,
+                  (uLong)stored_length) != Z_OK ||
+       (size_t)inflated_length != length) {
+      librdf_binary_reader_error(reader, "cannot decompress block");
+      return -1;
+    }
+#else
+    librdf_binary_reader_error(reader, "compressed block needs zlib support");
+    return -1;
+#endif
+  } else if(librdf_binary_reader_read(reader, reader->block,
+                                      length) != length) {
+    librdf_binary_reader_error(reader, "truncated block");
+    return -1;
+  }
+
+  if(librdf_binary_crc32(reader->crc_table, reader->block, length) !=
+     librdf_binary_get_u32(header + 10)) {
+    librdf_binary_reader_error(reader, "block checksum mismatch");
+    return -1;
+  }
+
+  reader->block_length = length;
+  reader->block_offset = 0;
+
+  return header[0];
+}
+
+
+static int
+librdf_binary_reader_add_term(librdf_binary_reader* reader, librdf_node* node)
+{
+  if(!node)
+    return 1;
+
+  if(reader->terms_count == reader->terms_size) {
+    librdf_node** terms;
+    u64 size = reader->terms_size ? reader->terms_size * 2 : 1024;
+
+    terms = LIBRDF_MALLOC(librdf_node**, (size_t)size * sizeof(librdf_node*));
+    if(!terms) {
+      librdf_free_node(node);
+      return 1;
+    }
+    if(reader->terms) {
+      memcpy(terms, reader->terms,
+             (size_t)reader->terms_count * sizeof(librdf_node*));
+      LIBRDF_FREE(librdf_node**, reader->terms);
+    }
+    reader->terms = terms;
+    reader->terms_size = size;
+  }
+
+  reader->terms[reader->terms_count++] = node;
+
+  return 0;
+}
+
+
+/*
+ * librdf_binary_reader_next - Move to the next statement
+ * @reader: reader
+ *
+ * Return value: >0 if a statement was found, 0 at the end, <0 on failure
+ */
+static int
+librdf_binary_reader_next(librdf_binary_reader* reader)
+{
+  if(reader->statement) {
+    librdf_free_statement(reader->statement);
+    reader->statement = NULL;
+  }
+  if(reader->context_node) {
+    librdf_free_node(reader->context_node);
+    reader->context_node = NULL;
+  }
+
+  while(!reader->finished) {
+    u64 type;
+    const unsigned char* string;
+    size_t length;
+
+    if(reader->block_offset == reader->block_length) {
+      int block_type = librdf_binary_reader_load_block(reader);
+
+      if(block_type < 0)
+        return -1;
+
+      if(!block_type) {
+        librdf_binary_reader_error(reader, "missing end block");
+        return -1;
+      }
+
+      if(block_type == LIBRDF_BINARY_BLOCK_END) {
+        u64 terms_count;
+        u64 statements_count;
+
+        if(librdf_binary_reader_get_number(reader, &terms_count) ||
+           librdf_binary_reader_get_number(reader, &statements_count))
+          return -1;
+        if(terms_count != reader->terms_count ||
+           statements_count != reader->statements_count) {
+          librdf_binary_reader_error(reader, "term or statement count mismatch");
+          return -1;
+        }
+        reader->finished = 1;
+        return 0;
+      }
+
+      if(block_type != LIBRDF_BINARY_BLOCK_DATA) {
+        librdf_binary_reader_error(reader, "unknown block type");
+        return -1;
+      }
+      continue;
+    }
+
+    if(librdf_binary_reader_get_number(reader, &type))
+      return -1;
+
+    switch((int)type) {
+      case LIBRDF_BINARY_RECORD_URI:
+        if(librdf_binary_reader_get_string(reader, &string, &length) ||
+           librdf_binary_reader_add_term(reader,
+                                         librdf_new_node_from_counted_uri_string(reader->world, string, length)))
+          return -1;
+        break;
+
+      case LIBRDF_BINARY_RECORD_BLANK:
+        if(librdf_binary_reader_get_string(reader, &string, &length) ||
+           librdf_binary_reader_add_term(reader,
+                                         librdf_new_node_from_counted_blank_identifier(reader->world, string, length)))
+          return -1;
+        break;
+
+      case LIBRDF_BINARY_RECORD_LITERAL:
+        {
+          const unsigned char* language;
+          size_t language_length;
+          librdf_uri* datatype = NULL;
+          u64 datatype_id;
+
+          if(librdf_binary_reader_get_string(reader, &string, &length) ||
+             librdf_binary_reader_get_string(reader, &language,
+                                             &language_length) ||
+             librdf_binary_reader_get_number(reader, &datatype_id))
+            return -1;
+          if(datatype_id) {
+            if(datatype_id > reader->terms_count ||
+               !librdf_node_is_resource(reader->terms[datatype_id - 1])) {
+              librdf_binary_reader_error(reader, "bad literal datatype");
+              return -1;
+            }
+            datatype = librdf_node_get_uri(reader->terms[datatype_id - 1]);
+          }
+
+          if(librdf_binary_reader_add_term(reader,
+                                           librdf_new_node_from_typed_counted_literal(reader->world,
+                                                                                      string, length,
+                                                                                      language_length ? (const char*)language : NULL,
+                                                                                      language_length,
+                                                                                      datatype)))
+            return -1;
+        }
+        break;
+
+      case LIBRDF_BINARY_RECORD_TRIPLE:
+      case LIBRDF_BINARY_RECORD_QUAD:
+        {
+          librdf_node *s, *p, *o, *c = NULL;
+
+          s = librdf_binary_reader_get_term(reader);
+          p = s ? librdf_binary_reader_get_term(reader) : NULL;
+          o = p ? librdf_binary_reader_get_term(reader) : NULL;
+          if(o && type == LIBRDF_BINARY_RECORD_QUAD) {
+            c = librdf_binary_reader_get_term(reader);
+            if(!c)
+              return -1;
+          }
+          if(!o)
+            return -1;
+
+          reader->statement = librdf_new_statement_from_nodes(reader->world,
+                                                              librdf_new_node_from_node(s),
+                                                              librdf_new_node_from_node(p),
+                                                              librdf_new_node_from_node(o));
+          if(!reader->statement)
+            return -1;
+          if(c)
+            reader->context_node = librdf_new_node_from_node(c);
+          reader->statements_count++;
+          return 1;
+        }
+
+      default:
+        librdf_binary_reader_error(reader, "unknown record type");
+        return -1;
+    }
+  }
+
+  return 0;
+}
+
+
+static void
+librdf_binary_reader_free(librdf_binary_reader* reader)
+{
+  u64 i;
+
+  if(reader->statement)
+    librdf_free_statement(reader->statement);
+  if(reader->context_node)
+    librdf_free_node(reader->context_node);
+
+  for(i = 0; i < reader->terms_count; i++)
+    librdf_free_node(reader->terms[i]);
+  if(reader->terms)
+    LIBRDF_FREE(librdf_node**, reader->terms);
+
+  if(reader->block)
+    LIBRDF_FREE(char*, reader->block);
+  if(reader->stored)
+    LIBRDF_FREE(char*, reader->stored);
+  if(reader->memory)
+    LIBRDF_FREE(char*, reader->memory);
+  if(reader->fh && reader->close_fh)
+    fclose(reader->fh);
+
+  LIBRDF_FREE(librdf_binary_reader, reader);
+}
+
+
+/*
+ * librdf_binary_new_reader - Start reading binary RDF
+ * @world: world
+ * @fh: file handle or NULL
+ * @close_fh: non 0 to close @fh when done
+ * @iostr: iostream or NULL
+ * @string: content to copy or NULL
+ * @length: length of @string
+ *
+ * Exactly one of @fh, @iostr and @string is used.  The first statement
+ * is read.
+ *
+ * Return value: new reader or NULL on failure
+ */
+static librdf_binary_reader*
+librdf_binary_new_reader(librdf_world* world, FILE* fh, int close_fh,
+                         raptor_iostream* iostr,
+                         const unsigned char* string, size_t length)
+{
+  librdf_binary_reader* reader;
+  unsigned char header[LIBRDF_BINARY_HEADER_LEN];
+
+  reader = LIBRDF_CALLOC(librdf_binary_reader*, 1, sizeof(*reader));
+  if(!reader) {
+    if(fh && close_fh)
+      fclose(fh);
+    return NULL;
+  }
+
+  reader->world = world;
+  reader->fh = fh;
+  reader->close_fh = close_fh;
+  reader->iostr = iostr;
+  librdf_binary_crc32_init(reader->crc_table);
+
+  if(string) {
+    reader->memory = LIBRDF_MALLOC(unsigned char*, length ? length : 1);
+    if(!reader->memory)
+      goto failed;
+    memcpy(reader->memory, string, length);
+    reader->memory_length = length;
+  }
+
+  if(librdf_binary_reader_read(reader, header,
+                               LIBRDF_BINARY_HEADER_LEN) != LIBRDF_BINARY_HEADER_LEN ||
+     memcmp(header, LIBRDF_BINARY_MAGIC, LIBRDF_BINARY_MAGIC_LEN)) {
+    librdf_binary_reader_error(reader, "missing header");
+    goto failed;
+  }
+  if(librdf_binary_get_u32(header + LIBRDF_BINARY_MAGIC_LEN) != LIBRDF_BINARY_VERSION) {
+    librdf_binary_reader_error(reader, "unsupported version");
+    goto failed;
+  }
+  reader->flags = (int)librdf_binary_get_u32(header + LIBRDF_BINARY_MAGIC_LEN + 4);
+
+  if(librdf_binary_reader_next(reader) < 0)
+    goto failed;
+
+  return reader;
+
+  failed:
+  librdf_binary_reader_free(reader);
+  return NULL;
+}
+
+
+static int
+librdf_parser_binary_end_of_stream(void* context)
+{
+  librdf_binary_reader* reader=(librdf_binary_reader*)context;
+
+  return !reader->statement;
+}
+
+
+static int
+librdf_parser_binary_next_statement(void* context)
+{
+  librdf_binary_reader* reader=(librdf_binary_reader*)context;
+  int rc;
+
+  rc = librdf_binary_reader_next(reader);
+  if(rc < 0)
+    reader->failed = 1;
+
+  return rc <= 0;
+}
+
+
+static void*
+librdf_parser_binary_get_statement(void* context, int flags)
+{
+  librdf_binary_reader* reader=(librdf_binary_reader*)context;
+
+  switch(flags) {
+    case LIBRDF_ITERATOR_GET_METHOD_GET_OBJECT:
+      return reader->statement;
+
+    case LIBRDF_ITERATOR_GET_METHOD_GET_CONTEXT:
+      return reader->context_node;
+
+    default:
+      librdf_log(reader->world,
+                 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_PARSER, NULL,
+                 "Unknown iterator method flag %d", flags);
+      return NULL;
+  }
+}
+
+
+static void
+librdf_parser_binary_finished(void* context)
+{
+  librdf_binary_reader* reader=(librdf_binary_reader*)context;
+
+  librdf_binary_reader_free(reader);
+}
+
+
+static librdf_stream*
+librdf_parser_binary_reader_as_stream(librdf_binary_reader* reader)
+{
+  librdf_stream* stream;
+
+  if(!reader)
+    return NULL;
+
+  stream = librdf_new_stream(reader->world, (void*)reader,
+                             &librdf_parser_binary_end_of_stream,
+                             &librdf_parser_binary_next_statement,
+                             &librdf_parser_binary_get_statement,
+                             &librdf_parser_binary_finished);
+  if(!stream)
+    librdf_binary_reader_free(reader);
+
+  return stream;
+}
+
+
+/* A stream of the statements from the reader up to a change of context */
+typedef struct {
+  librdf_binary_reader* reader;
+  librdf_node* context_node;    /* of the run or NULL */
+} librdf_parser_binary_run;
+
+
+static int
+librdf_parser_binary_run_end_of_stream(void* context)
+{
+  librdf_parser_binary_run* run=(librdf_parser_binary_run*)context;
+  librdf_binary_reader* reader=run->reader;
+
+  if(!reader->statement)
+    return 1;
+
+  if(!run->context_node || !reader->context_node)
+    return run->context_node != reader->context_node;
+
+  return !librdf_node_equals(run->context_node, reader->context_node);
+}
+
+
+static int
+librdf_parser_binary_run_next_statement(void* context)
+{
+  librdf_parser_binary_run* run=(librdf_parser_binary_run*)context;
+
+  if(librdf_binary_reader_next(run->reader) < 0)
+    run->reader->failed = 1;
+
+  return librdf_parser_binary_run_end_of_stream(context);
+}
+
+
+static void*
+librdf_parser_binary_run_get_statement(void* context, int flags)
+{
+  librdf_parser_binary_run* run=(librdf_parser_binary_run*)context;
+
+  return librdf_parser_binary_get_statement(run->reader, flags);
+}
+
+
+static void
+librdf_parser_binary_run_finished(void* context)
+{
+  /* the reader and run belong to the caller */
+}
+
+
+/*
+ * librdf_parser_binary_reader_into_model - Add all statements from a reader
+ * @reader: reader (freed)
+ * @model: model
+ *
+ * Dumps without contexts, or loaded into a model without them, are
+ * added with one add_statements call.  Otherwise each run of statements
+ * in the same context is added with one context_add_statements call.
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_parser_binary_reader_into_model(librdf_binary_reader* reader,
+                                       librdf_model* model)
+{
+  librdf_stream* stream;
+  librdf_parser_binary_run run;
+  int rc = 0;
+
+  if(!reader)
+    return 1;
+
+  if(!(reader->flags & LIBRDF_BINARY_FLAG_CONTEXTS) ||
+     !librdf_model_supports_contexts(model)) {
+    stream = librdf_parser_binary_reader_as_stream(reader);
+    if(!stream)
+      return 1;
+    rc = librdf_model_add_statements(model, stream);
+    if(!rc && reader->failed)
+      rc = 1;
+    librdf_free_stream(stream);
+    return rc;
+  }
+
+  run.reader = reader;
+  while(!rc && reader->statement) {
+    run.context_node = NULL;
+    if(reader->context_node) {
+      run.context_node = librdf_new_node_from_node(reader->context_node);
+      if(!run.context_node) {
+        rc = 1;
+        break;
+      }
+    }
+
+    stream = librdf_new_stream(reader->world, (void*)&run,
+                               &librdf_parser_binary_run_end_of_stream,
+                               &librdf_parser_binary_run_next_statement,
+                               &librdf_parser_binary_run_get_statement,
+                               &librdf_parser_binary_run_finished);
+    if(!stream)
+      rc = 1;
+    else {
+      if(run.context_node)
+        rc = librdf_model_context_add_statements(model, run.context_node,
+                                                 stream);
+      else
+        rc = librdf_model_add_statements(model, stream);
+      librdf_free_stream(stream);
+    }
+
+    if(run.context_node)
+      librdf_free_node(run.context_node);
+
+    if(!rc && reader->failed)
+      rc = 1;
+  }
+
+  librdf_binary_reader_free(reader);
+
+  return rc;
+}
+
+
+static int
+librdf_parser_binary_init(librdf_parser *parser, void *context)
+{
+  librdf_parser_binary_context* pcontext=(librdf_parser_binary_context*)context;
+
+  pcontext->parser = parser;
+
+  return 0;
+}
+
+
+static void
+librdf_parser_binary_terminate(void *context)
+{
+  /* nothing to do */
+}
+
+
+/* Open a file: URI.  Return value: FILE* or NULL on failure */
+static FILE*
+librdf_parser_binary_open_uri(librdf_parser_binary_context* pcontext,
+                              librdf_uri* uri)
+{
+  char* filename;
+  FILE* fh;
+
+  if(!librdf_uri_is_file_uri(uri)) {
+    librdf_log(pcontext->parser->world, 0, LIBRDF_LOG_ERROR,
+               LIBRDF_FROM_PARSER, NULL,
+               "Binary RDF can only be read from file: URIs");
+    return NULL;
+  }
+
+  filename = (char*)librdf_uri_to_filename(uri);
+  if(!filename)
+    return NULL;
+
+  fh = fopen(filename, "rb");
+  if(!fh)
+    librdf_log(pcontext->parser->world, 0, LIBRDF_LOG_ERROR,
+               LIBRDF_FROM_PARSER, NULL, "failed to open file '%s' - %s",
+               filename, strerror(errno));
+  SYSTEM_FREE(filename);
+
+  return fh;
+}
+
+
+static librdf_stream*
+librdf_parser_binary_parse_uri_as_stream(void *context, librdf_uri *uri,
+                                         librdf_uri *base_uri)
+{
+  librdf_parser_binary_context* pcontext=(librdf_parser_binary_context*)context;
+  FILE* fh;
+
+  fh = librdf_parser_binary_open_uri(pcontext, uri);
+  if(!fh)
+    return NULL;
+
+  return librdf_parser_binary_reader_as_stream(librdf_binary_new_reader(pcontext->parser->world, fh, 1, NULL, NULL, 0));
+}
+
+
+static int
+librdf_parser_binary_parse_uri_into_model(void *context, librdf_uri *uri,
+                                          librdf_uri *base_uri,
+                                          librdf_model *model)
+{
+  librdf_parser_binary_context* pcontext=(librdf_parser_binary_context*)context;
+  FILE* fh;
+
+  fh = librdf_parser_binary_open_uri(pcontext, uri);
+  if(!fh)
+    return 1;
+
+  return librdf_parser_binary_reader_into_model(librdf_binary_new_reader(pcontext->parser->world, fh, 1, NULL, NULL, 0),
+                                                model);
+}
+
+
+static librdf_stream*
+librdf_parser_binary_parse_counted_string_as_stream(void *context,
+                                                    const unsigned char *string,
+                                                    size_t length,
+                                                    librdf_uri* base_uri)
+{
+  librdf_parser_binary_context* pcontext=(librdf_parser_binary_context*)context;
+
+  return librdf_parser_binary_reader_as_stream(librdf_binary_new_reader(pcontext->parser->world, NULL, 0, NULL, string, length));
+}
+
+
+static int
+librdf_parser_binary_parse_counted_string_into_model(void *context,
+                                                     const unsigned char *string,
+                                                     size_t length,
+                                                     librdf_uri* base_uri,
+                                                     librdf_model* model)
+{
+  librdf_parser_binary_context* pcontext=(librdf_parser_binary_context*)context;
+
+  return librdf_parser_binary_reader_into_model(librdf_binary_new_reader(pcontext->parser->world, NULL, 0, NULL, string, length),
+                                                model);
+}
+
+
+static librdf_stream*
+librdf_parser_binary_parse_string_as_stream(void *context,
+                                            const unsigned char *string,
+                                            librdf_uri *base_uri)
+{
+  /* binary content cannot be measured with strlen */
+  librdf_parser_binary_context* pcontext=(librdf_parser_binary_context*)context;
+
+  librdf_log(pcontext->parser->world, 0, LIBRDF_LOG_ERROR,
+             LIBRDF_FROM_PARSER, NULL,
+             "Binary RDF must be parsed from a counted string");
+  return NULL;
+}
+
+
+static int
+librdf_parser_binary_parse_string_into_model(void *context,
+                                             const unsigned char *string,
+                                             librdf_uri* base_uri,
+                                             librdf_model* model)
+{
+  librdf_parser_binary_context* pcontext=(librdf_parser_binary_context*)context;
+
+  librdf_log(pcontext->parser->world, 0, LIBRDF_LOG_ERROR,
+             LIBRDF_FROM_PARSER, NULL,
+             "Binary RDF must be parsed from a counted string");
+  return 1;
+}
+
+
+static librdf_stream*
+librdf_parser_binary_parse_file_handle_as_stream(void *context,
+                                                 FILE *fh, int close_fh,
+                                                 librdf_uri *base_uri)
+{
+  librdf_parser_binary_context* pcontext=(librdf_parser_binary_context*)context;
+
+  return librdf_parser_binary_reader_as_stream(librdf_binary_new_reader(pcontext->parser->world, fh, close_fh, NULL, NULL, 0));
+}
+
+
+static int
+librdf_parser_binary_parse_file_handle_into_model(void *context, FILE *fh,
+                                                  int close_fh,
+                                                  librdf_uri *base_uri,
+                                                  librdf_model* model)
+{
+  librdf_parser_binary_context* pcontext=(librdf_parser_binary_context*)context;
+
+  return librdf_parser_binary_reader_into_model(librdf_binary_new_reader(pcontext->parser->world, fh, close_fh, NULL, NULL, 0),
+                                                model);
+}
+
+
+static librdf_stream*
+librdf_parser_binary_parse_iostream_as_stream(void *context,
+                                              raptor_iostream *iostream,
+                                              librdf_uri *base_uri)
+{
+  librdf_parser_binary_context* pcontext=(librdf_parser_binary_context*)context;
+  librdf_binary_reader* reader;
+  unsigned char* string = NULL;
+  size_t length = 0;
+  size_t size = 0;
+
+  /* The caller may free the iostream once this returns, so read it all */
+  while(1) {
+    int count;
+
+    if(length == size) {
+      unsigned char* new_string;
+
+      size = size ? size * 2 : 65536;
+      new_string = LIBRDF_MALLOC(unsigned char*, size);
+      if(!new_string) {
+        if(string)
+          LIBRDF_FREE(char*, string);
+        return NULL;
+      }
+      if(string) {
+        memcpy(new_string, string, length);
+        LIBRDF_FREE(char*, string);
+      }
+      string = new_string;
+    }
+
+    count = raptor_iostream_read_bytes(string + length, 1, size - length,
+                                       iostream);
+    if(count <= 0)
+      break;
+    length += (size_t)count;
+  }
+
+  reader = librdf_binary_new_reader(pcontext->parser->world, NULL, 0, NULL,
+                                    string, length);
+  LIBRDF_FREE(char*, string);
+
+  return librdf_parser_binary_reader_as_stream(reader);
+}
+
+
+static int
+librdf_parser_binary_parse_iostream_into_model(void *context,
+                                               raptor_iostream *iostream,
+                                               librdf_uri *base_uri,
+                                               librdf_model *model)
+{
+  librdf_parser_binary_context* pcontext=(librdf_parser_binary_context*)context;
+
+  return librdf_parser_binary_reader_into_model(librdf_binary_new_reader(pcontext->parser->world, NULL, 0, iostream, NULL, 0),
+                                                model);
+}
+
+
+static void
+librdf_parser_binary_register_factory(librdf_parser_factory *factory)
+{
+  factory->context_length = sizeof(librdf_parser_binary_context);
+
+  factory->init  = librdf_parser_binary_init;
+  factory->terminate = librdf_parser_binary_terminate;
+  factory->parse_uri_as_stream = librdf_parser_binary_parse_uri_as_stream;
+  factory->parse_uri_into_model = librdf_parser_binary_parse_uri_into_model;
+  factory->parse_string_as_stream = librdf_parser_binary_parse_string_as_stream;
+  factory->parse_string_into_model = librdf_parser_binary_parse_string_into_model;
+  factory->parse_counted_string_as_stream = librdf_parser_binary_parse_counted_string_as_stream;
+  factory->parse_counted_string_into_model = librdf_parser_binary_parse_counted_string_into_model;
+  factory->parse_iostream_as_stream = librdf_parser_binary_parse_iostream_as_stream;
+  factory->parse_iostream_into_model = librdf_parser_binary_parse_iostream_into_model;
+  factory->parse_file_handle_as_stream = librdf_parser_binary_parse_file_handle_as_stream;
+  factory->parse_file_handle_into_model = librdf_parser_binary_parse_file_handle_into_model;
+}
+
+
+/**
+ * librdf_parser_binary_constructor:
+ * @world: redland world object
+ *
+ * INTERNAL - Initialise the binary parser module.
+ *
+ **/
+void
+librdf_parser_binary_constructor(librdf_world *world)
+{
+  librdf_parser_register_factory(world, LIBRDF_BINARY_SYNTAX_NAME,
+                                 "Redland binary RDF dump",
+                                 LIBRDF_BINARY_MIME_TYPE, NULL,
+                                 &librdf_parser_binary_register_factory);
+}
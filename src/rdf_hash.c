@@ -88,6 +88,10 @@ librdf_init_hash(librdf_world *world)
 #ifdef HAVE_BDB_HASH
   librdf_init_hash_bdb(world);
 #endif
+#ifdef HAVE_LMDB_HASH
+  librdf_init_hash_lmdb(world);
+#endif
+  librdf_init_hash_log(world);
   /* Always have hash in memory implementation available */
   librdf_init_hash_memory(world);
 }
@@ -128,10 +132,110 @@ librdf_delete_hash_factories(librdf_world *world)
 
 /* hash datums structures */
 
+#ifdef WITH_THREADS
+/*
+ * With threads, each thread keeps its own free list of datums for
+ * each world so that making and freeing datums takes no lock.  The
+ * world mutex is only taken when a thread first uses a world or
+ * exits.
+ */
+
+/* Most datums kept on each thread's free list */
+#define LIBRDF_HASH_DATUM_CACHE_SIZE 256
+
+typedef struct librdf_hash_datum_cache_s
+{
+  struct librdf_hash_datum_cache_s* next;
+  librdf_world *world;
+  librdf_hash_datum* datums;
+  int count;
+} librdf_hash_datum_cache;
+
+
+static void
+librdf_free_hash_datum_cache_datums(librdf_hash_datum_cache* cache)
+{
+  librdf_hash_datum *datum, *next;
+
+  for(datum = cache->datums; datum; datum = next) {
+    next = datum->next;
+    LIBRDF_FREE(librdf_hash_datum, datum);
+  }
+  cache->datums = NULL;
+  cache->count = 0;
+}
+
+
+/* thread exit destructor for the per-thread free list */
+static void
+librdf_free_hash_datum_cache(void* data)
+{
+  librdf_hash_datum_cache* cache = (librdf_hash_datum_cache*)data;
+  librdf_world* world = cache->world;
+  librdf_hash_datum_cache** prev;
+
+  pthread_mutex_lock(world->hash_datums_mutex);
+  for(prev = &world->hash_datum_caches; *prev; prev = &(*prev)->next) {
+    if(*prev == cache) {
+      *prev = cache->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(world->hash_datums_mutex);
+
+  librdf_free_hash_datum_cache_datums(cache);
+  LIBRDF_FREE(librdf_hash_datum_cache, cache);
+}
+
+
+/*
+ * librdf_get_hash_datum_cache - Get the calling thread's free list of datums
+ * @world: redland world object
+ *
+ * Return value: free list or NULL if there is none
+ */
+static librdf_hash_datum_cache*
+librdf_get_hash_datum_cache(librdf_world *world)
+{
+  librdf_hash_datum_cache* cache;
+
+  if(!world->hash_datums_key_created)
+    return NULL;
+
+  cache = (librdf_hash_datum_cache*)pthread_getspecific(world->hash_datums_key);
+  if(cache)
+    return cache;
+
+  cache = LIBRDF_CALLOC(librdf_hash_datum_cache*, 1, sizeof(*cache));
+  if(!cache)
+    return NULL;
+  cache->world = world;
+  if(pthread_setspecific(world->hash_datums_key, cache)) {
+    LIBRDF_FREE(librdf_hash_datum_cache, cache);
+    return NULL;
+  }
+
+  pthread_mutex_lock(world->hash_datums_mutex);
+  cache->next = world->hash_datum_caches;
+  world->hash_datum_caches = cache;
+  pthread_mutex_unlock(world->hash_datums_mutex);
+
+  return cache;
+}
+#endif
+
+
 static void
 librdf_init_hash_datums(librdf_world *world)
 {
   world->hash_datums_list=NULL;
+
+#ifdef WITH_THREADS
+  world->hash_datum_caches = NULL;
+  world->hash_datums_key_created =
+    !pthread_key_create(&world->hash_datums_key,
+                        librdf_free_hash_datum_cache);
+#endif
 }
 
 
@@ -141,8 +245,22 @@ librdf_free_hash_datums(librdf_world *world)
   librdf_hash_datum *datum, *next;
   
 #ifdef WITH_THREADS
+  if(world->hash_datums_key_created) {
+    /* no thread exit destructors run after this */
+    pthread_key_delete(world->hash_datums_key);
+    world->hash_datums_key_created = 0;
+  }
+
   if(world->hash_datums_mutex)
     pthread_mutex_lock(world->hash_datums_mutex);
+
+  while(world->hash_datum_caches) {
+    librdf_hash_datum_cache* cache = world->hash_datum_caches;
+
+    world->hash_datum_caches = cache->next;
+    librdf_free_hash_datum_cache_datums(cache);
+    LIBRDF_FREE(librdf_hash_datum_cache, cache);
+  }
 #endif
 
   for(datum = world->hash_datums_list; datum; datum = next) {
@@ -172,26 +290,32 @@ librdf_hash_datum*
 librdf_new_hash_datum(librdf_world *world, void *data, size_t size)
 {
   librdf_hash_datum *datum;
-
-  librdf_world_open(world);
-
 #ifdef WITH_THREADS
-  pthread_mutex_lock(world->hash_datums_mutex);
+  librdf_hash_datum_cache* cache;
 #endif
 
+  /* avoid writing the shared open count on every call */
+  if(!world->opened)
+    librdf_world_open(world);
+
   /* get one from free list, or allocate new one */ 
+#ifdef WITH_THREADS
+  cache = librdf_get_hash_datum_cache(world);
+  if(cache && (datum = cache->datums)) {
+    cache->datums = datum->next;
+    cache->count--;
+  }
+#else
   if((datum = world->hash_datums_list)) {
     world->hash_datums_list = datum->next;
-  } else {
+  }
+#endif
+  else {
     datum = LIBRDF_CALLOC(librdf_hash_datum*, 1, sizeof(*datum));
     if(datum)
       datum->world = world;
   }
 
-#ifdef WITH_THREADS
-   pthread_mutex_unlock(world->hash_datums_mutex);
-#endif
-
   if(datum) {
     datum->data = data;
     datum->size = size;
@@ -211,6 +335,10 @@ librdf_new_hash_datum(librdf_world *world, void *data, size_t size)
 void
 librdf_free_hash_datum(librdf_hash_datum *datum) 
 {
+#ifdef WITH_THREADS
+  librdf_hash_datum_cache* cache;
+#endif
+
   if(!datum)
     return;
   
@@ -223,14 +351,16 @@ librdf_free_hash_datum(librdf_hash_datum *datum)
   }
 
 #ifdef WITH_THREADS
-  pthread_mutex_lock(datum->world->hash_datums_mutex);
-#endif
-
+  cache = librdf_get_hash_datum_cache(datum->world);
+  if(cache && cache->count < LIBRDF_HASH_DATUM_CACHE_SIZE) {
+    datum->next = cache->datums;
+    cache->datums = datum;
+    cache->count++;
+  } else
+    LIBRDF_FREE(librdf_hash_datum, datum);
+#else
   datum->next = datum->world->hash_datums_list;
   datum->world->hash_datums_list = datum;
-
-#ifdef WITH_THREADS
-  pthread_mutex_unlock(datum->world->hash_datums_mutex);
 #endif
 }
 
@@ -594,6 +724,31 @@ librdf_hash_close(librdf_hash* hash)
 }
 
 
+/**
+ * librdf_hash_present:
+ * @hash: hash object, not open
+ * @identifier: indentifier for the hash factory - usually a URI or file name
+ * @options: a hash of options for the hash factory or NULL if there are none.
+ *
+ * Check if a hash with the identifier was made by an earlier open.
+ *
+ * Unlike librdf_hash_open() this creates nothing and does not
+ * report a missing hash as an error.
+ *
+ * Return value: >0 if present, 0 if not, <0 on failure or if the hash
+ * factory cannot tell
+ **/
+int
+librdf_hash_present(librdf_hash* hash, const char *identifier,
+                    librdf_hash* options)
+{
+  if(!hash->factory->present)
+    return -1;
+
+  return hash->factory->present(hash->context, identifier, options);
+}
+
+
 /**
  * librdf_hash_values_count:
  * @hash: hash object
@@ -753,8 +908,12 @@ librdf_hash_get_all(librdf_hash* hash,
     return NULL;
   }
 
-  if(key->data)
+  if(key->data) {
     context->one_key=1;
+    /* returned as the key of the first value */
+    context->next_key.data=key->data;
+    context->next_key.size=key->size;
+  }
 
   context->hash=hash;
   context->key=key;
@@ -781,6 +940,62 @@ librdf_hash_get_all(librdf_hash* hash,
 }
 
 
+/**
+ * librdf_hash_get_prefix:
+ * @hash: hash object
+ * @prefix: key prefix
+ * @key: pointer to key
+ * @value: pointer to value
+ *
+ * Retrieve all key/value pairs from hash whose key starts with a prefix.
+ *
+ * The iterator returns #librdf_hash_datum objects for the keys and
+ * values as for librdf_hash_get_all().  Hashes with sorted keys
+ * go straight to the keys with the prefix, others scan every key.
+ *
+ * Return value: a #librdf_iterator serialization of the pairs or NULL on failure
+ **/
+librdf_iterator*
+librdf_hash_get_prefix(librdf_hash* hash, librdf_hash_datum *prefix,
+                       librdf_hash_datum *key, librdf_hash_datum *value)
+{
+  librdf_hash_get_all_iterator_context* context;
+  int status;
+  librdf_iterator* iterator;
+  
+  context = LIBRDF_CALLOC(librdf_hash_get_all_iterator_context*, 1,
+                          sizeof(*context));
+  if(!context)
+    return NULL;
+
+  if(!(context->cursor=librdf_new_hash_cursor(hash))) {
+    librdf_hash_get_all_iterator_finished(context);
+    return NULL;
+  }
+
+  context->hash=hash;
+  context->key=key;
+  context->value=value;
+
+  /* the cursor ends after the last key with the prefix */
+  status=librdf_hash_cursor_seek_prefix(context->cursor, prefix,
+                                        &context->next_key,
+                                        &context->next_value);
+
+  context->is_end=(status != 0);
+  
+  iterator=librdf_new_iterator(hash->world,
+                               (void*)context,
+                               librdf_hash_get_all_iterator_is_end,
+                               librdf_hash_get_all_iterator_next_method,
+                               librdf_hash_get_all_iterator_get_method,
+                               librdf_hash_get_all_iterator_finished);
+  if(!iterator)
+    librdf_hash_get_all_iterator_finished(context);
+  return iterator;
+}
+
+
 static int
 librdf_hash_get_all_iterator_is_end(void* iterator)
 {
@@ -1160,6 +1375,84 @@ librdf_hash_get_fd(librdf_hash* hash)
 }
 
 
+/**
+ * librdf_hash_get_stats:
+ * @hash: hash object
+ * @stats: statistics to fill in
+ *
+ * Get the cache statistics for the hash.
+ * 
+ * Return value: non 0 on failure or if the hash has no cache statistics
+ **/
+int
+librdf_hash_get_stats(librdf_hash* hash, librdf_hash_stats* stats)
+{
+  if(!hash->factory->get_stats)
+    return 1;
+
+  return hash->factory->get_stats(hash->context, stats);
+}
+
+
+/**
+ * librdf_hash_transaction_start:
+ * @hash: hash object
+ * @handle: transaction handle of another hash to join or NULL
+ *
+ * Start a transaction on the hash.
+ * 
+ * Hashes of the same type that join one handle are committed or
+ * rolled back together.
+ * 
+ * Return value: transaction handle or NULL on failure or if the hash
+ * does not support transactions
+ **/
+void*
+librdf_hash_transaction_start(librdf_hash* hash, void* handle)
+{
+  if(!hash->factory->transaction_start)
+    return NULL;
+
+  return hash->factory->transaction_start(hash->context, handle);
+}
+
+
+/**
+ * librdf_hash_transaction_commit:
+ * @hash: hash object
+ *
+ * Commit the current transaction of the hash.
+ * 
+ * Return value: non 0 on failure
+ **/
+int
+librdf_hash_transaction_commit(librdf_hash* hash)
+{
+  if(!hash->factory->transaction_commit)
+    return 1;
+
+  return hash->factory->transaction_commit(hash->context);
+}
+
+
+/**
+ * librdf_hash_transaction_rollback:
+ * @hash: hash object
+ *
+ * Roll back the current transaction of the hash.
+ * 
+ * Return value: non 0 on failure
+ **/
+int
+librdf_hash_transaction_rollback(librdf_hash* hash)
+{
+  if(!hash->factory->transaction_rollback)
+    return 1;
+
+  return hash->factory->transaction_rollback(hash->context);
+}
+
+
 /**
  * librdf_hash_print:
  * @hash: the hash
@@ -1872,15 +2165,313 @@ librdf_hash_interpret_template(const unsigned char* template_string,
 
 #ifdef STANDALONE
 
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
 /* one more prototype */
 int main(int argc, char *argv[]);
 
+/* BDB hashes can be opened in a shared environment */
+#if defined(HAVE_BDB_HASH) && defined(HAVE_DB_CREATE) && defined(HAVE_BDB_OPEN_7_ARGS) && defined(HAVE_SYS_STAT_H)
+#define LIBRDF_HASH_TEST_BDB_ENV 1
+#endif
+
+
+/* count the pairs with a key prefix or return -1 if a key is wrong */
+static int
+librdf_hash_test_prefix(librdf_hash* h, const char* prefix)
+{
+  librdf_hash_datum hd_prefix, hd_key, hd_value; /* on stack */
+  librdf_iterator* iterator;
+  int count = 0;
+
+  hd_prefix.data = (char*)prefix;
+  hd_prefix.size = strlen(prefix);
+  hd_key.data = NULL;
+  hd_value.data = NULL;
+
+  iterator = librdf_hash_get_prefix(h, &hd_prefix, &hd_key, &hd_value);
+  if(!iterator)
+    return -1;
+
+  while(!librdf_iterator_end(iterator)) {
+    librdf_hash_datum* k = (librdf_hash_datum*)librdf_iterator_get_key(iterator);
+
+    if(k->size < hd_prefix.size || memcmp(k->data, prefix, hd_prefix.size)) {
+      count = -1;
+      break;
+    }
+    count++;
+    librdf_iterator_next(iterator);
+  }
+  librdf_free_iterator(iterator);
+
+  return count;
+}
+
+
+#ifdef LIBRDF_HASH_TEST_BDB_ENV
+#define BDB_ENV_TEST_DIR "test-bdb-env"
+
+/* check two bdb hashes in one environment share its cache */
+static int
+librdf_hash_test_bdb_env(librdf_world* world, const char* program)
+{
+  const char* identifiers[2] = { BDB_ENV_TEST_DIR "/one",
+                                 BDB_ENV_TEST_DIR "/two" };
+  librdf_hash *hashes[2] = { NULL, NULL };
+  librdf_hash* options;
+  librdf_hash_stats stats[2];
+  char* value;
+  int failures = 0;
+  int i;
+
+  fprintf(stdout, "%s: Opening bdb hashes in a shared environment\n",
+          program);
+  mkdir(BDB_ENV_TEST_DIR, 0755);
+  options = librdf_new_hash_from_string(world, NULL,
+                                        "bdb-env-dir='" BDB_ENV_TEST_DIR "',bdb-cache-size='1048576'");
+  if(!options)
+    return 1;
+
+  for(i = 0; i < 2; i++) {
+    hashes[i] = librdf_new_hash(world, "bdb");
+    if(!hashes[i] ||
+       librdf_hash_open(hashes[i], identifiers[i], 0644, 1, 1, options) ||
+       librdf_hash_put_strings(hashes[i], "colour", "yellow")) {
+      fprintf(stderr, "%s: Failed to open bdb hash %s in an environment\n",
+              program, identifiers[i]);
+      failures++;
+      goto tidy;
+    }
+  }
+
+  for(i = 0; i < 2; i++) {
+    value = librdf_hash_get(hashes[i], "colour");
+    if(!value || strcmp(value, "yellow")) {
+      fprintf(stderr, "%s: bdb hash %s in an environment lost its value\n",
+              program, identifiers[i]);
+      failures++;
+    }
+    if(value)
+      LIBRDF_FREE(char*, value);
+  }
+
+  /* both hashes report the one cache of the environment */
+  if(librdf_hash_get_stats(hashes[0], &stats[0]) ||
+     librdf_hash_get_stats(hashes[1], &stats[1])) {
+    fprintf(stderr, "%s: Failed to get bdb environment cache stats\n",
+            program);
+    failures++;
+  } else if(!(stats[0].cache_hits + stats[0].cache_misses) ||
+            stats[0].cache_hits != stats[1].cache_hits ||
+            stats[0].cache_misses != stats[1].cache_misses ||
+            stats[0].pages_read != stats[1].pages_read) {
+    fprintf(stderr, "%s: bdb hashes do not share the environment cache (hits %lu and %lu, misses %lu and %lu)\n",
+            program, stats[0].cache_hits, stats[1].cache_hits,
+            stats[0].cache_misses, stats[1].cache_misses);
+    failures++;
+  }
+
+  tidy:
+  for(i = 0; i < 2; i++) {
+    if(hashes[i])
+      librdf_free_hash(hashes[i]);
+  }
+  librdf_free_hash(options);
+
+  return failures;
+}
+
+
+#define BDB_CONCURRENT_TEST_DIR "test-bdb-concurrent"
+
+/* check a read-only bdb-concurrent hash sees the writer's changes */
+static int
+librdf_hash_test_bdb_concurrent(librdf_world* world, const char* program)
+{
+  const char* identifier = BDB_CONCURRENT_TEST_DIR "/test";
+  librdf_hash *writer, *reader = NULL;
+  librdf_hash* options;
+  char* value;
+  int failures = 0;
+
+  fprintf(stdout, "%s: Opening a bdb-concurrent hash writer and reader\n",
+          program);
+  mkdir(BDB_CONCURRENT_TEST_DIR, 0755);
+  options = librdf_new_hash_from_string(world, NULL, "bdb-concurrent='yes'");
+  if(!options)
+    return 1;
+
+  writer = librdf_new_hash(world, "bdb");
+  if(!writer ||
+     librdf_hash_open(writer, identifier, 0644, 1, 1, options) ||
+     librdf_hash_put_strings(writer, "colour", "yellow") ||
+     librdf_hash_sync(writer)) {
+    fprintf(stderr, "%s: Failed to write bdb-concurrent hash\n", program);
+    failures++;
+    goto tidy;
+  }
+
+  reader = librdf_new_hash(world, "bdb");
+  if(!reader || librdf_hash_open(reader, identifier, 0644, 0, 0, options)) {
+    fprintf(stderr, "%s: Failed to open bdb-concurrent hash to read\n",
+            program);
+    failures++;
+    goto tidy;
+  }
+
+  /* a write after the reader opened is seen by it */
+  if(librdf_hash_put_strings(writer, "size", "large")) {
+    fprintf(stderr, "%s: Failed to write with a reader open\n", program);
+    failures++;
+  }
+
+  value = librdf_hash_get(reader, "colour");
+  if(!value || strcmp(value, "yellow"))
+    failures++;
+  if(value)
+    LIBRDF_FREE(char*, value);
+  value = librdf_hash_get(reader, "size");
+  if(!value || strcmp(value, "large"))
+    failures++;
+  if(value)
+    LIBRDF_FREE(char*, value);
+  if(failures)
+    fprintf(stderr, "%s: bdb-concurrent reader did not see the writer's values\n",
+            program);
+
+  if(!librdf_hash_put_strings(reader, "fruit", "banana")) {
+    fprintf(stderr, "%s: Read-only bdb-concurrent hash allowed a write\n",
+            program);
+    failures++;
+  }
+
+  tidy:
+  if(reader)
+    librdf_free_hash(reader);
+  if(writer)
+    librdf_free_hash(writer);
+  librdf_free_hash(options);
+
+  return failures;
+}
+#endif
+
+
+#ifdef HAVE_BDB_HASH
+#define BDB_BULK_TEST_KEYS 2000
+#define BDB_BULK_TEST_VALUES 300
+#define BDB_BULK_TEST_LARGE 4000
+
+/* count the values of a key or return -1 on failure */
+static int
+librdf_hash_test_values(librdf_hash* h, const char* key)
+{
+  librdf_hash_datum hd_key, hd_value; /* on stack */
+  librdf_iterator* iterator;
+  int count = 0;
+
+  hd_key.data = (char*)key;
+  hd_key.size = strlen(key);
+  hd_value.data = NULL;
+
+  iterator = librdf_hash_get_all(h, &hd_key, &hd_value);
+  if(!iterator)
+    return -1;
+  for(; !librdf_iterator_end(iterator); librdf_iterator_next(iterator))
+    count++;
+  librdf_free_iterator(iterator);
+
+  return count;
+}
+
+
+/* check bdb cursors read the same pairs in bulk and one at a time */
+static int
+librdf_hash_test_bdb_bulk(librdf_world* world, const char* program)
+{
+  /* a small buffer that needs several fetches and must grow for the
+   * large value, and no buffer */
+  const char* bulk_options[2] = { "bdb-bulk-size='1024'",
+                                  "bdb-bulk-size='0'" };
+  char key[32];
+  char value[32];
+  char* large;
+  char* large_value;
+  int failures = 0;
+  int i, j;
+
+  large = LIBRDF_MALLOC(char*, BDB_BULK_TEST_LARGE + 1);
+  if(!large)
+    return 1;
+  memset(large, 'x', BDB_BULK_TEST_LARGE);
+  large[BDB_BULK_TEST_LARGE] = '\0';
+
+  for(i = 0; i < 2; i++) {
+    librdf_hash* h;
+    librdf_hash* options;
+
+    fprintf(stdout, "%s: Reading bdb hash cursors with %s\n", program,
+            bulk_options[i]);
+    options = librdf_new_hash_from_string(world, NULL, bulk_options[i]);
+    h = librdf_new_hash(world, "bdb");
+    if(!options || !h ||
+       librdf_hash_open(h, "test-bulk", 0644, 1, 1, options)) {
+      fprintf(stderr, "%s: Failed to open bdb hash with %s\n", program,
+              bulk_options[i]);
+      failures++;
+    } else {
+      for(j = 0; j < BDB_BULK_TEST_KEYS; j++) {
+        sprintf(key, "key%d", j);
+        sprintf(value, "value%d", j);
+        librdf_hash_put_strings(h, key, value);
+      }
+      for(j = 0; j < BDB_BULK_TEST_VALUES; j++) {
+        sprintf(value, "value%d", j);
+        librdf_hash_put_strings(h, "many", value);
+      }
+      librdf_hash_put_strings(h, "large", large);
+
+      if(librdf_hash_test_prefix(h, "key") != BDB_BULK_TEST_KEYS ||
+         librdf_hash_test_values(h, "many") != BDB_BULK_TEST_VALUES ||
+         librdf_hash_test_values(h, "key7") != 1) {
+        fprintf(stderr, "%s: bdb hash with %s read %d keys and %d values, expected %d and %d\n",
+                program, bulk_options[i], librdf_hash_test_prefix(h, "key"),
+                librdf_hash_test_values(h, "many"), BDB_BULK_TEST_KEYS,
+                BDB_BULK_TEST_VALUES);
+        failures++;
+      }
+
+      large_value = librdf_hash_get(h, "large");
+      if(!large_value || strcmp(large_value, large)) {
+        fprintf(stderr, "%s: bdb hash with %s lost the large value\n",
+                program, bulk_options[i]);
+        failures++;
+      }
+      if(large_value)
+        LIBRDF_FREE(char*, large_value);
+    }
+
+    if(h)
+      librdf_free_hash(h);
+    if(options)
+      librdf_free_hash(options);
+  }
+
+  LIBRDF_FREE(char*, large);
+
+  return failures;
+}
+#endif
+
 
 int
 main(int argc, char *argv[]) 
 {
   librdf_hash *h, *h2, *ch;
-  const char *test_hash_types[]={"bdb", "memory", NULL};
+  const char *test_hash_types[]={"bdb", "lmdb", "log", "memory", NULL};
   const char *test_hash_values[]={"colour","yellow", /* Made in UK, can you guess? */
 			    "age", "new",
 			    "size", "large",
@@ -1983,6 +2574,16 @@ main(int argc, char *argv[])
     librdf_hash_print_values(h, test_duplicate_key, stdout);
     fputc('\n', stdout);
 
+    fprintf(stdout, "%s: pairs with key prefix 'col' %d, 'f' %d, 'z' %d\n",
+            program, librdf_hash_test_prefix(h, "col"),
+            librdf_hash_test_prefix(h, "f"), librdf_hash_test_prefix(h, "z"));
+    if(librdf_hash_test_prefix(h, "col") < 1 ||
+       librdf_hash_test_prefix(h, "f") != 1 ||
+       librdf_hash_test_prefix(h, "z") != 0) {
+      fprintf(stderr, "%s: %s hash prefix search failed\n", program, type);
+      return(1);
+    }
+
     fprintf(stdout, "%s: cloning %s hash\n", program, type);
     ch=librdf_new_hash_from_hash(h);
     if(ch) {
@@ -2002,6 +2603,57 @@ main(int argc, char *argv[])
     fprintf(stdout, "%s: Freeing hash\n", program);
     librdf_free_hash(h);
   }
+
+#ifdef HAVE_BDB_HASH
+  if(librdf_hash_test_bdb_bulk(world, program))
+    return(1);
+#endif
+
+#ifdef LIBRDF_HASH_TEST_BDB_ENV
+  if(librdf_hash_test_bdb_env(world, program) ||
+     librdf_hash_test_bdb_concurrent(world, program))
+    return(1);
+#endif
+
+  /* test a memory hash transaction rolls back puts and deletes */
+  fprintf(stdout, "%s: Rolling back a memory hash transaction\n", program);
+  h=librdf_new_hash(world, "memory");
+  if(!h || librdf_hash_open(h, "test", 0644, 1, 1, NULL)) {
+    fprintf(stderr, "%s: Failed to open memory hash\n", program);
+    return(1);
+  }
+  hd_key.data=(char*)test_hash_values[0];
+  hd_key.size=strlen((char*)hd_key.data);
+  hd_value.data=(char*)test_hash_values[1];
+  hd_value.size=strlen((char*)hd_value.data);
+  librdf_hash_put(h, &hd_key, &hd_value);
+
+  if(!librdf_hash_transaction_start(h, NULL)) {
+    fprintf(stderr, "%s: Failed to start memory hash transaction\n", program);
+    return(1);
+  }
+  librdf_hash_delete_all(h, &hd_key);
+  hd_key.data=(char*)test_hash_values[2];
+  hd_key.size=strlen((char*)hd_key.data);
+  hd_value.data=(char*)test_hash_values[3];
+  hd_value.size=strlen((char*)hd_value.data);
+  librdf_hash_put(h, &hd_key, &hd_value);
+  librdf_hash_transaction_rollback(h);
+
+  hd_key.data=(char*)test_hash_values[0];
+  hd_key.size=strlen((char*)hd_key.data);
+  hd_value.data=(char*)test_hash_values[1];
+  hd_value.size=strlen((char*)hd_value.data);
+  if(librdf_hash_values_count(h) != 1 ||
+     librdf_hash_exists(h, &hd_key, &hd_value) != 1) {
+    fprintf(stderr, "%s: Memory hash rollback gave ", program);
+    librdf_hash_print(h, stderr);
+    fputc('\n', stderr);
+    return(1);
+  }
+  librdf_hash_close(h);
+  librdf_free_hash(h);
+
   fprintf(stdout, "%s: Getting default hash factory\n", program);
   h2=librdf_new_hash(world, NULL);
   if(!h2) {
@@ -35,11 +35,15 @@
 #include <stdarg.h>
 
 #include <sys/types.h>
+#include <errno.h>
 
 /* for the memory allocation functions */
 #ifdef HAVE_STDLIB_H
 #include <stdlib.h>
 #endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
 
 
 #ifdef HAVE_DB_H
@@ -50,15 +54,72 @@
 #include <rdf_hash.h>
 
 
+/* Cursors read many key/value pairs per call with DB_MULTIPLE_KEY,
+ * or many values of one key with DB_MULTIPLE */
+#if defined(HAVE_BDB_CURSOR) && defined(DB_MULTIPLE_KEY)
+#define LIBRDF_HASH_BDB_BULK 1
+
+/* default size of the bulk read buffer; option bdb-bulk-size */
+#define LIBRDF_HASH_BDB_BULK_SIZE (64 * 1024)
+#endif
+
+
+/* Shared environments need the V4.1+ DB_ENV API */
+#if defined(HAVE_DB_CREATE) && defined(HAVE_BDB_OPEN_7_ARGS)
+#define LIBRDF_HASH_BDB_ENV 1
+
+/* Concurrent environments use transactions and snapshot reads where
+ * BDB has MVCC (V4.5+), otherwise the Concurrent Data Store.
+ */
+#ifdef DB_MULTIVERSION
+#define LIBRDF_HASH_BDB_MVCC 1
+#endif
+
+/* An environment shared by all the hashes opened with the same
+ * bdb-env-dir in this world, so that they use one mpool cache.
+ */
+typedef struct librdf_hash_bdb_env_s
+{
+  struct librdf_hash_bdb_env_s* next;
+  char* dir;
+  DB_ENV* env;
+  int usage;
+  /* non-0 if opened with locking for use by several processes */
+  int concurrent;
+  /* non-0 if opened with transactions */
+  int transactional;
+} librdf_hash_bdb_env;
+
+/* the storage transaction a hash operation is in, or NULL */
+#define LIBRDF_HASH_BDB_TXN(context) ((context)->txn)
+#else
+#define LIBRDF_HASH_BDB_TXN(context) NULL
+#endif
+
+
 typedef struct 
 {
   librdf_hash *hash;
   int mode;
   int is_writable;
   int is_new;
+  /* environment options; kept here so that clone can use them */
+  char* env_dir;
+  long cache_size;
+  long page_size;
+  int concurrent;
+  int transactions;
+  /* bulk read buffer size for cursors or 0 to read one pair at a time */
+  long bulk_size;
   /* for BerkeleyDB only */
   DB* db;
   char* file_name;
+#ifdef LIBRDF_HASH_BDB_ENV
+  librdf_hash_bdb_env* env;
+  /* current transaction and non-0 if this hash started it */
+  DB_TXN* txn;
+  int txn_owner;
+#endif
 } librdf_hash_bdb_context;
 
 
@@ -81,6 +142,11 @@ static int librdf_hash_bdb_delete_key(void* context, librdf_hash_datum *key);
 static int librdf_hash_bdb_delete_key_value(void* context, librdf_hash_datum *key, librdf_hash_datum *value);
 static int librdf_hash_bdb_sync(void* context);
 static int librdf_hash_bdb_get_fd(void* context);
+static int librdf_hash_bdb_present(void* context, const char *identifier, librdf_hash* options);
+static int librdf_hash_bdb_get_stats(void* context, librdf_hash_stats* stats);
+static void* librdf_hash_bdb_transaction_start(void* context, void* handle);
+static int librdf_hash_bdb_transaction_commit(void* context);
+static int librdf_hash_bdb_transaction_rollback(void* context);
 
 static void librdf_hash_bdb_register_factory(librdf_hash_factory *factory);
 
@@ -102,6 +168,9 @@ librdf_hash_bdb_create(librdf_hash* hash, void* context)
   librdf_hash_bdb_context* hcontext=(librdf_hash_bdb_context*)context;
 
   hcontext->hash=hash;
+#ifdef LIBRDF_HASH_BDB_BULK
+  hcontext->bulk_size=LIBRDF_HASH_BDB_BULK_SIZE;
+#endif
   return 0;
 }
 
@@ -117,11 +186,290 @@ librdf_hash_bdb_create(librdf_hash* hash, void* context)
 static int
 librdf_hash_bdb_destroy(void* context) 
 {
-  /* NOP */
+  librdf_hash_bdb_context* bdb_context=(librdf_hash_bdb_context*)context;
+
+  if(bdb_context->env_dir)
+    LIBRDF_FREE(char*, bdb_context->env_dir);
+  return 0;
+}
+
+
+#ifdef LIBRDF_HASH_BDB_ENV
+/**
+ * librdf_hash_bdb_env_open:
+ * @world: redland world
+ * @dir: environment home directory
+ * @cache_size: mpool cache size in bytes or 0 for the BDB default
+ * @concurrent: non-0 to open with locking for several processes
+ * @transactional: non-0 to open with transactions
+ * @mode: file creation mode
+ *
+ * Get the shared environment for a directory, opening it if needed.
+ *
+ * The cache size only applies when the environment is first created.
+ * A concurrent environment allows one writer process and many reader
+ * processes, all of which must open it as concurrent.
+ * 
+ * Return value: environment or NULL on failure
+ **/
+static librdf_hash_bdb_env*
+librdf_hash_bdb_env_open(librdf_world* world, const char* dir,
+                         long cache_size, int concurrent, int transactional,
+                         int mode)
+{
+  librdf_hash_bdb_env* env;
+  u_int32_t flags = DB_CREATE | DB_INIT_MPOOL;
+  int ret;
+  
+#ifdef WITH_THREADS
+  pthread_mutex_lock(world->mutex);
+  flags |= DB_THREAD;
+#endif
+
+  for(env = world->hash_bdb_envs; env; env = env->next) {
+    if(!strcmp(env->dir, dir)) {
+      if(env->concurrent != concurrent ||
+         env->transactional != transactional) {
+        librdf_log(world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                   "BDB environment '%s' is already open with different bdb-concurrent or transactions options",
+                   dir);
+        env = NULL;
+      } else
+        env->usage++;
+      goto unlock;
+    }
+  }
+
+  env = LIBRDF_CALLOC(librdf_hash_bdb_env*, 1, sizeof(*env));
+  if(!env)
+    goto unlock;
+
+  env->dir = LIBRDF_MALLOC(char*, strlen(dir) + 1);
+  if(!env->dir)
+    goto failed;
+  strcpy(env->dir, dir);
+
+  ret = db_env_create(&env->env, 0);
+  if(ret) {
+    env->env = NULL;
+    librdf_log(world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "BDB environment create failed - %s", db_strerror(ret));
+    goto failed;
+  }
+
+  if(cache_size > 0) {
+    long gbyte = 1024L * 1024L * 1024L;
+
+    ret = env->env->set_cachesize(env->env,
+                                  LIBRDF_GOOD_CAST(u_int32_t, cache_size / gbyte),
+                                  LIBRDF_GOOD_CAST(u_int32_t, cache_size % gbyte),
+                                  1);
+    if(ret) {
+      librdf_log(world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "BDB cache size %ld failed - %s", cache_size,
+                 db_strerror(ret));
+      goto failed;
+    }
+  }
+
+  env->concurrent = concurrent;
+  env->transactional = transactional;
+  if(transactional) {
+    flags |= DB_INIT_LOCK | DB_INIT_LOG | DB_INIT_TXN;
+    if(concurrent) {
+#ifdef DB_REGISTER
+      /* recover only if a process died holding the environment */
+      flags |= DB_REGISTER | DB_RECOVER;
+#endif
+    } else
+      flags |= DB_RECOVER;
+    /* operations outside a transaction each commit on their own */
+    env->env->set_flags(env->env, DB_AUTO_COMMIT, 1);
+    env->env->set_lk_detect(env->env, DB_LOCK_DEFAULT);
+#ifdef DB_LOG_AUTO_REMOVE
+    env->env->log_set_config(env->env, DB_LOG_AUTO_REMOVE, 1);
+#endif
+  } else if(concurrent)
+    flags |= DB_INIT_CDB;
+
+  ret = env->env->open(env->env, dir, flags, mode);
+  if(ret) {
+    librdf_log(world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "BDB environment open of '%s' failed - %s", dir,
+               db_strerror(ret));
+    goto failed;
+  }
+
+  env->usage = 1;
+  env->next = world->hash_bdb_envs;
+  world->hash_bdb_envs = env;
+  goto unlock;
+
+  failed:
+  /* a DB_ENV handle must be closed even if the open failed */
+  if(env->env)
+    env->env->close(env->env, 0);
+  if(env->dir)
+    LIBRDF_FREE(char*, env->dir);
+  LIBRDF_FREE(librdf_hash_bdb_env, env);
+  env = NULL;
+
+  unlock:
+#ifdef WITH_THREADS
+  pthread_mutex_unlock(world->mutex);
+#endif
+
+  return env;
+}
+
+
+/**
+ * librdf_hash_bdb_env_close:
+ * @world: redland world
+ * @env: shared environment
+ *
+ * Release a shared environment, closing it when it is no longer used.
+ * 
+ **/
+static void
+librdf_hash_bdb_env_close(librdf_world* world, librdf_hash_bdb_env* env)
+{
+  librdf_hash_bdb_env** prev;
+  
+#ifdef WITH_THREADS
+  pthread_mutex_lock(world->mutex);
+#endif
+
+  if(--env->usage) {
+#ifdef WITH_THREADS
+    pthread_mutex_unlock(world->mutex);
+#endif
+    return;
+  }
+
+  for(prev = &world->hash_bdb_envs; *prev; prev = &(*prev)->next) {
+    if(*prev == env) {
+      *prev = env->next;
+      break;
+    }
+  }
+
+#ifdef WITH_THREADS
+  pthread_mutex_unlock(world->mutex);
+#endif
+
+  env->env->close(env->env, 0);
+  LIBRDF_FREE(char*, env->dir);
+  LIBRDF_FREE(librdf_hash_bdb_env, env);
+}
+
+
+/*
+ * librdf_hash_bdb_absolute_file - make a relative file name absolute
+ *
+ * Files opened in an environment are found relative to its home
+ * directory so relative names are made relative to the current
+ * directory first.  Takes ownership of @file.
+ */
+static char*
+librdf_hash_bdb_absolute_file(char* file)
+{
+#ifdef HAVE_UNISTD_H
+  char cwd[4096];
+  char* new_file;
+  
+  if(*file == '/')
+    return file;
+
+  if(!getcwd(cwd, sizeof(cwd)))
+    return file;
+
+  new_file = LIBRDF_MALLOC(char*, strlen(cwd) + strlen(file) + 2);
+  if(new_file)
+    sprintf(new_file, "%s/%s", cwd, file);
+  LIBRDF_FREE(char*, file);
+  return new_file;
+#else
+  return file;
+#endif
+}
+
+
+/*
+ * librdf_hash_bdb_file_dir - get the directory part of a file name
+ *
+ * Returns a new string, "." if there is none.
+ */
+static char*
+librdf_hash_bdb_file_dir(const char* file)
+{
+  const char* p = strrchr(file, '/');
+  size_t len = p ? LIBRDF_GOOD_CAST(size_t, p - file) : 0;
+  char* dir;
+
+  if(p && !len)
+    len = 1;
+
+  dir = LIBRDF_MALLOC(char*, len + 2);
+  if(!dir)
+    return NULL;
+
+  if(len) {
+    memcpy(dir, file, len);
+    dir[len] = '\0';
+  } else
+    strcpy(dir, ".");
+  return dir;
+}
+
+
+/*
+ * librdf_hash_bdb_txn_begin - start a transaction if the hash is transactional
+ *
+ * Sets *txn to NULL when the hash has no transactional environment.
+ */
+static int
+librdf_hash_bdb_txn_begin(librdf_hash_bdb_context* bdb_context,
+                          DB_TXN** txn, u_int32_t flags)
+{
+  DB_ENV* env;
+  int ret;
+
+  *txn = NULL;
+  if(!bdb_context->env || !bdb_context->env->transactional)
+    return 0;
+
+  env = bdb_context->env->env;
+  ret = env->txn_begin(env, NULL, txn, flags);
+  if(ret) {
+    librdf_log(bdb_context->hash->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "BDB transaction begin failed - %s", db_strerror(ret));
+    *txn = NULL;
+    return 1;
+  }
   return 0;
 }
 
 
+/*
+ * librdf_hash_bdb_txn_end - commit a transaction or abort it if @status
+ */
+static int
+librdf_hash_bdb_txn_end(DB_TXN* txn, int status)
+{
+  if(!txn)
+    return status;
+
+  if(status) {
+    txn->abort(txn);
+    return status;
+  }
+
+  return (txn->commit(txn, 0) != 0);
+}
+#endif
+
+
 /**
  * librdf_hash_bdb_open:
  * @context: BerkeleyDB hash context
@@ -129,10 +477,22 @@ librdf_hash_bdb_destroy(void* context)
  * @mode: file creation mode
  * @is_writable: is hash writable?
  * @is_new: is hash new?
- * @options: hash options (currently unused)
+ * @options: hash options
  *
  * Open and maybe create a BerkeleyDB hash.
  * 
+ * The options 'bdb-env-dir', 'bdb-cache-size' and 'bdb-page-size'
+ * open the hash in a Berkeley DB environment shared with all other
+ * hashes using the same directory, with a cache of the given size in
+ * bytes and the given database page size.  Boolean option
+ * 'bdb-concurrent' opens a locking environment, by default in the
+ * directory of the hash file, so that one writer process and any
+ * number of reader processes can use the hash at once.  Boolean
+ * option 'transactions' opens a transactional environment in the same
+ * way so that the transaction methods can be used.  Option
+ * 'bdb-bulk-size' sets the size in bytes of the buffer cursors read
+ * many pairs into at once, or 0 to read one pair at a time.
+ * 
  * Return value: non 0 on failure.
  **/
 static int
@@ -145,6 +505,9 @@ librdf_hash_bdb_open(void* context, const char *identifier,
   char *file;
   int ret;
   u_int32_t flags = 0;
+#ifdef HAVE_DB_CREATE
+  DB_ENV* env = NULL;
+#endif
 
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(identifier, cstring, 1);
   
@@ -152,13 +515,42 @@ librdf_hash_bdb_open(void* context, const char *identifier,
   DB_INFO bdb_info;
 #endif
   
-  /* NOTE: If the options parameter is ever used here, the data must be
-   * copied into a private part of the context so that the clone
-   * method can access them
+  /* The options are copied into the context so that the clone
+   * method can use them
    */
   bdb_context->mode=mode;
   bdb_context->is_writable=is_writable;
   bdb_context->is_new=is_new;
+
+  if(options) {
+    char *env_dir;
+    long value;
+    
+    env_dir=librdf_hash_get(options, "bdb-env-dir");
+    if(env_dir) {
+      if(bdb_context->env_dir)
+        LIBRDF_FREE(char*, bdb_context->env_dir);
+      bdb_context->env_dir=env_dir;
+    }
+
+    value=librdf_hash_get_as_long(options, "bdb-cache-size");
+    if(value > 0)
+      bdb_context->cache_size=value;
+
+    value=librdf_hash_get_as_long(options, "bdb-page-size");
+    if(value > 0)
+      bdb_context->page_size=value;
+
+    if(librdf_hash_get_as_boolean(options, "bdb-concurrent") > 0)
+      bdb_context->concurrent=1;
+
+    if(librdf_hash_get_as_boolean(options, "transactions") > 0)
+      bdb_context->transactions=1;
+
+    value=librdf_hash_get_as_long(options, "bdb-bulk-size");
+    if(value >= 0)
+      bdb_context->bulk_size=value;
+  }
   
   file = LIBRDF_MALLOC(char*, strlen(identifier) + 4);
   if(!file)
@@ -166,19 +558,70 @@ librdf_hash_bdb_open(void* context, const char *identifier,
   sprintf(file, "%s.db", identifier);
 
 #ifdef HAVE_DB_CREATE
+#ifdef LIBRDF_HASH_BDB_ENV
+  /* concurrent or transactional hashes default to an environment
+   * beside the files */
+  if((bdb_context->concurrent || bdb_context->transactions) &&
+     !bdb_context->env_dir) {
+    bdb_context->env_dir = librdf_hash_bdb_file_dir(file);
+    if(!bdb_context->env_dir) {
+      LIBRDF_FREE(char*, file);
+      return 1;
+    }
+  }
+
+  if(bdb_context->env_dir) {
+    file = librdf_hash_bdb_absolute_file(file);
+    if(!file)
+      return 1;
+
+    bdb_context->env = librdf_hash_bdb_env_open(bdb_context->hash->world,
+                                                bdb_context->env_dir,
+                                                bdb_context->cache_size,
+                                                bdb_context->concurrent,
+#ifdef LIBRDF_HASH_BDB_MVCC
+                                                (bdb_context->transactions ||
+                                                 bdb_context->concurrent),
+#else
+                                                bdb_context->transactions,
+#endif
+                                                mode);
+    if(!bdb_context->env) {
+      LIBRDF_FREE(char*, file);
+      return 1;
+    }
+    env = bdb_context->env->env;
+  }
+#endif
+
   /* V3 prototype:
    * int db_create(DB **dbp, DB_ENV *dbenv, u_int32_t flags);
    */
-  ret = db_create(&bdb, NULL, flags);
+  ret = db_create(&bdb, env, flags);
   if(ret) {
     LIBRDF_DEBUG2("Failed to create BDB context - %d\n", ret);
-    return 1;
+    goto failed;
   }
   
 #ifdef HAVE_BDB_SET_FLAGS
   if((ret=bdb->set_flags(bdb, DB_DUP))) {
     LIBRDF_DEBUG2("Failed to set BDB duplicate flag - %d\n", ret);
-    return 1;
+    bdb->close(bdb, 0);
+    goto failed;
+  }
+#endif
+
+#ifdef LIBRDF_HASH_BDB_ENV
+  if(bdb_context->page_size > 0) {
+    ret = bdb->set_pagesize(bdb,
+                            LIBRDF_GOOD_CAST(u_int32_t, bdb_context->page_size));
+    if(ret) {
+      librdf_log(bdb_context->hash->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "BDB page size %ld failed - %s", bdb_context->page_size,
+                 db_strerror(ret));
+      bdb->close(bdb, 0);
+      goto failed;
+    }
   }
 #endif
   
@@ -189,6 +632,21 @@ librdf_hash_bdb_open(void* context, const char *identifier,
   flags = is_writable ? DB_CREATE : DB_RDONLY;
   if(is_new)
     flags |= DB_TRUNCATE;
+
+#ifdef LIBRDF_HASH_BDB_ENV
+  if(bdb_context->env && bdb_context->env->transactional) {
+    /* A transactional database cannot be truncated by open */
+    if(is_new) {
+      env->dbremove(env, NULL, file, NULL, DB_AUTO_COMMIT);
+      flags &= ~(u_int32_t)DB_TRUNCATE;
+    }
+    flags |= DB_AUTO_COMMIT;
+#ifdef LIBRDF_HASH_BDB_MVCC
+    if(bdb_context->concurrent)
+      flags |= DB_MULTIVERSION;
+#endif
+  }
+#endif
 #endif
 
 #if defined(HAVE_BDB_OPEN_6_ARGS) || defined(HAVE_BDB_OPEN_7_ARGS)
@@ -202,8 +660,8 @@ librdf_hash_bdb_open(void* context, const char *identifier,
   if(ret) {
     librdf_log(bdb_context->hash->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
                "BDB V4.0+ open of '%s' failed - %s", file, db_strerror(ret));
-    LIBRDF_FREE(char*, file);
-    return 1;
+    bdb->close(bdb, 0);
+    goto failed;
   }
 #else
 /* Must be HAVE_BDB_OPEN_7_ARGS */
@@ -216,8 +674,8 @@ librdf_hash_bdb_open(void* context, const char *identifier,
   if(ret) {
     librdf_log(bdb_context->hash->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
                "BDB V4.1+ open of '%s' failed - %s", file, db_strerror(ret));
-    LIBRDF_FREE(char*, file);
-    return 1;
+    bdb->close(bdb, 0);
+    goto failed;
   }
 #endif
 
@@ -276,6 +734,18 @@ ERROR - no idea how to use Berkeley DB
   bdb_context->db=bdb;
   bdb_context->file_name=file;
   return 0;
+
+#ifdef HAVE_DB_CREATE
+  failed:
+#ifdef LIBRDF_HASH_BDB_ENV
+  if(bdb_context->env) {
+    librdf_hash_bdb_env_close(bdb_context->hash->world, bdb_context->env);
+    bdb_context->env = NULL;
+  }
+#endif
+  LIBRDF_FREE(char*, file);
+  return 1;
+#endif
 }
 
 
@@ -303,6 +773,13 @@ librdf_hash_bdb_close(void* context)
 #else
   /* V1 */
   ret=db->close(db);
+#endif
+#ifdef LIBRDF_HASH_BDB_ENV
+  /* databases must be closed before their environment */
+  if(bdb_context->env) {
+    librdf_hash_bdb_env_close(bdb_context->hash->world, bdb_context->env);
+    bdb_context->env = NULL;
+  }
 #endif
   LIBRDF_FREE(char*, bdb_context->file_name);
   return ret;
@@ -336,8 +813,19 @@ librdf_hash_bdb_clone(librdf_hash *hash, void* context, char *new_identifier,
   /* copy data fields that might change */
   hcontext->hash=hash;
 
-  /* Note: The options are not used at present, so no need to make a copy 
-   */
+  /* copy the options that open saved, since none are passed here */
+  if(old_hcontext->env_dir) {
+    hcontext->env_dir=LIBRDF_MALLOC(char*, strlen(old_hcontext->env_dir) + 1);
+    if(!hcontext->env_dir)
+      return 1;
+    strcpy(hcontext->env_dir, old_hcontext->env_dir);
+  }
+  hcontext->cache_size=old_hcontext->cache_size;
+  hcontext->page_size=old_hcontext->page_size;
+  hcontext->concurrent=old_hcontext->concurrent;
+  hcontext->transactions=old_hcontext->transactions;
+  hcontext->bulk_size=old_hcontext->bulk_size;
+
   if(librdf_hash_bdb_open(context, new_identifier,
                           old_hcontext->mode, old_hcontext->is_writable,
                           old_hcontext->is_new, NULL))
@@ -396,6 +884,22 @@ typedef struct {
 #ifdef HAVE_BDB_CURSOR
   DBC* cursor;
 #endif
+#ifdef LIBRDF_HASH_BDB_ENV
+  /* snapshot transaction the cursor reads in, if concurrent */
+  DB_TXN* txn;
+#endif
+#ifdef LIBRDF_HASH_BDB_BULK
+  /* bulk read buffer and the position of the next pair in it */
+  void *bulk;
+  size_t bulk_size;
+  DBT bulk_data;
+  void *bulk_ptr;
+  size_t last_key_len;
+  /* non-0 if the buffer holds only values of bulk_key */
+  int bulk_dups;
+  void *bulk_key;
+  u_int32_t bulk_key_len;
+#endif
 } librdf_hash_bdb_cursor_context;
 
 
@@ -417,15 +921,44 @@ librdf_hash_bdb_cursor_init(void *cursor_context, void *hash_context)
 #endif
 
   cursor->hash=(librdf_hash_bdb_context*)hash_context;
+#ifdef LIBRDF_HASH_BDB_BULK
+  /* BDB needs a multiple of 1K; the buffer is allocated on first use */
+  if(cursor->hash->bulk_size > 0)
+    cursor->bulk_size = (LIBRDF_GOOD_CAST(size_t, cursor->hash->bulk_size) + 1023) & ~((size_t)1023);
+#endif
 
 #ifdef HAVE_BDB_CURSOR
   db=cursor->hash->db;
 #ifdef HAVE_BDB_CURSOR_4_ARGS
+#ifdef LIBRDF_HASH_BDB_ENV
+  if(cursor->hash->txn) {
+    /* read inside the storage transaction to see its changes */
+    if(db->cursor(db, cursor->hash->txn, &cursor->cursor, 0))
+      return 1;
+    return 0;
+  }
+
+#ifdef LIBRDF_HASH_BDB_MVCC
+  /* Read a snapshot so that a writer in another process is not
+   * blocked for the life of the cursor */
+  if(cursor->hash->env && cursor->hash->env->concurrent &&
+     librdf_hash_bdb_txn_begin(cursor->hash, &cursor->txn, DB_TXN_SNAPSHOT))
+    return 1;
+#endif
+
+  if(db->cursor(db, cursor->txn, &cursor->cursor, 0)) {
+    cursor->cursor = NULL;
+    librdf_hash_bdb_txn_end(cursor->txn, 1);
+    cursor->txn = NULL;
+    return 1;
+  }
+#else
   /* V3 prototype:
    * int DB->cursor(DB *db, DB_TXN *txnid, DBC **cursorp, u_int32_t flags);
    */
   if(db->cursor(db, NULL, &cursor->cursor, 0))
     return 1;
+#endif
 #else
   /* V2 prototype:
    * int DB->cursor(DB *db, DB_TXN *txnid, DBC **cursorp);
@@ -439,6 +972,219 @@ librdf_hash_bdb_cursor_init(void *cursor_context, void *hash_context)
 }
 
 
+#ifdef LIBRDF_HASH_BDB_BULK
+/*
+ * librdf_hash_bdb_cursor_bulk_fetch - fill the bulk buffer from the cursor
+ *
+ * The buffer grows if a single pair does not fit.
+ */
+static int
+librdf_hash_bdb_cursor_bulk_fetch(librdf_hash_bdb_cursor_context* cursor,
+                                  DBT* bdb_key, u_int32_t flags)
+{
+  u_int32_t multiple = cursor->bulk_dups ? DB_MULTIPLE : DB_MULTIPLE_KEY;
+  DBC *bdb_cursor=cursor->cursor;
+  int ret;
+
+  cursor->bulk_ptr = NULL;
+
+  while(1) {
+    if(!cursor->bulk) {
+      cursor->bulk = LIBRDF_MALLOC(void*, cursor->bulk_size);
+      if(!cursor->bulk)
+        return 1;
+    }
+
+    memset(&cursor->bulk_data, 0, sizeof(DBT));
+    cursor->bulk_data.data = cursor->bulk;
+    cursor->bulk_data.ulen = LIBRDF_BAD_CAST(u_int32_t, cursor->bulk_size);
+    cursor->bulk_data.flags = DB_DBT_USERMEM;
+
+    ret=bdb_cursor->c_get(bdb_cursor, bdb_key, &cursor->bulk_data,
+                          flags | multiple);
+#ifdef DB_BUFFER_SMALL
+    if(ret != DB_BUFFER_SMALL && ret != ENOMEM)
+      break;
+#else
+    if(ret != ENOMEM)
+      break;
+#endif
+
+    /* size is now the space needed; bulk buffers are in 1K units */
+    LIBRDF_FREE(char*, cursor->bulk);
+    cursor->bulk = NULL;
+    if(cursor->bulk_data.size <= cursor->bulk_size)
+      return ret;
+    cursor->bulk_size = (cursor->bulk_data.size + 1023) & ~((size_t)1023);
+  }
+
+  if(ret)
+    return ret;
+
+  DB_MULTIPLE_INIT(cursor->bulk_ptr, &cursor->bulk_data);
+  return 0;
+}
+
+
+/*
+ * librdf_hash_bdb_cursor_bulk_next - get the next pair from the bulk buffer
+ *
+ * Reads the following pairs into the buffer when it is used up.
+ */
+static int
+librdf_hash_bdb_cursor_bulk_next(librdf_hash_bdb_cursor_context* cursor,
+                                 void** key, u_int32_t* key_len,
+                                 void** value, u_int32_t* value_len)
+{
+  DBT bdb_key;
+  int ret;
+
+  while(1) {
+    if(cursor->bulk_ptr && cursor->bulk_dups) {
+      DB_MULTIPLE_NEXT(cursor->bulk_ptr, &cursor->bulk_data,
+                       *value, *value_len);
+      if(cursor->bulk_ptr) {
+        *key = cursor->bulk_key;
+        *key_len = cursor->bulk_key_len;
+        return 0;
+      }
+    } else if(cursor->bulk_ptr) {
+      DB_MULTIPLE_KEY_NEXT(cursor->bulk_ptr, &cursor->bulk_data,
+                           *key, *key_len, *value, *value_len);
+      if(cursor->bulk_ptr)
+        return 0;
+    }
+
+    memset(&bdb_key, 0, sizeof(DBT));
+    ret=librdf_hash_bdb_cursor_bulk_fetch(cursor, &bdb_key,
+                                          (cursor->bulk_dups ? DB_NEXT_DUP
+                                                             : DB_NEXT));
+    if(ret)
+      return ret;
+  }
+}
+
+
+/*
+ * librdf_hash_bdb_cursor_get_bulk - cursor get method using bulk reads
+ */
+static int
+librdf_hash_bdb_cursor_get_bulk(librdf_hash_bdb_cursor_context* cursor,
+                                librdf_hash_datum *key,
+                                librdf_hash_datum *value,
+                                unsigned int flags)
+{
+  DBT bdb_key;
+  void *k = NULL;
+  void *v = NULL;
+  u_int32_t k_len = 0;
+  u_int32_t v_len = 0;
+  int ret;
+
+  memset(&bdb_key, 0, sizeof(DBT));
+
+  switch(flags) {
+    case LIBRDF_HASH_CURSOR_SET:
+      /* only the values of this key are read, not the keys after it */
+      if(cursor->bulk_key)
+        LIBRDF_FREE(char*, cursor->bulk_key);
+      cursor->bulk_key = LIBRDF_MALLOC(void*, key->size ? key->size : 1);
+      if(!cursor->bulk_key)
+        return 1;
+      memcpy(cursor->bulk_key, key->data, key->size);
+      cursor->bulk_key_len = LIBRDF_BAD_CAST(u_int32_t, key->size);
+      cursor->bulk_dups = 1;
+
+      bdb_key.data = (char*)key->data;
+      bdb_key.size = LIBRDF_BAD_CAST(u_int32_t, key->size);
+      ret=librdf_hash_bdb_cursor_bulk_fetch(cursor, &bdb_key, DB_SET);
+      if(!ret)
+        ret=librdf_hash_bdb_cursor_bulk_next(cursor, &k, &k_len, &v, &v_len);
+      break;
+
+    case LIBRDF_HASH_CURSOR_SET_RANGE:
+      cursor->bulk_dups = 0;
+      bdb_key.data = (char*)key->data;
+      bdb_key.size = LIBRDF_BAD_CAST(u_int32_t, key->size);
+      ret=librdf_hash_bdb_cursor_bulk_fetch(cursor, &bdb_key, DB_SET_RANGE);
+      if(!ret)
+        ret=librdf_hash_bdb_cursor_bulk_next(cursor, &k, &k_len, &v, &v_len);
+      break;
+
+    case LIBRDF_HASH_CURSOR_FIRST:
+      cursor->bulk_dups = 0;
+      ret=librdf_hash_bdb_cursor_bulk_fetch(cursor, &bdb_key, DB_FIRST);
+      if(!ret)
+        ret=librdf_hash_bdb_cursor_bulk_next(cursor, &k, &k_len, &v, &v_len);
+      break;
+
+    case LIBRDF_HASH_CURSOR_NEXT_VALUE:
+      ret=librdf_hash_bdb_cursor_bulk_next(cursor, &k, &k_len, &v, &v_len);
+
+      /* If succeeded and key has changed, end */
+      if(!ret && cursor->last_key &&
+         (k_len != cursor->last_key_len ||
+          memcmp(cursor->last_key, k, k_len)))
+        ret=DB_NOTFOUND;
+      break;
+
+    case LIBRDF_HASH_CURSOR_NEXT:
+      /* Get next key/value, or skip to the next key when no value */
+      do {
+        ret=librdf_hash_bdb_cursor_bulk_next(cursor, &k, &k_len, &v, &v_len);
+      } while(!ret && !value && cursor->last_key &&
+              k_len == cursor->last_key_len &&
+              !memcmp(cursor->last_key, k, k_len));
+      break;
+
+    default:
+      librdf_log(cursor->hash->hash->world,
+                 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_HASH, NULL,
+                 "Unknown hash method flag %d", flags);
+      return 1;
+  }
+
+  /* Free previous key and values */
+  if(cursor->last_key) {
+    LIBRDF_FREE(char*, cursor->last_key);
+    cursor->last_key=NULL;
+  }
+    
+  if(cursor->last_value) {
+    LIBRDF_FREE(char*, cursor->last_value);
+    cursor->last_value=NULL;
+  }
+
+  if(ret) {
+#ifdef LIBRDF_DEBUG
+    if(ret != DB_NOTFOUND)
+      LIBRDF_DEBUG2("BDB cursor error - %d\n", ret);
+#endif
+    key->data=NULL;
+    return ret;
+  }
+
+  /* copy out of the buffer since it is reused by the next read */
+  cursor->last_key = key->data = LIBRDF_MALLOC(void*, k_len ? k_len : 1);
+  if(!key->data)
+    return 1;
+  memcpy(key->data, k, k_len);
+  key->size = k_len;
+  cursor->last_key_len = k_len;
+
+  if(value) {
+    cursor->last_value = value->data = LIBRDF_MALLOC(void*, v_len ? v_len : 1);
+    if(!value->data)
+      return 1;
+    memcpy(value->data, v, v_len);
+    value->size = v_len;
+  }
+
+  return 0;
+}
+#endif
+
+
 /**
  * librdf_hash_bdb_cursor_get:
  * @context: BerkeleyDB hash cursor context
@@ -466,6 +1212,11 @@ librdf_hash_bdb_cursor_get(void* context,
   DBT bdb_value;
   int ret;
 
+#ifdef LIBRDF_HASH_BDB_BULK
+  if(cursor->bulk_size)
+    return librdf_hash_bdb_cursor_get_bulk(cursor, key, value, flags);
+#endif
+
   /* docs say you must zero DBT's before use */
   memset(&bdb_key, 0, sizeof(DBT));
   memset(&bdb_value, 0, sizeof(DBT));
@@ -499,6 +1250,16 @@ librdf_hash_bdb_cursor_get(void* context,
 #endif
       break;
       
+    case LIBRDF_HASH_CURSOR_SET_RANGE:
+#ifdef HAVE_BDB_CURSOR
+      /* the btree returns the smallest key >= bdb_key */
+      ret=bdb_cursor->c_get(bdb_cursor, &bdb_key, &bdb_value, DB_SET_RANGE);
+#else
+      /* V1 */
+      ret=db->seq(db, &bdb_key, &bdb_value, R_CURSOR);
+#endif
+      break;
+      
     case LIBRDF_HASH_CURSOR_FIRST:
 #ifdef HAVE_BDB_CURSOR
       /* V2/V3 prototype:
@@ -658,6 +1419,19 @@ librdf_hash_bdb_cursor_finish(void* context)
   /* BDB V2/V3 */
   if(cursor->cursor)
     cursor->cursor->c_close(cursor->cursor);
+#endif
+#ifdef LIBRDF_HASH_BDB_ENV
+  /* the snapshot was only read so committing cannot fail usefully */
+  if(cursor->txn) {
+    librdf_hash_bdb_txn_end(cursor->txn, 0);
+    cursor->txn = NULL;
+  }
+#endif
+#ifdef LIBRDF_HASH_BDB_BULK
+  if(cursor->bulk)
+    LIBRDF_FREE(char*, cursor->bulk);
+  if(cursor->bulk_key)
+    LIBRDF_FREE(char*, cursor->bulk_key);
 #endif
   if(cursor->last_key)
     LIBRDF_FREE(char*, cursor->last_key);
@@ -704,7 +1478,7 @@ librdf_hash_bdb_put(void* context, librdf_hash_datum *key,
   /* V2/V3 prototype:
    * int DB->put(DB *db, DB_TXN *txnid, DBT *key, DBT *data, u_int32_t flags); 
    */
-  ret = db->put(db, NULL, &bdb_key, &bdb_value, flags);
+  ret = db->put(db, LIBRDF_HASH_BDB_TXN(bdb_context), &bdb_key, &bdb_value, flags);
 #else
   /* V1 */
   ret = db->put(db, &bdb_key, &bdb_value, flags);
@@ -760,7 +1534,7 @@ librdf_hash_bdb_exists(void* context, librdf_hash_datum *key,
   /* later V2 (sigh)/V3 */
   if(value)
     flags = DB_GET_BOTH;
-  ret = db->get(db, NULL, &bdb_key, &bdb_value, flags);
+  ret = db->get(db, LIBRDF_HASH_BDB_TXN(bdb_context), &bdb_key, &bdb_value, flags);
   if(ret == DB_NOTFOUND)
     ret= 0;
   else if(ret) /* failed */
@@ -771,7 +1545,7 @@ librdf_hash_bdb_exists(void* context, librdf_hash_datum *key,
   /* earlier V2 */
   if(!value) {
     /* don't care about value, can use standard get */
-    ret = db->get(db, NULL, &bdb_key, &bdb_value, flags);
+    ret = db->get(db, LIBRDF_HASH_BDB_TXN(bdb_context), &bdb_key, &bdb_value, flags);
     if(ret == DB_NOTFOUND)
       ret= 0;
     else if(ret) /* failed */
@@ -784,7 +1558,7 @@ librdf_hash_bdb_exists(void* context, librdf_hash_datum *key,
     
     ret=1;
     
-    if(db->cursor(db, NULL, &dbc))
+    if(db->cursor(db, LIBRDF_HASH_BDB_TXN(bdb_context), &dbc))
       ret= -1;
 
     if(ret >= 0) {
@@ -891,7 +1665,7 @@ librdf_hash_bdb_delete_key(void* context, librdf_hash_datum *key)
   
 #ifdef HAVE_BDB_DB_TXN
   /* V2/V3 */
-  ret = bdb->del(bdb, NULL, &bdb_key, flags);
+  ret = bdb->del(bdb, LIBRDF_HASH_BDB_TXN(bdb_context), &bdb_key, flags);
 #else
   /* V1 */
   ret = bdb->del(bdb, &bdb_key, flags);
@@ -926,6 +1700,7 @@ librdf_hash_bdb_delete_key_value(void* context,
   u_int32_t flags = 0;
 #ifdef HAVE_BDB_CURSOR
   DBC* dbc;
+  DB_TXN* txn = NULL;
 #endif
 
   memset(&bdb_key, 0, sizeof(DBT));
@@ -940,11 +1715,27 @@ librdf_hash_bdb_delete_key_value(void* context,
   
 #ifdef HAVE_BDB_CURSOR
 #ifdef HAVE_BDB_CURSOR_4_ARGS
+#ifdef LIBRDF_HASH_BDB_ENV
+  if(bdb_context->txn)
+    txn = bdb_context->txn;
+  else if(bdb_context->env && bdb_context->env->transactional) {
+    /* cursor writes are not auto committed */
+    if(librdf_hash_bdb_txn_begin(bdb_context, &txn, 0))
+      return 1;
+  } else if(bdb_context->env && bdb_context->env->concurrent)
+    /* the Concurrent Data Store needs cursors for writing marked */
+    flags = DB_WRITECURSOR;
+#endif
   /* V3 prototype:
    * int DB->cursor(DB *db, DB_TXN *txnid, DBC **cursorp, u_int32_t flags);
    */
-  if(bdb->cursor(bdb, NULL, &dbc, flags))
+  if(bdb->cursor(bdb, txn, &dbc, flags)) {
+#ifdef LIBRDF_HASH_BDB_ENV
+    if(txn != bdb_context->txn)
+      librdf_hash_bdb_txn_end(txn, 1);
+#endif
     return 1;
+  }
 #else
   /* V2 prototype:
    * int DB->cursor(DB *db, DB_TXN *txnid, DBC **cursorp);
@@ -965,6 +1756,10 @@ librdf_hash_bdb_delete_key_value(void* context,
   ret = dbc->c_get(dbc, &bdb_key, &bdb_value, flags);
   if(ret) {
     dbc->c_close(dbc);
+#ifdef LIBRDF_HASH_BDB_ENV
+    if(txn != bdb_context->txn)
+      librdf_hash_bdb_txn_end(txn, 1);
+#endif
     return 1;
   }
   
@@ -972,6 +1767,10 @@ librdf_hash_bdb_delete_key_value(void* context,
   ret=dbc->c_del(dbc, 0);
 
   dbc->c_close(dbc);
+#ifdef LIBRDF_HASH_BDB_ENV
+  if(txn != bdb_context->txn)
+    ret=librdf_hash_bdb_txn_end(txn, ret);
+#endif
 #else
   /* V1 prototype:
    * int db->seq(DB* db, DBT *key, DBT *data, u_int flags);
@@ -1011,6 +1810,15 @@ librdf_hash_bdb_sync(void* context)
   int ret;
 
   ret = db->sync(db, 0);
+
+#ifdef LIBRDF_HASH_BDB_ENV
+  /* checkpoint so that the log can be removed */
+  if(!ret && bdb_context->env && bdb_context->env->transactional) {
+    DB_ENV* env = bdb_context->env->env;
+
+    ret = env->txn_checkpoint(env, 0, 0, 0);
+  }
+#endif
   
   return ret;
 }
@@ -1042,6 +1850,178 @@ librdf_hash_bdb_get_fd(void* context)
 }
 
 
+/**
+ * librdf_hash_bdb_present:
+ * @context: BerkeleyDB hash context
+ * @identifier: file name prefix of the hash
+ * @options: #librdf_hash of options - not used
+ *
+ * Check if the BerkeleyDB file identifier".db" exists.
+ * 
+ * Return value: >0 if present, 0 if not, <0 on failure
+ **/
+static int
+librdf_hash_bdb_present(void* context, const char *identifier,
+                        librdf_hash* options)
+{
+  char *file;
+  FILE *fh;
+
+  file = LIBRDF_MALLOC(char*, strlen(identifier) + 4);
+  if(!file)
+    return -1;
+  sprintf(file, "%s.db", identifier);
+
+  fh = fopen(file, "rb");
+  LIBRDF_FREE(char*, file);
+  if(!fh)
+    return 0;
+
+  fclose(fh);
+  return 1;
+}
+
+
+/**
+ * librdf_hash_bdb_get_stats:
+ * @context: BerkeleyDB hash context
+ * @stats: statistics to fill in
+ *
+ * Get the mpool cache statistics of the shared environment.
+ * 
+ * Return value: non 0 on failure or if the hash has no environment
+ **/
+static int
+librdf_hash_bdb_get_stats(void* context, librdf_hash_stats* stats)
+{
+#ifdef LIBRDF_HASH_BDB_ENV
+  librdf_hash_bdb_context* bdb_context=(librdf_hash_bdb_context*)context;
+  DB_ENV* env;
+  DB_MPOOL_STAT* mpool_stat = NULL;
+
+  if(!bdb_context->env)
+    return 1;
+  env = bdb_context->env->env;
+
+  if(env->memp_stat(env, &mpool_stat, NULL, 0))
+    return 1;
+
+  stats->cache_hits = LIBRDF_GOOD_CAST(unsigned long, mpool_stat->st_cache_hit);
+  stats->cache_misses = LIBRDF_GOOD_CAST(unsigned long, mpool_stat->st_cache_miss);
+  stats->pages_read = LIBRDF_GOOD_CAST(unsigned long, mpool_stat->st_page_in);
+  stats->pages_written = LIBRDF_GOOD_CAST(unsigned long, mpool_stat->st_page_out);
+
+  /* allocated by BDB with malloc() */
+  SYSTEM_FREE(mpool_stat);
+  return 0;
+#else
+  return 1;
+#endif
+}
+
+
+/**
+ * librdf_hash_bdb_transaction_start:
+ * @context: BerkeleyDB hash context
+ * @handle: DB_TXN of another hash in the same environment or NULL
+ *
+ * Start a transaction, or join the transaction of another hash.
+ * 
+ * Needs a transactional environment, from option 'transactions' or
+ * 'bdb-concurrent'.  One DB_TXN covers all the hashes that join it so
+ * that they are committed atomically.
+ * 
+ * Return value: the DB_TXN or NULL on failure
+ **/
+static void*
+librdf_hash_bdb_transaction_start(void* context, void* handle)
+{
+#ifdef LIBRDF_HASH_BDB_ENV
+  librdf_hash_bdb_context* bdb_context=(librdf_hash_bdb_context*)context;
+
+  if(bdb_context->txn || !bdb_context->env ||
+     !bdb_context->env->transactional)
+    return NULL;
+
+  if(handle) {
+    bdb_context->txn = (DB_TXN*)handle;
+    bdb_context->txn_owner = 0;
+  } else {
+    if(librdf_hash_bdb_txn_begin(bdb_context, &bdb_context->txn, 0))
+      return NULL;
+    bdb_context->txn_owner = 1;
+  }
+
+  return bdb_context->txn;
+#else
+  return NULL;
+#endif
+}
+
+
+/**
+ * librdf_hash_bdb_transaction_commit:
+ * @context: BerkeleyDB hash context
+ *
+ * Commit the transaction if this hash started it, otherwise leave it.
+ * 
+ * Return value: non 0 on failure
+ **/
+static int
+librdf_hash_bdb_transaction_commit(void* context)
+{
+#ifdef LIBRDF_HASH_BDB_ENV
+  librdf_hash_bdb_context* bdb_context=(librdf_hash_bdb_context*)context;
+  int status = 0;
+
+  if(!bdb_context->txn)
+    return 1;
+
+  if(bdb_context->txn_owner) {
+    status = librdf_hash_bdb_txn_end(bdb_context->txn, 0);
+    if(status)
+      librdf_log(bdb_context->hash->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "BDB transaction commit failed");
+  }
+
+  bdb_context->txn = NULL;
+  bdb_context->txn_owner = 0;
+  return status;
+#else
+  return 1;
+#endif
+}
+
+
+/**
+ * librdf_hash_bdb_transaction_rollback:
+ * @context: BerkeleyDB hash context
+ *
+ * Abort the transaction if this hash started it, otherwise leave it.
+ * 
+ * Return value: non 0 on failure
+ **/
+static int
+librdf_hash_bdb_transaction_rollback(void* context)
+{
+#ifdef LIBRDF_HASH_BDB_ENV
+  librdf_hash_bdb_context* bdb_context=(librdf_hash_bdb_context*)context;
+
+  if(!bdb_context->txn)
+    return 1;
+
+  if(bdb_context->txn_owner)
+    librdf_hash_bdb_txn_end(bdb_context->txn, 1);
+
+  bdb_context->txn = NULL;
+  bdb_context->txn_owner = 0;
+  return 0;
+#else
+  return 1;
+#endif
+}
+
+
 /* local function to register BDB hash functions */
 
 /**
@@ -1072,10 +2052,18 @@ librdf_hash_bdb_register_factory(librdf_hash_factory *factory)
   factory->delete_key_value  = librdf_hash_bdb_delete_key_value;
   factory->sync    = librdf_hash_bdb_sync;
   factory->get_fd  = librdf_hash_bdb_get_fd;
+  factory->present = librdf_hash_bdb_present;
 
   factory->cursor_init   = librdf_hash_bdb_cursor_init;
   factory->cursor_get    = librdf_hash_bdb_cursor_get;
   factory->cursor_finish = librdf_hash_bdb_cursor_finish;
+  factory->sorted_keys   = 1;
+
+  factory->get_stats = librdf_hash_bdb_get_stats;
+
+  factory->transaction_start    = librdf_hash_bdb_transaction_start;
+  factory->transaction_commit   = librdf_hash_bdb_transaction_commit;
+  factory->transaction_rollback = librdf_hash_bdb_transaction_rollback;
 }
 
 
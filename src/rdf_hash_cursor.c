@@ -32,6 +32,7 @@
 #endif
 
 #include <stdio.h>
+#include <string.h>
 #include <stdarg.h>
 #include <ctype.h>
 #include <sys/types.h>
@@ -43,8 +44,23 @@
 struct librdf_hash_cursor_s {
   librdf_hash *hash;
   void *context;
+
+  /* keys returned after a seek: LIBRDF_HASH_CURSOR_BOUND_* */
+  int bound_type;
+  /* prefix or range start */
+  unsigned char *lower;
+  size_t lower_len;
+  /* range end (excluded) or NULL for no end */
+  unsigned char *upper;
+  size_t upper_len;
 };
 
+#define LIBRDF_HASH_CURSOR_BOUND_NONE 0
+#define LIBRDF_HASH_CURSOR_BOUND_PREFIX 1
+#define LIBRDF_HASH_CURSOR_BOUND_RANGE 2
+
+static int librdf_hash_cursor_get_bounded(librdf_hash_cursor *cursor, librdf_hash_datum *key, librdf_hash_datum *value, unsigned int flags);
+
 
 
 /**
@@ -101,6 +117,11 @@ librdf_free_hash_cursor (librdf_hash_cursor* cursor)
     LIBRDF_FREE(librdf_hash_cursor_context, cursor->context);
   }
 
+  if(cursor->lower)
+    LIBRDF_FREE(char*, cursor->lower);
+  if(cursor->upper)
+    LIBRDF_FREE(char*, cursor->upper);
+
   LIBRDF_FREE(librdf_hash_cursor, cursor);
 }
 
@@ -110,6 +131,7 @@ librdf_hash_cursor_set(librdf_hash_cursor *cursor,
                        librdf_hash_datum *key,
                        librdf_hash_datum *value)
 {
+  cursor->bound_type = LIBRDF_HASH_CURSOR_BOUND_NONE;
   return cursor->hash->factory->cursor_get(cursor->context, key, value, 
                                            LIBRDF_HASH_CURSOR_SET);
 }
@@ -129,6 +151,7 @@ int
 librdf_hash_cursor_get_first(librdf_hash_cursor *cursor,
                              librdf_hash_datum *key, librdf_hash_datum *value)
 {
+  cursor->bound_type = LIBRDF_HASH_CURSOR_BOUND_NONE;
   return cursor->hash->factory->cursor_get(cursor->context, key, value, 
                                            LIBRDF_HASH_CURSOR_FIRST);
 }
@@ -138,6 +161,184 @@ int
 librdf_hash_cursor_get_next(librdf_hash_cursor *cursor, librdf_hash_datum *key,
                             librdf_hash_datum *value)
 {
+  if(cursor->bound_type != LIBRDF_HASH_CURSOR_BOUND_NONE)
+    return librdf_hash_cursor_get_bounded(cursor, key, value,
+                                          LIBRDF_HASH_CURSOR_NEXT);
+
   return cursor->hash->factory->cursor_get(cursor->context, key, value, 
                                            LIBRDF_HASH_CURSOR_NEXT);
 }
+
+
+/* Compare keys in byte order, a shorter key first */
+static int
+librdf_hash_cursor_compare(const void *a, size_t a_len,
+                           const void *b, size_t b_len)
+{
+  int rc;
+
+  rc = memcmp(a, b, (a_len < b_len) ? a_len : b_len);
+  if(rc)
+    return rc;
+  return (a_len > b_len) - (a_len < b_len);
+}
+
+
+/* Return non 0 if the key is inside the bounds of the last seek */
+static int
+librdf_hash_cursor_in_bounds(librdf_hash_cursor *cursor,
+                             librdf_hash_datum *key)
+{
+  switch(cursor->bound_type) {
+    case LIBRDF_HASH_CURSOR_BOUND_PREFIX:
+      return key->size >= cursor->lower_len &&
+             !memcmp(key->data, cursor->lower, cursor->lower_len);
+
+    case LIBRDF_HASH_CURSOR_BOUND_RANGE:
+      if(cursor->lower &&
+         librdf_hash_cursor_compare(key->data, key->size,
+                                    cursor->lower, cursor->lower_len) < 0)
+        return 0;
+      if(cursor->upper &&
+         librdf_hash_cursor_compare(key->data, key->size,
+                                    cursor->upper, cursor->upper_len) >= 0)
+        return 0;
+      return 1;
+
+    case LIBRDF_HASH_CURSOR_BOUND_NONE:
+    default:
+      return 1;
+  }
+}
+
+
+/*
+ * librdf_hash_cursor_get_bounded - move the cursor to a key inside the bounds
+ *
+ * With sorted keys the first key outside the bounds is the end,
+ * otherwise the keys outside them are skipped.
+ */
+static int
+librdf_hash_cursor_get_bounded(librdf_hash_cursor *cursor,
+                               librdf_hash_datum *key,
+                               librdf_hash_datum *value,
+                               unsigned int flags)
+{
+  librdf_hash_factory *factory = cursor->hash->factory;
+  int status;
+
+  status = factory->cursor_get(cursor->context, key, value, flags);
+  while(!status && !librdf_hash_cursor_in_bounds(cursor, key)) {
+    if(factory->sorted_keys)
+      return 1;
+    status = factory->cursor_get(cursor->context, key, value,
+                                 LIBRDF_HASH_CURSOR_NEXT);
+  }
+
+  return status;
+}
+
+
+/* Copy a key bound into the cursor, freeing the old one */
+static int
+librdf_hash_cursor_set_bound(unsigned char **bound, size_t *bound_len,
+                             librdf_hash_datum *datum)
+{
+  if(*bound) {
+    LIBRDF_FREE(char*, *bound);
+    *bound = NULL;
+  }
+  *bound_len = 0;
+
+  if(!datum)
+    return 0;
+
+  *bound = LIBRDF_MALLOC(unsigned char*, datum->size ? datum->size : 1);
+  if(!*bound)
+    return 1;
+  memcpy(*bound, datum->data, datum->size);
+  *bound_len = datum->size;
+  return 0;
+}
+
+
+/* Go to the first key inside the bounds */
+static int
+librdf_hash_cursor_seek(librdf_hash_cursor *cursor,
+                        librdf_hash_datum *key, librdf_hash_datum *value)
+{
+  if(cursor->hash->factory->sorted_keys && cursor->lower) {
+    key->data = cursor->lower;
+    key->size = cursor->lower_len;
+    return librdf_hash_cursor_get_bounded(cursor, key, value,
+                                          LIBRDF_HASH_CURSOR_SET_RANGE);
+  }
+
+  return librdf_hash_cursor_get_bounded(cursor, key, value,
+                                        LIBRDF_HASH_CURSOR_FIRST);
+}
+
+
+/**
+ * librdf_hash_cursor_seek_prefix:
+ * @cursor: hash cursor
+ * @prefix: key prefix
+ * @key: pointer to returned key
+ * @value: pointer to returned value or NULL for keys only
+ *
+ * Move the cursor to the first key starting with a prefix.
+ *
+ * librdf_hash_cursor_get_next() then returns the following keys
+ * starting with @prefix and ends after the last one.  Hashes with
+ * sorted keys go straight to the prefix, others scan every key.
+ *
+ * Return value: non 0 if there is no such key or on failure
+ **/
+int
+librdf_hash_cursor_seek_prefix(librdf_hash_cursor *cursor,
+                               librdf_hash_datum *prefix,
+                               librdf_hash_datum *key,
+                               librdf_hash_datum *value)
+{
+  cursor->bound_type = LIBRDF_HASH_CURSOR_BOUND_NONE;
+  if(librdf_hash_cursor_set_bound(&cursor->lower, &cursor->lower_len, prefix) ||
+     librdf_hash_cursor_set_bound(&cursor->upper, &cursor->upper_len, NULL))
+    return 1;
+  cursor->bound_type = LIBRDF_HASH_CURSOR_BOUND_PREFIX;
+
+  return librdf_hash_cursor_seek(cursor, key, value);
+}
+
+
+/**
+ * librdf_hash_cursor_seek_range:
+ * @cursor: hash cursor
+ * @start: first key or NULL to start at the first key
+ * @end: key after the range or NULL to end at the last key
+ * @key: pointer to returned key
+ * @value: pointer to returned value or NULL for keys only
+ *
+ * Move the cursor to the first key in a range of keys.
+ *
+ * The range has the keys from @start up to but not including @end
+ * in byte order.  librdf_hash_cursor_get_next() then returns the
+ * following keys in the range and ends after the last one, in key
+ * order if the hash has sorted keys.
+ *
+ * Return value: non 0 if there is no such key or on failure
+ **/
+int
+librdf_hash_cursor_seek_range(librdf_hash_cursor *cursor,
+                              librdf_hash_datum *start,
+                              librdf_hash_datum *end,
+                              librdf_hash_datum *key,
+                              librdf_hash_datum *value)
+{
+  cursor->bound_type = LIBRDF_HASH_CURSOR_BOUND_NONE;
+  if(librdf_hash_cursor_set_bound(&cursor->lower, &cursor->lower_len, start) ||
+     librdf_hash_cursor_set_bound(&cursor->upper, &cursor->upper_len, end))
+    return 1;
+  cursor->bound_type = LIBRDF_HASH_CURSOR_BOUND_RANGE;
+
+  return librdf_hash_cursor_seek(cursor, key, value);
+}
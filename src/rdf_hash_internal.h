@@ -58,6 +58,15 @@ struct librdf_hash_s
 };
 
 
+/* Cache statistics reported by hashes that have a cache */
+typedef struct {
+  unsigned long cache_hits;
+  unsigned long cache_misses;
+  unsigned long pages_read;
+  unsigned long pages_written;
+} librdf_hash_stats;
+
+
 /** A Hash Factory */
 struct librdf_hash_factory_s {
   struct librdf_hash_factory_s* next;
@@ -82,6 +91,10 @@ struct librdf_hash_factory_s {
   /* end hash association */
   int (*close)(void* context);
 
+  /* non 0 if a hash with identifier was made before, without
+   * opening or creating it - OPTIONAL */
+  int (*present)(void* context, const char *identifier, librdf_hash* options);
+
   /* hoe many values? */
   int (*values_count)(void* context);
 
@@ -104,6 +117,20 @@ struct librdf_hash_factory_s {
   int (*cursor_init)(void *cursor_context, void* hash_context);
   int (*cursor_get)(void *cursor, librdf_hash_datum *key, librdf_hash_datum *value, unsigned int flags);
   void (*cursor_finish)(void *context);
+
+  /* non 0 if cursors return the keys in byte order and support
+   * LIBRDF_HASH_CURSOR_SET_RANGE - OPTIONAL */
+  int sorted_keys;
+
+  /* get cache statistics - OPTIONAL */
+  int (*get_stats)(void* context, librdf_hash_stats* stats);
+
+  /* start a transaction, joining the transaction of another hash if
+   * handle is not NULL; returns the transaction handle or NULL on
+   * failure - OPTIONAL */
+  void* (*transaction_start)(void* context, void* handle);
+  int (*transaction_commit)(void* context);
+  int (*transaction_rollback)(void* context);
 };
 typedef struct librdf_hash_factory_s librdf_hash_factory;
 
@@ -123,6 +150,8 @@ void librdf_finish_hash(librdf_world *world);
 #define LIBRDF_HASH_CURSOR_NEXT_VALUE 1
 #define LIBRDF_HASH_CURSOR_FIRST 2
 #define LIBRDF_HASH_CURSOR_NEXT 3
+/* first key >= the given key, only if the factory has sorted_keys */
+#define LIBRDF_HASH_CURSOR_SET_RANGE 4
 
 
 /* constructors */
@@ -134,6 +163,8 @@ librdf_hash* librdf_new_hash_from_factory(librdf_world *world, librdf_hash_facto
 int librdf_hash_open(librdf_hash* hash, const char *identifier, int mode, int is_writable, int is_new, librdf_hash* options);
 /* end hash association */
 int librdf_hash_close(librdf_hash* hash);
+/* check a hash was made before */
+int librdf_hash_present(librdf_hash* hash, const char *identifier, librdf_hash* options);
 
 /* how many values */
 int librdf_hash_values_count(librdf_hash* hash);
@@ -143,6 +174,8 @@ librdf_hash_datum* librdf_hash_get_one(librdf_hash* hash, librdf_hash_datum *key
 
 /* retrieve all values for a given hash key according to flags */
 librdf_iterator* librdf_hash_get_all(librdf_hash* hash, librdf_hash_datum *key, librdf_hash_datum *value);
+/* retrieve all key/value pairs whose key starts with prefix */
+librdf_iterator* librdf_hash_get_prefix(librdf_hash* hash, librdf_hash_datum *prefix, librdf_hash_datum *key, librdf_hash_datum *value);
 
 /* insert a key/value pair */
 int librdf_hash_put(librdf_hash* hash, librdf_hash_datum *key, librdf_hash_datum *value);
@@ -158,6 +191,12 @@ librdf_iterator* librdf_hash_keys(librdf_hash* hash, librdf_hash_datum *key);
 int librdf_hash_sync(librdf_hash* hash);
 /* get the file descriptor for the hash, if it is file based (for locking) */
 int librdf_hash_get_fd(librdf_hash* hash);
+/* get cache statistics, if the hash has a cache */
+int librdf_hash_get_stats(librdf_hash* hash, librdf_hash_stats* stats);
+/* transactions, if the hash supports them */
+void* librdf_hash_transaction_start(librdf_hash* hash, void* handle);
+int librdf_hash_transaction_commit(librdf_hash* hash);
+int librdf_hash_transaction_rollback(librdf_hash* hash);
 
 /* init a hash from an array of strings */
 int librdf_hash_from_array_of_strings(librdf_hash* hash, const char *array[]);
@@ -171,10 +210,16 @@ int librdf_hash_cursor_set(librdf_hash_cursor *cursor, librdf_hash_datum *key,li
 int librdf_hash_cursor_get_next_value(librdf_hash_cursor *cursor, librdf_hash_datum *key,librdf_hash_datum *value);
 int librdf_hash_cursor_get_first(librdf_hash_cursor *cursor, librdf_hash_datum *key, librdf_hash_datum *value);
 int librdf_hash_cursor_get_next(librdf_hash_cursor *cursor, librdf_hash_datum *key, librdf_hash_datum *value);
+int librdf_hash_cursor_seek_prefix(librdf_hash_cursor *cursor, librdf_hash_datum *prefix, librdf_hash_datum *key, librdf_hash_datum *value);
+int librdf_hash_cursor_seek_range(librdf_hash_cursor *cursor, librdf_hash_datum *start, librdf_hash_datum *end, librdf_hash_datum *key, librdf_hash_datum *value);
 
 #ifdef HAVE_BDB_HASH
 void librdf_init_hash_bdb(librdf_world *world);
 #endif
+#ifdef HAVE_LMDB_HASH
+void librdf_init_hash_lmdb(librdf_world *world);
+#endif
+void librdf_init_hash_log(librdf_world *world);
 void librdf_init_hash_memory(librdf_world *world);
 
 
@@ -0,0 +1,1589 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * rdf_hash_lmdb.c - RDF hash LMDB Interface Implementation
+ *
+ * Copyright (C) 2000-2008, David Beckett http://www.dajobe.org/
+ * Copyright (C) 2000-2004, University of Bristol, UK http://www.bristol.ac.uk/
+ * 
+ * This package is Free Software and part of Redland http://librdf.org/
+ * 
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ * 
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ * 
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ * 
+ * 
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <rdf_config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_rdf_config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include <sys/types.h>
+
+/* for the memory allocation functions */
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#include <lmdb.h>
+
+#include <redland.h>
+#include <rdf_hash.h>
+#include <rdf_types.h>
+
+
+/* Each key/value pair is one LMDB record so that keys and values are
+ * not limited by the LMDB maximum key size.  The record key is a hash
+ * of the key, a hash of the value and a sequence number for different
+ * pairs with the same hashes, so all the pairs of a key are next to
+ * each other.  The record data is the key length, the key and the
+ * value.
+ */
+#define LIBRDF_HASH_LMDB_HASH_LEN 8
+#define LIBRDF_HASH_LMDB_RECORD_KEY_LEN (2 * LIBRDF_HASH_LMDB_HASH_LEN + 4)
+#define LIBRDF_HASH_LMDB_HEADER_LEN 4
+
+/* named databases in one environment; one per hash */
+#define LIBRDF_HASH_LMDB_MAX_DBS 256
+
+
+/* An environment shared by all the hashes opened in the same
+ * directory in this world, so that one transaction can cover them.
+ */
+typedef struct librdf_hash_lmdb_env_s
+{
+  struct librdf_hash_lmdb_env_s* next;
+  char* dir;
+  MDB_env* env;
+  int usage;
+  /* non-0 if opened read only */
+  int read_only;
+  /* the write transaction begun by a hash in this environment */
+  MDB_txn* write_txn;
+} librdf_hash_lmdb_env;
+
+
+typedef struct
+{
+  librdf_hash *hash;
+  int mode;
+  int is_writable;
+  int is_new;
+  /* options; kept here so that clone can use them */
+  char* env_dir;
+  size_t map_size;
+  int no_sync;
+  librdf_hash_lmdb_env* env;
+  /* the named database of this hash */
+  MDB_dbi dbi;
+  /* current transaction and non-0 if this hash started it */
+  MDB_txn* txn;
+  int txn_owner;
+  /* changed when a transaction ends, which frees its cursors */
+  unsigned long txn_serial;
+} librdf_hash_lmdb_context;
+
+
+/* Implementing the hash cursor */
+static int librdf_hash_lmdb_cursor_init(void *cursor_context, void *hash_context);
+static int librdf_hash_lmdb_cursor_get(void *context, librdf_hash_datum* key, librdf_hash_datum* value, unsigned int flags);
+static void librdf_hash_lmdb_cursor_finish(void* context);
+
+
+/* prototypes for local functions */
+static int librdf_hash_lmdb_create(librdf_hash* hash, void* context);
+static int librdf_hash_lmdb_destroy(void* context);
+static int librdf_hash_lmdb_open(void* context, const char *identifier, int mode, int is_writable, int is_new, librdf_hash* options);
+static int librdf_hash_lmdb_close(void* context);
+static int librdf_hash_lmdb_clone(librdf_hash* new_hash, void *new_context, char *new_identifier, void* old_context);
+static int librdf_hash_lmdb_values_count(void *context);
+static int librdf_hash_lmdb_put(void* context, librdf_hash_datum *key, librdf_hash_datum *data);
+static int librdf_hash_lmdb_exists(void* context, librdf_hash_datum *key, librdf_hash_datum *value);
+static int librdf_hash_lmdb_delete_key(void* context, librdf_hash_datum *key);
+static int librdf_hash_lmdb_delete_key_value(void* context, librdf_hash_datum *key, librdf_hash_datum *value);
+static int librdf_hash_lmdb_sync(void* context);
+static int librdf_hash_lmdb_get_fd(void* context);
+static int librdf_hash_lmdb_present(void* context, const char *identifier, librdf_hash* options);
+static void* librdf_hash_lmdb_transaction_start(void* context, void* handle);
+static int librdf_hash_lmdb_transaction_commit(void* context);
+static int librdf_hash_lmdb_transaction_rollback(void* context);
+
+static void librdf_hash_lmdb_register_factory(librdf_hash_factory *factory);
+
+
+/* helper functions */
+
+static void
+librdf_hash_lmdb_error(librdf_hash_lmdb_context* context,
+                       const char* operation, int rc)
+{
+  if(rc == MDB_MAP_FULL)
+    librdf_log(context->hash->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "LMDB %s failed - the map is full, set a larger lmdb-map-size",
+               operation);
+  else
+    librdf_log(context->hash->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "LMDB %s failed - %s", operation, mdb_strerror(rc));
+}
+
+
+/*
+ * librdf_hash_lmdb_hash - 64 bit FNV-1a hash of a key or value
+ */
+static void
+librdf_hash_lmdb_hash(unsigned char* buffer, const void* data, size_t len)
+{
+  const unsigned char* p = (const unsigned char*)data;
+  u64 hash = ((u64)0xcbf29ce4UL << 32) | (u64)0x84222325UL;
+  u64 prime = ((u64)0x100 << 32) | (u64)0x1b3;
+  int i;
+
+  while(len--) {
+    hash ^= *p++;
+    hash *= prime;
+  }
+
+  for(i = LIBRDF_HASH_LMDB_HASH_LEN - 1; i >= 0; i--) {
+    buffer[i] = (unsigned char)(hash & 0xff);
+    hash >>= 8;
+  }
+}
+
+
+/*
+ * librdf_hash_lmdb_record_key - make the LMDB key of a key/value pair
+ */
+static void
+librdf_hash_lmdb_record_key(unsigned char* buffer, librdf_hash_datum* key,
+                            librdf_hash_datum* value, u32 seq)
+{
+  unsigned char* p = buffer + 2 * LIBRDF_HASH_LMDB_HASH_LEN;
+
+  librdf_hash_lmdb_hash(buffer, key->data, key->size);
+  librdf_hash_lmdb_hash(buffer + LIBRDF_HASH_LMDB_HASH_LEN,
+                        value->data, value->size);
+  p[0] = (unsigned char)((seq >> 24) & 0xff);
+  p[1] = (unsigned char)((seq >> 16) & 0xff);
+  p[2] = (unsigned char)((seq >> 8) & 0xff);
+  p[3] = (unsigned char)(seq & 0xff);
+}
+
+
+static u32
+librdf_hash_lmdb_record_seq(MDB_val* mkey)
+{
+  unsigned char* p = (unsigned char*)mkey->mv_data + 2 * LIBRDF_HASH_LMDB_HASH_LEN;
+
+  return ((u32)p[0] << 24) | ((u32)p[1] << 16) | ((u32)p[2] << 8) | (u32)p[3];
+}
+
+
+/*
+ * librdf_hash_lmdb_record_decode - find the key and value in record data
+ *
+ * The pointers are into the LMDB map.
+ */
+static int
+librdf_hash_lmdb_record_decode(MDB_val* mdata, void** key, size_t* key_len,
+                               void** value, size_t* value_len)
+{
+  unsigned char* p = (unsigned char*)mdata->mv_data;
+  size_t len;
+
+  if(mdata->mv_size < LIBRDF_HASH_LMDB_HEADER_LEN)
+    return 1;
+
+  len = ((size_t)p[0] << 24) | ((size_t)p[1] << 16) | ((size_t)p[2] << 8) |
+        (size_t)p[3];
+  if(len > mdata->mv_size - LIBRDF_HASH_LMDB_HEADER_LEN)
+    return 1;
+
+  *key = p + LIBRDF_HASH_LMDB_HEADER_LEN;
+  *key_len = len;
+  *value = p + LIBRDF_HASH_LMDB_HEADER_LEN + len;
+  *value_len = mdata->mv_size - LIBRDF_HASH_LMDB_HEADER_LEN - len;
+  return 0;
+}
+
+
+/*
+ * librdf_hash_lmdb_record_is - test if record data holds a key and value
+ *
+ * The value is not compared if it is NULL.
+ */
+static int
+librdf_hash_lmdb_record_is(MDB_val* mdata, librdf_hash_datum* key,
+                           librdf_hash_datum* value)
+{
+  void *k, *v;
+  size_t k_len, v_len;
+
+  if(librdf_hash_lmdb_record_decode(mdata, &k, &k_len, &v, &v_len))
+    return 0;
+
+  if(k_len != key->size || memcmp(k, key->data, k_len))
+    return 0;
+
+  if(value && (v_len != value->size || memcmp(v, value->data, v_len)))
+    return 0;
+
+  return 1;
+}
+
+
+/*
+ * librdf_hash_lmdb_skip_to_key - move a cursor forward to a pair with a key
+ *
+ * Starts from the record returned by the last cursor move, with
+ * result @rc, and passes over pairs of other keys with the same hash.
+ * Returns MDB_NOTFOUND at the end of the pairs with @key_hash.
+ */
+static int
+librdf_hash_lmdb_skip_to_key(MDB_cursor* cursor, librdf_hash_datum* key,
+                             const unsigned char* key_hash,
+                             MDB_val* mkey, MDB_val* mdata, int rc)
+{
+  while(!rc) {
+    if(mkey->mv_size != LIBRDF_HASH_LMDB_RECORD_KEY_LEN ||
+       memcmp(mkey->mv_data, key_hash, LIBRDF_HASH_LMDB_HASH_LEN))
+      return MDB_NOTFOUND;
+
+    if(librdf_hash_lmdb_record_is(mdata, key, NULL))
+      return 0;
+
+    rc = mdb_cursor_get(cursor, mkey, mdata, MDB_NEXT);
+  }
+
+  return rc;
+}
+
+
+/*
+ * librdf_hash_lmdb_find - move a cursor to a key/value pair
+ *
+ * Returns 0 if found, MDB_NOTFOUND if not or another LMDB error.  The
+ * sequence number a new record for the pair must use is returned in
+ * @seq if it is not NULL.
+ */
+static int
+librdf_hash_lmdb_find(MDB_cursor* cursor, librdf_hash_datum* key,
+                      librdf_hash_datum* value, u32* seq)
+{
+  unsigned char buffer[LIBRDF_HASH_LMDB_RECORD_KEY_LEN];
+  MDB_val mkey, mdata;
+  int rc;
+
+  librdf_hash_lmdb_record_key(buffer, key, value, 0);
+  if(seq)
+    *seq = 0;
+
+  mkey.mv_data = buffer;
+  mkey.mv_size = sizeof(buffer);
+  rc = mdb_cursor_get(cursor, &mkey, &mdata, MDB_SET_RANGE);
+  while(!rc) {
+    /* all records with both hashes are checked */
+    if(mkey.mv_size != sizeof(buffer) ||
+       memcmp(mkey.mv_data, buffer, 2 * LIBRDF_HASH_LMDB_HASH_LEN))
+      return MDB_NOTFOUND;
+
+    if(librdf_hash_lmdb_record_is(&mdata, key, value))
+      return 0;
+
+    if(seq)
+      *seq = librdf_hash_lmdb_record_seq(&mkey) + 1;
+
+    rc = mdb_cursor_get(cursor, &mkey, &mdata, MDB_NEXT);
+  }
+
+  return rc;
+}
+
+
+/*
+ * librdf_hash_lmdb_txn_begin - get the transaction for one operation
+ *
+ * Uses the current transaction of the hash if there is one, otherwise
+ * begins a new one that must be committed or aborted afterwards.
+ */
+static MDB_txn*
+librdf_hash_lmdb_txn_begin(librdf_hash_lmdb_context* context, int read_only)
+{
+  MDB_txn* txn = NULL;
+  int rc;
+
+  if(context->txn)
+    return context->txn;
+
+  rc = mdb_txn_begin(context->env->env, NULL, read_only ? MDB_RDONLY : 0,
+                     &txn);
+  if(rc) {
+    librdf_hash_lmdb_error(context, "transaction begin", rc);
+    return NULL;
+  }
+
+  return txn;
+}
+
+
+/*
+ * librdf_hash_lmdb_txn_end - commit an operation transaction or abort it if @status
+ */
+static int
+librdf_hash_lmdb_txn_end(librdf_hash_lmdb_context* context, MDB_txn* txn,
+                         int status)
+{
+  int rc;
+
+  if(txn == context->txn)
+    return status;
+
+  if(status) {
+    mdb_txn_abort(txn);
+    return status;
+  }
+
+  rc = mdb_txn_commit(txn);
+  if(rc) {
+    librdf_hash_lmdb_error(context, "commit", rc);
+    return 1;
+  }
+
+  return 0;
+}
+
+
+/**
+ * librdf_hash_lmdb_env_open:
+ * @world: redland world
+ * @dir: environment directory
+ * @map_size: map size in bytes
+ * @no_sync: non-0 to not flush to disk at each commit
+ * @read_only: non-0 to open read only
+ * @mode: file creation mode
+ *
+ * Get the shared environment for a directory, opening it if needed.
+ *
+ * The map size and sync options only apply when the environment is
+ * first opened.
+ *
+ * Return value: environment or NULL on failure
+ **/
+static librdf_hash_lmdb_env*
+librdf_hash_lmdb_env_open(librdf_world* world, const char* dir,
+                          size_t map_size, int no_sync, int read_only,
+                          int mode)
+{
+  librdf_hash_lmdb_env* env;
+  /* cursors each have a read transaction and may be open at once */
+  unsigned int flags = MDB_NOTLS;
+  int rc;
+
+#ifdef WITH_THREADS
+  pthread_mutex_lock(world->mutex);
+#endif
+
+  for(env = world->hash_lmdb_envs; env; env = env->next) {
+    if(!strcmp(env->dir, dir)) {
+      if(env->read_only && !read_only) {
+        librdf_log(world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                   "LMDB environment '%s' is already open read only", dir);
+        env = NULL;
+      } else
+        env->usage++;
+      goto unlock;
+    }
+  }
+
+  env = LIBRDF_CALLOC(librdf_hash_lmdb_env*, 1, sizeof(*env));
+  if(!env)
+    goto unlock;
+
+  env->dir = LIBRDF_MALLOC(char*, strlen(dir) + 1);
+  if(!env->dir)
+    goto failed;
+  strcpy(env->dir, dir);
+
+  rc = mdb_env_create(&env->env);
+  if(rc) {
+    env->env = NULL;
+    librdf_log(world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "LMDB environment create failed - %s", mdb_strerror(rc));
+    goto failed;
+  }
+
+  rc = mdb_env_set_mapsize(env->env, map_size);
+  if(!rc)
+    rc = mdb_env_set_maxdbs(env->env, LIBRDF_HASH_LMDB_MAX_DBS);
+  if(rc) {
+    librdf_log(world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "LMDB environment setup failed - %s", mdb_strerror(rc));
+    goto failed;
+  }
+
+  env->read_only = read_only;
+  if(read_only)
+    flags |= MDB_RDONLY;
+  if(no_sync)
+    flags |= MDB_NOSYNC;
+
+  rc = mdb_env_open(env->env, dir, flags, (mdb_mode_t)mode);
+  if(rc) {
+    librdf_log(world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "LMDB environment open of '%s' failed - %s", dir,
+               mdb_strerror(rc));
+    goto failed;
+  }
+
+  env->usage = 1;
+  env->next = world->hash_lmdb_envs;
+  world->hash_lmdb_envs = env;
+  goto unlock;
+
+  failed:
+  /* an MDB_env handle must be closed even if the open failed */
+  if(env->env)
+    mdb_env_close(env->env);
+  if(env->dir)
+    LIBRDF_FREE(char*, env->dir);
+  LIBRDF_FREE(librdf_hash_lmdb_env, env);
+  env = NULL;
+
+  unlock:
+#ifdef WITH_THREADS
+  pthread_mutex_unlock(world->mutex);
+#endif
+
+  return env;
+}
+
+
+/**
+ * librdf_hash_lmdb_env_close:
+ * @world: redland world
+ * @env: shared environment
+ *
+ * Release a shared environment, closing it when it is no longer used.
+ *
+ **/
+static void
+librdf_hash_lmdb_env_close(librdf_world* world, librdf_hash_lmdb_env* env)
+{
+  librdf_hash_lmdb_env** prev;
+
+#ifdef WITH_THREADS
+  pthread_mutex_lock(world->mutex);
+#endif
+
+  if(--env->usage) {
+#ifdef WITH_THREADS
+    pthread_mutex_unlock(world->mutex);
+#endif
+    return;
+  }
+
+  for(prev = &world->hash_lmdb_envs; *prev; prev = &(*prev)->next) {
+    if(*prev == env) {
+      *prev = env->next;
+      break;
+    }
+  }
+
+#ifdef WITH_THREADS
+  pthread_mutex_unlock(world->mutex);
+#endif
+
+  mdb_env_close(env->env);
+  LIBRDF_FREE(char*, env->dir);
+  LIBRDF_FREE(librdf_hash_lmdb_env, env);
+}
+
+
+/*
+ * librdf_hash_lmdb_file_dir - get the directory part of a file name
+ *
+ * Returns a new string, "." if there is none.
+ */
+static char*
+librdf_hash_lmdb_file_dir(const char* file)
+{
+  const char* p = strrchr(file, '/');
+  size_t len = p ? LIBRDF_GOOD_CAST(size_t, p - file) : 0;
+  char* dir;
+
+  if(p && !len)
+    len = 1;
+
+  dir = LIBRDF_MALLOC(char*, len + 2);
+  if(!dir)
+    return NULL;
+
+  if(len) {
+    memcpy(dir, file, len);
+    dir[len] = '\0';
+  } else
+    strcpy(dir, ".");
+  return dir;
+}
+
+
+/* functions implementing hash api */
+
+/**
+ * librdf_hash_lmdb_create:
+ * @hash: #librdf_hash hash that this implements
+ * @context: LMDB hash context
+ *
+ * Create an LMDB hash.
+ *
+ * Return value: non 0 on failure.
+ **/
+static int
+librdf_hash_lmdb_create(librdf_hash* hash, void* context)
+{
+  librdf_hash_lmdb_context* hcontext=(librdf_hash_lmdb_context*)context;
+
+  hcontext->hash=hash;
+
+  /* the map is only reserved address space so it can be large */
+  hcontext->map_size = (size_t)1024 * 1024 * 1024;
+  if(sizeof(size_t) > 4)
+    hcontext->map_size *= 16;
+  return 0;
+}
+
+
+/**
+ * librdf_hash_lmdb_destroy:
+ * @context: LMDB hash context
+ *
+ * Destroy an LMDB hash.
+ *
+ * Return value: non 0 on failure
+ **/
+static int
+librdf_hash_lmdb_destroy(void* context)
+{
+  librdf_hash_lmdb_context* hcontext=(librdf_hash_lmdb_context*)context;
+
+  if(hcontext->env_dir)
+    LIBRDF_FREE(char*, hcontext->env_dir);
+  return 0;
+}
+
+
+/**
+ * librdf_hash_lmdb_open:
+ * @context: LMDB hash context
+ * @identifier: file name prefix of the hash
+ * @mode: file creation mode
+ * @is_writable: is hash writable?
+ * @is_new: is hash new?
+ * @options: hash options
+ *
+ * Open and maybe create an LMDB hash.
+ *
+ * The hash is a named database in the LMDB environment of the
+ * directory of @identifier, or of option 'lmdb-env-dir', which all
+ * the hashes in that directory share.  Option 'lmdb-map-size' sets
+ * the largest size in bytes the environment can grow to and boolean
+ * option 'lmdb-sync' set to 'no' does not flush to disk at each
+ * commit.
+ *
+ * Return value: non 0 on failure.
+ **/
+static int
+librdf_hash_lmdb_open(void* context, const char *identifier,
+                      int mode, int is_writable, int is_new,
+                      librdf_hash* options)
+{
+  librdf_hash_lmdb_context* lmdb_context=(librdf_hash_lmdb_context*)context;
+  char* dir = NULL;
+  const char* name;
+  MDB_txn* txn;
+  int rc;
+
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(identifier, cstring, 1);
+
+  /* The options are copied into the context so that the clone
+   * method can use them
+   */
+  lmdb_context->mode=mode;
+  lmdb_context->is_writable=is_writable;
+  lmdb_context->is_new=is_new;
+
+  if(options) {
+    char *env_dir;
+    long value;
+
+    env_dir=librdf_hash_get(options, "lmdb-env-dir");
+    if(env_dir) {
+      if(lmdb_context->env_dir)
+        LIBRDF_FREE(char*, lmdb_context->env_dir);
+      lmdb_context->env_dir=env_dir;
+    }
+
+    value=librdf_hash_get_as_long(options, "lmdb-map-size");
+    if(value > 0)
+      lmdb_context->map_size=LIBRDF_GOOD_CAST(size_t, value);
+
+    if(!librdf_hash_get_as_boolean(options, "lmdb-sync"))
+      lmdb_context->no_sync=1;
+  }
+
+  if(!lmdb_context->env_dir) {
+    dir = librdf_hash_lmdb_file_dir(identifier);
+    if(!dir)
+      return 1;
+  }
+
+  name = strrchr(identifier, '/');
+  name = name ? name + 1 : identifier;
+
+  lmdb_context->env = librdf_hash_lmdb_env_open(lmdb_context->hash->world,
+                                                (dir ? dir : lmdb_context->env_dir),
+                                                lmdb_context->map_size,
+                                                lmdb_context->no_sync,
+                                                !is_writable, mode);
+  if(dir)
+    LIBRDF_FREE(char*, dir);
+  if(!lmdb_context->env)
+    return 1;
+
+  rc = mdb_txn_begin(lmdb_context->env->env, NULL,
+                     is_writable ? 0 : MDB_RDONLY, &txn);
+  if(rc) {
+    librdf_hash_lmdb_error(lmdb_context, "transaction begin", rc);
+    goto failed;
+  }
+
+  rc = mdb_dbi_open(txn, name, is_writable ? MDB_CREATE : 0,
+                    &lmdb_context->dbi);
+  if(!rc && is_writable && is_new)
+    rc = mdb_drop(txn, lmdb_context->dbi, 0);
+
+  if(rc) {
+    mdb_txn_abort(txn);
+    librdf_log(lmdb_context->hash->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "LMDB open of '%s' failed - %s", identifier, mdb_strerror(rc));
+    goto failed;
+  }
+
+  /* the database handle is kept for the life of the environment */
+  rc = mdb_txn_commit(txn);
+  if(rc) {
+    librdf_hash_lmdb_error(lmdb_context, "open commit", rc);
+    goto failed;
+  }
+
+  return 0;
+
+  failed:
+  librdf_hash_lmdb_env_close(lmdb_context->hash->world, lmdb_context->env);
+  lmdb_context->env = NULL;
+  return 1;
+}
+
+
+/**
+ * librdf_hash_lmdb_close:
+ * @context: LMDB hash context
+ *
+ * Close the hash.
+ *
+ * Finish the association between the rdf hash and the LMDB
+ * database, rolling back any unfinished transaction (does not delete
+ * the files)
+ *
+ * Return value: non 0 on failure
+ **/
+static int
+librdf_hash_lmdb_close(void* context)
+{
+  librdf_hash_lmdb_context* lmdb_context=(librdf_hash_lmdb_context*)context;
+
+  if(lmdb_context->txn)
+    librdf_hash_lmdb_transaction_rollback(context);
+
+  if(lmdb_context->env) {
+    librdf_hash_lmdb_env_close(lmdb_context->hash->world, lmdb_context->env);
+    lmdb_context->env = NULL;
+  }
+  return 0;
+}
+
+
+/**
+ * librdf_hash_lmdb_clone:
+ * @hash: new #librdf_hash that this implements
+ * @context: new LMDB hash context
+ * @new_identifier: new identifier for this hash
+ * @old_context: old LMDB hash context
+ *
+ * Clone the LMDB hash.
+ *
+ * Clones the existing LMDB hash into the new one with the
+ * new identifier.
+ *
+ * Return value: non 0 on failure
+ **/
+static int
+librdf_hash_lmdb_clone(librdf_hash *hash, void* context, char *new_identifier,
+                       void *old_context)
+{
+  librdf_hash_lmdb_context* hcontext=(librdf_hash_lmdb_context*)context;
+  librdf_hash_lmdb_context* old_hcontext=(librdf_hash_lmdb_context*)old_context;
+  librdf_hash_datum *key, *value;
+  librdf_iterator *iterator;
+  int status=0;
+
+  /* copy data fields that might change */
+  hcontext->hash=hash;
+
+  /* copy the options that open saved, since none are passed here */
+  if(old_hcontext->env_dir) {
+    hcontext->env_dir=LIBRDF_MALLOC(char*, strlen(old_hcontext->env_dir) + 1);
+    if(!hcontext->env_dir)
+      return 1;
+    strcpy(hcontext->env_dir, old_hcontext->env_dir);
+  }
+  hcontext->map_size=old_hcontext->map_size;
+  hcontext->no_sync=old_hcontext->no_sync;
+
+  if(librdf_hash_lmdb_open(context, new_identifier,
+                           old_hcontext->mode, old_hcontext->is_writable,
+                           old_hcontext->is_new, NULL))
+    return 1;
+
+
+  /* Use higher level functions to iterator this data
+   * on the other hand, maybe this is a good idea since that
+   * code is tested and works
+   */
+
+  key=librdf_new_hash_datum(hash->world, NULL, 0);
+  value=librdf_new_hash_datum(hash->world, NULL, 0);
+
+  iterator=librdf_hash_get_all(old_hcontext->hash, key, value);
+  while(!librdf_iterator_end(iterator)) {
+    librdf_hash_datum* k= (librdf_hash_datum*)librdf_iterator_get_key(iterator);
+    librdf_hash_datum* v= (librdf_hash_datum*)librdf_iterator_get_value(iterator);
+
+    if(librdf_hash_lmdb_put(hcontext, k, v)) {
+      status=1;
+      break;
+    }
+    librdf_iterator_next(iterator);
+  }
+  if(iterator)
+    librdf_free_iterator(iterator);
+
+  librdf_free_hash_datum(value);
+  librdf_free_hash_datum(key);
+
+  return status;
+}
+
+
+/**
+ * librdf_hash_lmdb_values_count:
+ * @context: LMDB hash context
+ *
+ * Get the number of values in the hash.
+ *
+ * Return value: number of values in the hash or <0 on failure
+ **/
+static int
+librdf_hash_lmdb_values_count(void *context)
+{
+  librdf_hash_lmdb_context* lmdb_context=(librdf_hash_lmdb_context*)context;
+  MDB_txn* txn;
+  MDB_stat stat;
+  int rc;
+
+  txn = librdf_hash_lmdb_txn_begin(lmdb_context, 1);
+  if(!txn)
+    return -1;
+
+  /* one record per key/value pair */
+  rc = mdb_stat(txn, lmdb_context->dbi, &stat);
+  if(txn != lmdb_context->txn)
+    mdb_txn_abort(txn);
+
+  return rc ? -1 : LIBRDF_BAD_CAST(int, stat.ms_entries);
+}
+
+
+
+typedef struct {
+  librdf_hash_lmdb_context* hash;
+  MDB_cursor* cursor;
+  /* read transaction of the cursor, or NULL if it is in the
+   * transaction of the hash */
+  MDB_txn* txn;
+  unsigned long txn_serial;
+  /* the key given to SET and its hash */
+  void *set_key;
+  size_t set_key_len;
+  unsigned char set_key_hash[LIBRDF_HASH_LMDB_HASH_LEN];
+  /* the key last returned by FIRST or NEXT, in the map unless copy */
+  void *last_key;
+  size_t last_key_len;
+  /* non-0 if the cursor is in the transaction of the hash, where a
+   * put or delete moves the map pages, so results are copied */
+  int copy;
+  void *key;
+  void *value;
+} librdf_hash_lmdb_cursor_context;
+
+
+/**
+ * librdf_hash_lmdb_cursor_init:
+ * @cursor_context: hash cursor context
+ * @hash_context: hash to operate over
+ *
+ * Initialise a new hash cursor.
+ *
+ * The cursor reads in its own read transaction, which sees the hash
+ * as it was when the cursor was made and does not block writers,
+ * unless the hash is in a transaction.  In the transaction of the
+ * hash the cursor returns copies, since writes invalidate the map.
+ *
+ * Return value: non 0 on failure
+ **/
+static int
+librdf_hash_lmdb_cursor_init(void *cursor_context, void *hash_context)
+{
+  librdf_hash_lmdb_cursor_context* cursor=(librdf_hash_lmdb_cursor_context*)cursor_context;
+  librdf_hash_lmdb_context* lmdb_context=(librdf_hash_lmdb_context*)hash_context;
+  MDB_txn* txn;
+  int rc;
+
+  cursor->hash=lmdb_context;
+
+  if(lmdb_context->txn) {
+    txn = lmdb_context->txn;
+    cursor->txn_serial = lmdb_context->txn_serial;
+    cursor->copy = 1;
+  } else {
+    rc = mdb_txn_begin(lmdb_context->env->env, NULL, MDB_RDONLY,
+                       &cursor->txn);
+    if(rc) {
+      cursor->txn = NULL;
+      librdf_hash_lmdb_error(lmdb_context, "cursor transaction begin", rc);
+      return 1;
+    }
+    txn = cursor->txn;
+  }
+
+  rc = mdb_cursor_open(txn, lmdb_context->dbi, &cursor->cursor);
+  if(rc) {
+    cursor->cursor = NULL;
+    librdf_hash_lmdb_error(lmdb_context, "cursor open", rc);
+    return 1;
+  }
+
+  return 0;
+}
+
+
+/**
+ * librdf_hash_lmdb_cursor_get:
+ * @context: LMDB hash cursor context
+ * @key: pointer to key to use
+ * @value: pointer to value to use
+ * @flags: flags
+ *
+ * Retrieve a hash value for the given key.
+ *
+ * The key and value returned point into the LMDB map and are not
+ * copied, unless the cursor is in the transaction of the hash.
+ *
+ * Return value: non 0 on failure
+ **/
+static int
+librdf_hash_lmdb_cursor_get(void* context,
+                            librdf_hash_datum *key, librdf_hash_datum *value,
+                            unsigned int flags)
+{
+  librdf_hash_lmdb_cursor_context* cursor=(librdf_hash_lmdb_cursor_context*)context;
+  MDB_cursor* mdb_cursor=cursor->cursor;
+  librdf_hash_datum set_key; /* on stack */
+  MDB_val mkey, mdata;
+  void *k, *v;
+  size_t k_len, v_len;
+  int rc;
+
+  switch(flags) {
+    case LIBRDF_HASH_CURSOR_SET:
+      /* keep the key since NEXT_VALUE compares with it */
+      if(cursor->set_key)
+        LIBRDF_FREE(char*, cursor->set_key);
+      cursor->set_key = LIBRDF_MALLOC(void*, key->size ? key->size : 1);
+      if(!cursor->set_key)
+        return 1;
+      memcpy(cursor->set_key, key->data, key->size);
+      cursor->set_key_len = key->size;
+      librdf_hash_lmdb_hash(cursor->set_key_hash, key->data, key->size);
+
+      set_key.data = cursor->set_key;
+      set_key.size = cursor->set_key_len;
+      mkey.mv_data = cursor->set_key_hash;
+      mkey.mv_size = LIBRDF_HASH_LMDB_HASH_LEN;
+      rc = mdb_cursor_get(mdb_cursor, &mkey, &mdata, MDB_SET_RANGE);
+      rc = librdf_hash_lmdb_skip_to_key(mdb_cursor, &set_key,
+                                        cursor->set_key_hash,
+                                        &mkey, &mdata, rc);
+      break;
+
+    case LIBRDF_HASH_CURSOR_NEXT_VALUE:
+      if(!cursor->set_key)
+        return 1;
+
+      set_key.data = cursor->set_key;
+      set_key.size = cursor->set_key_len;
+      rc = mdb_cursor_get(mdb_cursor, &mkey, &mdata, MDB_NEXT);
+      rc = librdf_hash_lmdb_skip_to_key(mdb_cursor, &set_key,
+                                        cursor->set_key_hash,
+                                        &mkey, &mdata, rc);
+      break;
+
+    case LIBRDF_HASH_CURSOR_FIRST:
+      rc = mdb_cursor_get(mdb_cursor, &mkey, &mdata, MDB_FIRST);
+      break;
+
+    case LIBRDF_HASH_CURSOR_NEXT:
+      rc = mdb_cursor_get(mdb_cursor, &mkey, &mdata, MDB_NEXT);
+
+      /* Get next key, or next key/value (when value defined) */
+      while(!rc && !value && cursor->last_key) {
+        if(librdf_hash_lmdb_record_decode(&mdata, &k, &k_len, &v, &v_len) ||
+           k_len != cursor->last_key_len ||
+           memcmp(k, cursor->last_key, k_len))
+          break;
+        rc = mdb_cursor_get(mdb_cursor, &mkey, &mdata, MDB_NEXT);
+      }
+      break;
+
+    default:
+      librdf_log(cursor->hash->hash->world,
+                 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_HASH, NULL,
+                 "Unknown hash method flag %d", flags);
+      return 1;
+  }
+
+  if(!rc &&
+     librdf_hash_lmdb_record_decode(&mdata, &k, &k_len, &v, &v_len)) {
+    librdf_log(cursor->hash->hash->world,
+               0, LIBRDF_LOG_ERROR, LIBRDF_FROM_HASH, NULL,
+               "LMDB hash record is corrupt");
+    rc = 1;
+  }
+
+  if(rc) {
+#ifdef LIBRDF_DEBUG
+    if(rc != MDB_NOTFOUND)
+      LIBRDF_DEBUG2("LMDB cursor error - %d\n", rc);
+#endif
+    key->data=NULL;
+    return 1;
+  }
+
+  if(cursor->copy) {
+    /* Free previous key and values */
+    if(cursor->key) {
+      LIBRDF_FREE(char*, cursor->key);
+      cursor->key = NULL;
+    }
+    if(cursor->value) {
+      LIBRDF_FREE(char*, cursor->value);
+      cursor->value = NULL;
+    }
+
+    if(flags == LIBRDF_HASH_CURSOR_FIRST || flags == LIBRDF_HASH_CURSOR_NEXT) {
+      if(cursor->last_key) {
+        LIBRDF_FREE(char*, cursor->last_key);
+        cursor->last_key = NULL;
+      }
+      cursor->last_key = LIBRDF_MALLOC(void*, k_len ? k_len : 1);
+      if(!cursor->last_key)
+        return 1;
+      memcpy(cursor->last_key, k, k_len);
+      cursor->last_key_len = k_len;
+    }
+
+    cursor->key = LIBRDF_MALLOC(void*, k_len ? k_len : 1);
+    if(!cursor->key)
+      return 1;
+    memcpy(cursor->key, k, k_len);
+    k = cursor->key;
+
+    if(value) {
+      cursor->value = LIBRDF_MALLOC(void*, v_len ? v_len : 1);
+      if(!cursor->value)
+        return 1;
+      memcpy(cursor->value, v, v_len);
+      v = cursor->value;
+    }
+  } else if(flags == LIBRDF_HASH_CURSOR_FIRST ||
+            flags == LIBRDF_HASH_CURSOR_NEXT) {
+    cursor->last_key = k;
+    cursor->last_key_len = k_len;
+  }
+
+  key->data = k;
+  key->size = k_len;
+  if(value) {
+    value->data = v;
+    value->size = v_len;
+  }
+
+  return 0;
+}
+
+
+/**
+ * librdf_hash_lmdb_cursor_finish:
+ * @context: LMDB hash cursor context
+ *
+ * Finish the serialisation of the hash lmdb get.
+ *
+ **/
+static void
+librdf_hash_lmdb_cursor_finish(void* context)
+{
+  librdf_hash_lmdb_cursor_context* cursor=(librdf_hash_lmdb_cursor_context*)context;
+
+  if(cursor->txn) {
+    if(cursor->cursor)
+      mdb_cursor_close(cursor->cursor);
+    mdb_txn_abort(cursor->txn);
+  } else if(cursor->cursor && cursor->hash->txn &&
+            cursor->txn_serial == cursor->hash->txn_serial) {
+    /* otherwise the end of the transaction freed the cursor */
+    mdb_cursor_close(cursor->cursor);
+  }
+
+  if(cursor->set_key)
+    LIBRDF_FREE(char*, cursor->set_key);
+
+  if(cursor->copy) {
+    if(cursor->last_key)
+      LIBRDF_FREE(char*, cursor->last_key);
+    if(cursor->key)
+      LIBRDF_FREE(char*, cursor->key);
+    if(cursor->value)
+      LIBRDF_FREE(char*, cursor->value);
+  }
+}
+
+
+/**
+ * librdf_hash_lmdb_put:
+ * @context: LMDB hash context
+ * @key: pointer to key to store
+ * @value: pointer to value to store
+ *
+ * Store a key/value pair in the hash.
+ *
+ * A pair that is already present is not stored again.
+ *
+ * Return value: non 0 on failure
+ **/
+static int
+librdf_hash_lmdb_put(void* context, librdf_hash_datum *key,
+                     librdf_hash_datum *value)
+{
+  librdf_hash_lmdb_context* lmdb_context=(librdf_hash_lmdb_context*)context;
+  unsigned char buffer[LIBRDF_HASH_LMDB_RECORD_KEY_LEN];
+  MDB_txn* txn;
+  MDB_cursor* cursor;
+  MDB_val mkey, mdata;
+  u32 seq;
+  int rc;
+
+  txn = librdf_hash_lmdb_txn_begin(lmdb_context, 0);
+  if(!txn)
+    return 1;
+
+  rc = mdb_cursor_open(txn, lmdb_context->dbi, &cursor);
+  if(!rc) {
+    rc = librdf_hash_lmdb_find(cursor, key, value, &seq);
+    if(rc == MDB_NOTFOUND) {
+      unsigned char* p;
+
+      librdf_hash_lmdb_record_key(buffer, key, value, seq);
+      mkey.mv_data = buffer;
+      mkey.mv_size = sizeof(buffer);
+      mdata.mv_data = NULL;
+      mdata.mv_size = LIBRDF_HASH_LMDB_HEADER_LEN + key->size + value->size;
+
+      /* write the record straight into the map */
+      rc = mdb_cursor_put(cursor, &mkey, &mdata, MDB_RESERVE);
+      if(!rc) {
+        p = (unsigned char*)mdata.mv_data;
+        p[0] = (unsigned char)((key->size >> 24) & 0xff);
+        p[1] = (unsigned char)((key->size >> 16) & 0xff);
+        p[2] = (unsigned char)((key->size >> 8) & 0xff);
+        p[3] = (unsigned char)(key->size & 0xff);
+        memcpy(p + LIBRDF_HASH_LMDB_HEADER_LEN, key->data, key->size);
+        memcpy(p + LIBRDF_HASH_LMDB_HEADER_LEN + key->size, value->data,
+               value->size);
+      }
+    }
+    mdb_cursor_close(cursor);
+  }
+
+  if(rc)
+    librdf_hash_lmdb_error(lmdb_context, "put", rc);
+
+  return librdf_hash_lmdb_txn_end(lmdb_context, txn, (rc != 0));
+}
+
+
+/**
+ * librdf_hash_lmdb_exists:
+ * @context: LMDB hash context
+ * @key: pointer to key
+ * @value: pointer to value (optional)
+ *
+ * Test the existence of a key/value in the hash.
+ *
+ * The value can be NULL in which case the check will just be
+ * for the key.
+ *
+ * Return value: >0 if the key/value exists in the hash, 0 if not, <0 on failure
+ **/
+static int
+librdf_hash_lmdb_exists(void* context, librdf_hash_datum *key,
+                        librdf_hash_datum *value)
+{
+  librdf_hash_lmdb_context* lmdb_context=(librdf_hash_lmdb_context*)context;
+  unsigned char key_hash[LIBRDF_HASH_LMDB_HASH_LEN];
+  MDB_txn* txn;
+  MDB_cursor* cursor;
+  MDB_val mkey, mdata;
+  int rc;
+
+  txn = librdf_hash_lmdb_txn_begin(lmdb_context, 1);
+  if(!txn)
+    return -1;
+
+  rc = mdb_cursor_open(txn, lmdb_context->dbi, &cursor);
+  if(!rc) {
+    if(value)
+      rc = librdf_hash_lmdb_find(cursor, key, value, NULL);
+    else {
+      librdf_hash_lmdb_hash(key_hash, key->data, key->size);
+      mkey.mv_data = key_hash;
+      mkey.mv_size = sizeof(key_hash);
+      rc = mdb_cursor_get(cursor, &mkey, &mdata, MDB_SET_RANGE);
+      rc = librdf_hash_lmdb_skip_to_key(cursor, key, key_hash,
+                                        &mkey, &mdata, rc);
+    }
+    mdb_cursor_close(cursor);
+  }
+
+  if(txn != lmdb_context->txn)
+    mdb_txn_abort(txn);
+
+  if(rc == MDB_NOTFOUND)
+    return 0;
+  return rc ? -1 : 1;
+}
+
+
+/**
+ * librdf_hash_lmdb_delete_key:
+ * @context: LMDB hash context
+ * @key: key
+ *
+ * Delete all values for given key from the hash.
+ *
+ * Return value: non 0 on failure
+ **/
+static int
+librdf_hash_lmdb_delete_key(void* context, librdf_hash_datum *key)
+{
+  librdf_hash_lmdb_context* lmdb_context=(librdf_hash_lmdb_context*)context;
+  unsigned char key_hash[LIBRDF_HASH_LMDB_HASH_LEN];
+  MDB_txn* txn;
+  MDB_cursor* cursor;
+  MDB_val mkey, mdata;
+  int found = 0;
+  int rc;
+
+  txn = librdf_hash_lmdb_txn_begin(lmdb_context, 0);
+  if(!txn)
+    return 1;
+
+  rc = mdb_cursor_open(txn, lmdb_context->dbi, &cursor);
+  if(!rc) {
+    librdf_hash_lmdb_hash(key_hash, key->data, key->size);
+    mkey.mv_data = key_hash;
+    mkey.mv_size = sizeof(key_hash);
+    rc = mdb_cursor_get(cursor, &mkey, &mdata, MDB_SET_RANGE);
+    rc = librdf_hash_lmdb_skip_to_key(cursor, key, key_hash,
+                                      &mkey, &mdata, rc);
+    while(!rc) {
+      rc = mdb_cursor_del(cursor, 0);
+      if(rc)
+        break;
+      found = 1;
+
+      /* after a delete the cursor is on the following record, which
+       * MDB_NEXT returns */
+      rc = mdb_cursor_get(cursor, &mkey, &mdata, MDB_NEXT);
+      rc = librdf_hash_lmdb_skip_to_key(cursor, key, key_hash,
+                                        &mkey, &mdata, rc);
+    }
+    mdb_cursor_close(cursor);
+  }
+
+  if(rc == MDB_NOTFOUND)
+    rc = found ? 0 : 1;
+  else if(rc)
+    librdf_hash_lmdb_error(lmdb_context, "delete", rc);
+
+  return librdf_hash_lmdb_txn_end(lmdb_context, txn, (rc != 0));
+}
+
+
+/**
+ * librdf_hash_lmdb_delete_key_value:
+ * @context: LMDB hash context
+ * @key: key
+ * @value: value
+ *
+ * Delete given key/value from the hash.
+ *
+ * Return value: non 0 on failure
+ **/
+static int
+librdf_hash_lmdb_delete_key_value(void* context,
+                                  librdf_hash_datum *key, librdf_hash_datum *value)
+{
+  librdf_hash_lmdb_context* lmdb_context=(librdf_hash_lmdb_context*)context;
+  MDB_txn* txn;
+  MDB_cursor* cursor;
+  int rc;
+
+  txn = librdf_hash_lmdb_txn_begin(lmdb_context, 0);
+  if(!txn)
+    return 1;
+
+  rc = mdb_cursor_open(txn, lmdb_context->dbi, &cursor);
+  if(!rc) {
+    rc = librdf_hash_lmdb_find(cursor, key, value, NULL);
+    if(!rc)
+      rc = mdb_cursor_del(cursor, 0);
+    mdb_cursor_close(cursor);
+  }
+
+  if(rc && rc != MDB_NOTFOUND)
+    librdf_hash_lmdb_error(lmdb_context, "delete", rc);
+
+  return librdf_hash_lmdb_txn_end(lmdb_context, txn, (rc != 0));
+}
+
+
+/**
+ * librdf_hash_lmdb_sync:
+ * @context: LMDB hash context
+ *
+ * Flush the environment of the hash to disk.
+ *
+ * Only needed when opened with lmdb-sync set to 'no'.
+ *
+ * Return value: non 0 on failure
+ **/
+static int
+librdf_hash_lmdb_sync(void* context)
+{
+  librdf_hash_lmdb_context* lmdb_context=(librdf_hash_lmdb_context*)context;
+  int rc;
+
+  if(lmdb_context->env->read_only)
+    return 0;
+
+  rc = mdb_env_sync(lmdb_context->env->env, 1);
+  if(rc)
+    librdf_hash_lmdb_error(lmdb_context, "sync", rc);
+  return (rc != 0);
+}
+
+
+/**
+ * librdf_hash_lmdb_get_fd:
+ * @context: LMDB hash context
+ *
+ * Get the file descriptor representing the hash.
+ *
+ * This is the data file of the environment, shared by the hashes in it.
+ *
+ * Return value: the file descriptor or <0 on failure
+ **/
+static int
+librdf_hash_lmdb_get_fd(void* context)
+{
+#ifdef WIN32
+  /* the file handle is not a descriptor */
+  return -1;
+#else
+  librdf_hash_lmdb_context* lmdb_context=(librdf_hash_lmdb_context*)context;
+  mdb_filehandle_t fd;
+
+  if(mdb_env_get_fd(lmdb_context->env->env, &fd))
+    return -1;
+  return fd;
+#endif
+}
+
+
+/**
+ * librdf_hash_lmdb_present:
+ * @context: LMDB hash context
+ * @identifier: file name of the hash
+ * @options: #librdf_hash of options
+ *
+ * Check if the named database of the hash exists in its environment,
+ * looking it up in a read transaction so that nothing is created.
+ *
+ * Return value: >0 if present, 0 if not, <0 on failure
+ **/
+static int
+librdf_hash_lmdb_present(void* context, const char *identifier,
+                         librdf_hash* options)
+{
+  librdf_hash_lmdb_context* lmdb_context=(librdf_hash_lmdb_context*)context;
+  librdf_world* world=lmdb_context->hash->world;
+  librdf_hash_lmdb_env* env;
+  char* dir = NULL;
+  char* data_file;
+  const char* name;
+  FILE* fh;
+  MDB_txn* txn;
+  MDB_dbi dbi;
+  int present = 0;
+  int rc;
+
+  if(options)
+    dir = librdf_hash_get(options, "lmdb-env-dir");
+  if(!dir)
+    dir = librdf_hash_lmdb_file_dir(identifier);
+  if(!dir)
+    return -1;
+
+  name = strrchr(identifier, '/');
+  name = name ? name + 1 : identifier;
+
+  /* an environment that was never made has no databases and cannot
+   * be opened read only */
+  data_file = LIBRDF_MALLOC(char*, strlen(dir) + 10);
+  if(!data_file) {
+    LIBRDF_FREE(char*, dir);
+    return -1;
+  }
+  sprintf(data_file, "%s/data.mdb", dir);
+  fh = fopen(data_file, "rb");
+  LIBRDF_FREE(char*, data_file);
+  if(!fh) {
+    LIBRDF_FREE(char*, dir);
+    return 0;
+  }
+  fclose(fh);
+
+  env = librdf_hash_lmdb_env_open(world, dir, lmdb_context->map_size,
+                                  lmdb_context->no_sync, 1, 0);
+  LIBRDF_FREE(char*, dir);
+  if(!env)
+    return -1;
+
+  rc = mdb_txn_begin(env->env, NULL, MDB_RDONLY, &txn);
+  if(!rc) {
+    rc = mdb_dbi_open(txn, name, 0, &dbi);
+    if(!rc)
+      present = 1;
+    else if(rc == MDB_NOTFOUND)
+      rc = 0;
+    mdb_txn_abort(txn);
+  }
+
+  librdf_hash_lmdb_env_close(world, env);
+
+  return rc ? -1 : present;
+}
+
+
+/**
+ * librdf_hash_lmdb_transaction_start:
+ * @context: LMDB hash context
+ * @handle: transaction handle of another hash or NULL
+ *
+ * Start a write transaction, or join the one of another hash in the
+ * same environment.
+ *
+ * Hashes in different environments each have their own transaction.
+ *
+ * Return value: transaction handle or NULL on failure
+ **/
+static void*
+librdf_hash_lmdb_transaction_start(void* context, void* handle)
+{
+  librdf_hash_lmdb_context* lmdb_context=(librdf_hash_lmdb_context*)context;
+  MDB_txn* txn;
+  int rc;
+
+  if(lmdb_context->txn)
+    return NULL;
+
+  /* LMDB allows only one write transaction in an environment; join
+   * it only if the handle is that transaction, since a handle from
+   * another type of hash is not an MDB_txn */
+  if(handle && handle == lmdb_context->env->write_txn) {
+    lmdb_context->txn = (MDB_txn*)handle;
+    lmdb_context->txn_owner = 0;
+    return handle;
+  }
+
+  rc = mdb_txn_begin(lmdb_context->env->env, NULL, 0, &txn);
+  if(rc) {
+    librdf_hash_lmdb_error(lmdb_context, "transaction begin", rc);
+    return NULL;
+  }
+
+  lmdb_context->txn = txn;
+  lmdb_context->txn_owner = 1;
+  lmdb_context->env->write_txn = txn;
+  return handle ? handle : txn;
+}
+
+
+/**
+ * librdf_hash_lmdb_transaction_commit:
+ * @context: LMDB hash context
+ *
+ * Commit the transaction if this hash started it, otherwise leave it.
+ *
+ * Return value: non 0 on failure
+ **/
+static int
+librdf_hash_lmdb_transaction_commit(void* context)
+{
+  librdf_hash_lmdb_context* lmdb_context=(librdf_hash_lmdb_context*)context;
+  int rc = 0;
+
+  if(!lmdb_context->txn)
+    return 1;
+
+  if(lmdb_context->txn_owner) {
+    rc = mdb_txn_commit(lmdb_context->txn);
+    if(rc)
+      librdf_hash_lmdb_error(lmdb_context, "transaction commit", rc);
+    lmdb_context->env->write_txn = NULL;
+  }
+
+  lmdb_context->txn = NULL;
+  lmdb_context->txn_owner = 0;
+  lmdb_context->txn_serial++;
+  return (rc != 0);
+}
+
+
+/**
+ * librdf_hash_lmdb_transaction_rollback:
+ * @context: LMDB hash context
+ *
+ * Abort the transaction if this hash started it, otherwise leave it.
+ *
+ * Return value: non 0 on failure
+ **/
+static int
+librdf_hash_lmdb_transaction_rollback(void* context)
+{
+  librdf_hash_lmdb_context* lmdb_context=(librdf_hash_lmdb_context*)context;
+
+  if(!lmdb_context->txn)
+    return 1;
+
+  if(lmdb_context->txn_owner) {
+    mdb_txn_abort(lmdb_context->txn);
+    lmdb_context->env->write_txn = NULL;
+  }
+
+  lmdb_context->txn = NULL;
+  lmdb_context->txn_owner = 0;
+  lmdb_context->txn_serial++;
+  return 0;
+}
+
+
+/* local function to register LMDB hash functions */
+
+/**
+ * librdf_hash_lmdb_register_factory:
+ * @factory: hash factory prototype
+ *
+ * Register the LMDB hash module with the hash factory.
+ *
+ **/
+static void
+librdf_hash_lmdb_register_factory(librdf_hash_factory *factory)
+{
+  factory->context_length = sizeof(librdf_hash_lmdb_context);
+  factory->cursor_context_length = sizeof(librdf_hash_lmdb_cursor_context);
+
+  factory->create  = librdf_hash_lmdb_create;
+  factory->destroy = librdf_hash_lmdb_destroy;
+
+  factory->open    = librdf_hash_lmdb_open;
+  factory->close   = librdf_hash_lmdb_close;
+  factory->clone   = librdf_hash_lmdb_clone;
+
+  factory->values_count = librdf_hash_lmdb_values_count;
+
+  factory->put     = librdf_hash_lmdb_put;
+  factory->exists  = librdf_hash_lmdb_exists;
+  factory->delete_key  = librdf_hash_lmdb_delete_key;
+  factory->delete_key_value  = librdf_hash_lmdb_delete_key_value;
+  factory->sync    = librdf_hash_lmdb_sync;
+  factory->get_fd  = librdf_hash_lmdb_get_fd;
+  factory->present = librdf_hash_lmdb_present;
+
+  factory->cursor_init   = librdf_hash_lmdb_cursor_init;
+  factory->cursor_get    = librdf_hash_lmdb_cursor_get;
+  factory->cursor_finish = librdf_hash_lmdb_cursor_finish;
+
+  factory->transaction_start    = librdf_hash_lmdb_transaction_start;
+  factory->transaction_commit   = librdf_hash_lmdb_transaction_commit;
+  factory->transaction_rollback = librdf_hash_lmdb_transaction_rollback;
+}
+
+
+/**
+ * librdf_init_hash_lmdb:
+ * @world: redland world object
+ *
+ * Initialise the LMDB hash module.
+ **/
+void
+librdf_init_hash_lmdb(librdf_world *world)
+{
+  librdf_hash_register_factory(world,
+                               "lmdb", &librdf_hash_lmdb_register_factory);
+}
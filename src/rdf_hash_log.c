@@ -0,0 +1,1210 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * rdf_hash_log.c - RDF hash log-structured file Implementation
+ *
+ * Copyright (C) 2000-2008, David Beckett http://www.dajobe.org/
+ * Copyright (C) 2000-2004, University of Bristol, UK http://www.bristol.ac.uk/
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ *
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <rdf_config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_rdf_config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <sys/types.h>
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#include <redland.h>
+#include <rdf_types.h>
+
+
+/*
+ * The keys and values are held in a memory hash and every change is
+ * appended to a log file, which is replayed when the hash is opened
+ * and rewritten with only the current pairs once it is mostly
+ * superseded records.
+ *
+ * The log starts with the magic string and a 4 byte version.  Each
+ * record is an operation byte, the 4 byte key and value lengths and
+ * the 4 byte FNV-1a checksum of the key and value, then the key and
+ * value.  The records of a transaction are between begin and commit
+ * records and are only replayed if the commit is there.  Integers are
+ * little endian.
+ */
+#define LIBRDF_HASH_LOG_MAGIC "LRDFHASH"
+#define LIBRDF_HASH_LOG_MAGIC_LEN 8
+#define LIBRDF_HASH_LOG_VERSION 1
+#define LIBRDF_HASH_LOG_HEADER_LEN (LIBRDF_HASH_LOG_MAGIC_LEN + 4)
+#define LIBRDF_HASH_LOG_RECORD_HEADER_LEN 13
+
+#define LIBRDF_HASH_LOG_PUT 'P'
+#define LIBRDF_HASH_LOG_DELETE_VALUE 'V'
+#define LIBRDF_HASH_LOG_DELETE_KEY 'K'
+#define LIBRDF_HASH_LOG_BEGIN 'B'
+#define LIBRDF_HASH_LOG_COMMIT 'C'
+
+/* Fewest records that trigger rewriting the log */
+#define LIBRDF_HASH_LOG_MIN_COMPACT 1000
+
+
+typedef struct
+{
+  librdf_hash *hash;
+  int mode;
+  int is_writable;
+  int is_new;
+  /* the current keys and values */
+  librdf_hash* table;
+  char* file_name;
+  /* log open for appending or NULL if read only */
+  FILE* fh;
+  /* change records in the log */
+  long records;
+  /* records of the current transaction, written at commit */
+  int in_transaction;
+  unsigned char* txn_buffer;
+  size_t txn_length;
+  size_t txn_size;
+  long txn_records;
+} librdf_hash_log_context;
+
+
+/* Implementing the hash cursor */
+static int librdf_hash_log_cursor_init(void *cursor_context, void *hash_context);
+static int librdf_hash_log_cursor_get(void* context, librdf_hash_datum* key, librdf_hash_datum* value, unsigned int flags);
+static void librdf_hash_log_cursor_finish(void* context);
+
+
+/* functions implementing the API */
+
+static int librdf_hash_log_create(librdf_hash* new_hash, void* context);
+static int librdf_hash_log_destroy(void* context);
+static int librdf_hash_log_open(void* context, const char *identifier, int mode, int is_writable, int is_new, librdf_hash* options);
+static int librdf_hash_log_close(void* context);
+static int librdf_hash_log_clone(librdf_hash* new_hash, void *new_context, char *new_identifier, void* old_context);
+static int librdf_hash_log_values_count(void *context);
+static int librdf_hash_log_put(void* context, librdf_hash_datum *key, librdf_hash_datum *data);
+static int librdf_hash_log_exists(void* context, librdf_hash_datum *key, librdf_hash_datum *value);
+static int librdf_hash_log_delete_key(void* context, librdf_hash_datum *key);
+static int librdf_hash_log_delete_key_value(void* context, librdf_hash_datum *key, librdf_hash_datum *value);
+static int librdf_hash_log_sync(void* context);
+static int librdf_hash_log_get_fd(void* context);
+static int librdf_hash_log_present(void* context, const char *identifier, librdf_hash* options);
+static void* librdf_hash_log_transaction_start(void* context, void* handle);
+static int librdf_hash_log_transaction_commit(void* context);
+static int librdf_hash_log_transaction_rollback(void* context);
+
+static void librdf_hash_log_register_factory(librdf_hash_factory *factory);
+
+
+/* helper functions */
+
+static u32
+librdf_hash_log_checksum(u32 hash, const unsigned char* data, size_t length)
+{
+  while(length--)
+    hash = (hash ^ *data++) * 16777619UL;
+
+  return hash;
+}
+
+
+static void
+librdf_hash_log_put_u32(unsigned char* buffer, u32 value)
+{
+  buffer[0] = (unsigned char)(value & 0xff);
+  buffer[1] = (unsigned char)((value >> 8) & 0xff);
+  buffer[2] = (unsigned char)((value >> 16) & 0xff);
+  buffer[3] = (unsigned char)((value >> 24) & 0xff);
+}
+
+
+static u32
+librdf_hash_log_get_u32(const unsigned char* buffer)
+{
+  return (u32)buffer[0] | ((u32)buffer[1] << 8) |
+         ((u32)buffer[2] << 16) | ((u32)buffer[3] << 24);
+}
+
+
+/* Flush a file handle to disk.  Return value: non 0 on failure */
+static int
+librdf_hash_log_flush(FILE* fh)
+{
+  if(fflush(fh))
+    return 1;
+#ifdef HAVE_FSYNC
+  if(fsync(fileno(fh)))
+    return 1;
+#endif
+  return 0;
+}
+
+
+/*
+ * librdf_hash_log_encode - make the header of a record
+ */
+static void
+librdf_hash_log_encode(unsigned char* header, int op,
+                       librdf_hash_datum* key, librdf_hash_datum* value)
+{
+  u32 sum = 2166136261UL;
+  size_t key_len = key ? key->size : 0;
+  size_t value_len = value ? value->size : 0;
+
+  if(key_len)
+    sum = librdf_hash_log_checksum(sum, (const unsigned char*)key->data, key_len);
+  if(value_len)
+    sum = librdf_hash_log_checksum(sum, (const unsigned char*)value->data, value_len);
+
+  header[0] = (unsigned char)op;
+  librdf_hash_log_put_u32(header + 1, (u32)key_len);
+  librdf_hash_log_put_u32(header + 5, (u32)value_len);
+  librdf_hash_log_put_u32(header + 9, sum);
+}
+
+
+/*
+ * librdf_hash_log_write_record - write a record to a file
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_hash_log_write_record(FILE* fh, int op,
+                             librdf_hash_datum* key, librdf_hash_datum* value)
+{
+  unsigned char header[LIBRDF_HASH_LOG_RECORD_HEADER_LEN];
+
+  librdf_hash_log_encode(header, op, key, value);
+  if(fwrite(header, 1, sizeof(header), fh) != sizeof(header))
+    return 1;
+  if(key && key->size && fwrite(key->data, 1, key->size, fh) != key->size)
+    return 1;
+  if(value && value->size &&
+     fwrite(value->data, 1, value->size, fh) != value->size)
+    return 1;
+  return 0;
+}
+
+
+/*
+ * librdf_hash_log_append - log a change
+ *
+ * In a transaction the record is kept until commit, otherwise it is
+ * buffered by stdio and librdf_hash_log_sync() makes it durable.
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_hash_log_append(librdf_hash_log_context* context, int op,
+                       librdf_hash_datum* key, librdf_hash_datum* value)
+{
+  if(!context->fh)
+    return 1;
+
+  if(context->in_transaction) {
+    size_t length = LIBRDF_HASH_LOG_RECORD_HEADER_LEN + key->size +
+                    (value ? value->size : 0);
+    unsigned char* p;
+
+    if(context->txn_length + length > context->txn_size) {
+      size_t size = (context->txn_length + length) * 2;
+
+      p = LIBRDF_MALLOC(unsigned char*, size);
+      if(!p)
+        return 1;
+      if(context->txn_buffer) {
+        memcpy(p, context->txn_buffer, context->txn_length);
+        LIBRDF_FREE(char*, context->txn_buffer);
+      }
+      context->txn_buffer = p;
+      context->txn_size = size;
+    }
+
+    p = context->txn_buffer + context->txn_length;
+    librdf_hash_log_encode(p, op, key, value);
+    p += LIBRDF_HASH_LOG_RECORD_HEADER_LEN;
+    memcpy(p, key->data, key->size);
+    if(value)
+      memcpy(p + key->size, value->data, value->size);
+    context->txn_length += length;
+    context->txn_records++;
+    return 0;
+  }
+
+  if(librdf_hash_log_write_record(context->fh, op, key, value)) {
+    librdf_log(context->hash->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "failed to write to log '%s' - %s",
+               context->file_name, strerror(errno));
+    return 1;
+  }
+
+  context->records++;
+  return 0;
+}
+
+
+/*
+ * librdf_hash_log_apply - apply a record to the table
+ */
+static void
+librdf_hash_log_apply(librdf_hash_log_context* context, int op,
+                      librdf_hash_datum* key, librdf_hash_datum* value)
+{
+  switch(op) {
+    case LIBRDF_HASH_LOG_PUT:
+      librdf_hash_put(context->table, key, value);
+      break;
+
+    case LIBRDF_HASH_LOG_DELETE_VALUE:
+      librdf_hash_delete(context->table, key, value);
+      break;
+
+    case LIBRDF_HASH_LOG_DELETE_KEY:
+      librdf_hash_delete_all(context->table, key);
+      break;
+
+    default:
+      break;
+  }
+}
+
+
+/*
+ * librdf_hash_log_replay - Apply the changes in the log to the table
+ * @context: log hash context
+ * @fh: log opened for reading
+ *
+ * A truncated or damaged record ends the replay and an unfinished
+ * transaction before it is rolled back.
+ *
+ * Return value: non 0 if the log was not completely replayed
+ */
+static int
+librdf_hash_log_replay(librdf_hash_log_context* context, FILE* fh)
+{
+  unsigned char header[LIBRDF_HASH_LOG_HEADER_LEN];
+  unsigned char* buffer = NULL;
+  size_t buffer_size = 0;
+  int in_transaction = 0;
+  int rc = 1;
+
+  if(fread(header, 1, LIBRDF_HASH_LOG_HEADER_LEN, fh) != LIBRDF_HASH_LOG_HEADER_LEN ||
+     memcmp(header, LIBRDF_HASH_LOG_MAGIC, LIBRDF_HASH_LOG_MAGIC_LEN) ||
+     librdf_hash_log_get_u32(header + LIBRDF_HASH_LOG_MAGIC_LEN) != LIBRDF_HASH_LOG_VERSION) {
+    librdf_log(context->hash->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "Log '%s' has a bad header", context->file_name);
+    return -1;
+  }
+
+  while(1) {
+    unsigned char record[LIBRDF_HASH_LOG_RECORD_HEADER_LEN];
+    librdf_hash_datum key, value; /* on stack */
+    size_t count;
+    size_t length;
+
+    count = fread(record, 1, LIBRDF_HASH_LOG_RECORD_HEADER_LEN, fh);
+    if(!count) {
+      rc = 0;
+      break;
+    }
+    if(count != LIBRDF_HASH_LOG_RECORD_HEADER_LEN)
+      break;
+
+    key.size = (size_t)librdf_hash_log_get_u32(record + 1);
+    value.size = (size_t)librdf_hash_log_get_u32(record + 5);
+    length = key.size + value.size;
+    if(length < key.size)
+      break;
+
+    if(length > buffer_size) {
+      if(buffer)
+        LIBRDF_FREE(char*, buffer);
+      buffer_size = length + 1024;
+      buffer = LIBRDF_MALLOC(unsigned char*, buffer_size);
+      if(!buffer)
+        break;
+    }
+
+    if(fread(buffer, 1, length, fh) != length ||
+       librdf_hash_log_checksum(2166136261UL, buffer, length) != librdf_hash_log_get_u32(record + 9))
+      break;
+
+    key.data = buffer;
+    value.data = buffer + key.size;
+
+    switch(record[0]) {
+      case LIBRDF_HASH_LOG_BEGIN:
+        /* the memory hash undo log takes back an unfinished transaction */
+        if(!in_transaction &&
+           librdf_hash_transaction_start(context->table, NULL))
+          in_transaction = 1;
+        break;
+
+      case LIBRDF_HASH_LOG_COMMIT:
+        if(in_transaction)
+          librdf_hash_transaction_commit(context->table);
+        in_transaction = 0;
+        break;
+
+      default:
+        librdf_hash_log_apply(context, record[0], &key, &value);
+        context->records++;
+        break;
+    }
+  }
+
+  if(in_transaction) {
+    librdf_hash_transaction_rollback(context->table);
+    rc = 1;
+  }
+
+  if(rc)
+    librdf_log(context->hash->world, 0, LIBRDF_LOG_WARN, LIBRDF_FROM_STORAGE, NULL,
+               "Log '%s' is damaged after %ld records",
+               context->file_name, context->records);
+
+  if(buffer)
+    LIBRDF_FREE(char*, buffer);
+
+  return rc;
+}
+
+
+/*
+ * librdf_hash_log_rewrite - Write a new log with only the current pairs
+ * @context: log hash context
+ *
+ * The new log is written to name".new" and renamed over the log.
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_hash_log_rewrite(librdf_hash_log_context* context)
+{
+  unsigned char header[LIBRDF_HASH_LOG_HEADER_LEN];
+  librdf_hash_datum *key, *value;
+  librdf_iterator *iterator;
+  char* new_name;
+  FILE* fh;
+  long records = 0;
+  int rc = 0;
+
+  new_name = LIBRDF_MALLOC(char*, strlen(context->file_name) + 5);
+  if(!new_name)
+    return 1;
+  sprintf(new_name, "%s.new", context->file_name);
+
+  fh = fopen(new_name, "wb");
+  if(!fh) {
+    librdf_log(context->hash->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "failed to open log '%s' for writing - %s",
+               new_name, strerror(errno));
+    LIBRDF_FREE(char*, new_name);
+    return 1;
+  }
+
+  memcpy(header, LIBRDF_HASH_LOG_MAGIC, LIBRDF_HASH_LOG_MAGIC_LEN);
+  librdf_hash_log_put_u32(header + LIBRDF_HASH_LOG_MAGIC_LEN,
+                          LIBRDF_HASH_LOG_VERSION);
+  if(fwrite(header, 1, LIBRDF_HASH_LOG_HEADER_LEN, fh) != LIBRDF_HASH_LOG_HEADER_LEN)
+    rc = 1;
+
+  key = librdf_new_hash_datum(context->hash->world, NULL, 0);
+  value = librdf_new_hash_datum(context->hash->world, NULL, 0);
+
+  iterator = librdf_hash_get_all(context->table, key, value);
+  while(!rc && !librdf_iterator_end(iterator)) {
+    librdf_hash_datum* k = (librdf_hash_datum*)librdf_iterator_get_key(iterator);
+    librdf_hash_datum* v = (librdf_hash_datum*)librdf_iterator_get_value(iterator);
+
+    rc = librdf_hash_log_write_record(fh, LIBRDF_HASH_LOG_PUT, k, v);
+    records++;
+    librdf_iterator_next(iterator);
+  }
+  if(iterator)
+    librdf_free_iterator(iterator);
+
+  librdf_free_hash_datum(value);
+  librdf_free_hash_datum(key);
+
+  /* the old log is only replaced once the new one is on disk */
+  if(!rc)
+    rc = librdf_hash_log_flush(fh);
+  fclose(fh);
+
+  if(!rc) {
+    if(context->fh) {
+      fclose(context->fh);
+      context->fh = NULL;
+    }
+#ifdef WIN32
+    remove(context->file_name);
+#endif
+    if(rename(new_name, context->file_name) < 0)
+      rc = 1;
+  }
+
+  if(rc) {
+    librdf_log(context->hash->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "failed to rewrite log '%s' - %s",
+               context->file_name, strerror(errno));
+    remove(new_name);
+  } else
+    context->records = records;
+
+  LIBRDF_FREE(char*, new_name);
+
+  if(!context->fh) {
+    context->fh = fopen(context->file_name, "ab");
+    if(!context->fh) {
+      librdf_log(context->hash->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "failed to open log '%s' for writing - %s",
+                 context->file_name, strerror(errno));
+      rc = 1;
+    }
+  }
+
+  return rc;
+}
+
+
+/* Return non 0 if the log is mostly superseded records */
+static int
+librdf_hash_log_full(librdf_hash_log_context* context)
+{
+  return context->records >= LIBRDF_HASH_LOG_MIN_COMPACT &&
+         context->records >= 2 * (long)librdf_hash_values_count(context->table);
+}
+
+
+
+/* functions implementing hash api */
+
+/**
+ * librdf_hash_log_create:
+ * @hash: #librdf_hash hash
+ * @context: log hash context
+ *
+ * Create a new log hash.
+ *
+ * Return value: non 0 on failure
+ **/
+static int
+librdf_hash_log_create(librdf_hash* hash, void* context)
+{
+  librdf_hash_log_context* hcontext=(librdf_hash_log_context*)context;
+
+  hcontext->hash=hash;
+  return 0;
+}
+
+
+/**
+ * librdf_hash_log_destroy:
+ * @context: log hash context
+ *
+ * Destroy a log hash.
+ *
+ * Return value: non 0 on failure
+ **/
+static int
+librdf_hash_log_destroy(void* context)
+{
+  /* NOP */
+  return 0;
+}
+
+
+/**
+ * librdf_hash_log_open:
+ * @context: log hash context
+ * @identifier: file name prefix of the log
+ * @mode: access mode - not used
+ * @is_writable: is hash writable?
+ * @is_new: is hash new?
+ * @options: #librdf_hash of options - not used
+ *
+ * Open a log hash, replaying the log file identifier".log".
+ *
+ * All the keys and values are kept in memory.  A log that ends
+ * with a damaged record, or is mostly superseded records, is
+ * rewritten when it is opened writable.
+ *
+ * Return value: non 0 on failure
+ **/
+static int
+librdf_hash_log_open(void* context, const char *identifier,
+                     int mode, int is_writable, int is_new,
+                     librdf_hash* options)
+{
+  librdf_hash_log_context* log_context=(librdf_hash_log_context*)context;
+  FILE* fh;
+  int rc = 0;
+
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(identifier, cstring, 1);
+
+  /* The options are copied into the context so that the clone
+   * method can use them
+   */
+  log_context->mode=mode;
+  log_context->is_writable=is_writable;
+  log_context->is_new=is_new;
+
+  log_context->table = librdf_new_hash(log_context->hash->world, "memory");
+  if(!log_context->table)
+    return 1;
+  if(librdf_hash_open(log_context->table, NULL, 0, 1, 1, NULL))
+    goto failed;
+
+  log_context->file_name = LIBRDF_MALLOC(char*, strlen(identifier) + 5);
+  if(!log_context->file_name)
+    goto failed;
+  sprintf(log_context->file_name, "%s.log", identifier);
+
+  fh = NULL;
+  if(!is_new || !is_writable) {
+    fh = fopen(log_context->file_name, "rb");
+    if(!fh && (!is_writable || errno != ENOENT)) {
+      librdf_log(log_context->hash->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "failed to open log '%s' - %s",
+                 log_context->file_name, strerror(errno));
+      goto failed;
+    }
+  }
+
+  if(fh) {
+    rc = librdf_hash_log_replay(log_context, fh);
+    fclose(fh);
+    if(rc < 0)
+      goto failed;
+  }
+
+  if(!is_writable)
+    return 0;
+
+  /* Write what was recovered, or an empty log, and continue from that */
+  if(!fh || rc || librdf_hash_log_full(log_context)) {
+    if(librdf_hash_log_rewrite(log_context))
+      goto failed;
+  } else {
+    log_context->fh = fopen(log_context->file_name, "ab");
+    if(!log_context->fh) {
+      librdf_log(log_context->hash->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "failed to open log '%s' for writing - %s",
+                 log_context->file_name, strerror(errno));
+      goto failed;
+    }
+  }
+
+  return 0;
+
+  failed:
+  if(log_context->file_name) {
+    LIBRDF_FREE(char*, log_context->file_name);
+    log_context->file_name = NULL;
+  }
+  librdf_free_hash(log_context->table);
+  log_context->table = NULL;
+  return 1;
+}
+
+
+/**
+ * librdf_hash_log_close:
+ * @context: log hash context
+ *
+ * Close the hash, rolling back any unfinished transaction.
+ *
+ * Return value: non 0 on failure
+ **/
+static int
+librdf_hash_log_close(void* context)
+{
+  librdf_hash_log_context* log_context=(librdf_hash_log_context*)context;
+  int rc = 0;
+
+  if(log_context->in_transaction)
+    librdf_hash_log_transaction_rollback(context);
+
+  if(log_context->fh) {
+    if(librdf_hash_log_full(log_context))
+      rc = librdf_hash_log_rewrite(log_context);
+    if(log_context->fh) {
+      if(fclose(log_context->fh))
+        rc = 1;
+      log_context->fh = NULL;
+    }
+  }
+
+  if(log_context->txn_buffer) {
+    LIBRDF_FREE(char*, log_context->txn_buffer);
+    log_context->txn_buffer = NULL;
+    log_context->txn_size = 0;
+  }
+
+  LIBRDF_FREE(char*, log_context->file_name);
+  log_context->file_name = NULL;
+
+  librdf_free_hash(log_context->table);
+  log_context->table = NULL;
+
+  return rc;
+}
+
+
+static int
+librdf_hash_log_clone(librdf_hash *hash, void* context, char *new_identifier,
+                      void *old_context)
+{
+  librdf_hash_log_context* hcontext=(librdf_hash_log_context*)context;
+  librdf_hash_log_context* old_hcontext=(librdf_hash_log_context*)old_context;
+  librdf_hash_datum *key, *value;
+  librdf_iterator *iterator;
+  int status=0;
+
+  /* copy data fields that might change */
+  hcontext->hash=hash;
+
+  if(librdf_hash_log_open(context, new_identifier,
+                          old_hcontext->mode, old_hcontext->is_writable,
+                          old_hcontext->is_new, NULL))
+    return 1;
+
+  /* Use higher level functions to iterator this data
+   * on the other hand, maybe this is a good idea since that
+   * code is tested and works
+   */
+
+  key=librdf_new_hash_datum(hash->world, NULL, 0);
+  value=librdf_new_hash_datum(hash->world, NULL, 0);
+
+  iterator=librdf_hash_get_all(old_hcontext->hash, key, value);
+  while(!librdf_iterator_end(iterator)) {
+    librdf_hash_datum* k= (librdf_hash_datum*)librdf_iterator_get_key(iterator);
+    librdf_hash_datum* v= (librdf_hash_datum*)librdf_iterator_get_value(iterator);
+
+    if(librdf_hash_log_put(hcontext, k, v)) {
+      status=1;
+      break;
+    }
+    librdf_iterator_next(iterator);
+  }
+  if(iterator)
+    librdf_free_iterator(iterator);
+
+  librdf_free_hash_datum(value);
+  librdf_free_hash_datum(key);
+
+  return status;
+}
+
+
+/**
+ * librdf_hash_log_values_count:
+ * @context: log hash context
+ *
+ * Get the number of values in the hash.
+ *
+ * Return value: number of values in the hash or <0 on failure
+ **/
+static int
+librdf_hash_log_values_count(void *context)
+{
+  librdf_hash_log_context* log_context=(librdf_hash_log_context*)context;
+
+  return librdf_hash_values_count(log_context->table);
+}
+
+
+
+typedef struct {
+  librdf_hash_cursor* cursor;
+} librdf_hash_log_cursor_context;
+
+
+
+/**
+ * librdf_hash_log_cursor_init:
+ * @cursor_context: hash cursor context
+ * @hash_context: hash to operate over
+ *
+ * Initialise a new hash cursor over the keys and values in memory.
+ *
+ * Return value: non 0 on failure
+ **/
+static int
+librdf_hash_log_cursor_init(void *cursor_context, void *hash_context)
+{
+  librdf_hash_log_cursor_context *cursor=(librdf_hash_log_cursor_context*)cursor_context;
+  librdf_hash_log_context* log_context=(librdf_hash_log_context*)hash_context;
+
+  cursor->cursor = librdf_new_hash_cursor(log_context->table);
+  return (cursor->cursor == NULL);
+}
+
+
+/**
+ * librdf_hash_log_cursor_get:
+ * @context: log hash cursor context
+ * @key: pointer to key to use
+ * @value: pointer to value to use
+ * @flags: flags
+ *
+ * Retrieve a hash value for the given key.
+ *
+ * Return value: non 0 on failure
+ **/
+static int
+librdf_hash_log_cursor_get(void* context,
+                           librdf_hash_datum *key,
+                           librdf_hash_datum *value,
+                           unsigned int flags)
+{
+  librdf_hash_log_cursor_context *cursor=(librdf_hash_log_cursor_context*)context;
+
+  switch(flags) {
+    case LIBRDF_HASH_CURSOR_SET:
+      return librdf_hash_cursor_set(cursor->cursor, key, value);
+
+    case LIBRDF_HASH_CURSOR_NEXT_VALUE:
+      return librdf_hash_cursor_get_next_value(cursor->cursor, key, value);
+
+    case LIBRDF_HASH_CURSOR_FIRST:
+      return librdf_hash_cursor_get_first(cursor->cursor, key, value);
+
+    case LIBRDF_HASH_CURSOR_NEXT:
+      return librdf_hash_cursor_get_next(cursor->cursor, key, value);
+
+    default:
+      return 1;
+  }
+}
+
+
+/**
+ * librdf_hash_log_cursor_finish:
+ * @context: log hash cursor context
+ *
+ * Finish the serialisation of the hash log get.
+ *
+ **/
+static void
+librdf_hash_log_cursor_finish(void* context)
+{
+  librdf_hash_log_cursor_context *cursor=(librdf_hash_log_cursor_context*)context;
+
+  if(cursor->cursor)
+    librdf_free_hash_cursor(cursor->cursor);
+}
+
+
+/**
+ * librdf_hash_log_put:
+ * @context: log hash context
+ * @key: pointer to key to store
+ * @value: pointer to value to store
+ *
+ * - Store a key/value pair in the hash.
+ *
+ * Return value: non 0 on failure
+ **/
+static int
+librdf_hash_log_put(void* context, librdf_hash_datum *key,
+                    librdf_hash_datum *value)
+{
+  librdf_hash_log_context* log_context=(librdf_hash_log_context*)context;
+
+  if(!log_context->fh || librdf_hash_put(log_context->table, key, value))
+    return 1;
+
+  if(librdf_hash_log_append(log_context, LIBRDF_HASH_LOG_PUT, key, value)) {
+    /* keep the table the same as the log */
+    librdf_hash_delete(log_context->table, key, value);
+    return 1;
+  }
+
+  return 0;
+}
+
+
+/**
+ * librdf_hash_log_exists:
+ * @context: log hash context
+ * @key: key
+ * @value: value
+ *
+ * Test the existence of a key in the hash.
+ *
+ * Return value: >0 if the key/value exists in the hash, 0 if not, <0 on failure
+ **/
+static int
+librdf_hash_log_exists(void* context,
+                       librdf_hash_datum *key, librdf_hash_datum *value)
+{
+  librdf_hash_log_context* log_context=(librdf_hash_log_context*)context;
+
+  return librdf_hash_exists(log_context->table, key, value);
+}
+
+
+/**
+ * librdf_hash_log_delete_key_value:
+ * @context: log hash context
+ * @key: pointer to key to delete
+ * @value: pointer to value to delete
+ *
+ * - Delete a key/value pair from the hash.
+ *
+ * Return value: non 0 on failure
+ **/
+static int
+librdf_hash_log_delete_key_value(void* context, librdf_hash_datum *key,
+                                 librdf_hash_datum *value)
+{
+  librdf_hash_log_context* log_context=(librdf_hash_log_context*)context;
+
+  if(!log_context->fh || librdf_hash_delete(log_context->table, key, value))
+    return 1;
+
+  if(librdf_hash_log_append(log_context, LIBRDF_HASH_LOG_DELETE_VALUE,
+                            key, value)) {
+    librdf_hash_put(log_context->table, key, value);
+    return 1;
+  }
+
+  return 0;
+}
+
+
+/**
+ * librdf_hash_log_delete_key:
+ * @context: log hash context
+ * @key: pointer to key to delete
+ *
+ * - Delete a key and all its values from the hash.
+ *
+ * Return value: non 0 on failure
+ **/
+static int
+librdf_hash_log_delete_key(void* context, librdf_hash_datum *key)
+{
+  librdf_hash_log_context* log_context=(librdf_hash_log_context*)context;
+  librdf_hash* saved;
+  librdf_hash_datum hd_key, hd_value; /* on stack */
+  librdf_iterator* iterator;
+  int rc=0;
+
+  if(!log_context->fh)
+    return 1;
+
+  /* keep the values to put back if the log cannot be written */
+  saved=librdf_new_hash(log_context->hash->world, NULL);
+  if(!saved)
+    return 1;
+  if(librdf_hash_open(saved, NULL, 0, 1, 1, NULL)) {
+    librdf_free_hash(saved);
+    return 1;
+  }
+
+  hd_key.data=key->data; hd_key.size=key->size;
+  hd_value.data=NULL; hd_value.size=0;
+  iterator=librdf_hash_get_all(log_context->table, &hd_key, &hd_value);
+  if(!iterator)
+    rc=1;
+  while(!rc && !librdf_iterator_end(iterator)) {
+    librdf_hash_datum* value=(librdf_hash_datum*)librdf_iterator_get_value(iterator);
+
+    rc=librdf_hash_put(saved, key, value);
+    librdf_iterator_next(iterator);
+  }
+  if(iterator)
+    librdf_free_iterator(iterator);
+
+  if(!rc)
+    rc=librdf_hash_delete_all(log_context->table, key);
+
+  if(!rc &&
+     librdf_hash_log_append(log_context, LIBRDF_HASH_LOG_DELETE_KEY,
+                            key, NULL)) {
+    /* keep the table the same as the log */
+    hd_key.data=key->data; hd_key.size=key->size;
+    hd_value.data=NULL; hd_value.size=0;
+    iterator=librdf_hash_get_all(saved, &hd_key, &hd_value);
+    while(iterator && !librdf_iterator_end(iterator)) {
+      librdf_hash_datum* value=(librdf_hash_datum*)librdf_iterator_get_value(iterator);
+
+      librdf_hash_put(log_context->table, key, value);
+      librdf_iterator_next(iterator);
+    }
+    if(iterator)
+      librdf_free_iterator(iterator);
+    rc=1;
+  }
+
+  librdf_hash_close(saved);
+  librdf_free_hash(saved);
+
+  return rc;
+}
+
+
+/**
+ * librdf_hash_log_sync:
+ * @context: log hash context
+ *
+ * Flush the log to disk, rewriting it first if it is mostly
+ * superseded records.
+ *
+ * Return value: non 0 on failure
+ **/
+static int
+librdf_hash_log_sync(void* context)
+{
+  librdf_hash_log_context* log_context=(librdf_hash_log_context*)context;
+
+  if(!log_context->fh)
+    return 0;
+
+  if(!log_context->in_transaction && librdf_hash_log_full(log_context))
+    return librdf_hash_log_rewrite(log_context);
+
+  if(librdf_hash_log_flush(log_context->fh)) {
+    librdf_log(log_context->hash->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "failed to write to log '%s' - %s",
+               log_context->file_name, strerror(errno));
+    return 1;
+  }
+
+  return 0;
+}
+
+
+/**
+ * librdf_hash_log_get_fd:
+ * @context: log hash context
+ *
+ * Get the file descriptor of the log.
+ *
+ * Return value: the file descriptor or -1 if read only
+ **/
+static int
+librdf_hash_log_get_fd(void* context)
+{
+  librdf_hash_log_context* log_context=(librdf_hash_log_context*)context;
+
+  return log_context->fh ? fileno(log_context->fh) : -1;
+}
+
+
+/**
+ * librdf_hash_log_present:
+ * @context: log hash context
+ * @identifier: file name prefix of the log
+ * @options: #librdf_hash of options - not used
+ *
+ * Check if the log file identifier".log" exists.
+ *
+ * Return value: >0 if present, 0 if not, <0 on failure
+ **/
+static int
+librdf_hash_log_present(void* context, const char *identifier,
+                        librdf_hash* options)
+{
+  char* file_name;
+  FILE* fh;
+
+  file_name = LIBRDF_MALLOC(char*, strlen(identifier) + 5);
+  if(!file_name)
+    return -1;
+  sprintf(file_name, "%s.log", identifier);
+
+  fh = fopen(file_name, "rb");
+  LIBRDF_FREE(char*, file_name);
+  if(!fh)
+    return 0;
+
+  fclose(fh);
+  return 1;
+}
+
+
+/**
+ * librdf_hash_log_transaction_start:
+ * @context: log hash context
+ * @handle: transaction handle of another hash or NULL
+ *
+ * Start a transaction, keeping the log records until commit.
+ *
+ * Each log hash has its own log so the @handle is only passed back.
+ *
+ * Return value: transaction handle or NULL on failure
+ **/
+static void*
+librdf_hash_log_transaction_start(void* context, void* handle)
+{
+  librdf_hash_log_context* log_context=(librdf_hash_log_context*)context;
+
+  if(log_context->in_transaction || !log_context->fh)
+    return NULL;
+
+  if(!librdf_hash_transaction_start(log_context->table, NULL))
+    return NULL;
+
+  log_context->in_transaction = 1;
+  log_context->txn_length = 0;
+  log_context->txn_records = 0;
+  return handle ? handle : context;
+}
+
+
+/**
+ * librdf_hash_log_transaction_commit:
+ * @context: log hash context
+ *
+ * Commit a transaction by writing its records to the log between
+ * begin and commit records and flushing the log to disk.
+ *
+ * Return value: non 0 on failure
+ **/
+static int
+librdf_hash_log_transaction_commit(void* context)
+{
+  librdf_hash_log_context* log_context=(librdf_hash_log_context*)context;
+  int rc = 0;
+
+  if(!log_context->in_transaction)
+    return 1;
+
+  if(log_context->txn_records) {
+    if(librdf_hash_log_write_record(log_context->fh, LIBRDF_HASH_LOG_BEGIN,
+                                    NULL, NULL) ||
+       fwrite(log_context->txn_buffer, 1, log_context->txn_length,
+              log_context->fh) != log_context->txn_length ||
+       librdf_hash_log_write_record(log_context->fh, LIBRDF_HASH_LOG_COMMIT,
+                                    NULL, NULL) ||
+       librdf_hash_log_flush(log_context->fh)) {
+      librdf_log(log_context->hash->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "failed to write to log '%s' - %s",
+                 log_context->file_name, strerror(errno));
+      /* what did not reach the log is taken back */
+      log_context->in_transaction = 0;
+      librdf_hash_transaction_rollback(log_context->table);
+      return 1;
+    }
+    log_context->records += log_context->txn_records;
+  }
+
+  log_context->in_transaction = 0;
+  rc = librdf_hash_transaction_commit(log_context->table);
+  return rc;
+}
+
+
+/**
+ * librdf_hash_log_transaction_rollback:
+ * @context: log hash context
+ *
+ * Roll back a transaction by dropping its records and undoing the
+ * changes in memory.
+ *
+ * Return value: non 0 on failure
+ **/
+static int
+librdf_hash_log_transaction_rollback(void* context)
+{
+  librdf_hash_log_context* log_context=(librdf_hash_log_context*)context;
+
+  if(!log_context->in_transaction)
+    return 1;
+
+  log_context->in_transaction = 0;
+  return librdf_hash_transaction_rollback(log_context->table);
+}
+
+
+/* local function to register log hash functions */
+
+/**
+ * librdf_hash_log_register_factory:
+ * @factory: hash factory prototype
+ *
+ * Register the log hash module with the hash factory.
+ *
+ **/
+static void
+librdf_hash_log_register_factory(librdf_hash_factory *factory)
+{
+  factory->context_length = sizeof(librdf_hash_log_context);
+  factory->cursor_context_length = sizeof(librdf_hash_log_cursor_context);
+
+  factory->create  = librdf_hash_log_create;
+  factory->destroy = librdf_hash_log_destroy;
+
+  factory->open    = librdf_hash_log_open;
+  factory->close   = librdf_hash_log_close;
+  factory->clone   = librdf_hash_log_clone;
+
+  factory->values_count = librdf_hash_log_values_count;
+
+  factory->put     = librdf_hash_log_put;
+  factory->exists  = librdf_hash_log_exists;
+  factory->delete_key  = librdf_hash_log_delete_key;
+  factory->delete_key_value  = librdf_hash_log_delete_key_value;
+  factory->sync    = librdf_hash_log_sync;
+  factory->get_fd  = librdf_hash_log_get_fd;
+  factory->present = librdf_hash_log_present;
+
+  factory->cursor_init   = librdf_hash_log_cursor_init;
+  factory->cursor_get    = librdf_hash_log_cursor_get;
+  factory->cursor_finish = librdf_hash_log_cursor_finish;
+
+  factory->transaction_start    = librdf_hash_log_transaction_start;
+  factory->transaction_commit   = librdf_hash_log_transaction_commit;
+  factory->transaction_rollback = librdf_hash_log_transaction_rollback;
+}
+
+/**
+ * librdf_init_hash_log:
+ * @world: redland world object
+ *
+ * Initialise the log-structured file hash module.
+ **/
+void
+librdf_init_hash_log(librdf_world *world)
+{
+  librdf_hash_register_factory(world,
+                               "log", &librdf_hash_log_register_factory);
+}
@@ -66,6 +66,24 @@ struct librdf_hash_memory_node_s
 typedef struct librdf_hash_memory_node_s librdf_hash_memory_node;
 
 
+/* undo log entry recorded during a transaction */
+typedef enum {
+  LIBRDF_HASH_MEMORY_UNDO_PUT,    /* undo a delete by putting back */
+  LIBRDF_HASH_MEMORY_UNDO_DELETE  /* undo a put by deleting */
+} librdf_hash_memory_undo_op;
+
+struct librdf_hash_memory_undo_s
+{
+  struct librdf_hash_memory_undo_s* next;
+  librdf_hash_memory_undo_op op;
+  void *key;
+  size_t key_len;
+  void *value;
+  size_t value_len;
+};
+typedef struct librdf_hash_memory_undo_s librdf_hash_memory_undo;
+
+
 typedef struct
 {
   /* the hash object */
@@ -86,6 +104,11 @@ typedef struct
    * or in the code: size * 1000 < load_factor * capacity
    */
   size_t load_factor;
+
+  /* non-0 during a transaction */
+  int in_transaction;
+  /* undo log for the transaction, newest first */
+  librdf_hash_memory_undo* undo;
 } librdf_hash_memory_context;
 
 
@@ -124,6 +147,9 @@ static int librdf_hash_memory_delete_key(void* context, librdf_hash_datum *key);
 static int librdf_hash_memory_delete_key_value(void* context, librdf_hash_datum *key, librdf_hash_datum *value);
 static int librdf_hash_memory_sync(void* context);
 static int librdf_hash_memory_get_fd(void* context);
+static void* librdf_hash_memory_transaction_start(void* context, void* handle);
+static int librdf_hash_memory_transaction_commit(void* context);
+static int librdf_hash_memory_transaction_rollback(void* context);
 
 static void librdf_hash_memory_register_factory(librdf_hash_factory *factory);
 
@@ -340,6 +366,9 @@ librdf_hash_memory_destroy(void* context)
 {
   librdf_hash_memory_context* hcontext=(librdf_hash_memory_context*)context;
 
+  /* an unfinished transaction is committed */
+  librdf_hash_memory_transaction_commit(context);
+
   if(hcontext->nodes) {
     size_t i;
   
@@ -667,6 +696,55 @@ librdf_hash_memory_cursor_finish(void* context)
 }
 
 
+/*
+ * librdf_hash_memory_new_undo - make an undo log entry with copies of key and value
+ */
+static librdf_hash_memory_undo*
+librdf_hash_memory_new_undo(librdf_hash_memory_undo_op op,
+                            const void *key, size_t key_len,
+                            const void *value, size_t value_len)
+{
+  librdf_hash_memory_undo* undo;
+
+  undo = LIBRDF_CALLOC(librdf_hash_memory_undo*, 1, sizeof(*undo));
+  if(!undo)
+    return NULL;
+
+  undo->op = op;
+  undo->key = LIBRDF_MALLOC(void*, key_len ? key_len : 1);
+  undo->value = LIBRDF_MALLOC(void*, value_len ? value_len : 1);
+  if(!undo->key || !undo->value) {
+    if(undo->key)
+      LIBRDF_FREE(char*, undo->key);
+    if(undo->value)
+      LIBRDF_FREE(char*, undo->value);
+    LIBRDF_FREE(librdf_hash_memory_undo, undo);
+    return NULL;
+  }
+
+  memcpy(undo->key, key, key_len);
+  undo->key_len = key_len;
+  memcpy(undo->value, value, value_len);
+  undo->value_len = value_len;
+
+  return undo;
+}
+
+
+static void
+librdf_hash_memory_free_undo(librdf_hash_memory_undo* undo)
+{
+  while(undo) {
+    librdf_hash_memory_undo* next = undo->next;
+
+    LIBRDF_FREE(char*, undo->key);
+    LIBRDF_FREE(char*, undo->value);
+    LIBRDF_FREE(librdf_hash_memory_undo, undo);
+    undo = next;
+  }
+}
+
+
 /**
  * librdf_hash_memory_put:
  * @context: memory hash context
@@ -780,6 +858,23 @@ librdf_hash_memory_put(void* context, librdf_hash_datum *key,
   if(!node->next)
     hash->size++;
 
+  if(hash->in_transaction) {
+    librdf_hash_memory_undo* undo;
+
+    undo = librdf_hash_memory_new_undo(LIBRDF_HASH_MEMORY_UNDO_DELETE,
+                                       key->data, key->size,
+                                       value->data, value->size);
+    if(!undo) {
+      /* cannot be undone so take it back now */
+      hash->in_transaction = 0;
+      librdf_hash_memory_delete_key_value(hash, key, value);
+      hash->in_transaction = 1;
+      return 1;
+    }
+    undo->next = hash->undo;
+    hash->undo = undo;
+  }
+
   return 0;
 }
 
@@ -866,6 +961,18 @@ librdf_hash_memory_delete_key_value(void* context, librdf_hash_datum *key,
   if(!vnode)
     return 1;
 
+  if(hash->in_transaction) {
+    librdf_hash_memory_undo* undo;
+
+    undo = librdf_hash_memory_new_undo(LIBRDF_HASH_MEMORY_UNDO_PUT,
+                                       key->data, key->size,
+                                       value->data, value->size);
+    if(!undo)
+      return 1;
+    undo->next = hash->undo;
+    hash->undo = undo;
+  }
+
   /* found - delete it from list */
   if(!vprev) {
     /* at start of list so delete from there */
@@ -949,6 +1056,33 @@ librdf_hash_memory_delete_key(void* context, librdf_hash_datum *key)
   if(!node)
     return 1;
 
+  if(hash->in_transaction) {
+    librdf_hash_memory_node_value *vnode;
+    librdf_hash_memory_undo *undo = NULL;
+    librdf_hash_memory_undo *last = NULL;
+
+    /* record every value so that the whole key can be put back */
+    for(vnode = node->values; vnode; vnode = vnode->next) {
+      librdf_hash_memory_undo* u;
+
+      u = librdf_hash_memory_new_undo(LIBRDF_HASH_MEMORY_UNDO_PUT,
+                                      node->key, node->key_len,
+                                      vnode->value, vnode->value_len);
+      if(!u) {
+        librdf_hash_memory_free_undo(undo);
+        return 1;
+      }
+      u->next = undo;
+      undo = u;
+      if(!last)
+        last = u;
+    }
+    if(last) {
+      last->next = hash->undo;
+      hash->undo = undo;
+    }
+  }
+
   /* search list from here */
   if(!prev) {
     /* is at start of list, so delete from there */
@@ -1004,6 +1138,88 @@ librdf_hash_memory_get_fd(void* context)
 }
 
 
+/**
+ * librdf_hash_memory_transaction_start:
+ * @context: memory hash context
+ * @handle: transaction handle of another hash or NULL
+ *
+ * Start a transaction by recording an undo log.
+ * 
+ * Each memory hash keeps its own undo log so the @handle is only
+ * passed back.
+ * 
+ * Return value: transaction handle or NULL on failure
+ **/
+static void*
+librdf_hash_memory_transaction_start(void* context, void* handle) 
+{
+  librdf_hash_memory_context* hash=(librdf_hash_memory_context*)context;
+
+  if(hash->in_transaction)
+    return NULL;
+
+  hash->in_transaction = 1;
+  return handle ? handle : context;
+}
+
+
+/**
+ * librdf_hash_memory_transaction_commit:
+ * @context: memory hash context
+ *
+ * Commit a transaction by forgetting the undo log.
+ * 
+ * Return value: non 0 on failure
+ **/
+static int
+librdf_hash_memory_transaction_commit(void* context) 
+{
+  librdf_hash_memory_context* hash=(librdf_hash_memory_context*)context;
+
+  librdf_hash_memory_free_undo(hash->undo);
+  hash->undo = NULL;
+  hash->in_transaction = 0;
+  return 0;
+}
+
+
+/**
+ * librdf_hash_memory_transaction_rollback:
+ * @context: memory hash context
+ *
+ * Roll back a transaction by replaying the undo log, newest first.
+ * 
+ * Return value: non 0 on failure
+ **/
+static int
+librdf_hash_memory_transaction_rollback(void* context) 
+{
+  librdf_hash_memory_context* hash=(librdf_hash_memory_context*)context;
+  librdf_hash_memory_undo* undo;
+  int status = 0;
+
+  hash->in_transaction = 0;
+
+  for(undo = hash->undo; undo; undo = undo->next) {
+    librdf_hash_datum key, value; /* on stack */
+
+    key.data = undo->key;
+    key.size = undo->key_len;
+    value.data = undo->value;
+    value.size = undo->value_len;
+
+    if(undo->op == LIBRDF_HASH_MEMORY_UNDO_PUT)
+      status |= librdf_hash_memory_put(hash, &key, &value);
+    else
+      status |= librdf_hash_memory_delete_key_value(hash, &key, &value);
+  }
+
+  librdf_hash_memory_free_undo(hash->undo);
+  hash->undo = NULL;
+  return status;
+}
+
+
 /* local function to register memory hash functions */
 
 /**
@@ -1038,6 +1254,10 @@ librdf_hash_memory_register_factory(librdf_hash_factory *factory)
   factory->cursor_init   = librdf_hash_memory_cursor_init;
   factory->cursor_get    = librdf_hash_memory_cursor_get;
   factory->cursor_finish = librdf_hash_memory_cursor_finish;
+
+  factory->transaction_start    = librdf_hash_memory_transaction_start;
+  factory->transaction_commit   = librdf_hash_memory_transaction_commit;
+  factory->transaction_rollback = librdf_hash_memory_transaction_rollback;
 }
 
 /**
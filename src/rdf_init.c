@@ -257,11 +257,9 @@ librdf_world_init_mutex(librdf_world* world)
   world->mutex = (pthread_mutex_t *) SYSTEM_MALLOC(sizeof(pthread_mutex_t));
   pthread_mutex_init(world->mutex, NULL);
 
-  world->nodes_mutex = (pthread_mutex_t *) SYSTEM_MALLOC(sizeof(pthread_mutex_t));
-  pthread_mutex_init(world->nodes_mutex, NULL);
-
-  world->statements_mutex = (pthread_mutex_t *) SYSTEM_MALLOC(sizeof(pthread_mutex_t));
-  pthread_mutex_init(world->statements_mutex, NULL);
+  /* nodes_mutex and statements_mutex are not made: nodes and
+   * statements are raptor terms and statements with no shared
+   * free lists to lock */
 
   world->hash_datums_mutex = (pthread_mutex_t *) SYSTEM_MALLOC(sizeof(pthread_mutex_t));
   pthread_mutex_init(world->hash_datums_mutex, NULL);
@@ -160,6 +160,21 @@ struct librdf_world_s
   void* rasqal_init_handler_user_data;
 
   librdf_uri* xsd_namespace_uri;
+
+#ifdef WITH_THREADS
+  /* per-thread free lists of librdf_hash_datums */
+  pthread_key_t hash_datums_key;
+  int hash_datums_key_created;
+
+  /* all the per-thread free lists; locked by hash_datums_mutex */
+  struct librdf_hash_datum_cache_s* hash_datum_caches;
+#endif
+
+  /* shared Berkeley DB environments; locked by mutex */
+  struct librdf_hash_bdb_env_s* hash_bdb_envs;
+
+  /* shared LMDB environments; locked by mutex */
+  struct librdf_hash_lmdb_env_s* hash_lmdb_envs;
 };
 
 unsigned char* librdf_world_get_genid(librdf_world* world);
@@ -150,13 +150,31 @@ librdf_list_clear(librdf_list* list)
  **/
 int
 librdf_list_add(librdf_list* list, void *data) 
+{
+  return (librdf_list_add_node(list, data) == NULL);
+}
+
+
+/*
+ * librdf_list_add_node:
+ * @list: #librdf_list object
+ * @data: the data value
+ *
+ * INTERNAL - Add a data item to the end of a librdf_list, as
+ * librdf_list_add(), returning the list node for a later
+ * librdf_list_remove_node().
+ *
+ * Return value: the new list node or NULL on failure
+ */
+librdf_list_node*
+librdf_list_add_node(librdf_list* list, void *data) 
 {
   librdf_list_node* node;
   
   /* need new node */
   node = LIBRDF_CALLOC(librdf_list_node*, 1, sizeof(*node));
   if(!node)
-    return 1;
+    return NULL;
   
   node->data=data;
 
@@ -176,7 +194,7 @@ librdf_list_add(librdf_list* list, void *data)
   /* node->next = NULL implicitly */
 
   list->length++;
-  return 0;
+  return node;
 }
 
 
@@ -247,6 +265,24 @@ librdf_list_remove(librdf_list* list, void *data)
     /* not found */
     return NULL;
 
+  return librdf_list_remove_node(list, node);
+}
+
+
+/*
+ * librdf_list_remove_node:
+ * @list: #librdf_list object
+ * @node: list node returned by librdf_list_add_node()
+ *
+ * INTERNAL - Remove a list node from a librdf_list without searching.
+ *
+ * Return value: the data stored in the node
+ */
+void *
+librdf_list_remove_node(librdf_list* list, librdf_list_node* node)
+{
+  void *data;
+
   librdf_list_iterators_replace_node(list, node, node->next);
   
   if(node == list->first)
@@ -70,6 +70,9 @@ struct librdf_list_s
   librdf_list_iterator_context* last_iterator;
 };
 
+librdf_list_node* librdf_list_add_node(librdf_list* list, void *data);
+void* librdf_list_remove_node(librdf_list* list, librdf_list_node* node);
+
 #ifdef __cplusplus
 }
 #endif
@@ -465,6 +465,34 @@ librdf_model_size(librdf_model* model)
 }
 
 
+/**
+ * librdf_model_count_statements:
+ * @model: #librdf_model object
+ * @predicate: #librdf_node predicate to count or NULL for any
+ * @context_node: #librdf_node context to count in or NULL for all
+ *
+ * Get the number of statements with a predicate and/or in a context.
+ *
+ * See librdf_storage_count_statements() for details.
+ *
+ * Return value: the number of statements or <0 if not possible
+ **/
+int
+librdf_model_count_statements(librdf_model* model, librdf_node* predicate,
+                              librdf_node* context_node)
+{
+  librdf_storage *storage;
+
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(model, librdf_model, -1);
+
+  storage=librdf_model_get_storage(model);
+  if(!storage)
+    return -1;
+
+  return librdf_storage_count_statements(storage, predicate, context_node);
+}
+
+
 /**
  * librdf_model_add_statement:
  * @model: model object
@@ -1930,6 +1958,12 @@ int main(int argc, char *argv[]);
 int test_model_cloning(char const *program, librdf_world *);
 int test_model(librdf_world *world, const char *program,
     const char *storage_type, const char *storage_name, const char* storage_options);
+#ifdef STORAGE_FROZEN
+int test_frozen_model(librdf_world *world, const char *program);
+#endif
+#ifdef STORAGE_FILE
+int test_file_log_model(librdf_world *world, const char *program);
+#endif
 
 int
 main(int argc, char *argv[]) 
@@ -1965,10 +1999,15 @@ main(int argc, char *argv[])
 #else
       "hashes", "test", "hash-type='memory',write='yes',new='yes',contexts='yes'",
 #endif
+      "hashes", "test2", "hash-type='memory',write='yes',new='yes',contexts='yes',indexes='spo,pos,osp',counts='yes'",
 #endif
 #ifdef STORAGE_TREES
       "trees", "test", "contexts='yes'",
 #endif
+#ifdef STORAGE_COMPACT
+      "compact", "test", NULL,
+#endif
+      /* frozen stores are written once; see test_frozen_model() */
 #ifdef STORAGE_FILE
       "file", "test.rdf", NULL,
 #endif
@@ -1993,6 +2032,14 @@ main(int argc, char *argv[])
         break;
       }
     }
+#ifdef STORAGE_FROZEN
+    if(!status && test_frozen_model(world, program))
+      status = 1;
+#endif
+#ifdef STORAGE_FILE
+    if(!status && test_file_log_model(world, program))
+      status = 1;
+#endif
   } else {
     status = test_model(world, program, storage_type, storage_name, storage_options);
   }
@@ -2003,6 +2050,234 @@ main(int argc, char *argv[])
   return status;
 }
 
+
+#ifdef STORAGE_FROZEN
+#define FROZEN_TEST_FILE "test.frozen"
+
+/*
+ * A frozen store is written when it is closed and only read after, so
+ * it is tested by freezing the statements of a memory model then
+ * opening the file again and looking for each of them.
+ */
+int
+test_frozen_model(librdf_world *world, const char *program)
+{
+  librdf_storage *storage, *frozen_storage;
+  librdf_model *model, *frozen_model;
+  librdf_parser* parser;
+  librdf_uri* base_uri;
+  librdf_statement* statement;
+  librdf_node* context_node;
+  librdf_stream* stream;
+  librdf_iterator* iterator;
+  int count=0;
+  int status=0;
+
+  storage=librdf_new_storage(world, "memory", NULL, "contexts='yes'");
+  model=librdf_new_model(world, storage, NULL);
+  base_uri=librdf_new_uri(world, (const unsigned char*)"http://example.org/test1.rdf");
+  context_node=librdf_new_node_from_uri(world, base_uri);
+  parser=librdf_new_parser(world, "rdfxml", NULL, NULL);
+  if(!parser ||
+     librdf_parser_parse_string_into_model(parser,
+                                           (const unsigned char*)EX1_CONTENT,
+                                           base_uri, model)) {
+    fprintf(stderr, "%s: Failed to parse test content\n", program);
+    return 1;
+  }
+  librdf_free_parser(parser);
+
+  statement=librdf_new_statement_from_nodes(world,
+    librdf_new_node_from_uri_string(world, (const unsigned char*)"http://example.org/"),
+    librdf_new_node_from_uri_string(world, (const unsigned char*)"http://purl.org/dc/elements/1.1/creator"),
+    librdf_new_node_from_literal(world, (const unsigned char*)"DaveX", NULL, 0));
+  librdf_model_context_add_statement(model, context_node, statement);
+  librdf_free_statement(statement);
+
+  fprintf(stderr, "%s: Freezing model to %s\n", program, FROZEN_TEST_FILE);
+  frozen_storage=librdf_new_storage(world, "frozen", FROZEN_TEST_FILE,
+                                    "new='yes'");
+  frozen_model=frozen_storage ? librdf_new_model(world, frozen_storage, NULL) : NULL;
+  if(!frozen_model) {
+    fprintf(stderr, "%s: Failed to create new frozen store\n", program);
+    return 1;
+  }
+  stream=librdf_model_as_stream(model);
+  while(!librdf_stream_end(stream)) {
+    librdf_node* node=librdf_stream_get_context2(stream);
+
+    statement=librdf_stream_get_object(stream);
+    if(node)
+      librdf_model_context_add_statement(frozen_model, node, statement);
+    else
+      librdf_model_add_statement(frozen_model, statement);
+    librdf_stream_next(stream);
+  }
+  librdf_free_stream(stream);
+  /* writes the file */
+  librdf_free_model(frozen_model);
+  librdf_free_storage(frozen_storage);
+
+  fprintf(stderr, "%s: Opening frozen store %s\n", program, FROZEN_TEST_FILE);
+  frozen_storage=librdf_new_storage(world, "frozen", FROZEN_TEST_FILE, NULL);
+  frozen_model=frozen_storage ? librdf_new_model(world, frozen_storage, NULL) : NULL;
+  if(!frozen_model) {
+    fprintf(stderr, "%s: Failed to open frozen store\n", program);
+    return 1;
+  }
+
+  if(librdf_model_size(frozen_model) != librdf_model_size(model)) {
+    fprintf(stderr, "%s: Frozen store has %d statements, expected %d\n",
+            program, librdf_model_size(frozen_model), librdf_model_size(model));
+    status=1;
+  }
+
+  stream=librdf_model_as_stream(model);
+  while(!status && !librdf_stream_end(stream)) {
+    statement=librdf_stream_get_object(stream);
+    if(!librdf_model_contains_statement(frozen_model, statement)) {
+      fprintf(stderr, "%s: Frozen store does not contain statement ", program);
+      librdf_statement_print(statement, stderr);
+      fputc('\n', stderr);
+      status=1;
+    }
+    librdf_stream_next(stream);
+  }
+  librdf_free_stream(stream);
+
+  if(!status) {
+    stream=librdf_model_context_as_stream(frozen_model, context_node);
+    while(stream && !librdf_stream_end(stream)) {
+      count++;
+      librdf_stream_next(stream);
+    }
+    if(stream)
+      librdf_free_stream(stream);
+
+    iterator=librdf_model_get_contexts(frozen_model);
+    if(count != 1 || !iterator || librdf_iterator_end(iterator)) {
+      fprintf(stderr, "%s: Frozen store has %d statements in the context, expected 1\n",
+              program, count);
+      status=1;
+    }
+    if(iterator)
+      librdf_free_iterator(iterator);
+  }
+
+  librdf_free_model(frozen_model);
+  librdf_free_storage(frozen_storage);
+  remove(FROZEN_TEST_FILE);
+
+  librdf_free_node(context_node);
+  librdf_free_uri(base_uri);
+  librdf_free_model(model);
+  librdf_free_storage(storage);
+
+  return status;
+}
+#endif
+
+#ifdef STORAGE_FILE
+#define FILE_LOG_TEST_FILE "test-log.rdf"
+#define FILE_LOG_TEST_LOG FILE_LOG_TEST_FILE ".log"
+
+/*
+ * Changes to a file store with a log are appended to the log rather
+ * than written to the file, so they must be found again when the
+ * store is next opened and the log replayed.
+ */
+int
+test_file_log_model(librdf_world *world, const char *program)
+{
+  librdf_storage *storage;
+  librdf_model *model;
+  librdf_parser* parser;
+  librdf_uri* base_uri;
+  librdf_statement *added, *removed;
+  FILE* fh;
+  int status=0;
+
+  remove(FILE_LOG_TEST_FILE);
+  remove(FILE_LOG_TEST_LOG);
+
+  added=librdf_new_statement_from_nodes(world,
+    librdf_new_node_from_uri_string(world, (const unsigned char*)"http://example.org/"),
+    librdf_new_node_from_uri_string(world, (const unsigned char*)"http://purl.org/dc/elements/1.1/creator"),
+    librdf_new_node_from_literal(world, (const unsigned char*)"DaveX", NULL, 0));
+  removed=librdf_new_statement_from_nodes(world,
+    librdf_new_node_from_uri_string(world, (const unsigned char*)"http://purl.org/net/dajobe/"),
+    librdf_new_node_from_uri_string(world, (const unsigned char*)"http://purl.org/dc/elements/1.1/creator"),
+    librdf_new_node_from_literal(world, (const unsigned char*)"Dave Beckett", NULL, 0));
+
+  fprintf(stderr, "%s: Writing logged file store %s\n", program,
+          FILE_LOG_TEST_FILE);
+  storage=librdf_new_storage(world, "file", FILE_LOG_TEST_FILE, "log='yes'");
+  model=storage ? librdf_new_model(world, storage, NULL) : NULL;
+  if(!model) {
+    fprintf(stderr, "%s: Failed to create logged file store\n", program);
+    return 1;
+  }
+
+  base_uri=librdf_new_uri(world, (const unsigned char*)"http://example.org/test1.rdf");
+  parser=librdf_new_parser(world, "rdfxml", NULL, NULL);
+  if(!parser ||
+     librdf_parser_parse_string_into_model(parser,
+                                           (const unsigned char*)EX1_CONTENT,
+                                           base_uri, model) ||
+     librdf_model_add_statement(model, added) ||
+     librdf_model_remove_statement(model, removed) ||
+     librdf_model_sync(model)) {
+    fprintf(stderr, "%s: Failed to change logged file store\n", program);
+    status=1;
+  }
+  if(parser)
+    librdf_free_parser(parser);
+  librdf_free_uri(base_uri);
+  librdf_free_model(model);
+  librdf_free_storage(storage);
+
+  /* the log holds the changes; too few to have been compacted */
+  fh=fopen(FILE_LOG_TEST_LOG, "rb");
+  if(!fh) {
+    fprintf(stderr, "%s: File store log %s was not written\n", program,
+            FILE_LOG_TEST_LOG);
+    status=1;
+  } else
+    fclose(fh);
+
+  fprintf(stderr, "%s: Replaying logged file store %s\n", program,
+          FILE_LOG_TEST_FILE);
+  storage=librdf_new_storage(world, "file", FILE_LOG_TEST_FILE, "log='yes'");
+  model=storage ? librdf_new_model(world, storage, NULL) : NULL;
+  if(!model) {
+    fprintf(stderr, "%s: Failed to open logged file store\n", program);
+    status=1;
+  } else {
+    if(librdf_model_size(model) != 3) {
+      fprintf(stderr, "%s: Logged file store has %d statements, expected 3\n",
+              program, librdf_model_size(model));
+      status=1;
+    }
+    if(!librdf_model_contains_statement(model, added) ||
+       librdf_model_contains_statement(model, removed)) {
+      fprintf(stderr, "%s: Logged file store changes were not replayed\n",
+              program);
+      status=1;
+    }
+    librdf_free_model(model);
+  }
+  if(storage)
+    librdf_free_storage(storage);
+
+  librdf_free_statement(added);
+  librdf_free_statement(removed);
+  remove(FILE_LOG_TEST_FILE);
+  remove(FILE_LOG_TEST_LOG);
+
+  return status;
+}
+#endif
+
 int
 test_model(librdf_world *world, const char *program,
     const char *storage_type, const char *storage_name, const char *storage_options)
@@ -2164,6 +2439,29 @@ test_model(librdf_world *world, const char *program,
     status=1;
   }
 
+  /* plus the first statement with the same predicate */
+  count=librdf_model_count_statements(model, n2, NULL);
+  expected_count=TEST_SIMILAR_COUNT - 3 + 1;
+  if(count != expected_count) {
+    fprintf(stderr, "%s: model has %d statements with predicate, expected %d\n", program, count, expected_count);
+    status=1;
+  }
+
+  /* arcs point from the subject and to the object only */
+  literal[4]='1';
+  literal_node=librdf_new_node_from_literal(world, (const unsigned char*)literal, NULL, 0);
+  if(!librdf_model_has_arc_out(model, n1, n2) ||
+     librdf_model_has_arc_in(model, n1, n2)) {
+    fprintf(stderr, "%s: librdf_model_has_arc_out/in gave the wrong answer for the subject\n", program);
+    status=1;
+  }
+  if(!librdf_model_has_arc_in(model, literal_node, n2) ||
+     librdf_model_has_arc_out(model, literal_node, n2)) {
+    fprintf(stderr, "%s: librdf_model_has_arc_in/out gave the wrong answer for the object '%s'\n", program, literal);
+    status=1;
+  }
+  librdf_free_node(literal_node);
+
   librdf_free_node(n1);
   librdf_free_node(n2);
 
@@ -66,6 +66,8 @@ void librdf_free_model(librdf_model *model);
 /* functions / methods */
 REDLAND_API
 int librdf_model_size(librdf_model* model);
+REDLAND_API
+int librdf_model_count_statements(librdf_model* model, librdf_node* predicate, librdf_node* context_node);
 
 /* add statements */
 REDLAND_API
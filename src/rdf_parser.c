@@ -39,6 +39,15 @@
 
 #include <redland.h>
 
+#ifdef STANDALONE
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#endif
+
 
 #ifndef STANDALONE
 
@@ -53,6 +62,7 @@ void
 librdf_init_parser(librdf_world *world)
 {
   librdf_parser_raptor_constructor(world);
+  librdf_parser_binary_constructor(world);
 }
 
 
@@ -690,6 +700,50 @@ librdf_parser_parse_file_handle_into_model(librdf_parser* parser, FILE *fh,
 }
 
 
+/**
+ * librdf_parser_parse_file_handle_into_model_parallel:
+ * @parser: the parser
+ * @fh: FILE* to read content source
+ * @close_fh: non-0 to fclose() the file handle on finishing
+ * @base_uri: the base URI to use (or NULL)
+ * @model: the model to write to
+ * @threads: number of parsing threads
+ *
+ * Parse a FILE* handle of content into an #librdf_model using threads.
+ *
+ * For line-based syntaxes (N-Triples and N-Quads) the content is
+ * split at line boundaries and the pieces parsed by @threads worker
+ * threads while the calling thread adds the statements to @model in
+ * batches.  Statements are not added in document order.
+ *
+ * Other syntaxes, @threads less than 2 or a library built without
+ * thread support parse as librdf_parser_parse_file_handle_into_model().
+ *
+ * Return value: non 0 on failure
+ **/
+int
+librdf_parser_parse_file_handle_into_model_parallel(librdf_parser* parser,
+                                                    FILE *fh, int close_fh,
+                                                    librdf_uri* base_uri,
+                                                    librdf_model* model,
+                                                    int threads)
+{
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(parser, librdf_parser, 1);
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(fh, FILE, 1);
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(model, librdf_model, 1);
+
+  if(threads > 1 && parser->factory->parse_file_handle_into_model_parallel)
+    return parser->factory->parse_file_handle_into_model_parallel(parser->context,
+                                                                  fh, close_fh,
+                                                                  base_uri,
+                                                                  model,
+                                                                  threads);
+
+  return librdf_parser_parse_file_handle_into_model(parser, fh, close_fh,
+                                                    base_uri, model);
+}
+
+
 /**
  * librdf_parser_parse_iostream_as_stream:
  * @parser: the parser
@@ -1048,6 +1102,358 @@ static const unsigned char *file_content[URI_STRING_COUNT] = {
   (const unsigned char*)TURTLE_CONTENT
 };
 
+/*
+ * test_parallel_bnodes - check separate parallel parses of the same
+ * blank node ID give different nodes
+ *
+ * Return value: number of failures
+ */
+static int
+test_parallel_bnodes(librdf_world* world, const char* program,
+                     librdf_uri* base_uri)
+{
+  static const char* const bnode_content[2] = {
+    "_:a <http://example.org/p> \"one\" .\n",
+    "_:a <http://example.org/p> \"two\" .\n"
+  };
+  librdf_storage* storage;
+  librdf_model *model = NULL;
+  librdf_parser* parser;
+  librdf_statement* partial = NULL;
+  librdf_node* subjects[2] = {NULL, NULL};
+  librdf_stream* stream;
+  FILE* fh;
+  int count = 0;
+  int failures = 0;
+  int i;
+
+  fprintf(stderr, "%s: Testing blank nodes in separate parallel parses\n",
+          program);
+
+  storage = librdf_new_storage(world, NULL, NULL, NULL);
+  if(storage)
+    model = librdf_new_model(world, storage, NULL);
+  parser = librdf_new_parser(world, "ntriples", NULL, NULL);
+  if(model)
+    partial = librdf_new_statement_from_nodes(world, NULL,
+                librdf_new_node_from_uri_string(world, (const unsigned char*)"http://example.org/p"),
+                NULL);
+  if(!model || !parser || !partial) {
+    fprintf(stderr, "%s: Failed to create blank node test objects\n",
+            program);
+    failures++;
+    goto tidy;
+  }
+
+  for(i = 0; i < 2; i++) {
+    fh = tmpfile();
+    if(!fh) {
+      failures++;
+      goto tidy;
+    }
+    fputs(bnode_content[i], fh);
+    rewind(fh);
+    if(librdf_parser_parse_file_handle_into_model_parallel(parser, fh, 1,
+                                                           base_uri, model,
+                                                           2)) {
+      fprintf(stderr, "%s: Failed to parse blank node content %d\n",
+              program, i);
+      failures++;
+      goto tidy;
+    }
+  }
+
+  stream = librdf_model_find_statements(model, partial);
+  for(; stream && !librdf_stream_end(stream); librdf_stream_next(stream)) {
+    librdf_statement* statement = librdf_stream_get_object(stream);
+    if(count < 2)
+      subjects[count] = librdf_new_node_from_node(librdf_statement_get_subject(statement));
+    count++;
+  }
+  if(stream)
+    librdf_free_stream(stream);
+
+  if(count != 2 || !subjects[0] || !subjects[1] ||
+     librdf_node_equals(subjects[0], subjects[1])) {
+    fprintf(stderr, "%s: Blank nodes from separate parses were merged (%d statements)\n",
+            program, count);
+    failures++;
+  }
+
+  tidy:
+  if(subjects[0])
+    librdf_free_node(subjects[0]);
+  if(subjects[1])
+    librdf_free_node(subjects[1]);
+  if(partial)
+    librdf_free_statement(partial);
+  if(parser)
+    librdf_free_parser(parser);
+  if(model)
+    librdf_free_model(model);
+  if(storage)
+    librdf_free_storage(storage);
+
+  return failures;
+}
+
+
+/* More statements than fit in the parallel parse batch queue of
+ * 2 threads, so workers wait for the model to take batches */
+#define PARALLEL_BATCHES_COUNT 20000
+
+/*
+ * test_parallel_batches - check a parallel parse that produces more
+ * batches than its queue holds adds every statement
+ *
+ * Return value: number of failures
+ */
+static int
+test_parallel_batches(librdf_world* world, const char* program,
+                      librdf_uri* base_uri)
+{
+  librdf_storage* storage;
+  librdf_model *model = NULL;
+  librdf_parser* parser;
+  FILE* fh;
+  int size;
+  int failures = 0;
+  int i;
+
+  fprintf(stderr, "%s: Testing parallel parse of %d statements\n",
+          program, PARALLEL_BATCHES_COUNT);
+
+  storage = librdf_new_storage(world, NULL, NULL, NULL);
+  if(storage)
+    model = librdf_new_model(world, storage, NULL);
+  parser = librdf_new_parser(world, "ntriples", NULL, NULL);
+  fh = tmpfile();
+  if(!model || !parser || !fh) {
+    fprintf(stderr, "%s: Failed to create parallel parse test objects\n",
+            program);
+    if(fh)
+      fclose(fh);
+    failures++;
+    goto tidy;
+  }
+
+  for(i = 0; i < PARALLEL_BATCHES_COUNT; i++)
+    fprintf(fh, "<http://example.org/s%d> <http://example.org/p> \"%d\" .\n",
+            i, i);
+  rewind(fh);
+
+  if(librdf_parser_parse_file_handle_into_model_parallel(parser, fh, 1,
+                                                         base_uri, model,
+                                                         2)) {
+    fprintf(stderr, "%s: Failed to parse content in parallel\n", program);
+    failures++;
+    goto tidy;
+  }
+
+  size = librdf_model_size(model);
+  if(size != PARALLEL_BATCHES_COUNT) {
+    fprintf(stderr, "%s: Parallel parse returned %d triples, not %d as expected\n",
+            program, size, PARALLEL_BATCHES_COUNT);
+    failures++;
+  }
+
+  tidy:
+  if(parser)
+    librdf_free_parser(parser);
+  if(model)
+    librdf_free_model(model);
+  if(storage)
+    librdf_free_storage(storage);
+
+  return failures;
+}
+
+
+/*
+ * test_batch_size_feature - check the batch size feature only takes
+ * positive integers
+ *
+ * Return value: number of failures
+ */
+static int
+test_batch_size_feature(librdf_world* world, const char* program)
+{
+  static const char* const bad_values[4] = { "abc", "0", "-5", "10x" };
+  librdf_parser* parser;
+  librdf_uri* feature;
+  librdf_node* value;
+  int failures = 0;
+  int i;
+
+  fprintf(stderr, "%s: Testing parser batch size feature\n", program);
+
+  parser = librdf_new_parser(world, "ntriples", NULL, NULL);
+  feature = librdf_new_uri(world, (const unsigned char*)LIBRDF_PARSER_FEATURE_BATCH_SIZE);
+  if(!parser || !feature) {
+    failures++;
+    goto tidy;
+  }
+
+  for(i = 0; i < 4; i++) {
+    value = librdf_new_node_from_literal(world,
+                                         (const unsigned char*)bad_values[i],
+                                         NULL, 0);
+    if(!librdf_parser_set_feature(parser, feature, value)) {
+      fprintf(stderr, "%s: Batch size '%s' was accepted\n", program,
+              bad_values[i]);
+      failures++;
+    }
+    librdf_free_node(value);
+  }
+
+  value = librdf_new_node_from_literal(world, (const unsigned char*)"10",
+                                       NULL, 0);
+  if(librdf_parser_set_feature(parser, feature, value)) {
+    fprintf(stderr, "%s: Batch size '10' was rejected\n", program);
+    failures++;
+  }
+  librdf_free_node(value);
+
+  value = librdf_parser_get_feature(parser, feature);
+  if(!value ||
+     strcmp((const char*)librdf_node_get_literal_value(value), "10")) {
+    fprintf(stderr, "%s: Batch size was not set to 10\n", program);
+    failures++;
+  }
+  if(value)
+    librdf_free_node(value);
+
+  tidy:
+  if(feature)
+    librdf_free_uri(feature);
+  if(parser)
+    librdf_free_parser(parser);
+
+  return failures;
+}
+
+
+#if defined(HAVE_ZLIB) || defined(HAVE_ZSTD)
+/* Decompressed content filling the parser's 64K input buffer exactly
+ * twice, in lines of 64 bytes */
+#define COMPRESSED_CONTENT_LENGTH (2 * 64 * 1024)
+#define COMPRESSED_LINES_COUNT (COMPRESSED_CONTENT_LENGTH / 64)
+#define COMPRESSED_TEST_FILE "test-compressed.nt"
+
+/*
+ * test_compressed_input - check compressed files whose content is an
+ * exact multiple of the decompression buffer size are read fully
+ *
+ * Return value: number of failures
+ */
+static int
+test_compressed_input(librdf_world* world, const char* program,
+                      librdf_uri* base_uri)
+{
+  static const char* const formats[3] = { "gzip", "zstd", NULL };
+  char* content;
+  size_t length = 0;
+  int failures = 0;
+  int i;
+
+  content = (char*)malloc(COMPRESSED_CONTENT_LENGTH + 1);
+  if(!content)
+    return 1;
+  for(i = 0; i < COMPRESSED_LINES_COUNT; i++)
+    length += (size_t)sprintf(content + length,
+                              "<http://example.org/s%05d> <http://example.org/p> \"abcdefgh\" .\n",
+                              i);
+  if(length != COMPRESSED_CONTENT_LENGTH) {
+    fprintf(stderr, "%s: Compressed test content is %d bytes, not %d\n",
+            program, (int)length, COMPRESSED_CONTENT_LENGTH);
+    free(content);
+    return 1;
+  }
+
+  for(i = 0; formats[i]; i++) {
+    librdf_storage* storage;
+    librdf_model *model = NULL;
+    librdf_parser* parser;
+    FILE* fh = NULL;
+    int written = 0;
+    int size;
+
+    if(!strcmp(formats[i], "gzip")) {
+#ifdef HAVE_ZLIB
+      gzFile gz = gzopen(COMPRESSED_TEST_FILE, "wb9");
+      if(gz) {
+        written = (gzwrite(gz, content, (unsigned)length) == (int)length);
+        if(gzclose(gz) != Z_OK)
+          written = 0;
+      }
+#else
+      continue;
+#endif
+    } else {
+#ifdef HAVE_ZSTD
+      size_t bound = ZSTD_compressBound(length);
+      void* compressed = malloc(bound);
+      if(compressed) {
+        size_t csize = ZSTD_compress(compressed, bound, content, length, 19);
+        fh = fopen(COMPRESSED_TEST_FILE, "wb");
+        if(fh) {
+          written = (!ZSTD_isError(csize) &&
+                     fwrite(compressed, 1, csize, fh) == csize);
+          if(fclose(fh))
+            written = 0;
+          fh = NULL;
+        }
+        free(compressed);
+      }
+#else
+      continue;
+#endif
+    }
+
+    fprintf(stderr, "%s: Testing %s input of %d bytes\n", program,
+            formats[i], COMPRESSED_CONTENT_LENGTH);
+
+    storage = librdf_new_storage(world, NULL, NULL, NULL);
+    if(storage)
+      model = librdf_new_model(world, storage, NULL);
+    parser = librdf_new_parser(world, "ntriples", NULL, NULL);
+    if(written)
+      fh = fopen(COMPRESSED_TEST_FILE, "rb");
+    if(!model || !parser || !fh) {
+      fprintf(stderr, "%s: Failed to create %s test objects\n", program,
+              formats[i]);
+      if(fh)
+        fclose(fh);
+      failures++;
+    } else if(librdf_parser_parse_file_handle_into_model(parser, fh, 1,
+                                                         base_uri, model)) {
+      fprintf(stderr, "%s: Failed to parse %s input\n", program, formats[i]);
+      failures++;
+    } else {
+      size = librdf_model_size(model);
+      if(size != COMPRESSED_LINES_COUNT) {
+        fprintf(stderr, "%s: %s input gave %d triples, not %d as expected\n",
+                program, formats[i], size, COMPRESSED_LINES_COUNT);
+        failures++;
+      }
+    }
+
+    if(parser)
+      librdf_free_parser(parser);
+    if(model)
+      librdf_free_model(model);
+    if(storage)
+      librdf_free_storage(storage);
+    remove(COMPRESSED_TEST_FILE);
+  }
+
+  free(content);
+
+  return failures;
+}
+#endif
+
+
 int
 main(int argc, char *argv[])
 {
@@ -1292,6 +1698,14 @@ main(int argc, char *argv[])
   }
 
 
+  failures += test_parallel_bnodes(world, program, uris[1]);
+  failures += test_parallel_batches(world, program, uris[1]);
+  failures += test_batch_size_feature(world, program);
+#if defined(HAVE_ZLIB) || defined(HAVE_ZSTD)
+  failures += test_compressed_input(world, program, uris[1]);
+#endif
+
+
   fprintf(stderr, "%s: Freeing URIs\n", program);
   for (testi = 0; testi < URI_STRING_COUNT; testi++) {
     librdf_free_uri(uris[testi]);
@@ -74,6 +74,8 @@ REDLAND_API
 librdf_stream* librdf_parser_parse_file_handle_as_stream(librdf_parser* parser, FILE* fh, int close_fh, librdf_uri* base_uri);
 REDLAND_API
 int librdf_parser_parse_file_handle_into_model(librdf_parser* parser, FILE *fh, int close_fh, librdf_uri* base_uri, librdf_model* model);
+REDLAND_API
+int librdf_parser_parse_file_handle_into_model_parallel(librdf_parser* parser, FILE *fh, int close_fh, librdf_uri* base_uri, librdf_model* model, int threads);
 REDLAND_API REDLAND_DEPRECATED
 void librdf_parser_set_error(librdf_parser* parser, void *user_data, void (*error_fn)(void *user_data, const char *msg, ...));
 REDLAND_API REDLAND_DEPRECATED
@@ -101,6 +103,16 @@ librdf_uri_filter_func librdf_parser_get_uri_filter(librdf_parser* parser, void*
  */
 #define LIBRDF_PARSER_FEATURE_WARNING_COUNT "http://feature.librdf.org/parser-warning-count"
 
+/**
+ * LIBRDF_PARSER_FEATURE_BATCH_SIZE:
+ *
+ * Parser feature URI string for the number of statements handed to
+ * the model in each add_statements call when parsing into a model.
+ * The value must be a positive integer; 1 adds statements one at a
+ * time.
+ */
+#define LIBRDF_PARSER_FEATURE_BATCH_SIZE "http://feature.librdf.org/parser-batch-size"
+
 REDLAND_API
 librdf_node* librdf_parser_get_feature(librdf_parser* parser, librdf_uri *feature);
 REDLAND_API
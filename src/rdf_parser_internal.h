@@ -77,6 +77,8 @@ struct librdf_parser_factory_s
   int (*get_namespaces_seen_count)(void* context);
   int (*parse_file_handle_into_model)(void *_context, FILE *fh, int close_fh, librdf_uri* base_uri, librdf_model *model);
   librdf_stream* (*parse_file_handle_as_stream)(void *_context, FILE *fh, int close_fh, librdf_uri *base_uri);
+  /* parse with worker threads - optional */
+  int (*parse_file_handle_into_model_parallel)(void *_context, FILE *fh, int close_fh, librdf_uri* base_uri, librdf_model *model, int threads);
 };
 
 
@@ -103,6 +105,9 @@ void librdf_finish_parser(librdf_world *world);
 void librdf_parser_raptor_constructor(librdf_world* world);
 void librdf_parser_raptor_destructor(void);
 
+/* rdf_binary.c */
+void librdf_parser_binary_constructor(librdf_world* world);
+
 
 #ifdef __cplusplus
 }
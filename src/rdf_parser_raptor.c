@@ -33,12 +33,29 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
 #ifdef HAVE_STDLIB_H
 #include <stdlib.h>
 #endif
 #ifdef HAVE_ERRNO_H
 #include <errno.h>
 #endif
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#define LIBRDF_PARSER_RAPTOR_USE_MMAP 1
+#endif
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef WITH_THREADS
+#include <pthread.h>
+#endif
 
 #include <redland.h>
 
@@ -49,6 +66,9 @@ static int librdf_parser_raptor_serialise_next_statement(void* context);
 static void* librdf_parser_raptor_serialise_get_statement(void* context, int flags);
 static void librdf_parser_raptor_serialise_finished(void* context);
 
+/* Default number of statements added to a model per add_statements call */
+#define LIBRDF_PARSER_RAPTOR_BATCH_SIZE 1000
+
 
 typedef struct {
   librdf_parser *parser;        /* librdf parser object */
@@ -61,11 +81,56 @@ typedef struct {
   int errors;
   int warnings;
 
+  /* statements added to a model per add_statements call; 1 or less
+   * adds them one at a time */
+  int batch_size;
+
   raptor_www *www;              /* raptor stream */
   void *stream_context;         /* librdf_parser_raptor_stream_context* */
 } librdf_parser_raptor_context;
 
 
+typedef enum {
+  LIBRDF_PARSER_RAPTOR_INPUT_PLAIN,
+  LIBRDF_PARSER_RAPTOR_INPUT_GZIP,
+  LIBRDF_PARSER_RAPTOR_INPUT_ZSTD
+} librdf_parser_raptor_input_type;
+
+
+/* Bytes read from a file, mapped into memory where possible and
+ * decompressed if the content starts with a gzip or zstd header */
+typedef struct {
+  librdf_world* world;
+  FILE *fh;
+
+  /* file mapped into memory or NULL */
+  unsigned char *map;
+  size_t map_length;
+  size_t map_offset;
+
+  /* bytes read from fh; buffer_pending is set if not yet returned */
+  unsigned char *buffer;
+  size_t buffer_length;
+  int buffer_pending;
+
+  librdf_parser_raptor_input_type type;
+  /* decompressed bytes */
+  unsigned char *out;
+  /* set when all compressed bytes have been read */
+  int raw_end;
+  /* set when all decompressed bytes have been returned */
+  int end;
+#ifdef HAVE_ZLIB
+  z_stream zstream;
+#endif
+#ifdef HAVE_ZSTD
+  ZSTD_DStream *zstd;
+  ZSTD_inBuffer zstd_in;
+  size_t zstd_hint;             /* 0 at the end of a frame */
+#endif
+} librdf_parser_raptor_input;
+
+
 typedef struct {
   librdf_parser_raptor_context* pcontext; /* parser context */
 
@@ -73,6 +138,7 @@ typedef struct {
   FILE *fh;
   /* when true, this FH is closed on finish */
   int close_fh;
+  librdf_parser_raptor_input input;
 
   /* when finished */
   int finished;
@@ -81,12 +147,27 @@ typedef struct {
   librdf_model *model;
 
   /* The set of statements pending is a sequence, with 'current'
-   * as the first entry and any remaining ones held in 'statements'.
+   * as the first entry and any remaining ones held in the ring
+   * 'queue' of queue_size entries starting at queue_start.
    * The latter are filled by the parser
-   * sequence is empty := current=NULL and librdf_list_size(statements)=0
+   * sequence is empty := current=NULL and queue_count=0
+   *
+   * When parsing from a file the parser is only given more input
+   * once the queue is empty so the queue stays small.
    */
   librdf_statement* current; /* current statement */
-  librdf_list* statements;
+  librdf_statement** queue;
+  int queue_size;
+  int queue_start;
+  int queue_count;
+
+  /* when storing into a model in batches: statements waiting to be
+   * added, all in context batch_context (or none if NULL) */
+  librdf_statement** batch;
+  int batch_count;
+  librdf_node* batch_context;
+  /* non 0 if adding a batch failed */
+  int batch_failed;
 } librdf_parser_raptor_stream_context;
 
 
@@ -128,6 +209,8 @@ librdf_parser_raptor_init(librdf_parser *parser, void *context)
 
   librdf_raptor_reset_bnode_hash(parser->world);
 
+  pcontext->batch_size = LIBRDF_PARSER_RAPTOR_BATCH_SIZE;
+
   return 0;
 }
 
@@ -162,6 +245,216 @@ librdf_parser_raptor_terminate(void *context)
 }
 
 
+/* Initial number of entries in the queue of parsed statements */
+#define LIBRDF_PARSER_RAPTOR_QUEUE_SIZE 64
+
+
+/*
+ * librdf_parser_raptor_queue_add - Add a statement to the end of the queue of parsed statements
+ * @scontext: stream context
+ * @statement: statement (ownership taken on success)
+ *
+ * The queue only grows when one piece of input gives more statements
+ * than it holds.
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_parser_raptor_queue_add(librdf_parser_raptor_stream_context* scontext,
+                               librdf_statement* statement)
+{
+  if(scontext->queue_count == scontext->queue_size) {
+    librdf_statement** new_queue;
+    int new_size;
+    int i;
+
+    new_size = scontext->queue_size ? scontext->queue_size * 2 :
+                                      LIBRDF_PARSER_RAPTOR_QUEUE_SIZE;
+    new_queue = LIBRDF_MALLOC(librdf_statement**,
+                              LIBRDF_GOOD_CAST(size_t, new_size) * sizeof(librdf_statement*));
+    if(!new_queue)
+      return 1;
+
+    for(i=0; i < scontext->queue_count; i++)
+      new_queue[i]=scontext->queue[(scontext->queue_start + i) % scontext->queue_size];
+
+    if(scontext->queue)
+      LIBRDF_FREE(librdf_statement**, scontext->queue);
+    scontext->queue=new_queue;
+    scontext->queue_size=new_size;
+    scontext->queue_start=0;
+  }
+
+  scontext->queue[(scontext->queue_start + scontext->queue_count) % scontext->queue_size]=statement;
+  scontext->queue_count++;
+
+  return 0;
+}
+
+
+/*
+ * librdf_parser_raptor_queue_remove - Remove the statement at the start of the queue of parsed statements
+ * @scontext: stream context
+ *
+ * Return value: statement or NULL if the queue is empty
+ */
+static librdf_statement*
+librdf_parser_raptor_queue_remove(librdf_parser_raptor_stream_context* scontext)
+{
+  librdf_statement* statement;
+
+  if(!scontext->queue_count)
+    return NULL;
+
+  statement=scontext->queue[scontext->queue_start];
+  scontext->queue_start=(scontext->queue_start + 1) % scontext->queue_size;
+  scontext->queue_count--;
+
+  return statement;
+}
+
+
+/* Stream over an array of statements for handing to add_statements */
+typedef struct {
+  librdf_statement **statements;
+  int count;
+  int offset;
+} librdf_parser_raptor_batch_stream_context;
+
+
+static int
+librdf_parser_raptor_batch_stream_end_of_stream(void* context)
+{
+  librdf_parser_raptor_batch_stream_context* bcontext=(librdf_parser_raptor_batch_stream_context*)context;
+
+  return bcontext->offset >= bcontext->count;
+}
+
+
+static int
+librdf_parser_raptor_batch_stream_next_statement(void* context)
+{
+  librdf_parser_raptor_batch_stream_context* bcontext=(librdf_parser_raptor_batch_stream_context*)context;
+
+  bcontext->offset++;
+  return bcontext->offset >= bcontext->count;
+}
+
+
+static void*
+librdf_parser_raptor_batch_stream_get_statement(void* context, int flags)
+{
+  librdf_parser_raptor_batch_stream_context* bcontext=(librdf_parser_raptor_batch_stream_context*)context;
+
+  switch(flags) {
+    case LIBRDF_ITERATOR_GET_METHOD_GET_OBJECT:
+      return bcontext->statements[bcontext->offset];
+
+    case LIBRDF_ITERATOR_GET_METHOD_GET_CONTEXT:
+    default:
+      return NULL;
+  }
+}
+
+
+static void
+librdf_parser_raptor_batch_stream_finished(void* context)
+{
+  librdf_parser_raptor_batch_stream_context* bcontext=(librdf_parser_raptor_batch_stream_context*)context;
+
+  LIBRDF_FREE(librdf_parser_raptor_batch_stream_context, bcontext);
+}
+
+
+/*
+ * librdf_parser_raptor_add_batch - Add an array of statements to a model in one call
+ * @model: model
+ * @context_node: context to add to or NULL
+ * @statements: array of statements (still owned by caller)
+ * @count: number of statements
+ *
+ * The batch is added inside a transaction when the model supports
+ * them and the caller does not already have one open.
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_parser_raptor_add_batch(librdf_model* model, librdf_node* context_node,
+                               librdf_statement** statements, int count)
+{
+  librdf_parser_raptor_batch_stream_context* bcontext;
+  librdf_stream* stream;
+  int in_transaction=0;
+  int rc;
+
+  if(!count)
+    return 0;
+
+  bcontext = LIBRDF_CALLOC(librdf_parser_raptor_batch_stream_context*, 1,
+                           sizeof(*bcontext));
+  if(!bcontext)
+    return 1;
+  bcontext->statements=statements;
+  bcontext->count=count;
+
+  stream=librdf_new_stream(model->world, (void*)bcontext,
+                           &librdf_parser_raptor_batch_stream_end_of_stream,
+                           &librdf_parser_raptor_batch_stream_next_statement,
+                           &librdf_parser_raptor_batch_stream_get_statement,
+                           &librdf_parser_raptor_batch_stream_finished);
+  if(!stream) {
+    librdf_parser_raptor_batch_stream_finished((void*)bcontext);
+    return 1;
+  }
+
+  if(!librdf_model_transaction_get_handle(model))
+    in_transaction=!librdf_model_transaction_start(model);
+
+  if(context_node)
+    rc=librdf_model_context_add_statements(model, context_node, stream);
+  else
+    rc=librdf_model_add_statements(model, stream);
+
+  librdf_free_stream(stream);
+
+  if(in_transaction) {
+    if(rc)
+      librdf_model_transaction_rollback(model);
+    else
+      rc=librdf_model_transaction_commit(model);
+  }
+
+  return rc;
+}
+
+
+/*
+ * librdf_parser_raptor_flush_batch - Add the pending batch of statements to the model
+ * @scontext: stream context
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_parser_raptor_flush_batch(librdf_parser_raptor_stream_context* scontext)
+{
+  int rc;
+
+  rc=librdf_parser_raptor_add_batch(scontext->model, scontext->batch_context,
+                                    scontext->batch, scontext->batch_count);
+  if(rc)
+    scontext->batch_failed=1;
+
+  while(scontext->batch_count)
+    librdf_free_statement(scontext->batch[--scontext->batch_count]);
+  if(scontext->batch_context) {
+    librdf_free_node(scontext->batch_context);
+    scontext->batch_context=NULL;
+  }
+
+  return rc;
+}
+
+
 /*
  * librdf_parser_raptor_new_statement_handler - helper callback function for raptor RDF when a new triple is asserted
  * @context: context for callback
@@ -266,19 +559,43 @@ librdf_parser_raptor_new_statement_handler(void *context,
 #endif
 
   if(scontext->model) {
-    if(librdf_model_supports_contexts(scontext->model) &&
-       rstatement->graph &&
-       (rstatement->graph->type == RAPTOR_TERM_TYPE_URI ||
-        rstatement->graph->type == RAPTOR_TERM_TYPE_BLANK)) {
-      node = librdf_new_node_from_uri(world, (librdf_uri*)rstatement->graph->value.uri);
+    node=NULL;
+    if(librdf_model_supports_contexts(scontext->model) && rstatement->graph) {
+      if(rstatement->graph->type == RAPTOR_TERM_TYPE_URI)
+        node = librdf_new_node_from_uri(world, (librdf_uri*)rstatement->graph->value.uri);
+      else if(rstatement->graph->type == RAPTOR_TERM_TYPE_BLANK)
+        node = librdf_new_node_from_blank_identifier(world, rstatement->graph->value.blank.string);
+    }
+
+    if(scontext->batch) {
+      rc=0;
+      /* Add the pending batch when the context changes */
+      if(scontext->batch_count &&
+         !((!node && !scontext->batch_context) ||
+           (node && scontext->batch_context &&
+            librdf_node_equals(node, scontext->batch_context))))
+        rc=librdf_parser_raptor_flush_batch(scontext);
+
+      if(!scontext->batch_count) {
+        scontext->batch_context=node;
+        node=NULL;
+      }
+      scontext->batch[scontext->batch_count++]=statement;
+      statement=NULL;
+
+      if(scontext->batch_count == scontext->pcontext->batch_size)
+        rc=librdf_parser_raptor_flush_batch(scontext) || rc;
+    } else if(node)
       rc = librdf_model_context_add_statement(scontext->model, node, statement);
-      librdf_free_node(node);
-    } else {
+    else
       rc = librdf_model_add_statement(scontext->model, statement);
-    }
-    librdf_free_statement(statement);
+
+    if(node)
+      librdf_free_node(node);
+    if(statement)
+      librdf_free_statement(statement);
   } else {
-    rc=librdf_list_add(scontext->statements, statement);
+    rc=librdf_parser_raptor_queue_add(scontext, statement);
     if(rc)
       librdf_free_statement(statement);
   }
@@ -334,8 +651,366 @@ librdf_parser_raptor_namespace_handler(void* user_data,
 }
 
 
-/* FIXME: Yeah?  What about it? */
-#define RAPTOR_IO_BUFFER_LEN 1024
+/* Size of each piece of input given to the parser */
+#define LIBRDF_PARSER_RAPTOR_INPUT_LEN (64 * 1024)
+
+
+/*
+ * librdf_parser_raptor_input_read_raw - Get the next piece of file content
+ * @input: input
+ * @data_p: pointer to store the bytes
+ * @length_p: pointer to store the length; 0 at end of file
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_parser_raptor_input_read_raw(librdf_parser_raptor_input* input,
+                                    const unsigned char** data_p,
+                                    size_t* length_p)
+{
+  size_t length;
+
+  if(input->map) {
+    length = input->map_length - input->map_offset;
+    if(length > LIBRDF_PARSER_RAPTOR_INPUT_LEN)
+      length = LIBRDF_PARSER_RAPTOR_INPUT_LEN;
+    *data_p = input->map + input->map_offset;
+    *length_p = length;
+    input->map_offset += length;
+    return 0;
+  }
+
+  if(!input->buffer_pending) {
+    if(!input->buffer) {
+      input->buffer = LIBRDF_MALLOC(unsigned char*,
+                                    LIBRDF_PARSER_RAPTOR_INPUT_LEN);
+      if(!input->buffer)
+        return 1;
+    }
+    input->buffer_length = fread(input->buffer, 1,
+                                 LIBRDF_PARSER_RAPTOR_INPUT_LEN, input->fh);
+    if(!input->buffer_length && ferror(input->fh)) {
+      librdf_log(input->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_PARSER, NULL,
+                 "Failed to read input - %s", strerror(errno));
+      return 1;
+    }
+  }
+  input->buffer_pending = 0;
+
+  *data_p = input->buffer;
+  *length_p = input->buffer_length;
+  return 0;
+}
+
+
+/*
+ * librdf_parser_raptor_input_init - Start reading a file
+ * @input: input (zeroed)
+ * @world: world
+ * @fh: file handle
+ * @map_fh: non 0 to allow mapping @fh into memory
+ *
+ * A mapped handle is not moved from its current position.
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_parser_raptor_input_init(librdf_parser_raptor_input* input,
+                                librdf_world* world, FILE* fh, int map_fh)
+{
+  const unsigned char* data;
+  size_t length;
+
+  input->world = world;
+  input->fh = fh;
+
+#ifdef LIBRDF_PARSER_RAPTOR_USE_MMAP
+  if(map_fh) {
+    struct stat st;
+    long offset = ftell(fh);
+
+    if(offset >= 0 && !fstat(fileno(fh), &st) && S_ISREG(st.st_mode) &&
+       st.st_size > offset) {
+      void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE,
+                       fileno(fh), 0);
+      if(map != MAP_FAILED) {
+#ifdef HAVE_MADVISE
+        madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+#endif
+        input->map = (unsigned char*)map;
+        input->map_length = (size_t)st.st_size;
+        input->map_offset = (size_t)offset;
+      }
+    }
+  }
+#endif
+
+  /* Look at the start of the content for a compression header */
+  if(input->map) {
+    data = input->map + input->map_offset;
+    length = input->map_length - input->map_offset;
+  } else {
+    if(librdf_parser_raptor_input_read_raw(input, &data, &length))
+      return 1;
+    input->buffer_pending = 1;
+  }
+
+  if(length >= 2 && data[0] == 0x1f && data[1] == 0x8b) {
+#ifdef HAVE_ZLIB
+    /* 15 + 32: maximum window and detect a gzip or zlib header */
+    if(inflateInit2(&input->zstream, 15 + 32) != Z_OK)
+      return 1;
+    input->type = LIBRDF_PARSER_RAPTOR_INPUT_GZIP;
+#else
+    librdf_log(world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_PARSER, NULL,
+               "Cannot read gzip compressed input without zlib support");
+    return 1;
+#endif
+  } else if(length >= 4 && data[0] == 0x28 && data[1] == 0xb5 &&
+            data[2] == 0x2f && data[3] == 0xfd) {
+#ifdef HAVE_ZSTD
+    input->zstd = ZSTD_createDStream();
+    if(!input->zstd || ZSTD_isError(ZSTD_initDStream(input->zstd)))
+      return 1;
+    input->type = LIBRDF_PARSER_RAPTOR_INPUT_ZSTD;
+#else
+    librdf_log(world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_PARSER, NULL,
+               "Cannot read zstd compressed input without zstd support");
+    return 1;
+#endif
+  }
+
+  if(input->type != LIBRDF_PARSER_RAPTOR_INPUT_PLAIN) {
+    input->out = LIBRDF_MALLOC(unsigned char*, LIBRDF_PARSER_RAPTOR_INPUT_LEN);
+    if(!input->out)
+      return 1;
+  }
+
+  return 0;
+}
+
+
+/*
+ * librdf_parser_raptor_input_read - Get the next piece of content
+ * @input: input
+ * @data_p: pointer to store the bytes
+ * @length_p: pointer to store the length; 0 at end of content
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_parser_raptor_input_read(librdf_parser_raptor_input* input,
+                                const unsigned char** data_p,
+                                size_t* length_p)
+{
+#if defined(HAVE_ZLIB) || defined(HAVE_ZSTD)
+  const unsigned char* raw;
+  size_t raw_length;
+#endif
+
+  *length_p = 0;
+
+  switch(input->type) {
+    case LIBRDF_PARSER_RAPTOR_INPUT_GZIP:
+#ifdef HAVE_ZLIB
+      if(input->end)
+        return 0;
+
+      input->zstream.next_out = input->out;
+      input->zstream.avail_out = LIBRDF_PARSER_RAPTOR_INPUT_LEN;
+      while(input->zstream.avail_out) {
+        int rc;
+
+        if(!input->zstream.avail_in && !input->raw_end) {
+          if(librdf_parser_raptor_input_read_raw(input, &raw, &raw_length))
+            return 1;
+          if(!raw_length)
+            input->raw_end = 1;
+          input->zstream.next_in = (Bytef*)raw;
+          input->zstream.avail_in = (uInt)raw_length;
+        }
+
+        /* After the last compressed bytes inflate may still have
+         * output held back from a full buffer */
+        rc = inflate(&input->zstream, Z_NO_FLUSH);
+        if(rc == Z_STREAM_END) {
+          /* Another gzip member may follow, as written by pigz */
+          if(!input->zstream.avail_in && !input->raw_end) {
+            if(librdf_parser_raptor_input_read_raw(input, &raw, &raw_length))
+              return 1;
+            if(!raw_length)
+              input->raw_end = 1;
+            input->zstream.next_in = (Bytef*)raw;
+            input->zstream.avail_in = (uInt)raw_length;
+          }
+          if(!input->zstream.avail_in) {
+            input->end = 1;
+            break;
+          }
+          inflateReset(&input->zstream);
+        } else if(rc == Z_BUF_ERROR && input->raw_end) {
+          /* no progress without more input */
+          librdf_log(input->world, 0, LIBRDF_LOG_ERROR,
+                     LIBRDF_FROM_PARSER, NULL,
+                     "Truncated gzip compressed input");
+          return 1;
+        } else if(rc != Z_OK && rc != Z_BUF_ERROR) {
+          librdf_log(input->world, 0, LIBRDF_LOG_ERROR,
+                     LIBRDF_FROM_PARSER, NULL,
+                     "Failed to decompress gzip input - %s",
+                     input->zstream.msg ? input->zstream.msg : "unknown error");
+          return 1;
+        }
+      }
+
+      *data_p = input->out;
+      *length_p = LIBRDF_PARSER_RAPTOR_INPUT_LEN - input->zstream.avail_out;
+#endif
+      return 0;
+
+    case LIBRDF_PARSER_RAPTOR_INPUT_ZSTD:
+#ifdef HAVE_ZSTD
+      if(input->end)
+        return 0;
+
+      if(1) {
+        ZSTD_outBuffer out;
+
+        out.dst = input->out;
+        out.size = LIBRDF_PARSER_RAPTOR_INPUT_LEN;
+        out.pos = 0;
+        while(out.pos < out.size) {
+          size_t rc;
+          size_t out_pos;
+
+          if(input->zstd_in.pos == input->zstd_in.size && !input->raw_end) {
+            if(librdf_parser_raptor_input_read_raw(input, &raw, &raw_length))
+              return 1;
+            if(!raw_length)
+              input->raw_end = 1;
+            input->zstd_in.src = raw;
+            input->zstd_in.size = raw_length;
+            input->zstd_in.pos = 0;
+          }
+
+          /* A frame that was decoded and flushed ends the content */
+          if(input->raw_end && !input->zstd_hint) {
+            input->end = 1;
+            break;
+          }
+
+          /* Handles several concatenated frames; after the last
+           * compressed bytes this flushes output held back from a
+           * full buffer */
+          out_pos = out.pos;
+          rc = ZSTD_decompressStream(input->zstd, &out, &input->zstd_in);
+          if(ZSTD_isError(rc)) {
+            librdf_log(input->world, 0, LIBRDF_LOG_ERROR,
+                       LIBRDF_FROM_PARSER, NULL,
+                       "Failed to decompress zstd input - %s",
+                       ZSTD_getErrorName(rc));
+            return 1;
+          }
+          input->zstd_hint = rc;
+
+          if(input->raw_end && rc && out.pos == out_pos) {
+            /* no progress without more input */
+            librdf_log(input->world, 0, LIBRDF_LOG_ERROR,
+                       LIBRDF_FROM_PARSER, NULL,
+                       "Truncated zstd compressed input");
+            return 1;
+          }
+        }
+
+        *data_p = input->out;
+        *length_p = out.pos;
+      }
+#endif
+      return 0;
+
+    case LIBRDF_PARSER_RAPTOR_INPUT_PLAIN:
+    default:
+      return librdf_parser_raptor_input_read_raw(input, data_p, length_p);
+  }
+}
+
+
+/*
+ * librdf_parser_raptor_input_finish - Stop reading a file
+ * @input: input
+ *
+ * Does not close the file handle.
+ */
+static void
+librdf_parser_raptor_input_finish(librdf_parser_raptor_input* input)
+{
+#ifdef HAVE_ZLIB
+  if(input->type == LIBRDF_PARSER_RAPTOR_INPUT_GZIP)
+    inflateEnd(&input->zstream);
+#endif
+#ifdef HAVE_ZSTD
+  if(input->zstd)
+    ZSTD_freeDStream(input->zstd);
+  input->zstd = NULL;
+#endif
+  input->type = LIBRDF_PARSER_RAPTOR_INPUT_PLAIN;
+
+#ifdef LIBRDF_PARSER_RAPTOR_USE_MMAP
+  if(input->map)
+    munmap(input->map, input->map_length);
+#endif
+  input->map = NULL;
+
+  if(input->buffer)
+    LIBRDF_FREE(char*, input->buffer);
+  input->buffer = NULL;
+  if(input->out)
+    LIBRDF_FREE(char*, input->out);
+  input->out = NULL;
+}
+
+
+/*
+ * librdf_parser_raptor_parse_input - Parse all of a file
+ * @pcontext: parser context
+ * @fh: file handle
+ * @map_fh: non 0 to allow mapping @fh into memory
+ * @base_uri: base URI or NULL
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_parser_raptor_parse_input(librdf_parser_raptor_context* pcontext,
+                                 FILE* fh, int map_fh, librdf_uri* base_uri)
+{
+  librdf_parser_raptor_input input;
+  int status;
+
+  memset(&input, '\0', sizeof(input));
+
+  status = librdf_parser_raptor_input_init(&input, pcontext->parser->world,
+                                           fh, map_fh);
+  if(!status)
+    status = raptor_parser_parse_start(pcontext->rdf_parser,
+                                       (raptor_uri*)base_uri);
+  while(!status) {
+    const unsigned char* data;
+    size_t length;
+
+    status = librdf_parser_raptor_input_read(&input, &data, &length);
+    if(status)
+      break;
+
+    status = raptor_parser_parse_chunk(pcontext->rdf_parser,
+                                       length ? data : NULL, length, !length);
+    if(!length)
+      break;
+  }
+
+  librdf_parser_raptor_input_finish(&input);
+
+  return status;
+}
 
 
 /*
@@ -346,38 +1021,44 @@ librdf_parser_raptor_namespace_handler(void* user_data,
  */
 static int
 librdf_parser_raptor_get_next_statement(librdf_parser_raptor_stream_context *context) {
-  unsigned char buffer[RAPTOR_IO_BUFFER_LEN];
   int status=0;
 
   if(context->finished || !context->fh)
     return 0;
 
   context->current=NULL;
-  while(!feof(context->fh)) {
+  while(1) {
+    const unsigned char* data;
     size_t len;
     int ret;
 
-    len = fread(buffer, 1, RAPTOR_IO_BUFFER_LEN, context->fh);
-    ret = raptor_parser_parse_chunk(context->pcontext->rdf_parser, buffer, len,
-                                    (len < RAPTOR_IO_BUFFER_LEN));
+    if(librdf_parser_raptor_input_read(&context->input, &data, &len)) {
+      status=(-1);
+      break; /* failed and done */
+    }
 
+    ret = raptor_parser_parse_chunk(context->pcontext->rdf_parser,
+                                    len ? data : NULL, len, !len);
     if(ret) {
       status=(-1);
       break; /* failed and done */
     }
 
+    if(!len)
+      context->finished=1;
+
     /* parsing found at least 1 statement, return */
-    if(librdf_list_size(context->statements)) {
-      context->current=(librdf_statement*)librdf_list_pop(context->statements);
+    if(context->queue_count) {
+      context->current=librdf_parser_raptor_queue_remove(context);
       status=1;
       break;
     }
 
-    if(len < RAPTOR_IO_BUFFER_LEN)
+    if(context->finished)
       break;
   }
 
-  if(feof(context->fh) || status <1)
+  if(status <1)
     context->finished=1;
 
   return status;
@@ -438,10 +1119,6 @@ librdf_parser_raptor_parse_file_handle_as_stream(void *context,
   scontext->pcontext=pcontext;
   pcontext->stream_context=scontext;
 
-  scontext->statements=librdf_new_list(pcontext->parser->world);
-  if(!scontext->statements)
-    goto oom;
-
   if(pcontext->nspace_prefixes)
     raptor_free_sequence(pcontext->nspace_prefixes);
   pcontext->nspace_prefixes=raptor_new_sequence(free, NULL);
@@ -464,6 +1141,14 @@ librdf_parser_raptor_parse_file_handle_as_stream(void *context,
   scontext->fh=fh;
   scontext->close_fh=close_fh;
 
+  /* Map regular files that the stream owns rather than copying
+   * them through a buffer */
+  if(librdf_parser_raptor_input_init(&scontext->input,
+                                     pcontext->parser->world, fh, close_fh)) {
+    librdf_parser_raptor_serialise_finished((void*)scontext);
+    return NULL;
+  }
+
   if(pcontext->parser->uri_filter)
     raptor_parser_set_uri_filter(pcontext->rdf_parser,
                                  librdf_parser_raptor_relay_filter,
@@ -474,7 +1159,7 @@ librdf_parser_raptor_parse_file_handle_as_stream(void *context,
 
   rc = raptor_parser_parse_start(pcontext->rdf_parser, (raptor_uri*)base_uri);
   if(!rc) {
-    /* start parsing; initialises scontext->statements, scontext->current */
+    /* start parsing; initialises scontext->queue, scontext->current */
     librdf_parser_raptor_get_next_statement(scontext);
 
     stream=librdf_new_stream(pcontext->parser->world,
@@ -605,10 +1290,6 @@ librdf_parser_raptor_parse_as_stream_common(void *context, librdf_uri *uri,
   scontext->pcontext=pcontext;
   pcontext->stream_context=scontext;
 
-  scontext->statements=librdf_new_list(pcontext->parser->world);
-  if(!scontext->statements)
-    goto oom;
-
   if(pcontext->nspace_prefixes)
     raptor_free_sequence(pcontext->nspace_prefixes);
   pcontext->nspace_prefixes=raptor_new_sequence(free, NULL);
@@ -711,7 +1392,7 @@ librdf_parser_raptor_parse_as_stream_common(void *context, librdf_uri *uri,
 
 
   /* get first statement, else is empty */
-  scontext->current=(librdf_statement*)librdf_list_pop(scontext->statements);
+  scontext->current=librdf_parser_raptor_queue_remove(scontext);
 
   stream=librdf_new_stream(pcontext->parser->world,
                            (void*)scontext,
@@ -829,6 +1510,7 @@ librdf_parser_raptor_parse_iostream_as_stream(void *context,
  * @string: string content to parser, or NULL
  * @length: length of the string or 0 if not yet counted
  * @fh: FILE* content source, or NULL
+ * @map_fh: non 0 if @fh may be mapped into memory
  * @iostream: iostream content, or NULL
  * @base_uri: #librdf_uri URI of the content location or NULL
  * @model: #librdf_model of model
@@ -847,6 +1529,7 @@ librdf_parser_raptor_parse_into_model_common(void *context,
                                              const unsigned char *string,
                                              size_t length,
                                              FILE *fh,
+                                             int map_fh,
                                              raptor_iostream *iostream,
                                              librdf_uri *base_uri,
                                              librdf_model* model)
@@ -911,23 +1594,48 @@ librdf_parser_raptor_parse_into_model_common(void *context,
   /* direct into model */
   scontext->model=model;
 
+  if(pcontext->batch_size > 1) {
+    scontext->batch = LIBRDF_CALLOC(librdf_statement**,
+                                    LIBRDF_GOOD_CAST(size_t, pcontext->batch_size),
+                                    sizeof(librdf_statement*));
+    if(!scontext->batch)
+      goto oom;
+  }
+
   if(pcontext->parser->uri_filter)
     raptor_parser_set_uri_filter(pcontext->rdf_parser,
                                  librdf_parser_raptor_relay_filter,
                                  pcontext->parser);
 
-  if(uri) {
-    status = raptor_parser_parse_uri(pcontext->rdf_parser, (raptor_uri*)uri,
-                                     (raptor_uri*)base_uri);
-  } else if (string != NULL) {
-    status = raptor_parser_parse_start(pcontext->rdf_parser, (raptor_uri*)base_uri);
-    if(!status) {
-      if(!length)
+  if(uri && librdf_uri_is_file_uri(uri)) {
+    char* filename=(char*)librdf_uri_to_filename(uri);
+
+    if(!filename)
+      goto oom;
+
+    fh=fopen(filename, "rb");
+    if(fh) {
+      status = librdf_parser_raptor_parse_input(pcontext, fh, 1, base_uri);
+      fclose(fh);
+    } else {
+      librdf_log(pcontext->parser->world, 0, LIBRDF_LOG_ERROR,
+                 LIBRDF_FROM_PARSER, NULL, "failed to open file '%s' - %s",
+                 filename, strerror(errno));
+      status = 1;
+    }
+    SYSTEM_FREE(filename);
+  } else if(uri) {
+    status = raptor_parser_parse_uri(pcontext->rdf_parser, (raptor_uri*)uri,
+                                     (raptor_uri*)base_uri);
+  } else if (string != NULL) {
+    status = raptor_parser_parse_start(pcontext->rdf_parser, (raptor_uri*)base_uri);
+    if(!status) {
+      if(!length)
         length = strlen((const char*)string);
       status = raptor_parser_parse_chunk(pcontext->rdf_parser, string, length, 1);
     }
   } else if(fh) {
-    status = raptor_parser_parse_file_stream(pcontext->rdf_parser, fh, NULL, (raptor_uri*)base_uri);
+    status = librdf_parser_raptor_parse_input(pcontext, fh, map_fh, base_uri);
   } else if(iostream) {
     status = raptor_parser_parse_iostream(pcontext->rdf_parser, iostream,  (raptor_uri*)base_uri);
   } else {
@@ -935,6 +1643,11 @@ librdf_parser_raptor_parse_into_model_common(void *context,
     status = -1;
   }
 
+  if(scontext->batch_count)
+    librdf_parser_raptor_flush_batch(scontext);
+  if(scontext->batch_failed && !status)
+    status = 1;
+
   librdf_parser_raptor_serialise_finished((void*)scontext);
 
   return status;
@@ -968,7 +1681,7 @@ librdf_parser_raptor_parse_uri_into_model(void *context, librdf_uri *uri,
                                           librdf_model* model)
 {
   return librdf_parser_raptor_parse_into_model_common(context, uri,
-                                                      NULL, 0, NULL, NULL,
+                                                      NULL, 0, NULL, 0, NULL,
                                                       base_uri, model);}
 
 
@@ -992,7 +1705,7 @@ librdf_parser_raptor_parse_string_into_model(void *context,
                                              librdf_model* model)
 {
   return librdf_parser_raptor_parse_into_model_common(context, NULL,
-                                                      string, 0, NULL, NULL,
+                                                      string, 0, NULL, 0, NULL,
                                                       base_uri, model);
 }
 
@@ -1017,8 +1730,8 @@ librdf_parser_raptor_parse_file_handle_into_model(void *context, FILE *fh,
                                                   librdf_model* model)
 {
   int status=librdf_parser_raptor_parse_into_model_common(context, NULL,
-                                                          NULL, 0, fh, NULL,
-                                                          base_uri, model);
+                                                          NULL, 0, fh, close_fh,
+                                                          NULL, base_uri, model);
 
   if (close_fh)
     fclose(fh);
@@ -1047,8 +1760,8 @@ librdf_parser_raptor_parse_counted_string_into_model(void *context,
                                                      librdf_model* model)
 {
   return librdf_parser_raptor_parse_into_model_common(context, NULL,
-                                                      string, length, NULL, NULL,
-                                                      base_uri, model);
+                                                      string, length, NULL, 0,
+                                                      NULL, base_uri, model);
 }
 
 
@@ -1070,11 +1783,813 @@ librdf_parser_raptor_parse_iostream_into_model(void *context,
                                                librdf_model* model)
 {
   return librdf_parser_raptor_parse_into_model_common(context, NULL,
-                                                      NULL, 0, NULL, iostream,
+                                                      NULL, 0, NULL, 0, iostream,
                                                       base_uri, model);
 }
 
 
+#ifdef WITH_THREADS
+
+/*
+ * Parallel parsing of line-based syntaxes
+ *
+ * A reader thread splits the input at line boundaries into chunks,
+ * worker threads parse chunks each with a private raptor world and
+ * queue batches of statement terms as strings, and the calling
+ * thread turns the batches into statements and adds them to the
+ * model.  Both queues are bounded so memory use does not depend on
+ * the input size.
+ */
+
+/* Size of each chunk of input handed to a worker */
+#define LIBRDF_PARSER_RAPTOR_PARALLEL_CHUNK_SIZE (4 * 1024 * 1024)
+
+/* Number of statements in each batch handed to the model */
+#define LIBRDF_PARSER_RAPTOR_PARALLEL_BATCH_SIZE 1000
+
+typedef struct {
+  raptor_term_type type;        /* RAPTOR_TERM_TYPE_UNKNOWN if no term */
+  unsigned char *value;         /* URI string, blank node id or literal */
+  unsigned char *language;
+  unsigned char *datatype;      /* datatype URI string */
+} librdf_parser_raptor_parallel_term;
+
+typedef struct {
+  /* 4 terms per statement: subject, predicate, object, graph */
+  librdf_parser_raptor_parallel_term *terms;
+  int count;
+  int size;
+} librdf_parser_raptor_parallel_batch;
+
+typedef struct {
+  unsigned char *data;
+  size_t length;
+} librdf_parser_raptor_parallel_chunk;
+
+typedef struct {
+  const char *parser_name;
+  const unsigned char *base_uri_string;
+  /* only used by the reader thread */
+  librdf_parser_raptor_input input;
+  const unsigned char *pending;
+  size_t pending_length;
+  int read_failed;
+  /* maximum entries in each of the chunks and batches queues */
+  int queue_size;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t chunk_cond;    /* chunk queued or input finished */
+  pthread_cond_t chunk_space_cond; /* chunk dequeued */
+  pthread_cond_t batch_cond;    /* batch queued or a worker finished */
+  pthread_cond_t batch_space_cond; /* batch dequeued */
+
+  raptor_sequence *chunks;
+  raptor_sequence *batches;
+  int input_finished;
+  int workers_running;
+  int failed;                   /* set to stop all threads */
+  int errors;
+  int warnings;
+} librdf_parser_raptor_parallel_context;
+
+typedef struct {
+  librdf_parser_raptor_parallel_context *pcontext;
+  pthread_t thread;
+  raptor_world *world;
+  librdf_parser_raptor_parallel_batch *batch;
+  int errors;
+  int warnings;
+} librdf_parser_raptor_parallel_worker;
+
+
+static void
+librdf_parser_raptor_parallel_free_chunk(librdf_parser_raptor_parallel_chunk* chunk)
+{
+  if(chunk->data)
+    LIBRDF_FREE(char*, chunk->data);
+  LIBRDF_FREE(librdf_parser_raptor_parallel_chunk, chunk);
+}
+
+
+static void
+librdf_parser_raptor_parallel_free_batch(librdf_parser_raptor_parallel_batch* batch)
+{
+  int i;
+
+  for(i=0; i < batch->count * 4; i++) {
+    librdf_parser_raptor_parallel_term* term=&batch->terms[i];
+
+    if(term->value)
+      LIBRDF_FREE(char*, term->value);
+    if(term->language)
+      LIBRDF_FREE(char*, term->language);
+    if(term->datatype)
+      LIBRDF_FREE(char*, term->datatype);
+  }
+  if(batch->terms)
+    LIBRDF_FREE(librdf_parser_raptor_parallel_term*, batch->terms);
+  LIBRDF_FREE(librdf_parser_raptor_parallel_batch, batch);
+}
+
+
+static unsigned char*
+librdf_parser_raptor_parallel_copy_string(const unsigned char* string,
+                                          size_t length)
+{
+  unsigned char* copy;
+
+  copy = LIBRDF_MALLOC(unsigned char*, length + 1);
+  if(copy) {
+    memcpy(copy, string, length);
+    copy[length]='\0';
+  }
+
+  return copy;
+}
+
+
+/* Copy a raptor term from a worker world into strings */
+static int
+librdf_parser_raptor_parallel_copy_term(librdf_parser_raptor_parallel_term* term,
+                                        raptor_term* rterm)
+{
+  const unsigned char* string;
+  size_t length;
+
+  term->type=RAPTOR_TERM_TYPE_UNKNOWN;
+  term->value=NULL;
+  term->language=NULL;
+  term->datatype=NULL;
+
+  if(!rterm)
+    return 0;
+
+  switch(rterm->type) {
+    case RAPTOR_TERM_TYPE_URI:
+      string=raptor_uri_as_counted_string(rterm->value.uri, &length);
+      term->value=librdf_parser_raptor_parallel_copy_string(string, length);
+      break;
+
+    case RAPTOR_TERM_TYPE_BLANK:
+      term->value=librdf_parser_raptor_parallel_copy_string(rterm->value.blank.string,
+                                                            rterm->value.blank.string_len);
+      break;
+
+    case RAPTOR_TERM_TYPE_LITERAL:
+      term->value=librdf_parser_raptor_parallel_copy_string(rterm->value.literal.string,
+                                                            rterm->value.literal.string_len);
+      if(rterm->value.literal.language) {
+        term->language=librdf_parser_raptor_parallel_copy_string(rterm->value.literal.language,
+                                                                 rterm->value.literal.language_len);
+        if(!term->language)
+          return 1;
+      }
+      if(rterm->value.literal.datatype) {
+        string=raptor_uri_as_counted_string(rterm->value.literal.datatype,
+                                            &length);
+        term->datatype=librdf_parser_raptor_parallel_copy_string(string,
+                                                                 length);
+        if(!term->datatype)
+          return 1;
+      }
+      break;
+
+    case RAPTOR_TERM_TYPE_UNKNOWN:
+    default:
+      return 1;
+  }
+
+  if(!term->value)
+    return 1;
+
+  term->type=rterm->type;
+  return 0;
+}
+
+
+/* Queue the worker's batch, waiting for space */
+static void
+librdf_parser_raptor_parallel_queue_batch(librdf_parser_raptor_parallel_worker* worker)
+{
+  librdf_parser_raptor_parallel_context* pcontext=worker->pcontext;
+  librdf_parser_raptor_parallel_batch* batch=worker->batch;
+
+  worker->batch=NULL;
+  if(!batch)
+    return;
+
+  pthread_mutex_lock(&pcontext->mutex);
+  while(raptor_sequence_size(pcontext->batches) >= pcontext->queue_size &&
+        !pcontext->failed)
+    pthread_cond_wait(&pcontext->batch_space_cond, &pcontext->mutex);
+
+  if(pcontext->failed)
+    librdf_parser_raptor_parallel_free_batch(batch);
+  else if(!raptor_sequence_push(pcontext->batches, batch))
+    pthread_cond_signal(&pcontext->batch_cond);
+  /* else push freed the batch */
+  pthread_mutex_unlock(&pcontext->mutex);
+}
+
+
+static void
+librdf_parser_raptor_parallel_statement_handler(void *user_data,
+                                                raptor_statement *rstatement)
+{
+  librdf_parser_raptor_parallel_worker* worker=(librdf_parser_raptor_parallel_worker*)user_data;
+  librdf_parser_raptor_parallel_batch* batch=worker->batch;
+  librdf_parser_raptor_parallel_term* terms;
+  int rc;
+
+  if(!batch) {
+    batch = LIBRDF_CALLOC(librdf_parser_raptor_parallel_batch*, 1,
+                          sizeof(*batch));
+    if(!batch) {
+      worker->errors++;
+      return;
+    }
+    batch->terms = LIBRDF_CALLOC(librdf_parser_raptor_parallel_term*,
+                                 LIBRDF_PARSER_RAPTOR_PARALLEL_BATCH_SIZE * 4,
+                                 sizeof(librdf_parser_raptor_parallel_term));
+    if(!batch->terms) {
+      LIBRDF_FREE(librdf_parser_raptor_parallel_batch, batch);
+      worker->errors++;
+      return;
+    }
+    batch->size=LIBRDF_PARSER_RAPTOR_PARALLEL_BATCH_SIZE;
+    worker->batch=batch;
+  }
+
+  terms=&batch->terms[batch->count * 4];
+  /* count the statement first so a partial copy is freed with the batch */
+  batch->count++;
+  rc=librdf_parser_raptor_parallel_copy_term(&terms[0], rstatement->subject);
+  rc=rc || librdf_parser_raptor_parallel_copy_term(&terms[1], rstatement->predicate);
+  rc=rc || librdf_parser_raptor_parallel_copy_term(&terms[2], rstatement->object);
+  rc=rc || librdf_parser_raptor_parallel_copy_term(&terms[3], rstatement->graph);
+  if(rc) {
+    worker->errors++;
+    /* leave the statement out when the batch is added */
+    terms[0].type=RAPTOR_TERM_TYPE_UNKNOWN;
+  }
+
+  if(batch->count == batch->size)
+    librdf_parser_raptor_parallel_queue_batch(worker);
+}
+
+
+static void
+librdf_parser_raptor_parallel_log_handler(void *user_data,
+                                          raptor_log_message *message)
+{
+  librdf_parser_raptor_parallel_worker* worker=(librdf_parser_raptor_parallel_worker*)user_data;
+
+  switch(message->level) {
+    case RAPTOR_LOG_LEVEL_FATAL:
+    case RAPTOR_LOG_LEVEL_ERROR:
+      worker->errors++;
+      break;
+
+    case RAPTOR_LOG_LEVEL_WARN:
+      worker->warnings++;
+      break;
+
+    case RAPTOR_LOG_LEVEL_NONE:
+    case RAPTOR_LOG_LEVEL_TRACE:
+    case RAPTOR_LOG_LEVEL_DEBUG:
+    case RAPTOR_LOG_LEVEL_INFO:
+    default:
+      break;
+  }
+}
+
+
+static void*
+librdf_parser_raptor_parallel_worker_main(void* arg)
+{
+  librdf_parser_raptor_parallel_worker* worker=(librdf_parser_raptor_parallel_worker*)arg;
+  librdf_parser_raptor_parallel_context* pcontext=worker->pcontext;
+  raptor_parser* rdf_parser;
+
+  rdf_parser=raptor_new_parser(worker->world, pcontext->parser_name);
+  if(rdf_parser)
+    raptor_parser_set_statement_handler(rdf_parser, worker,
+                                        librdf_parser_raptor_parallel_statement_handler);
+  else
+    worker->errors++;
+
+  while(rdf_parser) {
+    librdf_parser_raptor_parallel_chunk* chunk;
+    raptor_uri* base_uri=NULL;
+
+    pthread_mutex_lock(&pcontext->mutex);
+    while(!raptor_sequence_size(pcontext->chunks) &&
+          !pcontext->input_finished && !pcontext->failed)
+      pthread_cond_wait(&pcontext->chunk_cond, &pcontext->mutex);
+    chunk=NULL;
+    if(!pcontext->failed && raptor_sequence_size(pcontext->chunks)) {
+      chunk=(librdf_parser_raptor_parallel_chunk*)raptor_sequence_unshift(pcontext->chunks);
+      pthread_cond_signal(&pcontext->chunk_space_cond);
+    }
+    pthread_mutex_unlock(&pcontext->mutex);
+
+    if(!chunk)
+      break;
+
+    if(pcontext->base_uri_string)
+      base_uri=raptor_new_uri(worker->world, pcontext->base_uri_string);
+
+    if(raptor_parser_parse_start(rdf_parser, base_uri) ||
+       raptor_parser_parse_chunk(rdf_parser, chunk->data, chunk->length, 1))
+      worker->errors++;
+
+    if(base_uri)
+      raptor_free_uri(base_uri);
+    librdf_parser_raptor_parallel_free_chunk(chunk);
+
+    librdf_parser_raptor_parallel_queue_batch(worker);
+  }
+
+  if(rdf_parser)
+    raptor_free_parser(rdf_parser);
+  if(worker->batch)
+    librdf_parser_raptor_parallel_free_batch(worker->batch);
+  worker->batch=NULL;
+
+  pthread_mutex_lock(&pcontext->mutex);
+  pcontext->errors+=worker->errors;
+  pcontext->warnings+=worker->warnings;
+  pcontext->workers_running--;
+  pthread_cond_broadcast(&pcontext->batch_cond);
+  pthread_mutex_unlock(&pcontext->mutex);
+
+  return NULL;
+}
+
+
+/* Queue a chunk, waiting for space.  Return value: non 0 to stop */
+static int
+librdf_parser_raptor_parallel_queue_chunk(librdf_parser_raptor_parallel_context* pcontext,
+                                          unsigned char* data, size_t length)
+{
+  librdf_parser_raptor_parallel_chunk* chunk;
+  int rc=0;
+
+  chunk = LIBRDF_CALLOC(librdf_parser_raptor_parallel_chunk*, 1,
+                        sizeof(*chunk));
+  if(!chunk) {
+    LIBRDF_FREE(char*, data);
+    return 1;
+  }
+  chunk->data=data;
+  chunk->length=length;
+
+  pthread_mutex_lock(&pcontext->mutex);
+  while(raptor_sequence_size(pcontext->chunks) >= pcontext->queue_size &&
+        !pcontext->failed)
+    pthread_cond_wait(&pcontext->chunk_space_cond, &pcontext->mutex);
+
+  if(pcontext->failed) {
+    librdf_parser_raptor_parallel_free_chunk(chunk);
+    rc=1;
+  } else if(raptor_sequence_push(pcontext->chunks, chunk))
+    rc=1;
+  else
+    pthread_cond_signal(&pcontext->chunk_cond);
+  pthread_mutex_unlock(&pcontext->mutex);
+
+  return rc;
+}
+
+
+/* Fill a buffer from the input.  Return value: bytes, 0 at end */
+static size_t
+librdf_parser_raptor_parallel_fill(librdf_parser_raptor_parallel_context* pcontext,
+                                   unsigned char* buffer, size_t size)
+{
+  size_t length=0;
+
+  while(length < size) {
+    size_t n;
+
+    if(!pcontext->pending_length) {
+      if(librdf_parser_raptor_input_read(&pcontext->input, &pcontext->pending,
+                                         &pcontext->pending_length)) {
+        pcontext->read_failed=1;
+        break;
+      }
+      if(!pcontext->pending_length)
+        break;
+    }
+
+    n=size - length;
+    if(n > pcontext->pending_length)
+      n=pcontext->pending_length;
+    memcpy(buffer + length, pcontext->pending, n);
+    pcontext->pending+=n;
+    pcontext->pending_length-=n;
+    length+=n;
+  }
+
+  return length;
+}
+
+
+static void*
+librdf_parser_raptor_parallel_reader_main(void* arg)
+{
+  librdf_parser_raptor_parallel_context* pcontext=(librdf_parser_raptor_parallel_context*)arg;
+  unsigned char* carry=NULL;
+  size_t carry_length=0;
+
+  while(1) {
+    unsigned char* buffer;
+    size_t length;
+    size_t line_end;
+
+    buffer = LIBRDF_MALLOC(unsigned char*,
+                           carry_length + LIBRDF_PARSER_RAPTOR_PARALLEL_CHUNK_SIZE);
+    if(!buffer)
+      break;
+    if(carry) {
+      memcpy(buffer, carry, carry_length);
+      LIBRDF_FREE(char*, carry);
+      carry=NULL;
+    }
+
+    length=librdf_parser_raptor_parallel_fill(pcontext, buffer + carry_length,
+                                              LIBRDF_PARSER_RAPTOR_PARALLEL_CHUNK_SIZE);
+    if(!length) {
+      /* end of input - last line may have no newline */
+      if(carry_length)
+        librdf_parser_raptor_parallel_queue_chunk(pcontext, buffer,
+                                                  carry_length);
+      else
+        LIBRDF_FREE(char*, buffer);
+      carry_length=0;
+      break;
+    }
+    length+=carry_length;
+
+    /* Split after the last newline, carrying the rest to the next chunk */
+    for(line_end=length; line_end > 0 && buffer[line_end-1] != '\n'; line_end--)
+      ;
+    if(!line_end) {
+      /* no newline yet - a line longer than a chunk */
+      carry=buffer;
+      carry_length=length;
+      continue;
+    }
+
+    carry_length=length - line_end;
+    if(carry_length) {
+      carry = LIBRDF_MALLOC(unsigned char*, carry_length);
+      if(!carry) {
+        LIBRDF_FREE(char*, buffer);
+        break;
+      }
+      memcpy(carry, buffer + line_end, carry_length);
+    }
+
+    if(librdf_parser_raptor_parallel_queue_chunk(pcontext, buffer, line_end))
+      break;
+  }
+
+  if(carry)
+    LIBRDF_FREE(char*, carry);
+
+  pthread_mutex_lock(&pcontext->mutex);
+  if(pcontext->read_failed)
+    pcontext->errors++;
+  pcontext->input_finished=1;
+  pthread_cond_broadcast(&pcontext->chunk_cond);
+  pthread_mutex_unlock(&pcontext->mutex);
+
+  return NULL;
+}
+
+
+/* Make a node from a batch term in the librdf world */
+static librdf_node*
+librdf_parser_raptor_parallel_term_to_node(librdf_world* world,
+                                           librdf_parser_raptor_parallel_term* term)
+{
+  librdf_node* node=NULL;
+  librdf_uri* datatype=NULL;
+  unsigned char* id;
+
+  switch(term->type) {
+    case RAPTOR_TERM_TYPE_URI:
+      node=librdf_new_node_from_uri_string(world, term->value);
+      break;
+
+    case RAPTOR_TERM_TYPE_BLANK:
+      /* map ids so the same id in different chunks is the same node */
+      id=librdf_raptor_map_bnodeid(world, term->value);
+      if(id) {
+        node=librdf_new_node_from_blank_identifier(world, id);
+        LIBRDF_FREE(char*, id);
+      }
+      break;
+
+    case RAPTOR_TERM_TYPE_LITERAL:
+      if(term->datatype) {
+        datatype=librdf_new_uri(world, term->datatype);
+        if(!datatype)
+          break;
+      }
+      node=librdf_new_node_from_typed_literal(world, term->value,
+                                              (const char*)term->language,
+                                              datatype);
+      if(datatype)
+        librdf_free_uri(datatype);
+      break;
+
+    case RAPTOR_TERM_TYPE_UNKNOWN:
+    default:
+      break;
+  }
+
+  return node;
+}
+
+
+/*
+ * librdf_parser_raptor_parallel_add_batch - Add a batch of terms to a model
+ * @model: model
+ * @batch: batch
+ *
+ * Consecutive statements in the same graph are added with one call.
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_parser_raptor_parallel_add_batch(librdf_model* model,
+                                        librdf_parser_raptor_parallel_batch* batch)
+{
+  librdf_world* world=model->world;
+  librdf_statement* statements[LIBRDF_PARSER_RAPTOR_PARALLEL_BATCH_SIZE];
+  librdf_node* run_context=NULL;
+  int supports_contexts;
+  int count=0;
+  int status=0;
+  int i;
+
+  supports_contexts=librdf_model_supports_contexts(model);
+
+  for(i=0; i < batch->count && !status; i++) {
+    librdf_parser_raptor_parallel_term* terms=&batch->terms[i * 4];
+    librdf_statement* statement;
+    librdf_node* context_node=NULL;
+    librdf_node* s;
+    librdf_node* p;
+    librdf_node* o;
+
+    if(terms[0].type == RAPTOR_TERM_TYPE_UNKNOWN)
+      continue;
+
+    s=librdf_parser_raptor_parallel_term_to_node(world, &terms[0]);
+    p=librdf_parser_raptor_parallel_term_to_node(world, &terms[1]);
+    o=librdf_parser_raptor_parallel_term_to_node(world, &terms[2]);
+    if(!s || !p || !o) {
+      if(s)
+        librdf_free_node(s);
+      if(p)
+        librdf_free_node(p);
+      if(o)
+        librdf_free_node(o);
+      status=1;
+      break;
+    }
+    statement=librdf_new_statement_from_nodes(world, s, p, o);
+    if(!statement) {
+      status=1;
+      break;
+    }
+
+    if(supports_contexts && terms[3].type != RAPTOR_TERM_TYPE_UNKNOWN)
+      context_node=librdf_parser_raptor_parallel_term_to_node(world,
+                                                              &terms[3]);
+
+    /* Flush the run when the graph changes */
+    if(count &&
+       !((!run_context && !context_node) ||
+         (run_context && context_node &&
+          librdf_node_equals(run_context, context_node)))) {
+      status=librdf_parser_raptor_add_batch(model, run_context,
+                                            statements, count);
+      while(count)
+        librdf_free_statement(statements[--count]);
+    }
+    if(!count) {
+      if(run_context)
+        librdf_free_node(run_context);
+      run_context=context_node;
+    } else if(context_node)
+      librdf_free_node(context_node);
+
+    statements[count++]=statement;
+  }
+
+  if(!status)
+    status=librdf_parser_raptor_add_batch(model, run_context,
+                                          statements, count);
+  while(count)
+    librdf_free_statement(statements[--count]);
+  if(run_context)
+    librdf_free_node(run_context);
+
+  return status;
+}
+
+
+/**
+ * librdf_parser_raptor_parse_file_handle_into_model_parallel:
+ * @context: parser context
+ * @fh: FILE* of content source
+ * @close_fh: non-0 to fclose(fh) on finish
+ * @base_uri: #librdf_uri URI of the content location (or NULL)
+ * @model: #librdf_model of model
+ * @threads: number of parsing threads
+ *
+ * INTERNAL - Parse line-based content from a FILE* handle with threads
+ *
+ * Only N-Triples and N-Quads are split, other syntaxes are parsed
+ * with librdf_parser_raptor_parse_file_handle_into_model().
+ *
+ * Return value: non 0 on failure
+ **/
+static int
+librdf_parser_raptor_parse_file_handle_into_model_parallel(void *context,
+                                                           FILE *fh,
+                                                           int close_fh,
+                                                           librdf_uri *base_uri,
+                                                           librdf_model* model,
+                                                           int threads)
+{
+  librdf_parser_raptor_context* pcontext=(librdf_parser_raptor_context*)context;
+  librdf_parser_raptor_parallel_context parallel;
+  librdf_parser_raptor_parallel_worker* workers;
+  pthread_t reader;
+  int reader_started=0;
+  int workers_started=0;
+  int status=0;
+  int i;
+
+  if(strcmp(pcontext->parser_name, "ntriples") &&
+     strcmp(pcontext->parser_name, "nquads"))
+    return librdf_parser_raptor_parse_file_handle_into_model(context, fh,
+                                                             close_fh,
+                                                             base_uri, model);
+
+  /* blank node IDs are only shared within one parse */
+  librdf_raptor_reset_bnode_hash(pcontext->parser->world);
+
+  memset(&parallel, '\0', sizeof(parallel));
+  parallel.parser_name=pcontext->parser_name;
+  parallel.base_uri_string=base_uri ? librdf_uri_as_string(base_uri) : NULL;
+  parallel.queue_size=threads * 2;
+  parallel.chunks=raptor_new_sequence((raptor_data_free_handler)librdf_parser_raptor_parallel_free_chunk, NULL);
+  parallel.batches=raptor_new_sequence((raptor_data_free_handler)librdf_parser_raptor_parallel_free_batch, NULL);
+
+  workers = LIBRDF_CALLOC(librdf_parser_raptor_parallel_worker*,
+                          LIBRDF_GOOD_CAST(size_t, threads),
+                          sizeof(*workers));
+  if(!parallel.chunks || !parallel.batches || !workers) {
+    status=1;
+    goto tidy;
+  }
+
+  pthread_mutex_init(&parallel.mutex, NULL);
+  pthread_cond_init(&parallel.chunk_cond, NULL);
+  pthread_cond_init(&parallel.chunk_space_cond, NULL);
+  pthread_cond_init(&parallel.batch_cond, NULL);
+  pthread_cond_init(&parallel.batch_space_cond, NULL);
+
+  pcontext->errors=0;
+  pcontext->warnings=0;
+
+  /* raptor worlds are made here since raptor initialisation is not
+   * thread safe */
+  for(i=0; i < threads; i++) {
+    workers[i].pcontext=&parallel;
+    workers[i].world=raptor_new_world();
+    if(!workers[i].world || raptor_world_open(workers[i].world)) {
+      status=1;
+      break;
+    }
+    raptor_world_set_log_handler(workers[i].world, &workers[i],
+                                 librdf_parser_raptor_parallel_log_handler);
+  }
+
+  /* Map the file if it is closed here; the input is decompressed
+   * if needed in the reader thread */
+  if(!status)
+    status=librdf_parser_raptor_input_init(&parallel.input,
+                                           pcontext->parser->world,
+                                           fh, close_fh);
+
+  if(!status && !pthread_create(&reader, NULL,
+                                librdf_parser_raptor_parallel_reader_main,
+                                &parallel))
+    reader_started=1;
+  else
+    status=1;
+
+  for(i=0; !status && i < threads; i++) {
+    pthread_mutex_lock(&parallel.mutex);
+    parallel.workers_running++;
+    pthread_mutex_unlock(&parallel.mutex);
+    if(pthread_create(&workers[i].thread, NULL,
+                      librdf_parser_raptor_parallel_worker_main,
+                      &workers[i])) {
+      pthread_mutex_lock(&parallel.mutex);
+      parallel.workers_running--;
+      pthread_mutex_unlock(&parallel.mutex);
+      /* carry on with the workers already started */
+      if(!i)
+        status=1;
+      break;
+    }
+    workers_started++;
+  }
+
+  /* Add batches to the model until every worker has finished */
+  while(!status) {
+    librdf_parser_raptor_parallel_batch* batch=NULL;
+
+    pthread_mutex_lock(&parallel.mutex);
+    while(!raptor_sequence_size(parallel.batches) &&
+          parallel.workers_running)
+      pthread_cond_wait(&parallel.batch_cond, &parallel.mutex);
+    if(raptor_sequence_size(parallel.batches)) {
+      batch=(librdf_parser_raptor_parallel_batch*)raptor_sequence_unshift(parallel.batches);
+      pthread_cond_signal(&parallel.batch_space_cond);
+    }
+    pthread_mutex_unlock(&parallel.mutex);
+
+    if(!batch)
+      break;
+
+    status=librdf_parser_raptor_parallel_add_batch(model, batch);
+    librdf_parser_raptor_parallel_free_batch(batch);
+  }
+
+  /* Stop and wait for all the threads; the reader may still be
+   * waiting for queue space if the workers stopped early */
+  pthread_mutex_lock(&parallel.mutex);
+  parallel.failed=1;
+  pthread_cond_broadcast(&parallel.chunk_cond);
+  pthread_cond_broadcast(&parallel.chunk_space_cond);
+  pthread_cond_broadcast(&parallel.batch_space_cond);
+  pthread_mutex_unlock(&parallel.mutex);
+
+  if(reader_started)
+    pthread_join(reader, NULL);
+  for(i=0; i < workers_started; i++)
+    pthread_join(workers[i].thread, NULL);
+
+  pthread_mutex_destroy(&parallel.mutex);
+  pthread_cond_destroy(&parallel.chunk_cond);
+  pthread_cond_destroy(&parallel.chunk_space_cond);
+  pthread_cond_destroy(&parallel.batch_cond);
+  pthread_cond_destroy(&parallel.batch_space_cond);
+
+  pcontext->errors=parallel.errors;
+  pcontext->warnings=parallel.warnings;
+  if(parallel.errors) {
+    librdf_log(pcontext->parser->world, 0, LIBRDF_LOG_ERROR,
+               LIBRDF_FROM_PARSER, NULL,
+               "%d errors parsing %s in parallel", parallel.errors,
+               pcontext->parser_name);
+    status=1;
+  }
+
+  tidy:
+  if(workers) {
+    for(i=0; i < threads; i++) {
+      if(workers[i].world)
+        raptor_free_world(workers[i].world);
+    }
+    LIBRDF_FREE(librdf_parser_raptor_parallel_worker*, workers);
+  }
+  if(parallel.chunks)
+    raptor_free_sequence(parallel.chunks);
+  if(parallel.batches)
+    raptor_free_sequence(parallel.batches);
+  librdf_parser_raptor_input_finish(&parallel.input);
+
+  if(close_fh)
+    fclose(fh);
+
+  librdf_raptor_reset_bnode_hash(pcontext->parser->world);
+
+  return status;
+}
+
+#endif
+
+
 /**
  * librdf_parser_raptor_serialise_end_of_stream:
  * @context: the context passed in by #librdf_stream
@@ -1088,7 +2603,7 @@ librdf_parser_raptor_serialise_end_of_stream(void* context)
 {
   librdf_parser_raptor_stream_context* scontext=(librdf_parser_raptor_stream_context*)context;
 
-  return (!scontext->current && !librdf_list_size(scontext->statements));
+  return (!scontext->current && !scontext->queue_count);
 }
 
 
@@ -1110,7 +2625,7 @@ librdf_parser_raptor_serialise_next_statement(void* context)
 
   /* get another statement if there is one */
   while(!scontext->current) {
-    scontext->current=(librdf_statement*)librdf_list_pop(scontext->statements);
+    scontext->current=librdf_parser_raptor_queue_remove(scontext);
     if(scontext->current)
       break;
 
@@ -1175,11 +2690,21 @@ librdf_parser_raptor_serialise_finished(void* context)
     if(scontext->current)
       librdf_free_statement(scontext->current);
 
-    if(scontext->statements) {
-      while((statement=(librdf_statement*)librdf_list_pop(scontext->statements)))
+    if(scontext->queue) {
+      while((statement=librdf_parser_raptor_queue_remove(scontext)))
         librdf_free_statement(statement);
-      librdf_free_list(scontext->statements);
+      LIBRDF_FREE(librdf_statement**, scontext->queue);
+    }
+
+    librdf_parser_raptor_input_finish(&scontext->input);
+
+    if(scontext->batch) {
+      while(scontext->batch_count)
+        librdf_free_statement(scontext->batch[--scontext->batch_count]);
+      LIBRDF_FREE(librdf_statement**, scontext->batch);
     }
+    if(scontext->batch_context)
+      librdf_free_node(scontext->batch_context);
 
     if(scontext->fh && scontext->close_fh)
       fclose(scontext->fh);
@@ -1216,6 +2741,10 @@ librdf_parser_raptor_get_feature(void* context, librdf_uri *feature)
     sprintf((char*)intbuffer, "%d", pcontext->warnings);
     return librdf_new_node_from_typed_literal(pcontext->parser->world,
                                               intbuffer, NULL, NULL);
+  } else if(!strcmp((const char*)uri_string, LIBRDF_PARSER_FEATURE_BATCH_SIZE)) {
+    sprintf((char*)intbuffer, "%d", pcontext->batch_size);
+    return librdf_new_node_from_typed_literal(pcontext->parser->world,
+                                              intbuffer, NULL, NULL);
   } else {
     /* raptor2: try a raptor option */
     raptor_option feature_i;
@@ -1246,6 +2775,27 @@ librdf_parser_raptor_set_feature(void* context,
   if(!feature)
     return 1;
 
+  if(!strcmp((const char*)librdf_uri_as_string(feature),
+             LIBRDF_PARSER_FEATURE_BATCH_SIZE)) {
+    long batch_size;
+    char *end_ptr;
+
+    if(!librdf_node_is_literal(value))
+      return 1;
+    value_s=(const unsigned char*)librdf_node_get_literal_value(value);
+    batch_size=strtol((const char*)value_s, &end_ptr, 10);
+    if(end_ptr == (const char*)value_s || *end_ptr ||
+       batch_size < 1 || batch_size > INT_MAX) {
+      librdf_log(pcontext->parser->world,
+                 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_PARSER, NULL,
+                 "Parser batch size '%s' is not a positive integer",
+                 (const char*)value_s);
+      return 1;
+    }
+    pcontext->batch_size=(int)batch_size;
+    return 0;
+  }
+
   /* try a raptor feature */
   feature_i = raptor_world_get_option_from_uri(pcontext->parser->world->raptor_world_ptr, (raptor_uri*)feature);
   if((int)feature_i < 0)
@@ -1350,6 +2900,9 @@ librdf_parser_raptor_register_factory(librdf_parser_factory *factory)
   factory->parse_iostream_into_model = librdf_parser_raptor_parse_iostream_into_model;
   factory->parse_file_handle_as_stream = librdf_parser_raptor_parse_file_handle_as_stream;
   factory->parse_file_handle_into_model = librdf_parser_raptor_parse_file_handle_into_model;
+#ifdef WITH_THREADS
+  factory->parse_file_handle_into_model_parallel = librdf_parser_raptor_parse_file_handle_into_model_parallel;
+#endif
   factory->get_feature = librdf_parser_raptor_get_feature;
   factory->set_feature = librdf_parser_raptor_set_feature;
   factory->get_accept_header = librdf_parser_raptor_get_accept_header;
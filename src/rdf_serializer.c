@@ -56,6 +56,7 @@ void
 librdf_init_serializer(librdf_world *world) 
 {
   librdf_serializer_raptor_constructor(world);
+  librdf_serializer_binary_constructor(world);
 }
 
 
@@ -535,6 +536,49 @@ librdf_serializer_serialize_model_to_file_handle(librdf_serializer* serializer,
 }
 
 
+/**
+ * librdf_serializer_serialize_model_to_file_handle_parallel:
+ * @serializer: the serializer
+ * @handle: file handle to serialize to
+ * @base_uri: the base URI to use (or NULL)
+ * @model: the #librdf_model model to use
+ * @threads: number of formatting threads
+ *
+ * Write a serialized #librdf_model to a FILE* using threads.
+ *
+ * For line-based syntaxes (N-Triples and N-Quads) the statements are
+ * formatted in chunks by @threads worker threads while the calling
+ * thread reads the model and writes the chunks in order, so the
+ * output is the same as librdf_serializer_serialize_model_to_file_handle().
+ *
+ * Other syntaxes, @threads less than 2 or a library built without
+ * thread support serialize as librdf_serializer_serialize_model_to_file_handle().
+ *
+ * Return value: non 0 on failure
+ **/
+int
+librdf_serializer_serialize_model_to_file_handle_parallel(librdf_serializer* serializer,
+                                                          FILE *handle,
+                                                          librdf_uri* base_uri,
+                                                          librdf_model* model,
+                                                          int threads)
+{
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(serializer, librdf_serializer, 1);
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(handle, FILE*, 1);
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(model, librdf_model, 1);
+
+  if(threads > 1 && serializer->factory->serialize_model_to_file_handle_parallel)
+    return serializer->factory->serialize_model_to_file_handle_parallel(serializer->context,
+                                                                        handle,
+                                                                        base_uri,
+                                                                        model,
+                                                                        threads);
+
+  return serializer->factory->serialize_model_to_file_handle(serializer->context,
+                                                             handle, base_uri, model);
+}
+
+
 /**
  * librdf_serializer_serialize_stream_to_file:
  * @serializer: the serializer
@@ -779,6 +823,270 @@ librdf_serializer_serialize_model_to_iostream(librdf_serializer* serializer,
 }
 
 
+/* Size of the buffer between a serializer and a write handler */
+#define LIBRDF_SERIALIZER_HANDLER_BUFFER_SIZE 65536
+
+typedef struct {
+  /* NULL to only count the bytes */
+  librdf_serializer_write_handler handler;
+  void *user_data;
+  unsigned char *buffer;
+  size_t buffer_length;
+  size_t length;                /* total bytes written */
+  int failed;
+} librdf_serializer_handler_context;
+
+
+static int
+librdf_serializer_handler_flush(librdf_serializer_handler_context* hcontext)
+{
+  if(hcontext->buffer_length && !hcontext->failed &&
+     hcontext->handler(hcontext->user_data, hcontext->buffer,
+                       hcontext->buffer_length))
+    hcontext->failed=1;
+  hcontext->buffer_length=0;
+
+  return hcontext->failed;
+}
+
+
+static int
+librdf_serializer_handler_write_bytes(void *context, const void *ptr,
+                                      size_t size, size_t nmemb)
+{
+  librdf_serializer_handler_context* hcontext=(librdf_serializer_handler_context*)context;
+  size_t length=size * nmemb;
+
+  if(hcontext->failed)
+    return -1;
+
+  hcontext->length += length;
+  if(!hcontext->handler)
+    return LIBRDF_GOOD_CAST(int, nmemb);
+
+  if(hcontext->buffer_length + length > LIBRDF_SERIALIZER_HANDLER_BUFFER_SIZE &&
+     librdf_serializer_handler_flush(hcontext))
+    return -1;
+
+  /* Hand large writes straight to the handler */
+  if(length >= LIBRDF_SERIALIZER_HANDLER_BUFFER_SIZE) {
+    if(hcontext->handler(hcontext->user_data, (const unsigned char*)ptr,
+                         length)) {
+      hcontext->failed=1;
+      return -1;
+    }
+  } else {
+    memcpy(hcontext->buffer + hcontext->buffer_length, ptr, length);
+    hcontext->buffer_length += length;
+  }
+
+  return LIBRDF_GOOD_CAST(int, nmemb);
+}
+
+
+static int
+librdf_serializer_handler_write_byte(void *context, const int byte)
+{
+  unsigned char c=LIBRDF_GOOD_CAST(unsigned char, byte);
+
+  return librdf_serializer_handler_write_bytes(context, &c, 1, 1) != 1;
+}
+
+
+static int
+librdf_serializer_handler_write_end(void *context)
+{
+  librdf_serializer_handler_context* hcontext=(librdf_serializer_handler_context*)context;
+
+  if(hcontext->handler)
+    return librdf_serializer_handler_flush(hcontext);
+
+  return 0;
+}
+
+
+static const raptor_iostream_handler librdf_serializer_handler_iostream_handler = {
+  /* .version     = */ 2,
+  /* .init        = */ NULL,
+  /* .finish      = */ NULL,
+  /* .write_byte  = */ librdf_serializer_handler_write_byte,
+  /* .write_bytes = */ librdf_serializer_handler_write_bytes,
+  /* .write_end   = */ librdf_serializer_handler_write_end,
+  /* .read_bytes  = */ NULL,
+  /* .read_eof    = */ NULL
+};
+
+
+/*
+ * librdf_serializer_serialize_to_handler_common - Serialize a model or stream through a bounded buffer
+ * @serializer: serializer
+ * @base_uri: base URI (or NULL)
+ * @model: model or NULL
+ * @stream: stream if @model is NULL
+ * @handler: write handler or NULL to count bytes only
+ * @user_data: handler user data
+ * @length_p: pointer to store the total length or NULL
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_serializer_serialize_to_handler_common(librdf_serializer* serializer,
+                                              librdf_uri* base_uri,
+                                              librdf_model* model,
+                                              librdf_stream* stream,
+                                              librdf_serializer_write_handler handler,
+                                              void *user_data,
+                                              size_t* length_p)
+{
+  librdf_serializer_handler_context hcontext;
+  raptor_iostream* iostr;
+  int rc;
+
+  memset(&hcontext, '\0', sizeof(hcontext));
+  hcontext.handler=handler;
+  hcontext.user_data=user_data;
+  if(handler) {
+    hcontext.buffer=LIBRDF_MALLOC(unsigned char*,
+                                  LIBRDF_SERIALIZER_HANDLER_BUFFER_SIZE);
+    if(!hcontext.buffer)
+      return 1;
+  }
+
+  iostr=raptor_new_iostream_from_handler(serializer->world->raptor_world_ptr,
+                                         &hcontext,
+                                         &librdf_serializer_handler_iostream_handler);
+  if(!iostr) {
+    if(hcontext.buffer)
+      LIBRDF_FREE(char*, hcontext.buffer);
+    return 1;
+  }
+
+  /* takes ownership of iostr; freeing it flushes the buffer */
+  if(model)
+    rc=serializer->factory->serialize_model_to_iostream(serializer->context,
+                                                        base_uri, model,
+                                                        iostr);
+  else
+    rc=serializer->factory->serialize_stream_to_iostream(serializer->context,
+                                                         base_uri, stream,
+                                                         iostr);
+
+  if(!rc && hcontext.handler)
+    rc=librdf_serializer_handler_flush(&hcontext);
+  if(hcontext.failed)
+    rc=1;
+
+  if(hcontext.buffer)
+    LIBRDF_FREE(char*, hcontext.buffer);
+
+  if(length_p)
+    *length_p=hcontext.length;
+
+  return rc;
+}
+
+
+/**
+ * librdf_serializer_serialize_model_to_handler:
+ * @serializer: the serializer
+ * @base_uri: the base URI to use (or NULL)
+ * @model: the #librdf_model model to use
+ * @handler: function to call with each chunk of output
+ * @user_data: user data for @handler
+ *
+ * Write a serialized #librdf_model in chunks to a handler.
+ *
+ * The output is collected in a fixed size buffer that is passed to
+ * @handler when full, so memory use does not grow with the model.
+ * The data passed to @handler is only valid during the call.
+ * Serializing stops if @handler returns non 0.
+ *
+ * Return value: non 0 on failure
+ **/
+int
+librdf_serializer_serialize_model_to_handler(librdf_serializer* serializer,
+                                             librdf_uri* base_uri,
+                                             librdf_model* model,
+                                             librdf_serializer_write_handler handler,
+                                             void *user_data)
+{
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(serializer, librdf_serializer, 1);
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(model, librdf_model, 1);
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(handler, librdf_serializer_write_handler, 1);
+
+  return librdf_serializer_serialize_to_handler_common(serializer, base_uri,
+                                                       model, NULL,
+                                                       handler, user_data,
+                                                       NULL);
+}
+
+
+/**
+ * librdf_serializer_serialize_stream_to_handler:
+ * @serializer: the serializer
+ * @base_uri: the base URI to use (or NULL)
+ * @stream: the #librdf_stream stream to use
+ * @handler: function to call with each chunk of output
+ * @user_data: user data for @handler
+ *
+ * Write a #librdf_stream in chunks to a handler.
+ *
+ * See librdf_serializer_serialize_model_to_handler().
+ *
+ * Return value: non 0 on failure
+ **/
+int
+librdf_serializer_serialize_stream_to_handler(librdf_serializer* serializer,
+                                              librdf_uri* base_uri,
+                                              librdf_stream* stream,
+                                              librdf_serializer_write_handler handler,
+                                              void *user_data)
+{
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(serializer, librdf_serializer, 1);
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(stream, librdf_stream, 1);
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(handler, librdf_serializer_write_handler, 1);
+
+  return librdf_serializer_serialize_to_handler_common(serializer, base_uri,
+                                                       NULL, stream,
+                                                       handler, user_data,
+                                                       NULL);
+}
+
+
+/**
+ * librdf_serializer_get_model_serialized_length:
+ * @serializer: the serializer
+ * @base_uri: the base URI to use (or NULL)
+ * @model: the #librdf_model model to use
+ * @length_p: pointer to store the length
+ *
+ * Get the length of a serialized #librdf_model without storing it.
+ *
+ * The model is serialized and the bytes counted, so a caller that
+ * needs the serialization in memory can allocate it once and fill
+ * it with librdf_serializer_serialize_model_to_handler(), instead of
+ * the buffer being grown while serializing.  The model must not
+ * change between the calls.
+ *
+ * Return value: non 0 on failure
+ **/
+int
+librdf_serializer_get_model_serialized_length(librdf_serializer* serializer,
+                                              librdf_uri* base_uri,
+                                              librdf_model* model,
+                                              size_t* length_p)
+{
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(serializer, librdf_serializer, 1);
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(model, librdf_model, 1);
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(length_p, size_t, 1);
+
+  return librdf_serializer_serialize_to_handler_common(serializer, base_uri,
+                                                       model, NULL,
+                                                       NULL, NULL,
+                                                       length_p);
+}
+
+
 #ifndef REDLAND_DISABLE_DEPRECATED
 /**
  * librdf_serializer_set_error:
@@ -920,6 +1228,27 @@ struct log_data {
 } LogData;
 
 
+struct copy_data {
+  unsigned char *buffer;
+  size_t size;
+  size_t length;
+};
+
+
+static int
+copy_handler(void *user_data, const unsigned char *data, size_t length)
+{
+  struct copy_data* cd=(struct copy_data*)user_data;
+
+  if(cd->length + length > cd->size)
+    return 1;
+  memcpy(cd->buffer + cd->length, data, length);
+  cd->length += length;
+
+  return 0;
+}
+
+
 static int REDLAND_CALLBACK_STDCALL
 log_handler(void *user_data, librdf_log_message *message) 
 {
@@ -945,6 +1274,211 @@ log_handler(void *user_data, librdf_log_message *message)
 }
 
 
+/* Statements written to test binary dumps spanning several blocks */
+#define BINARY_TEST_STATEMENTS 20000
+
+/*
+ * test_binary_round_trip - Write a model as a binary dump and read it back
+ *
+ * The dump is over one block long and has statements in a context and
+ * outside any.
+ *
+ * Return value: non 0 on failure
+ */
+static int
+test_binary_round_trip(librdf_world* world, const char* program)
+{
+  librdf_storage *storage[2];
+  librdf_model *model[2];
+  librdf_serializer* serializer;
+  librdf_parser* parser;
+  librdf_node* context_node;
+  librdf_stream* stream;
+  unsigned char *string=NULL;
+  size_t string_length=0;
+  char literal[64];
+  int i;
+  int failed=0;
+
+  for(i=0; i < 2; i++) {
+    storage[i]=librdf_new_storage(world, "hashes", "test",
+                                  "hash-type='memory',contexts='yes'");
+    model[i]=storage[i] ? librdf_new_model(world, storage[i], NULL) : NULL;
+    if(!model[i]) {
+      fprintf(stderr, "%s: Failed to create model with contexts\n", program);
+      return 1;
+    }
+  }
+  context_node=librdf_new_node_from_uri_string(world, (const unsigned char*)"http://example.org/graph");
+
+  for(i=0; i < BINARY_TEST_STATEMENTS; i++) {
+    librdf_statement* statement;
+
+    sprintf(literal, "value %d of a statement in a binary RDF test dump", i);
+    statement=librdf_new_statement_from_nodes(world,
+      librdf_new_node_from_uri_string(world, (const unsigned char*)"http://example.org/subject"),
+      librdf_new_node_from_uri_string(world, (const unsigned char*)"http://example.org/predicate"),
+      librdf_new_node_from_literal(world, (const unsigned char*)literal, NULL, 0));
+    if(i % 2)
+      librdf_model_context_add_statement(model[0], context_node, statement);
+    else
+      librdf_model_add_statement(model[0], statement);
+    librdf_free_statement(statement);
+  }
+
+  fprintf(stderr, "%s: Writing and reading back a binary dump\n", program);
+  serializer=librdf_new_serializer(world, "redland-binary", NULL, NULL);
+  parser=librdf_new_parser(world, "redland-binary", NULL, NULL);
+  if(serializer)
+    string=librdf_serializer_serialize_model_to_counted_string(serializer,
+                                                               NULL, model[0],
+                                                               &string_length);
+  if(!string || !parser ||
+     librdf_parser_parse_counted_string_into_model(parser, string,
+                                                   string_length, NULL,
+                                                   model[1])) {
+    fprintf(stderr, "%s: Failed to write and read a binary dump\n", program);
+    failed=1;
+  }
+
+  if(!failed &&
+     librdf_model_size(model[1]) != librdf_model_size(model[0])) {
+    fprintf(stderr, "%s: Binary dump read back %d statements, expected %d\n",
+            program, librdf_model_size(model[1]),
+            librdf_model_size(model[0]));
+    failed=1;
+  }
+
+  /* every statement is read back in the same context */
+  stream=failed ? NULL : librdf_model_as_stream(model[0]);
+  while(stream && !librdf_stream_end(stream)) {
+    librdf_statement* statement=librdf_stream_get_object(stream);
+    librdf_node* node=(librdf_node*)librdf_stream_get_context2(stream);
+    int found;
+
+    if(node) {
+      librdf_stream* found_stream;
+
+      found_stream=librdf_model_find_statements_in_context(model[1],
+                                                           statement, node);
+      found=found_stream && !librdf_stream_end(found_stream);
+      if(found_stream)
+        librdf_free_stream(found_stream);
+    } else
+      found=librdf_model_contains_statement(model[1], statement);
+
+    if(!found) {
+      fprintf(stderr, "%s: Binary dump did not read back statement ", program);
+      librdf_statement_print(statement, stderr);
+      fputc('\n', stderr);
+      failed=1;
+      break;
+    }
+    librdf_stream_next(stream);
+  }
+  if(stream)
+    librdf_free_stream(stream);
+
+  if(string)
+    librdf_free_memory(string);
+  if(parser)
+    librdf_free_parser(parser);
+  if(serializer)
+    librdf_free_serializer(serializer);
+  librdf_free_node(context_node);
+  for(i=0; i < 2; i++) {
+    librdf_free_model(model[i]);
+    librdf_free_storage(storage[i]);
+  }
+
+  return failed;
+}
+
+
+/* Statements for a parallel serialize over several formatting chunks */
+#define PARALLEL_TEST_STATEMENTS 25000
+
+/*
+ * test_parallel_serialize - Check a parallel N-Triples serialize writes
+ * the same bytes as a serial one
+ *
+ * Return value: non 0 on failure
+ */
+static int
+test_parallel_serialize(librdf_world* world, const char* program)
+{
+  librdf_storage *storage;
+  librdf_model *model;
+  librdf_serializer* serializer;
+  unsigned char *string=NULL;
+  unsigned char *buffer=NULL;
+  size_t string_length=0;
+  char literal[64];
+  FILE *fh=NULL;
+  int i;
+  int failed=0;
+
+  storage=librdf_new_storage(world, NULL, NULL, NULL);
+  model=storage ? librdf_new_model(world, storage, NULL) : NULL;
+  serializer=librdf_new_serializer(world, "ntriples", NULL, NULL);
+  if(!model || !serializer) {
+    fprintf(stderr, "%s: Failed to create parallel serialize test objects\n",
+            program);
+    return 1;
+  }
+
+  for(i=0; i < PARALLEL_TEST_STATEMENTS; i++) {
+    librdf_statement* statement;
+
+    sprintf(literal, "value %d", i);
+    statement=librdf_new_statement_from_nodes(world,
+      librdf_new_node_from_uri_string(world, (const unsigned char*)"http://example.org/subject"),
+      librdf_new_node_from_uri_string(world, (const unsigned char*)"http://example.org/predicate"),
+      librdf_new_node_from_literal(world, (const unsigned char*)literal, NULL, 0));
+    librdf_model_add_statement(model, statement);
+    librdf_free_statement(statement);
+  }
+
+  fprintf(stderr, "%s: Serializing %d statements in parallel\n", program,
+          PARALLEL_TEST_STATEMENTS);
+  string=librdf_serializer_serialize_model_to_counted_string(serializer,
+                                                             NULL, model,
+                                                             &string_length);
+  fh=tmpfile();
+  if(!string || !fh ||
+     librdf_serializer_serialize_model_to_file_handle_parallel(serializer, fh,
+                                                               NULL, model,
+                                                               4)) {
+    fprintf(stderr, "%s: Failed to serialize model in parallel\n", program);
+    failed=1;
+  }
+
+  if(!failed) {
+    buffer=(unsigned char*)malloc(string_length + 1);
+    rewind(fh);
+    if(!buffer ||
+       fread(buffer, 1, string_length + 1, fh) != string_length ||
+       memcmp(buffer, string, string_length)) {
+      fprintf(stderr, "%s: Parallel serialize output differs from the serial output\n",
+              program);
+      failed=1;
+    }
+  }
+
+  if(buffer)
+    free(buffer);
+  if(fh)
+    fclose(fh);
+  if(string)
+    librdf_free_memory(string);
+  librdf_free_serializer(serializer);
+  librdf_free_model(model);
+  librdf_free_storage(storage);
+
+  return failed;
+}
+
+
 #define EXPECTED_ERRORS1 3
 /* Extra error is another UTF-8 encoding error */
 #define EXPECTED_ERRORS2 4
@@ -976,6 +1510,7 @@ main(int argc, char *argv[])
   librdf_stream* stream;
   FILE *fh;
   struct stat st_buf;
+  struct copy_data cd;
 
   world=librdf_new_world();
   librdf_world_open(world);
@@ -1129,11 +1664,41 @@ main(int argc, char *argv[])
   librdf_free_stream(stream);
 
 
+  fprintf(stderr, "%s: Serializing model to a handler\n", program);
+
+  if(librdf_serializer_get_model_serialized_length(serializer, NULL, model,
+                                                   &string_length) ||
+     string_length != EXPECTED_GOOD_STRING_LENGTH) {
+    fprintf(stderr, "%s: Serialized model length was %d, expected %d\n",
+            program, (int)string_length, EXPECTED_GOOD_STRING_LENGTH);
+    return 1;
+  }
+
+  cd.buffer=(unsigned char*)malloc(string_length);
+  cd.size=string_length;
+  cd.length=0;
+  if(librdf_serializer_serialize_model_to_handler(serializer, NULL, model,
+                                                  copy_handler, &cd) ||
+     cd.length != string_length) {
+    fprintf(stderr, "%s: Serialising model to a handler returned %d bytes, expected %d\n",
+            program, (int)cd.length, (int)string_length);
+    return 1;
+  }
+  free(cd.buffer);
+
+
   librdf_free_serializer(serializer); serializer=NULL;
   librdf_free_model(model); model=NULL;
   librdf_free_storage(storage); storage=NULL;
 
 
+  if(test_binary_round_trip(world, program))
+    return 1;
+
+  if(test_parallel_serialize(world, program))
+    return 1;
+
+
   librdf_free_world(world);
   
   /* keep gcc -Wall happy */
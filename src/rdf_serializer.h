@@ -67,6 +67,27 @@ REDLAND_API
 int librdf_serializer_serialize_stream_to_file_handle(librdf_serializer* serializer, FILE *handle, librdf_uri* base_uri, librdf_stream *stream);
 REDLAND_API
 int librdf_serializer_serialize_model_to_file_handle(librdf_serializer* serializer, FILE *handle, librdf_uri* base_uri, librdf_model* model);
+/**
+ * librdf_serializer_write_handler:
+ * @user_data: user data
+ * @data: serialized bytes, only valid during the call
+ * @length: number of bytes
+ *
+ * Handler for chunks of serialized output.
+ *
+ * Return value: non 0 to stop serializing
+ */
+typedef int (*librdf_serializer_write_handler)(void *user_data, const unsigned char *data, size_t length);
+
+REDLAND_API
+int librdf_serializer_serialize_model_to_handler(librdf_serializer* serializer, librdf_uri* base_uri, librdf_model* model, librdf_serializer_write_handler handler, void *user_data);
+REDLAND_API
+int librdf_serializer_serialize_stream_to_handler(librdf_serializer* serializer, librdf_uri* base_uri, librdf_stream* stream, librdf_serializer_write_handler handler, void *user_data);
+REDLAND_API
+int librdf_serializer_get_model_serialized_length(librdf_serializer* serializer, librdf_uri* base_uri, librdf_model* model, size_t* length_p);
+
+REDLAND_API
+int librdf_serializer_serialize_model_to_file_handle_parallel(librdf_serializer* serializer, FILE *handle, librdf_uri* base_uri, librdf_model* model, int threads);
 REDLAND_API
 int librdf_serializer_serialize_stream_to_file(librdf_serializer* serializer, const char *name, librdf_uri* base_uri, librdf_stream* stream);
 REDLAND_API
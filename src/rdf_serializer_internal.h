@@ -77,6 +77,9 @@ struct librdf_serializer_factory_s
   int (*serialize_stream_to_iostream)(void *context, librdf_uri* base_uri, librdf_stream *stream, raptor_iostream* iostr);
 
   int (*serialize_model_to_iostream)(void *context, librdf_uri* base_uri, librdf_model *model, raptor_iostream* iostr);
+
+  /* serialize with worker threads - optional */
+  int (*serialize_model_to_file_handle_parallel)(void *_context, FILE *handle, librdf_uri* base_uri, librdf_model *model, int threads);
 };
 
 
@@ -105,6 +108,9 @@ void librdf_finish_serializer(librdf_world *world);
 void librdf_serializer_raptor_constructor(librdf_world* world);
 void librdf_serializer_rdfxml_constructor(librdf_world* world);
 
+/* rdf_binary.c */
+void librdf_serializer_binary_constructor(librdf_world* world);
+
 
 #ifdef __cplusplus
 }
@@ -36,6 +36,10 @@
 
 #include <redland.h>
 
+#ifdef WITH_THREADS
+#include <pthread.h>
+#endif
+
 
 typedef struct {
   librdf_serializer *serializer;        /* librdf serializer object */
@@ -404,6 +408,348 @@ librdf_serializer_raptor_serialize_model_to_iostream(void *context,
 }
 
 
+#ifdef WITH_THREADS
+
+/*
+ * Parallel serializing of line-based syntaxes
+ *
+ * The calling thread reads the model stream into chunks of statement
+ * copies, worker threads format chunks into strings and the calling
+ * thread writes the strings in the order the chunks were made, so
+ * the output is the same as serializing on one thread.  Only the
+ * calling thread reads the model or changes node reference counts;
+ * workers only read the statements of the chunk they format.
+ */
+
+/* Number of statements in each chunk handed to a worker */
+#define LIBRDF_SERIALIZER_RAPTOR_PARALLEL_CHUNK_SIZE 10000
+
+typedef struct {
+  librdf_statement **statements;
+  int count;
+  /* set by the worker */
+  unsigned char *output;
+  size_t output_length;
+  int done;
+  int failed;
+} librdf_serializer_raptor_parallel_chunk;
+
+typedef struct {
+  int is_nquads;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t job_cond;      /* chunk queued or serializing finished */
+  pthread_cond_t done_cond;     /* chunk formatted */
+
+  /* chunks waiting for a worker */
+  raptor_sequence *jobs;
+  /* ring of chunks in output order */
+  librdf_serializer_raptor_parallel_chunk **chunks;
+  int chunks_size;
+  int chunks_start;
+  int chunks_count;
+  int finished;                 /* set to stop the workers */
+} librdf_serializer_raptor_parallel_context;
+
+typedef struct {
+  librdf_serializer_raptor_parallel_context *pcontext;
+  pthread_t thread;
+  raptor_world *world;
+} librdf_serializer_raptor_parallel_worker;
+
+
+static void
+librdf_serializer_raptor_parallel_free_chunk(librdf_serializer_raptor_parallel_chunk* chunk)
+{
+  int i;
+
+  for(i=0; i < chunk->count; i++)
+    librdf_free_statement(chunk->statements[i]);
+  if(chunk->statements)
+    LIBRDF_FREE(librdf_statement**, chunk->statements);
+  if(chunk->output)
+    raptor_free_memory(chunk->output);
+  LIBRDF_FREE(librdf_serializer_raptor_parallel_chunk, chunk);
+}
+
+
+/*
+ * librdf_serializer_raptor_parallel_read_chunk - Copy statements from a stream
+ * @world: redland world
+ * @stream: stream
+ *
+ * Return value: new chunk, which may be empty, or NULL on failure
+ */
+static librdf_serializer_raptor_parallel_chunk*
+librdf_serializer_raptor_parallel_read_chunk(librdf_world* world,
+                                             librdf_stream* stream)
+{
+  librdf_serializer_raptor_parallel_chunk* chunk;
+
+  chunk = LIBRDF_CALLOC(librdf_serializer_raptor_parallel_chunk*, 1,
+                        sizeof(*chunk));
+  if(!chunk)
+    return NULL;
+
+  chunk->statements = LIBRDF_MALLOC(librdf_statement**,
+                                    LIBRDF_SERIALIZER_RAPTOR_PARALLEL_CHUNK_SIZE * sizeof(librdf_statement*));
+  if(!chunk->statements) {
+    librdf_serializer_raptor_parallel_free_chunk(chunk);
+    return NULL;
+  }
+
+  while(chunk->count < LIBRDF_SERIALIZER_RAPTOR_PARALLEL_CHUNK_SIZE &&
+        !librdf_stream_end(stream)) {
+    librdf_statement *statement = librdf_stream_get_object(stream);
+    librdf_node *graph = librdf_stream_get_context2(stream);
+    librdf_statement *copy;
+
+    copy = librdf_new_statement_from_nodes(world,
+                                           librdf_new_node_from_node(librdf_statement_get_subject(statement)),
+                                           librdf_new_node_from_node(librdf_statement_get_predicate(statement)),
+                                           librdf_new_node_from_node(librdf_statement_get_object(statement)));
+    if(!copy) {
+      librdf_serializer_raptor_parallel_free_chunk(chunk);
+      return NULL;
+    }
+    if(graph)
+      copy->graph = librdf_new_node_from_node(graph);
+
+    chunk->statements[chunk->count++] = copy;
+    librdf_stream_next(stream);
+  }
+
+  return chunk;
+}
+
+
+static void*
+librdf_serializer_raptor_parallel_worker_main(void* arg)
+{
+  librdf_serializer_raptor_parallel_worker* worker=(librdf_serializer_raptor_parallel_worker*)arg;
+  librdf_serializer_raptor_parallel_context* pcontext=worker->pcontext;
+
+  while(1) {
+    librdf_serializer_raptor_parallel_chunk* chunk;
+    raptor_iostream *iostr;
+    void *string=NULL;
+    size_t length=0;
+    int failed=0;
+    int i;
+
+    pthread_mutex_lock(&pcontext->mutex);
+    while(!raptor_sequence_size(pcontext->jobs) && !pcontext->finished)
+      pthread_cond_wait(&pcontext->job_cond, &pcontext->mutex);
+    chunk=NULL;
+    if(!pcontext->finished)
+      chunk=(librdf_serializer_raptor_parallel_chunk*)raptor_sequence_unshift(pcontext->jobs);
+    pthread_mutex_unlock(&pcontext->mutex);
+
+    if(!chunk)
+      break;
+
+    /* the terms belong to the shared world but are only read */
+    iostr=raptor_new_iostream_to_string(worker->world, &string, &length,
+                                        malloc);
+    if(!iostr)
+      failed=1;
+    for(i=0; !failed && i < chunk->count; i++)
+      failed=raptor_statement_ntriples_write(chunk->statements[i], iostr,
+                                             pcontext->is_nquads);
+    if(iostr)
+      raptor_free_iostream(iostr);
+
+    pthread_mutex_lock(&pcontext->mutex);
+    chunk->output=(unsigned char*)string;
+    chunk->output_length=length;
+    chunk->failed=failed;
+    chunk->done=1;
+    pthread_cond_broadcast(&pcontext->done_cond);
+    pthread_mutex_unlock(&pcontext->mutex);
+  }
+
+  return NULL;
+}
+
+
+/**
+ * librdf_serializer_raptor_serialize_model_to_file_handle_parallel:
+ * @context: serializer context
+ * @handle: FILE* to write to
+ * @base_uri: base URI (or NULL)
+ * @model: model
+ * @threads: number of formatting threads
+ *
+ * Serialize a model as N-Triples or N-Quads using threads.
+ *
+ * Other syntaxes are serialized on the calling thread.
+ *
+ * Return value: non 0 on failure
+ **/
+static int
+librdf_serializer_raptor_serialize_model_to_file_handle_parallel(void *context,
+                                                                 FILE *handle,
+                                                                 librdf_uri* base_uri,
+                                                                 librdf_model *model,
+                                                                 int threads)
+{
+  librdf_serializer_raptor_context* scontext=(librdf_serializer_raptor_context*)context;
+  librdf_serializer_raptor_parallel_context parallel;
+  librdf_serializer_raptor_parallel_worker* workers;
+  librdf_world* world=scontext->serializer->world;
+  librdf_stream *stream=NULL;
+  int stream_ended=0;
+  int workers_started=0;
+  int status=0;
+  int i;
+
+  if(strcmp(scontext->serializer_name, "ntriples") &&
+     strcmp(scontext->serializer_name, "nquads"))
+    return librdf_serializer_raptor_serialize_model_to_file_handle(context,
+                                                                   handle,
+                                                                   base_uri,
+                                                                   model);
+
+  memset(&parallel, '\0', sizeof(parallel));
+  parallel.is_nquads=!strcmp(scontext->serializer_name, "nquads");
+  parallel.chunks_size=threads * 2;
+  parallel.jobs=raptor_new_sequence(NULL, NULL);
+  parallel.chunks=LIBRDF_CALLOC(librdf_serializer_raptor_parallel_chunk**,
+                                LIBRDF_GOOD_CAST(size_t, parallel.chunks_size),
+                                sizeof(librdf_serializer_raptor_parallel_chunk*));
+
+  workers = LIBRDF_CALLOC(librdf_serializer_raptor_parallel_worker*,
+                          LIBRDF_GOOD_CAST(size_t, threads),
+                          sizeof(*workers));
+  if(!parallel.jobs || !parallel.chunks || !workers) {
+    status=1;
+    goto tidy;
+  }
+
+  stream=librdf_model_as_stream(model);
+  if(!stream) {
+    status=1;
+    goto tidy;
+  }
+
+  pthread_mutex_init(&parallel.mutex, NULL);
+  pthread_cond_init(&parallel.job_cond, NULL);
+  pthread_cond_init(&parallel.done_cond, NULL);
+
+  /* raptor worlds are made here since raptor initialisation is not
+   * thread safe */
+  for(i=0; !status && i < threads; i++) {
+    workers[i].pcontext=&parallel;
+    workers[i].world=raptor_new_world();
+    if(!workers[i].world || raptor_world_open(workers[i].world))
+      status=1;
+  }
+
+  for(i=0; !status && i < threads; i++) {
+    if(pthread_create(&workers[i].thread, NULL,
+                      librdf_serializer_raptor_parallel_worker_main,
+                      &workers[i])) {
+      /* carry on with the workers already started */
+      if(!i)
+        status=1;
+      break;
+    }
+    workers_started++;
+  }
+
+  /* Queue chunks while there is room and write formatted chunks in order */
+  while(!status) {
+    librdf_serializer_raptor_parallel_chunk* chunk=NULL;
+
+    pthread_mutex_lock(&parallel.mutex);
+    while(parallel.chunks_count &&
+          (parallel.chunks_count == parallel.chunks_size || stream_ended) &&
+          !parallel.chunks[parallel.chunks_start]->done)
+      pthread_cond_wait(&parallel.done_cond, &parallel.mutex);
+    if(parallel.chunks_count && parallel.chunks[parallel.chunks_start]->done) {
+      chunk=parallel.chunks[parallel.chunks_start];
+      parallel.chunks[parallel.chunks_start]=NULL;
+      parallel.chunks_start=(parallel.chunks_start + 1) % parallel.chunks_size;
+      parallel.chunks_count--;
+    }
+    pthread_mutex_unlock(&parallel.mutex);
+
+    if(chunk) {
+      if(chunk->failed ||
+         (chunk->output_length &&
+          fwrite(chunk->output, 1, chunk->output_length, handle) != chunk->output_length))
+        status=1;
+      librdf_serializer_raptor_parallel_free_chunk(chunk);
+      continue;
+    }
+
+    if(stream_ended)
+      break;
+
+    chunk=librdf_serializer_raptor_parallel_read_chunk(world, stream);
+    if(!chunk) {
+      status=1;
+      break;
+    }
+    if(librdf_stream_end(stream))
+      stream_ended=1;
+    if(!chunk->count) {
+      librdf_serializer_raptor_parallel_free_chunk(chunk);
+      continue;
+    }
+
+    pthread_mutex_lock(&parallel.mutex);
+    parallel.chunks[(parallel.chunks_start + parallel.chunks_count) % parallel.chunks_size]=chunk;
+    parallel.chunks_count++;
+    if(raptor_sequence_push(parallel.jobs, chunk))
+      status=1;
+    else
+      pthread_cond_signal(&parallel.job_cond);
+    pthread_mutex_unlock(&parallel.mutex);
+  }
+
+  /* Stop and wait for the workers; chunks left are freed below */
+  pthread_mutex_lock(&parallel.mutex);
+  parallel.finished=1;
+  pthread_cond_broadcast(&parallel.job_cond);
+  pthread_mutex_unlock(&parallel.mutex);
+
+  for(i=0; i < workers_started; i++)
+    pthread_join(workers[i].thread, NULL);
+
+  pthread_mutex_destroy(&parallel.mutex);
+  pthread_cond_destroy(&parallel.job_cond);
+  pthread_cond_destroy(&parallel.done_cond);
+
+  if(status)
+    librdf_log(world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_SERIALIZER, NULL,
+               "Failed to serialize %s in parallel",
+               scontext->serializer_name);
+
+  tidy:
+  if(parallel.chunks) {
+    for(i=0; i < parallel.chunks_count; i++)
+      librdf_serializer_raptor_parallel_free_chunk(parallel.chunks[(parallel.chunks_start + i) % parallel.chunks_size]);
+    LIBRDF_FREE(librdf_serializer_raptor_parallel_chunk**, parallel.chunks);
+  }
+  if(workers) {
+    for(i=0; i < threads; i++) {
+      if(workers[i].world)
+        raptor_free_world(workers[i].world);
+    }
+    LIBRDF_FREE(librdf_serializer_raptor_parallel_worker*, workers);
+  }
+  if(parallel.jobs)
+    raptor_free_sequence(parallel.jobs);
+  if(stream)
+    librdf_free_stream(stream);
+
+  return status;
+}
+
+#endif /* WITH_THREADS */
+
+
 /**
  * librdf_serializer_raptor_register_factory:
  * @factory: factory
@@ -429,6 +775,9 @@ librdf_serializer_raptor_register_factory(librdf_serializer_factory *factory)
   factory->serialize_model_to_counted_string = librdf_serializer_raptor_serialize_model_to_counted_string;
   factory->serialize_stream_to_iostream = librdf_serializer_raptor_serialize_stream_to_iostream;
   factory->serialize_model_to_iostream = librdf_serializer_raptor_serialize_model_to_iostream;
+#ifdef WITH_THREADS
+  factory->serialize_model_to_file_handle_parallel = librdf_serializer_raptor_serialize_model_to_file_handle_parallel;
+#endif
 }
 
 
@@ -58,7 +58,6 @@ static void* librdf_storage_stream_to_node_iterator_get_method(void* iterator, i
 static void librdf_storage_stream_to_node_iterator_finished(void* iterator);
 
 /* helper function for creating iterators for get sources, targets, arcs */
-static librdf_iterator* librdf_storage_node_stream_to_node_create(librdf_storage* storage, librdf_node* node1, librdf_node *node2, librdf_statement_part want);
 
 /* helper functions for dynamically loading storage modules */
 #ifdef MODULAR_LIBRDF
@@ -105,6 +104,12 @@ librdf_init_storage(librdf_world *world)
   #ifdef STORAGE_FILE
     librdf_init_storage_file(world);
   #endif
+  #ifdef STORAGE_COMPACT
+    librdf_init_storage_compact(world);
+  #endif
+  #ifdef STORAGE_FROZEN
+    librdf_init_storage_frozen(world);
+  #endif
 
 #ifdef MODULAR_LIBRDF
 
@@ -869,6 +874,77 @@ librdf_storage_size(librdf_storage* storage)
 }
 
 
+/**
+ * librdf_storage_count_statements:
+ * @storage: #librdf_storage object
+ * @predicate: #librdf_node predicate to count or NULL for any
+ * @context_node: #librdf_node context to count in or NULL for all
+ *
+ * Get the number of statements with a predicate and/or in a context.
+ *
+ * Uses the counts kept by the storage if it has them, otherwise
+ * counts the statements that match.  With neither @predicate nor
+ * @context_node this is the same as librdf_storage_size().
+ *
+ * Return value: The number of statements or < 0 if cannot be determined
+ **/
+int
+librdf_storage_count_statements(librdf_storage* storage,
+                                librdf_node* predicate,
+                                librdf_node* context_node)
+{
+  librdf_statement *partial_statement;
+  librdf_stream *stream;
+  int count;
+
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(storage, librdf_storage, -1);
+
+  if(storage->factory->count_statements) {
+    count=storage->factory->count_statements(storage, predicate, context_node);
+    if(count >= 0)
+      return count;
+  }
+
+  if(!predicate && !context_node) {
+    count=librdf_storage_size(storage);
+    if(count >= 0)
+      return count;
+  }
+
+  partial_statement=librdf_new_statement(storage->world);
+  if(!partial_statement)
+    return -1;
+
+  if(predicate) {
+    predicate=librdf_new_node_from_node(predicate);
+    if(!predicate) {
+      librdf_free_statement(partial_statement);
+      return -1;
+    }
+    librdf_statement_set_predicate(partial_statement, predicate);
+  }
+
+  if(context_node)
+    stream=librdf_storage_find_statements_in_context(storage,
+                                                     partial_statement,
+                                                     context_node);
+  else
+    stream=librdf_storage_find_statements(storage, partial_statement);
+  librdf_free_statement(partial_statement);
+  if(!stream)
+    return -1;
+
+  count=0;
+  while(!librdf_stream_end(stream)) {
+    count++;
+    librdf_stream_next(stream);
+  }
+  librdf_free_stream(stream);
+
+  return count;
+}
+
+
 /**
  * librdf_storage_add_statement:
  * @storage: #librdf_storage object
@@ -1211,7 +1287,7 @@ librdf_storage_stream_to_node_iterator_finished(void* iterator)
  * 
  * Return value: a new #librdf_iterator or NULL on failure
  **/
-static librdf_iterator*
+librdf_iterator*
 librdf_storage_node_stream_to_node_create(librdf_storage* storage,
                                           librdf_node *node1,
                                           librdf_node *node2,
@@ -1992,6 +2068,11 @@ librdf_storage_transaction_get_handle(librdf_storage* storage)
 
 /* one more prototype */
 int main(int argc, char *argv[]);
+librdf_statement* test_memory_statement(librdf_world *world, int i);
+int test_memory_storage(librdf_world *world, const char *program);
+#ifdef HAVE_BDB_HASH
+int test_hashes_counts(librdf_world *world, const char *program);
+#endif
 
 
 int
@@ -2012,6 +2093,9 @@ main(int argc, char *argv[])
     #ifdef STORAGE_TREES
 	    "trees", "test", "contexts='yes'",
     #endif
+    #ifdef STORAGE_COMPACT
+	    "compact", "test", NULL,
+    #endif
     #ifdef STORAGE_FILE
       "file", "file://../redland.rdf", NULL,
 	    "uri", "http://librdf.org/redland.rdf", NULL,
@@ -2070,10 +2154,269 @@ main(int argc, char *argv[])
 
   }
   
+  if(test_memory_storage(world, program))
+    ret++;
+
+#ifdef HAVE_BDB_HASH
+  if(test_hashes_counts(world, program))
+    ret++;
+#endif
 
   librdf_free_world(world);
   
   return ret;
 }
 
+
+#define MEMORY_TEST_COUNT 200
+
+librdf_statement*
+test_memory_statement(librdf_world *world, int i)
+{
+  char buffer[64];
+  librdf_node *subject, *object;
+
+  sprintf(buffer, "http://example.org/s%d", i);
+  subject=librdf_new_node_from_uri_string(world, (const unsigned char*)buffer);
+  sprintf(buffer, "value %d", i);
+  object=librdf_new_node_from_literal(world, (const unsigned char*)buffer,
+                                      NULL, 0);
+
+  return librdf_new_statement_from_nodes(world, subject,
+    librdf_new_node_from_uri_string(world, (const unsigned char*)"http://example.org/p"),
+    object);
+}
+
+
+/* add, find, remove and re-add statements in the memory store */
+int
+test_memory_storage(librdf_world *world, const char *program)
+{
+  librdf_storage* storage;
+  librdf_statement* statement;
+  librdf_node* context_node;
+  librdf_stream* stream;
+  int count;
+  int i;
+  int status=0;
+
+  fprintf(stdout, "%s: Testing memory storage add and remove\n", program);
+  storage=librdf_new_storage(world, "memory", NULL, "contexts='yes'");
+  if(!storage || librdf_storage_open(storage, NULL)) {
+    fprintf(stderr, "%s: Failed to open memory storage\n", program);
+    return 1;
+  }
+
+  for(i=0; i < MEMORY_TEST_COUNT; i++) {
+    statement=test_memory_statement(world, i);
+    if(librdf_storage_add_statement(storage, statement))
+      status=1;
+    librdf_free_statement(statement);
+  }
+  if(status || librdf_storage_size(storage) != MEMORY_TEST_COUNT) {
+    fprintf(stderr, "%s: Memory storage has %d statements after adding %d\n",
+            program, librdf_storage_size(storage), MEMORY_TEST_COUNT);
+    status=1;
+    goto tidy;
+  }
+
+  /* remove the even statements */
+  for(i=0; i < MEMORY_TEST_COUNT; i += 2) {
+    statement=test_memory_statement(world, i);
+    if(librdf_storage_remove_statement(storage, statement)) {
+      fprintf(stderr, "%s: Failed to remove statement %d\n", program, i);
+      status=1;
+    }
+    if(!librdf_storage_remove_statement(storage, statement)) {
+      fprintf(stderr, "%s: Removed statement %d twice\n", program, i);
+      status=1;
+    }
+    librdf_free_statement(statement);
+  }
+  if(librdf_storage_size(storage) != MEMORY_TEST_COUNT / 2)
+    status=1;
+
+  for(i=0; i < MEMORY_TEST_COUNT; i++) {
+    statement=test_memory_statement(world, i);
+    if(librdf_storage_contains_statement(storage, statement) != (i % 2)) {
+      fprintf(stderr, "%s: Statement %d %s after removal\n", program, i,
+              (i % 2) ? "missing" : "still present");
+      status=1;
+    }
+    librdf_free_statement(statement);
+  }
+
+  /* the remaining statements must still be found by predicate */
+  statement=librdf_new_statement_from_nodes(world, NULL,
+    librdf_new_node_from_uri_string(world, (const unsigned char*)"http://example.org/p"),
+    NULL);
+  stream=librdf_storage_find_statements(storage, statement);
+  librdf_free_statement(statement);
+  for(count=0; stream && !librdf_stream_end(stream); librdf_stream_next(stream))
+    count++;
+  if(stream)
+    librdf_free_stream(stream);
+  if(count != MEMORY_TEST_COUNT / 2) {
+    fprintf(stderr, "%s: Found %d statements by predicate, expected %d\n",
+            program, count, MEMORY_TEST_COUNT / 2);
+    status=1;
+  }
+
+  /* re-add the even statements */
+  for(i=0; i < MEMORY_TEST_COUNT; i += 2) {
+    statement=test_memory_statement(world, i);
+    if(librdf_storage_add_statement(storage, statement) ||
+       !librdf_storage_contains_statement(storage, statement))
+      status=1;
+    librdf_free_statement(statement);
+  }
+  if(status || librdf_storage_size(storage) != MEMORY_TEST_COUNT) {
+    fprintf(stderr, "%s: Memory storage has %d statements after re-adding\n",
+            program, librdf_storage_size(storage));
+    status=1;
+    goto tidy;
+  }
+
+  /* a statement in a context is only removed from that context */
+  context_node=librdf_new_node_from_uri_string(world, (const unsigned char*)"http://example.org/graph");
+  statement=test_memory_statement(world, MEMORY_TEST_COUNT);
+  if(librdf_storage_context_add_statement(storage, context_node, statement) ||
+     librdf_storage_size(storage) != MEMORY_TEST_COUNT + 1) {
+    fprintf(stderr, "%s: Failed to add statement to context\n", program);
+    status=1;
+  }
+  if(!librdf_storage_remove_statement(storage, statement)) {
+    fprintf(stderr, "%s: Removed context statement without its context\n",
+            program);
+    status=1;
+  }
+  if(librdf_storage_context_remove_statement(storage, context_node, statement) ||
+     librdf_storage_contains_statement(storage, statement) ||
+     librdf_storage_size(storage) != MEMORY_TEST_COUNT) {
+    fprintf(stderr, "%s: Failed to remove statement from context\n",
+            program);
+    status=1;
+  }
+  stream=librdf_storage_context_as_stream(storage, context_node);
+  if(stream) {
+    if(!librdf_stream_end(stream)) {
+      fprintf(stderr, "%s: Context not empty after removal\n", program);
+      status=1;
+    }
+    librdf_free_stream(stream);
+  }
+  librdf_free_statement(statement);
+  librdf_free_node(context_node);
+
+  tidy:
+  librdf_storage_close(storage);
+  librdf_free_storage(storage);
+
+  return status;
+}
+
+
+#ifdef HAVE_BDB_HASH
+#define COUNTS_TEST_OPTIONS "hash-type='bdb',dir='.',write='yes'"
+
+/* open a bdb hashes store, add statements from first to first+count-1
+ * and return its size after closing and opening it again, or -1 */
+static int
+test_hashes_counts_update(librdf_world *world, const char *name,
+                          const char *options, int first, int count)
+{
+  librdf_storage* storage;
+  librdf_statement* statement;
+  int size=-1;
+  int i;
+
+  storage=librdf_new_storage(world, "hashes", name, options);
+  if(!storage)
+    return -1;
+  if(librdf_storage_open(storage, NULL)) {
+    librdf_free_storage(storage);
+    return -1;
+  }
+
+  for(i=first; i < first + count; i++) {
+    statement=test_memory_statement(world, i);
+    librdf_storage_add_statement(storage, statement);
+    librdf_free_statement(statement);
+  }
+  librdf_storage_close(storage);
+
+  if(!librdf_storage_open(storage, NULL)) {
+    size=librdf_storage_size(storage);
+    librdf_storage_close(storage);
+  }
+  librdf_free_storage(storage);
+
+  return size;
+}
+
+
+/* counts kept by one open are not trusted after a write without them */
+int
+test_hashes_counts(librdf_world *world, const char *program)
+{
+  const char* const files[] = {
+    "test-counts-sp2o.db", "test-counts-po2s.db", "test-counts-so2p.db",
+    "test-counts-counts.db",
+    "test-nocounts-sp2o.db", "test-nocounts-po2s.db", "test-nocounts-so2p.db",
+    NULL
+  };
+  FILE* fh;
+  int status=0;
+  int size;
+  int i;
+
+  fprintf(stdout, "%s: Testing hashes storage counts\n", program);
+
+  size=test_hashes_counts_update(world, "test-counts",
+                                 COUNTS_TEST_OPTIONS ",new='yes',counts='yes'",
+                                 0, 10);
+  if(size != 10) {
+    fprintf(stderr, "%s: Counted store has size %d, expected 10\n",
+            program, size);
+    status=1;
+  }
+
+  size=test_hashes_counts_update(world, "test-counts",
+                                 COUNTS_TEST_OPTIONS, 10, 2);
+  if(size != 12) {
+    fprintf(stderr, "%s: Store has size %d without counts, expected 12\n",
+            program, size);
+    status=1;
+  }
+
+  size=test_hashes_counts_update(world, "test-counts",
+                                 COUNTS_TEST_OPTIONS ",counts='yes'", 12, 1);
+  if(size != 13) {
+    fprintf(stderr, "%s: Store has size %d with stale counts, expected 13\n",
+            program, size);
+    status=1;
+  }
+
+  /* a store never opened with counts has no counts hash */
+  size=test_hashes_counts_update(world, "test-nocounts",
+                                 COUNTS_TEST_OPTIONS ",new='yes'", 0, 5);
+  if(size != 5) {
+    fprintf(stderr, "%s: Store has size %d, expected 5\n", program, size);
+    status=1;
+  }
+  fh=fopen("test-nocounts-counts.db", "rb");
+  if(fh) {
+    fprintf(stderr, "%s: Store without counts made a counts hash\n",
+            program);
+    fclose(fh);
+    status=1;
+  }
+
+  for(i=0; files[i]; i++)
+    remove(files[i]);
+
+  return status;
+}
+#endif
+
 #endif
@@ -80,6 +80,8 @@ int librdf_storage_close(librdf_storage* storage);
 
 REDLAND_API
 int librdf_storage_size(librdf_storage* storage);
+REDLAND_API
+int librdf_storage_count_statements(librdf_storage* storage, librdf_node* predicate, librdf_node* context_node);
 
 REDLAND_API
 int librdf_storage_add_statement(librdf_storage* storage, librdf_statement* statement);
@@ -147,6 +149,17 @@ librdf_stream* librdf_storage_find_statements_in_context(librdf_storage* storage
 REDLAND_API
 librdf_iterator* librdf_storage_get_contexts(librdf_storage* storage);
 
+/**
+ * LIBRDF_STORAGE_FEATURE_CACHE_STATS:
+ *
+ * Storage feature URI string for getting the cache statistics of a
+ * storage with a cache, such as hashes storage using a Berkeley DB
+ * environment (option 'bdb-env-dir').  The value is a literal of the
+ * form "cache-hits='N', cache-misses='N', cache-hit-ratio='R',
+ * pages-read='N', pages-written='N'".
+ */
+#define LIBRDF_STORAGE_FEATURE_CACHE_STATS "http://feature.librdf.org/storage-cache-stats"
+
 /* features */
 REDLAND_API
 librdf_node* librdf_storage_get_feature(librdf_storage* storage, librdf_uri* feature);
@@ -0,0 +1,1698 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * rdf_storage_compact.c - RDF Storage in compact in-memory indexes
+ *
+ * Copyright (C) 2000-2008, David Beckett http://www.dajobe.org/
+ * Copyright (C) 2000-2004, University of Bristol, UK http://www.bristol.ac.uk/
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ *
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <rdf_config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_rdf_config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#include <redland.h>
+#include <rdf_types.h>
+
+
+/*
+ * A compact store keeps each node once, as its librdf_node_encode()
+ * form in a term dictionary that gives it a term ID from 1, and each
+ * statement as the three term IDs of its parts.
+ *
+ * The statements are held in three adjacency indexes, with the parts
+ * in SPO, POS and OSP order, laid out like HDT BitmapTriples: for
+ * each ID of the first part a range of the distinct second parts
+ * used with it and for each of those pairs a range of the third
+ * parts.  Sorted offset arrays mark where the ranges start in place
+ * of bitmaps with rank and select, so that a range is found with one
+ * lookup and one binary search.  An index costs 4 bytes a statement,
+ * 8 bytes a pair and 4 bytes a term ID.
+ *
+ * The indexes are built from sorted statements and not changed
+ * afterwards.  Statements added or removed since are kept in two
+ * hashed sets and merged into new indexes the next time the
+ * statements are searched, so loading and then querying a graph
+ * builds the indexes once.  Streams keep a reference to the indexes
+ * they were made from and are not affected by later changes.
+ *
+ * Term IDs, pairs and statements of each index are limited to fewer
+ * than 2^32.  Nodes stay in the dictionary once added.
+ */
+
+/* statement parts */
+#define LIBRDF_STORAGE_COMPACT_SUBJECT   0
+#define LIBRDF_STORAGE_COMPACT_PREDICATE 1
+#define LIBRDF_STORAGE_COMPACT_OBJECT    2
+
+/* the largest term ID or count; the value is a removed set member */
+#define LIBRDF_STORAGE_COMPACT_MAX_ID 0xFFFFFFFEUL
+#define LIBRDF_STORAGE_COMPACT_DELETED 0xFFFFFFFFUL
+
+typedef enum {
+  LIBRDF_STORAGE_COMPACT_SPO,
+  LIBRDF_STORAGE_COMPACT_POS,
+  LIBRDF_STORAGE_COMPACT_OSP,
+  LIBRDF_STORAGE_COMPACT_ORDERS
+} librdf_storage_compact_order;
+
+/* The statement part in each column of an index */
+static const int librdf_storage_compact_orders[LIBRDF_STORAGE_COMPACT_ORDERS][3]={
+  {0, 1, 2},
+  {1, 2, 0},
+  {2, 0, 1}
+};
+
+
+/* One index of the statements */
+typedef struct
+{
+  /* the pairs with first ID a are first[a] to first[a+1]-1 */
+  u32* first;
+  size_t first_count;
+  /* the second ID of each pair and its first row, then the row count */
+  u32* second;
+  u32* pair_start;
+  size_t pair_count;
+  /* the third ID of each row */
+  u32* third;
+} librdf_storage_compact_index;
+
+
+/* The indexes built at one time, shared with the streams made from them */
+typedef struct
+{
+  int usage;
+  size_t triple_count;
+  librdf_storage_compact_index indexes[LIBRDF_STORAGE_COMPACT_ORDERS];
+} librdf_storage_compact_indexes;
+
+
+/* A hashed set of statements as term ID triples, empty slots 0 */
+typedef struct
+{
+  u32* slots;
+  size_t slot_count;
+  /* members and slots used by members or removed members */
+  size_t count;
+  size_t used;
+} librdf_storage_compact_set;
+
+
+typedef struct
+{
+  /* term dictionary: the encoded node of ID i is term_data from
+   * term_offsets[i-1] to term_offsets[i] */
+  unsigned char* term_data;
+  size_t term_data_length;
+  size_t term_data_size;
+  size_t* term_offsets;
+  size_t term_count;
+  size_t term_offsets_size;
+  /* open addressed table of term IDs by encoded node */
+  u32* term_slots;
+  size_t term_slot_count;
+
+  /* buffer for encoding nodes */
+  unsigned char* buffer;
+  size_t buffer_size;
+
+  /* indexes or NULL before the first statement is searched */
+  librdf_storage_compact_indexes* indexes;
+
+  /* statements added that are not in the indexes and statements
+   * in the indexes that are removed */
+  librdf_storage_compact_set added;
+  librdf_storage_compact_set removed;
+} librdf_storage_compact_instance;
+
+
+/* A position in an index */
+typedef struct
+{
+  const librdf_storage_compact_index* index;
+  /* current first ID, pair and row, and the row after the last */
+  u32 first_id;
+  size_t pair;
+  size_t position;
+  size_t end;
+} librdf_storage_compact_cursor;
+
+
+/* prototypes for local functions */
+static int librdf_storage_compact_init(librdf_storage* storage, const char *name, librdf_hash* options);
+static void librdf_storage_compact_terminate(librdf_storage* storage);
+static int librdf_storage_compact_open(librdf_storage* storage, librdf_model* model);
+static int librdf_storage_compact_close(librdf_storage* storage);
+static int librdf_storage_compact_size(librdf_storage* storage);
+static int librdf_storage_compact_add_statement(librdf_storage* storage, librdf_statement* statement);
+static int librdf_storage_compact_add_statements(librdf_storage* storage, librdf_stream* statement_stream);
+static int librdf_storage_compact_remove_statement(librdf_storage* storage, librdf_statement* statement);
+static int librdf_storage_compact_contains_statement(librdf_storage* storage, librdf_statement* statement);
+static int librdf_storage_compact_has_arc_in(librdf_storage *storage, librdf_node *node, librdf_node *property);
+static int librdf_storage_compact_has_arc_out(librdf_storage *storage, librdf_node *node, librdf_node *property);
+static librdf_stream* librdf_storage_compact_serialise(librdf_storage* storage);
+static librdf_stream* librdf_storage_compact_find_statements(librdf_storage* storage, librdf_statement* statement);
+static librdf_iterator* librdf_storage_compact_find_sources(librdf_storage* storage, librdf_node* arc, librdf_node *target);
+static librdf_iterator* librdf_storage_compact_find_arcs(librdf_storage* storage, librdf_node* source, librdf_node *target);
+static librdf_iterator* librdf_storage_compact_find_targets(librdf_storage* storage, librdf_node* source, librdf_node *arc);
+static librdf_node* librdf_storage_compact_get_feature(librdf_storage* storage, librdf_uri* feature);
+
+/* statement stream methods */
+static int librdf_storage_compact_stream_end_of_stream(void* context);
+static int librdf_storage_compact_stream_next_statement(void* context);
+static void* librdf_storage_compact_stream_get_statement(void* context, int flags);
+static void librdf_storage_compact_stream_finished(void* context);
+
+/* node iterator methods */
+static int librdf_storage_compact_node_iterator_is_end(void* iterator);
+static int librdf_storage_compact_node_iterator_next_method(void* iterator);
+static void* librdf_storage_compact_node_iterator_get_method(void* iterator, int flags);
+static void librdf_storage_compact_node_iterator_finished(void* iterator);
+
+/* helper functions */
+static int librdf_storage_compact_merge(librdf_storage* storage);
+static void librdf_storage_compact_indexes_release(librdf_storage_compact_indexes* indexes);
+
+static void librdf_storage_compact_register_factory(librdf_storage_factory *factory);
+
+
+/* Grow an array of @used elements to hold at least @needed */
+static int
+librdf_storage_compact_grow(void** array, size_t* size, size_t used,
+                            size_t needed, size_t element_size)
+{
+  size_t new_size=*size ? *size : 1024;
+  void* new_array;
+
+  if(needed <= *size)
+    return 0;
+
+  while(new_size < needed)
+    new_size *= 2;
+
+  new_array=LIBRDF_MALLOC(void*, new_size * element_size);
+  if(!new_array)
+    return 1;
+  if(*array) {
+    memcpy(new_array, *array, used * element_size);
+    LIBRDF_FREE(data, *array);
+  }
+  *array=new_array;
+  *size=new_size;
+
+  return 0;
+}
+
+
+/* FNV-1a hash of an encoded node */
+static u32
+librdf_storage_compact_hash_bytes(const unsigned char* data, size_t length)
+{
+  u32 hash=2166136261UL;
+  size_t i;
+
+  for(i=0; i < length; i++) {
+    hash ^= data[i];
+    hash *= 16777619UL;
+  }
+
+  return hash;
+}
+
+
+static u32
+librdf_storage_compact_hash_row(const u32* row)
+{
+  u32 hash=row[0] * 2654435761UL;
+
+  hash ^= row[1] + 0x9e3779b9UL + (hash << 6) + (hash >> 2);
+  hash ^= row[2] + 0x9e3779b9UL + (hash << 6) + (hash >> 2);
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6bUL;
+  hash ^= hash >> 13;
+
+  return hash;
+}
+
+
+/*
+ * librdf_storage_compact_set_slot - find the slot of a statement in a set
+ *
+ * Return value: the slot holding @row or else the empty slot ending
+ * its probe sequence
+ */
+static size_t
+librdf_storage_compact_set_slot(const librdf_storage_compact_set* set,
+                                const u32* row)
+{
+  size_t mask=set->slot_count - 1;
+  size_t slot=librdf_storage_compact_hash_row(row) & mask;
+
+  while(1) {
+    const u32* member=set->slots + slot * 3;
+
+    if(!member[0] ||
+       (member[0] == row[0] && member[1] == row[1] && member[2] == row[2]))
+      return slot;
+    slot=(slot + 1) & mask;
+  }
+}
+
+
+static int
+librdf_storage_compact_set_contains(const librdf_storage_compact_set* set,
+                                    const u32* row)
+{
+  size_t slot;
+
+  if(!set->count)
+    return 0;
+
+  slot=librdf_storage_compact_set_slot(set, row);
+  return (set->slots[slot * 3] != 0);
+}
+
+
+/* Add a statement not in the set; non 0 on failure */
+static int
+librdf_storage_compact_set_add(librdf_storage_compact_set* set, const u32* row)
+{
+  size_t slot;
+
+  /* keep the slots used by members or removed members under half */
+  if((set->used + 1) * 2 > set->slot_count) {
+    size_t slot_count=set->slot_count ? set->slot_count : 64;
+    u32* old_slots=set->slots;
+    size_t old_slot_count=set->slot_count;
+    size_t i;
+
+    /* double unless most used slots were removed members */
+    if((set->count + 1) * 4 > slot_count)
+      slot_count *= 2;
+
+    set->slots=LIBRDF_CALLOC(u32*, slot_count * 3, sizeof(u32));
+    if(!set->slots) {
+      set->slots=old_slots;
+      return 1;
+    }
+    set->slot_count=slot_count;
+    set->used=set->count;
+
+    for(i=0; i < old_slot_count; i++) {
+      const u32* member=old_slots + i * 3;
+
+      if(member[0] && member[0] != LIBRDF_STORAGE_COMPACT_DELETED) {
+        slot=librdf_storage_compact_set_slot(set, member);
+        memcpy(set->slots + slot * 3, member, 3 * sizeof(u32));
+      }
+    }
+    if(old_slots)
+      LIBRDF_FREE(u32, old_slots);
+  }
+
+  slot=librdf_storage_compact_set_slot(set, row);
+  memcpy(set->slots + slot * 3, row, 3 * sizeof(u32));
+  set->count++;
+  set->used++;
+
+  return 0;
+}
+
+
+/* Remove a statement from the set, leaving its slot used */
+static void
+librdf_storage_compact_set_remove(librdf_storage_compact_set* set,
+                                  const u32* row)
+{
+  size_t slot;
+
+  if(!set->count)
+    return;
+
+  slot=librdf_storage_compact_set_slot(set, row);
+  if(!set->slots[slot * 3])
+    return;
+
+  set->slots[slot * 3]=LIBRDF_STORAGE_COMPACT_DELETED;
+  set->slots[slot * 3 + 1]=0;
+  set->slots[slot * 3 + 2]=0;
+  set->count--;
+}
+
+
+static void
+librdf_storage_compact_set_clear(librdf_storage_compact_set* set)
+{
+  if(set->slots)
+    LIBRDF_FREE(u32, set->slots);
+  set->slots=NULL;
+  set->slot_count=0;
+  set->count=0;
+  set->used=0;
+}
+
+
+/*
+ * librdf_storage_compact_encode - encode a node into the instance buffer
+ *
+ * Return value: the buffer or NULL on failure
+ */
+static unsigned char*
+librdf_storage_compact_encode(librdf_storage_compact_instance* context,
+                              librdf_node* node, size_t* length_p)
+{
+  size_t length;
+
+  length=librdf_node_encode(node, NULL, 0);
+  if(!length)
+    return NULL;
+
+  if(length > context->buffer_size) {
+    if(context->buffer)
+      LIBRDF_FREE(data, context->buffer);
+    context->buffer=LIBRDF_MALLOC(unsigned char*, length);
+    if(!context->buffer) {
+      context->buffer_size=0;
+      return NULL;
+    }
+    context->buffer_size=length;
+  }
+
+  if(!librdf_node_encode(node, context->buffer, length))
+    return NULL;
+
+  *length_p=length;
+  return context->buffer;
+}
+
+
+/*
+ * librdf_storage_compact_term_slot - find the dictionary slot of a node
+ *
+ * Return value: the slot holding the ID of the encoded node or else
+ * the empty slot ending its probe sequence
+ */
+static size_t
+librdf_storage_compact_term_slot(librdf_storage_compact_instance* context,
+                                 const unsigned char* data, size_t length)
+{
+  size_t mask=context->term_slot_count - 1;
+  size_t slot=librdf_storage_compact_hash_bytes(data, length) & mask;
+
+  while(1) {
+    u32 id=context->term_slots[slot];
+    size_t start, end;
+
+    if(!id)
+      return slot;
+
+    start=context->term_offsets[id - 1];
+    end=context->term_offsets[id];
+    if(end - start == length &&
+       !memcmp(context->term_data + start, data, length))
+      return slot;
+
+    slot=(slot + 1) & mask;
+  }
+}
+
+
+/*
+ * librdf_storage_compact_find_term - find the term ID of a node
+ *
+ * Return value: the term ID or 0 if the node is not present
+ */
+static u32
+librdf_storage_compact_find_term(librdf_storage* storage, librdf_node* node)
+{
+  librdf_storage_compact_instance* context=(librdf_storage_compact_instance*)storage->instance;
+  unsigned char* data;
+  size_t length;
+
+  if(!context->term_count)
+    return 0;
+
+  data=librdf_storage_compact_encode(context, node, &length);
+  if(!data)
+    return 0;
+
+  return context->term_slots[librdf_storage_compact_term_slot(context, data, length)];
+}
+
+
+/*
+ * librdf_storage_compact_add_term - get the term ID of a node, adding it
+ *
+ * Return value: the term ID or 0 on failure
+ */
+static u32
+librdf_storage_compact_add_term(librdf_storage* storage, librdf_node* node)
+{
+  librdf_storage_compact_instance* context=(librdf_storage_compact_instance*)storage->instance;
+  unsigned char* data;
+  size_t length;
+  size_t slot;
+  u32 id;
+
+  data=librdf_storage_compact_encode(context, node, &length);
+  if(!data)
+    return 0;
+
+  if(context->term_count) {
+    slot=librdf_storage_compact_term_slot(context, data, length);
+    if(context->term_slots[slot])
+      return context->term_slots[slot];
+  }
+
+  if(context->term_count >= LIBRDF_STORAGE_COMPACT_MAX_ID) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "Compact storage has too many nodes");
+    return 0;
+  }
+
+  if(librdf_storage_compact_grow((void**)&context->term_data,
+                                 &context->term_data_size,
+                                 context->term_data_length,
+                                 context->term_data_length + length, 1) ||
+     librdf_storage_compact_grow((void**)&context->term_offsets,
+                                 &context->term_offsets_size,
+                                 context->term_count + 1,
+                                 context->term_count + 2, sizeof(size_t)))
+    return 0;
+
+  /* keep the table under half full */
+  if((context->term_count + 1) * 2 > context->term_slot_count) {
+    size_t slot_count=context->term_slot_count ? context->term_slot_count * 2 : 1024;
+    u32* slots;
+    size_t i;
+
+    slots=LIBRDF_CALLOC(u32*, slot_count, sizeof(u32));
+    if(!slots)
+      return 0;
+    if(context->term_slots)
+      LIBRDF_FREE(u32, context->term_slots);
+    context->term_slots=slots;
+    context->term_slot_count=slot_count;
+
+    for(i=1; i <= context->term_count; i++) {
+      size_t start=context->term_offsets[i - 1];
+      size_t end=context->term_offsets[i];
+
+      slot=librdf_storage_compact_term_slot(context, context->term_data + start,
+                                            end - start);
+      context->term_slots[slot]=(u32)i;
+    }
+  }
+
+  if(!context->term_count)
+    context->term_offsets[0]=0;
+  memcpy(context->term_data + context->term_data_length, data, length);
+
+  /* probe before the new term is counted as it is not yet there */
+  slot=librdf_storage_compact_term_slot(context, data, length);
+
+  id=(u32)++context->term_count;
+  context->term_data_length += length;
+  context->term_offsets[id]=context->term_data_length;
+  context->term_slots[slot]=id;
+
+  return id;
+}
+
+
+/*
+ * librdf_storage_compact_get_term - make the node for a term ID
+ *
+ * Return value: new #librdf_node or NULL on failure
+ */
+static librdf_node*
+librdf_storage_compact_get_term(librdf_storage* storage, u32 id)
+{
+  librdf_storage_compact_instance* context=(librdf_storage_compact_instance*)storage->instance;
+  size_t start;
+
+  if(!id || id > context->term_count)
+    return NULL;
+
+  start=context->term_offsets[id - 1];
+  return librdf_node_decode(storage->world, NULL,
+                            context->term_data + start,
+                            context->term_offsets[id] - start);
+}
+
+
+/* Find the first of @array[@low] to @array[@high-1] equal to @value or @high */
+static size_t
+librdf_storage_compact_search(const u32* array, size_t low, size_t high,
+                              u32 value)
+{
+  size_t end=high;
+
+  while(low < high) {
+    size_t mid=low + (high - low) / 2;
+
+    if(array[mid] < value)
+      low=mid + 1;
+    else
+      high=mid;
+  }
+
+  return (low < end && array[low] == value) ? low : end;
+}
+
+
+/* Move the cursor first ID and pair to those of its current row */
+static void
+librdf_storage_compact_cursor_sync(librdf_storage_compact_cursor* cursor)
+{
+  const librdf_storage_compact_index* index=cursor->index;
+
+  if(cursor->position >= cursor->end)
+    return;
+
+  while(index->pair_start[cursor->pair + 1] <= cursor->position)
+    cursor->pair++;
+  while(index->first[cursor->first_id + 1] <= cursor->pair)
+    cursor->first_id++;
+}
+
+
+/*
+ * librdf_storage_compact_cursor_init - start reading rows of an index
+ * @cursor: cursor to set
+ * @index: index
+ * @key: IDs of the first, second and third columns, each 0 for any
+ *
+ * The bound columns must be a prefix of the key.
+ */
+static void
+librdf_storage_compact_cursor_init(librdf_storage_compact_cursor* cursor,
+                                   const librdf_storage_compact_index* index,
+                                   const u32* key)
+{
+  size_t low, high;
+
+  cursor->index=index;
+  cursor->first_id=0;
+  cursor->pair=0;
+  cursor->position=0;
+  cursor->end=0;
+
+  if(!index->pair_count)
+    return;
+
+  if(!key[0]) {
+    cursor->end=index->pair_start[index->pair_count];
+    librdf_storage_compact_cursor_sync(cursor);
+    return;
+  }
+
+  /* no statements use term IDs added after the index was built */
+  if((size_t)key[0] + 1 >= index->first_count)
+    return;
+
+  low=index->first[key[0]];
+  high=index->first[key[0] + 1];
+  if(key[1]) {
+    low=librdf_storage_compact_search(index->second, low, high, key[1]);
+    if(low == high)
+      return;
+    high=low + 1;
+  }
+
+  cursor->first_id=key[0];
+  cursor->pair=low;
+  cursor->position=index->pair_start[low];
+  cursor->end=index->pair_start[high];
+
+  if(key[1] && key[2]) {
+    size_t position=librdf_storage_compact_search(index->third,
+                                                  cursor->position,
+                                                  cursor->end, key[2]);
+    if(position == cursor->end) {
+      cursor->position=cursor->end;
+      return;
+    }
+    cursor->position=position;
+    cursor->end=position + 1;
+  }
+}
+
+
+static void
+librdf_storage_compact_cursor_next(librdf_storage_compact_cursor* cursor)
+{
+  if(cursor->position >= cursor->end)
+    return;
+
+  cursor->position++;
+  librdf_storage_compact_cursor_sync(cursor);
+}
+
+
+/* Get the current row of the cursor as subject, predicate and object IDs */
+static void
+librdf_storage_compact_cursor_get(librdf_storage_compact_cursor* cursor,
+                                  int order, u32* triple)
+{
+  const int* columns=librdf_storage_compact_orders[order];
+
+  triple[columns[0]]=cursor->first_id;
+  triple[columns[1]]=cursor->index->second[cursor->pair];
+  triple[columns[2]]=cursor->index->third[cursor->position];
+}
+
+
+/* Check a statement is in the indexes, without the changes since */
+static int
+librdf_storage_compact_indexes_contain(librdf_storage_compact_indexes* indexes,
+                                       const u32* triple)
+{
+  librdf_storage_compact_cursor cursor;
+
+  if(!indexes)
+    return 0;
+
+  librdf_storage_compact_cursor_init(&cursor,
+                                     &indexes->indexes[LIBRDF_STORAGE_COMPACT_SPO],
+                                     triple);
+  return (cursor.position < cursor.end);
+}
+
+
+static void
+librdf_storage_compact_indexes_release(librdf_storage_compact_indexes* indexes)
+{
+  int i;
+
+  if(--indexes->usage)
+    return;
+
+  for(i=0; i < LIBRDF_STORAGE_COMPACT_ORDERS; i++) {
+    librdf_storage_compact_index* index=&indexes->indexes[i];
+
+    if(index->first)
+      LIBRDF_FREE(u32, index->first);
+    if(index->second)
+      LIBRDF_FREE(u32, index->second);
+    if(index->pair_start)
+      LIBRDF_FREE(u32, index->pair_start);
+    if(index->third)
+      LIBRDF_FREE(u32, index->third);
+  }
+
+  LIBRDF_FREE(librdf_storage_compact_indexes, indexes);
+}
+
+
+static int
+librdf_storage_compact_compare_rows(const void* a, const void* b)
+{
+  const u32* ra=(const u32*)a;
+  const u32* rb=(const u32*)b;
+  int i;
+
+  for(i=0; i < 3; i++) {
+    if(ra[i] != rb[i])
+      return (ra[i] < rb[i]) ? -1 : 1;
+  }
+  return 0;
+}
+
+
+/*
+ * librdf_storage_compact_sort - sort rows of three IDs
+ *
+ * A radix sort on 16 bits at a time, skipping passes where every row
+ * has the same digit, falling back to qsort() when there is not the
+ * memory for a second copy of the rows.
+ */
+static void
+librdf_storage_compact_sort(u32* rows, size_t count)
+{
+  u32* from=rows;
+  u32* to;
+  size_t* counts;
+  int pass;
+
+  if(count < 2)
+    return;
+
+  to=LIBRDF_MALLOC(u32*, count * 3 * sizeof(u32));
+  counts=LIBRDF_MALLOC(size_t*, 65536 * sizeof(size_t));
+  if(!to || !counts) {
+    if(to)
+      LIBRDF_FREE(u32, to);
+    if(counts)
+      LIBRDF_FREE(size_t, counts);
+    qsort(rows, count, 3 * sizeof(u32), librdf_storage_compact_compare_rows);
+    return;
+  }
+
+  /* least significant digit first: low then high half of each column
+   * from the last column */
+  for(pass=0; pass < 6; pass++) {
+    int column=2 - pass / 2;
+    int shift=(pass & 1) * 16;
+    size_t total=0;
+    size_t i;
+    u32* swap;
+
+    memset(counts, 0, 65536 * sizeof(size_t));
+    for(i=0; i < count; i++)
+      counts[(from[i * 3 + column] >> shift) & 0xFFFF]++;
+
+    if(counts[(from[column] >> shift) & 0xFFFF] == count)
+      continue;
+
+    for(i=0; i < 65536; i++) {
+      size_t digit_count=counts[i];
+      counts[i]=total;
+      total += digit_count;
+    }
+
+    for(i=0; i < count; i++) {
+      size_t digit=(from[i * 3 + column] >> shift) & 0xFFFF;
+      memcpy(to + counts[digit]++ * 3, from + i * 3, 3 * sizeof(u32));
+    }
+
+    swap=from; from=to; to=swap;
+  }
+
+  if(from != rows) {
+    memcpy(rows, from, count * 3 * sizeof(u32));
+    to=from;
+  }
+
+  LIBRDF_FREE(u32, to);
+  LIBRDF_FREE(size_t, counts);
+}
+
+
+/*
+ * librdf_storage_compact_index_build - build an index from sorted rows
+ * @index: index to fill
+ * @rows: @count distinct sorted rows in the column order of the index
+ * @max_id: largest term ID
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_storage_compact_index_build(librdf_storage_compact_index* index,
+                                   const u32* rows, size_t count, u32 max_id)
+{
+  size_t pair_count=0;
+  size_t pair;
+  size_t i;
+
+  for(i=0; i < count; i++) {
+    if(!i || rows[i * 3] != rows[i * 3 - 3] ||
+       rows[i * 3 + 1] != rows[i * 3 - 2])
+      pair_count++;
+  }
+  if(pair_count > LIBRDF_STORAGE_COMPACT_MAX_ID)
+    return 1;
+
+  index->first_count=(size_t)max_id + 2;
+  index->first=LIBRDF_CALLOC(u32*, index->first_count, sizeof(u32));
+  index->second=LIBRDF_MALLOC(u32*, (pair_count ? pair_count : 1) * sizeof(u32));
+  index->pair_start=LIBRDF_MALLOC(u32*, (pair_count + 1) * sizeof(u32));
+  index->third=LIBRDF_MALLOC(u32*, (count ? count : 1) * sizeof(u32));
+  if(!index->first || !index->second || !index->pair_start || !index->third)
+    return 1;
+  index->pair_count=pair_count;
+
+  pair=0;
+  for(i=0; i < count; i++) {
+    const u32* row=rows + i * 3;
+
+    if(!i || row[0] != row[-3] || row[1] != row[-2]) {
+      index->second[pair]=row[1];
+      index->pair_start[pair]=(u32)i;
+      /* counted against the next ID until summed below */
+      index->first[row[0] + 1]++;
+      pair++;
+    }
+    index->third[i]=row[2];
+  }
+  index->pair_start[pair_count]=(u32)count;
+
+  for(i=1; i < index->first_count; i++)
+    index->first[i] += index->first[i - 1];
+
+  return 0;
+}
+
+
+/*
+ * librdf_storage_compact_merge - build indexes including all changes
+ * @storage: the storage
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_storage_compact_merge(librdf_storage* storage)
+{
+  librdf_storage_compact_instance* context=(librdf_storage_compact_instance*)storage->instance;
+  librdf_storage_compact_indexes* old_indexes=context->indexes;
+  librdf_storage_compact_indexes* indexes;
+  u32* rows;
+  size_t count;
+  size_t n=0;
+  size_t i;
+  int order;
+
+  if(old_indexes && !context->added.count && !context->removed.count)
+    return 0;
+
+  count=(old_indexes ? old_indexes->triple_count : 0) -
+        context->removed.count + context->added.count;
+  if(count > LIBRDF_STORAGE_COMPACT_MAX_ID) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "Compact storage has too many statements");
+    return 1;
+  }
+
+  rows=LIBRDF_MALLOC(u32*, (count ? count : 1) * 3 * sizeof(u32));
+  if(!rows)
+    return 1;
+
+  if(old_indexes) {
+    librdf_storage_compact_cursor cursor;
+    u32 key[3]={0, 0, 0};
+
+    librdf_storage_compact_cursor_init(&cursor,
+                                       &old_indexes->indexes[LIBRDF_STORAGE_COMPACT_SPO],
+                                       key);
+    for(; cursor.position < cursor.end;
+        librdf_storage_compact_cursor_next(&cursor)) {
+      u32* row=rows + n * 3;
+
+      librdf_storage_compact_cursor_get(&cursor, LIBRDF_STORAGE_COMPACT_SPO,
+                                        row);
+      if(!librdf_storage_compact_set_contains(&context->removed, row))
+        n++;
+    }
+  }
+
+  for(i=0; i < context->added.slot_count; i++) {
+    const u32* member=context->added.slots + i * 3;
+
+    if(member[0] && member[0] != LIBRDF_STORAGE_COMPACT_DELETED) {
+      memcpy(rows + n * 3, member, 3 * sizeof(u32));
+      n++;
+    }
+  }
+
+  indexes=LIBRDF_CALLOC(librdf_storage_compact_indexes*, 1, sizeof(*indexes));
+  if(!indexes) {
+    LIBRDF_FREE(u32, rows);
+    return 1;
+  }
+  indexes->usage=1;
+  indexes->triple_count=n;
+
+  /* rotate each row left to go from SPO to POS to OSP order */
+  for(order=0; order < LIBRDF_STORAGE_COMPACT_ORDERS; order++) {
+    if(order) {
+      for(i=0; i < n; i++) {
+        u32* row=rows + i * 3;
+        u32 id=row[0];
+
+        row[0]=row[1];
+        row[1]=row[2];
+        row[2]=id;
+      }
+    }
+
+    librdf_storage_compact_sort(rows, n);
+    if(librdf_storage_compact_index_build(&indexes->indexes[order], rows, n,
+                                          (u32)context->term_count)) {
+      librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "Failed to build compact storage indexes");
+      librdf_storage_compact_indexes_release(indexes);
+      LIBRDF_FREE(u32, rows);
+      return 1;
+    }
+  }
+
+  LIBRDF_FREE(u32, rows);
+
+  if(old_indexes)
+    librdf_storage_compact_indexes_release(old_indexes);
+  context->indexes=indexes;
+
+  librdf_storage_compact_set_clear(&context->added);
+  librdf_storage_compact_set_clear(&context->removed);
+
+  return 0;
+}
+
+
+/* functions implementing storage api */
+static int
+librdf_storage_compact_init(librdf_storage* storage, const char *name,
+                            librdf_hash* options)
+{
+  librdf_storage_compact_instance* context;
+
+  context = LIBRDF_CALLOC(librdf_storage_compact_instance*, 1, sizeof(*context));
+  if(!context) {
+    if(options)
+      librdf_free_hash(options);
+    return 1;
+  }
+
+  librdf_storage_set_instance(storage, context);
+
+  /* no options, might as well free them now */
+  if(options)
+    librdf_free_hash(options);
+
+  return 0;
+}
+
+
+static void
+librdf_storage_compact_terminate(librdf_storage* storage)
+{
+  librdf_storage_compact_instance* context=(librdf_storage_compact_instance*)storage->instance;
+
+  if(!context)
+    return;
+
+  if(context->indexes)
+    librdf_storage_compact_indexes_release(context->indexes);
+
+  librdf_storage_compact_set_clear(&context->added);
+  librdf_storage_compact_set_clear(&context->removed);
+
+  if(context->term_data)
+    LIBRDF_FREE(data, context->term_data);
+  if(context->term_offsets)
+    LIBRDF_FREE(size_t, context->term_offsets);
+  if(context->term_slots)
+    LIBRDF_FREE(u32, context->term_slots);
+  if(context->buffer)
+    LIBRDF_FREE(data, context->buffer);
+
+  LIBRDF_FREE(librdf_storage_compact_instance, context);
+}
+
+
+static int
+librdf_storage_compact_open(librdf_storage* storage, librdf_model* model)
+{
+  /* nop */
+  return 0;
+}
+
+
+static int
+librdf_storage_compact_close(librdf_storage* storage)
+{
+  /* nop */
+  return 0;
+}
+
+
+static int
+librdf_storage_compact_size(librdf_storage* storage)
+{
+  librdf_storage_compact_instance* context=(librdf_storage_compact_instance*)storage->instance;
+  size_t count;
+
+  count=(context->indexes ? context->indexes->triple_count : 0) -
+        context->removed.count + context->added.count;
+
+  return (int)count;
+}
+
+
+static int
+librdf_storage_compact_add_statement(librdf_storage* storage,
+                                     librdf_statement* statement)
+{
+  librdf_storage_compact_instance* context=(librdf_storage_compact_instance*)storage->instance;
+  u32 triple[3];
+
+  if(!librdf_statement_is_complete(statement))
+    return 1;
+
+  triple[0]=librdf_storage_compact_add_term(storage, librdf_statement_get_subject(statement));
+  triple[1]=librdf_storage_compact_add_term(storage, librdf_statement_get_predicate(statement));
+  triple[2]=librdf_storage_compact_add_term(storage, librdf_statement_get_object(statement));
+  if(!triple[0] || !triple[1] || !triple[2])
+    return 1;
+
+  /* do not add duplicate statements */
+  if(librdf_storage_compact_set_contains(&context->added, triple))
+    return 0;
+
+  if(librdf_storage_compact_set_contains(&context->removed, triple)) {
+    librdf_storage_compact_set_remove(&context->removed, triple);
+    return 0;
+  }
+
+  if(librdf_storage_compact_indexes_contain(context->indexes, triple))
+    return 0;
+
+  return librdf_storage_compact_set_add(&context->added, triple);
+}
+
+
+static int
+librdf_storage_compact_add_statements(librdf_storage* storage,
+                                      librdf_stream* statement_stream)
+{
+  int status=0;
+
+  for(; !librdf_stream_end(statement_stream);
+      librdf_stream_next(statement_stream)) {
+    librdf_statement* statement=librdf_stream_get_object(statement_stream);
+
+    if(!statement) {
+      status=1;
+      break;
+    }
+
+    status=librdf_storage_compact_add_statement(storage, statement);
+    if(status)
+      break;
+  }
+
+  return status;
+}
+
+
+static int
+librdf_storage_compact_remove_statement(librdf_storage* storage,
+                                        librdf_statement* statement)
+{
+  librdf_storage_compact_instance* context=(librdf_storage_compact_instance*)storage->instance;
+  u32 triple[3];
+
+  if(!librdf_statement_is_complete(statement))
+    return 1;
+
+  triple[0]=librdf_storage_compact_find_term(storage, librdf_statement_get_subject(statement));
+  triple[1]=librdf_storage_compact_find_term(storage, librdf_statement_get_predicate(statement));
+  triple[2]=librdf_storage_compact_find_term(storage, librdf_statement_get_object(statement));
+  if(!triple[0] || !triple[1] || !triple[2])
+    return 1;
+
+  if(librdf_storage_compact_set_contains(&context->added, triple)) {
+    librdf_storage_compact_set_remove(&context->added, triple);
+    return 0;
+  }
+
+  if(librdf_storage_compact_set_contains(&context->removed, triple) ||
+     !librdf_storage_compact_indexes_contain(context->indexes, triple))
+    return 1;
+
+  return librdf_storage_compact_set_add(&context->removed, triple);
+}
+
+
+static int
+librdf_storage_compact_contains_statement(librdf_storage* storage,
+                                          librdf_statement* statement)
+{
+  librdf_storage_compact_instance* context=(librdf_storage_compact_instance*)storage->instance;
+  u32 triple[3];
+
+  if(!librdf_statement_is_complete(statement))
+    return 0;
+
+  triple[0]=librdf_storage_compact_find_term(storage, librdf_statement_get_subject(statement));
+  triple[1]=librdf_storage_compact_find_term(storage, librdf_statement_get_predicate(statement));
+  triple[2]=librdf_storage_compact_find_term(storage, librdf_statement_get_object(statement));
+  if(!triple[0] || !triple[1] || !triple[2])
+    return 0;
+
+  if(librdf_storage_compact_set_contains(&context->added, triple))
+    return 1;
+  if(librdf_storage_compact_set_contains(&context->removed, triple))
+    return 0;
+
+  return librdf_storage_compact_indexes_contain(context->indexes, triple);
+}
+
+
+/*
+ * librdf_storage_compact_start - find the rows of an index for some IDs
+ * @storage: the storage
+ * @triple: subject, predicate and object IDs, each 0 for any
+ * @cursor: cursor to set
+ *
+ * Merges any changes into the indexes then picks the index with the
+ * given IDs first, so every row of the range matches.
+ *
+ * Return value: the index order or <0 on failure
+ */
+static int
+librdf_storage_compact_start(librdf_storage* storage, const u32* triple,
+                             librdf_storage_compact_cursor* cursor)
+{
+  librdf_storage_compact_instance* context=(librdf_storage_compact_instance*)storage->instance;
+  const int* columns;
+  u32 key[3];
+  int order;
+  int i;
+
+  if(librdf_storage_compact_merge(storage))
+    return -1;
+
+  if(triple[LIBRDF_STORAGE_COMPACT_SUBJECT])
+    order=(triple[LIBRDF_STORAGE_COMPACT_OBJECT] &&
+           !triple[LIBRDF_STORAGE_COMPACT_PREDICATE]) ?
+          LIBRDF_STORAGE_COMPACT_OSP : LIBRDF_STORAGE_COMPACT_SPO;
+  else if(triple[LIBRDF_STORAGE_COMPACT_PREDICATE])
+    order=LIBRDF_STORAGE_COMPACT_POS;
+  else if(triple[LIBRDF_STORAGE_COMPACT_OBJECT])
+    order=LIBRDF_STORAGE_COMPACT_OSP;
+  else
+    order=LIBRDF_STORAGE_COMPACT_SPO;
+
+  columns=librdf_storage_compact_orders[order];
+  for(i=0; i < 3; i++)
+    key[i]=triple[columns[i]];
+
+  librdf_storage_compact_cursor_init(cursor, &context->indexes->indexes[order],
+                                     key);
+
+  return order;
+}
+
+
+/*
+ * librdf_storage_compact_find_triple - get the IDs of statement parts
+ *
+ * Return value: non 0 if a given part is not in the dictionary
+ */
+static int
+librdf_storage_compact_find_triple(librdf_storage* storage,
+                                   librdf_node* subject,
+                                   librdf_node* predicate,
+                                   librdf_node* object,
+                                   u32* triple)
+{
+  librdf_node* nodes[3];
+  int i;
+
+  nodes[LIBRDF_STORAGE_COMPACT_SUBJECT]=subject;
+  nodes[LIBRDF_STORAGE_COMPACT_PREDICATE]=predicate;
+  nodes[LIBRDF_STORAGE_COMPACT_OBJECT]=object;
+
+  for(i=0; i < 3; i++) {
+    triple[i]=0;
+    if(nodes[i]) {
+      triple[i]=librdf_storage_compact_find_term(storage, nodes[i]);
+      if(!triple[i])
+        return 1;
+    }
+  }
+
+  return 0;
+}
+
+
+static int
+librdf_storage_compact_has_arc(librdf_storage* storage, librdf_node* subject,
+                               librdf_node* predicate, librdf_node* object)
+{
+  librdf_storage_compact_cursor cursor;
+  u32 triple[3];
+
+  if(librdf_storage_compact_find_triple(storage, subject, predicate, object,
+                                        triple))
+    return 0;
+
+  if(librdf_storage_compact_start(storage, triple, &cursor) < 0)
+    return 0;
+
+  return (cursor.position < cursor.end);
+}
+
+
+static int
+librdf_storage_compact_has_arc_in(librdf_storage *storage, librdf_node *node,
+                                  librdf_node *property)
+{
+  /* [?, property, node] */
+  return librdf_storage_compact_has_arc(storage, NULL, property, node);
+}
+
+
+static int
+librdf_storage_compact_has_arc_out(librdf_storage *storage, librdf_node *node,
+                                   librdf_node *property)
+{
+  /* [node, property, ?] */
+  return librdf_storage_compact_has_arc(storage, node, property, NULL);
+}
+
+
+typedef struct {
+  librdf_storage* storage;
+
+  /* the indexes read, kept while the stream is in use */
+  librdf_storage_compact_indexes* indexes;
+  int order;
+  librdf_storage_compact_cursor cursor;
+
+  /* current statement, once made */
+  librdf_statement* statement;
+  int current_is_made;
+} librdf_storage_compact_stream_context;
+
+
+static librdf_stream*
+librdf_storage_compact_find_common(librdf_storage* storage,
+                                   librdf_statement* statement)
+{
+  librdf_storage_compact_instance* context=(librdf_storage_compact_instance*)storage->instance;
+  librdf_storage_compact_stream_context* scontext;
+  librdf_stream* stream;
+  librdf_storage_compact_cursor cursor;
+  u32 triple[3];
+  int order;
+
+  if(statement &&
+     librdf_storage_compact_find_triple(storage,
+                                        librdf_statement_get_subject(statement),
+                                        librdf_statement_get_predicate(statement),
+                                        librdf_statement_get_object(statement),
+                                        triple))
+    /* an unknown node matches nothing */
+    return librdf_new_empty_stream(storage->world);
+  if(!statement)
+    triple[0]=triple[1]=triple[2]=0;
+
+  order=librdf_storage_compact_start(storage, triple, &cursor);
+  if(order < 0)
+    return NULL;
+
+  scontext = LIBRDF_CALLOC(librdf_storage_compact_stream_context*, 1,
+                           sizeof(*scontext));
+  if(!scontext)
+    return NULL;
+
+  scontext->statement=librdf_new_statement(storage->world);
+  if(!scontext->statement) {
+    LIBRDF_FREE(librdf_storage_compact_stream_context, scontext);
+    return NULL;
+  }
+
+  scontext->indexes=context->indexes;
+  scontext->indexes->usage++;
+  scontext->order=order;
+  scontext->cursor=cursor;
+
+  scontext->storage=storage;
+  librdf_storage_add_reference(scontext->storage);
+
+  stream=librdf_new_stream(storage->world,
+                           (void*)scontext,
+                           &librdf_storage_compact_stream_end_of_stream,
+                           &librdf_storage_compact_stream_next_statement,
+                           &librdf_storage_compact_stream_get_statement,
+                           &librdf_storage_compact_stream_finished);
+  if(!stream) {
+    librdf_storage_compact_stream_finished((void*)scontext);
+    return NULL;
+  }
+
+  return stream;
+}
+
+
+static int
+librdf_storage_compact_stream_end_of_stream(void* context)
+{
+  librdf_storage_compact_stream_context* scontext=(librdf_storage_compact_stream_context*)context;
+
+  return (scontext->cursor.position >= scontext->cursor.end);
+}
+
+
+static int
+librdf_storage_compact_stream_next_statement(void* context)
+{
+  librdf_storage_compact_stream_context* scontext=(librdf_storage_compact_stream_context*)context;
+
+  librdf_storage_compact_cursor_next(&scontext->cursor);
+  scontext->current_is_made=0;
+
+  return (scontext->cursor.position >= scontext->cursor.end);
+}
+
+
+static void*
+librdf_storage_compact_stream_get_statement(void* context, int flags)
+{
+  librdf_storage_compact_stream_context* scontext=(librdf_storage_compact_stream_context*)context;
+  u32 triple[3];
+  librdf_node* node;
+  int i;
+
+  if(scontext->cursor.position >= scontext->cursor.end)
+    return NULL;
+
+  if(!scontext->current_is_made) {
+    librdf_storage_compact_cursor_get(&scontext->cursor, scontext->order,
+                                      triple);
+    librdf_statement_clear(scontext->statement);
+
+    for(i=0; i < 3; i++) {
+      node=librdf_storage_compact_get_term(scontext->storage, triple[i]);
+      if(!node)
+        return NULL;
+      if(i == LIBRDF_STORAGE_COMPACT_SUBJECT)
+        librdf_statement_set_subject(scontext->statement, node);
+      else if(i == LIBRDF_STORAGE_COMPACT_PREDICATE)
+        librdf_statement_set_predicate(scontext->statement, node);
+      else
+        librdf_statement_set_object(scontext->statement, node);
+    }
+
+    scontext->current_is_made=1;
+  }
+
+  switch(flags) {
+    case LIBRDF_ITERATOR_GET_METHOD_GET_OBJECT:
+      return scontext->statement;
+    case LIBRDF_ITERATOR_GET_METHOD_GET_CONTEXT:
+      return NULL;
+    default:
+      librdf_log(scontext->storage->world,
+                 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "Unknown iterator method flag %d", flags);
+      return NULL;
+  }
+}
+
+
+static void
+librdf_storage_compact_stream_finished(void* context)
+{
+  librdf_storage_compact_stream_context* scontext=(librdf_storage_compact_stream_context*)context;
+
+  if(scontext->statement)
+    librdf_free_statement(scontext->statement);
+
+  if(scontext->indexes)
+    librdf_storage_compact_indexes_release(scontext->indexes);
+
+  if(scontext->storage)
+    librdf_storage_remove_reference(scontext->storage);
+
+  LIBRDF_FREE(librdf_storage_compact_stream_context, scontext);
+}
+
+
+static librdf_stream*
+librdf_storage_compact_serialise(librdf_storage* storage)
+{
+  return librdf_storage_compact_find_common(storage, NULL);
+}
+
+
+static librdf_stream*
+librdf_storage_compact_find_statements(librdf_storage* storage,
+                                       librdf_statement* statement)
+{
+  return librdf_storage_compact_find_common(storage, statement);
+}
+
+
+typedef struct {
+  librdf_storage* storage;
+  /* the indexes read, kept while the iterator is in use */
+  librdf_storage_compact_indexes* indexes;
+  /* the rows of one pair, giving the nodes in the third column */
+  librdf_storage_compact_cursor cursor;
+  librdf_node* current;
+} librdf_storage_compact_node_iterator_context;
+
+
+static int
+librdf_storage_compact_node_iterator_is_end(void* iterator)
+{
+  librdf_storage_compact_node_iterator_context* icontext=(librdf_storage_compact_node_iterator_context*)iterator;
+
+  return (icontext->cursor.position >= icontext->cursor.end);
+}
+
+
+static int
+librdf_storage_compact_node_iterator_next_method(void* iterator)
+{
+  librdf_storage_compact_node_iterator_context* icontext=(librdf_storage_compact_node_iterator_context*)iterator;
+
+  if(icontext->cursor.position >= icontext->cursor.end)
+    return 1;
+
+  icontext->cursor.position++;
+  if(icontext->current) {
+    librdf_free_node(icontext->current);
+    icontext->current=NULL;
+  }
+
+  return (icontext->cursor.position >= icontext->cursor.end);
+}
+
+
+static void*
+librdf_storage_compact_node_iterator_get_method(void* iterator, int flags)
+{
+  librdf_storage_compact_node_iterator_context* icontext=(librdf_storage_compact_node_iterator_context*)iterator;
+  void *result=NULL;
+
+  switch(flags) {
+    case LIBRDF_ITERATOR_GET_METHOD_GET_OBJECT:
+      if(icontext->cursor.position >= icontext->cursor.end)
+        return NULL;
+
+      if(!icontext->current) {
+        u32 id=icontext->cursor.index->third[icontext->cursor.position];
+        icontext->current=librdf_storage_compact_get_term(icontext->storage, id);
+      }
+      result=icontext->current;
+      break;
+
+    case LIBRDF_ITERATOR_GET_METHOD_GET_CONTEXT:
+    case LIBRDF_ITERATOR_GET_METHOD_GET_KEY:
+    case LIBRDF_ITERATOR_GET_METHOD_GET_VALUE:
+      result=NULL;
+      break;
+
+    default:
+      librdf_log(icontext->storage->world,
+                 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "Unknown iterator method flag %d", flags);
+      result=NULL;
+      break;
+  }
+
+  return result;
+}
+
+
+static void
+librdf_storage_compact_node_iterator_finished(void* iterator)
+{
+  librdf_storage_compact_node_iterator_context* icontext=(librdf_storage_compact_node_iterator_context*)iterator;
+
+  if(icontext->current)
+    librdf_free_node(icontext->current);
+
+  if(icontext->indexes)
+    librdf_storage_compact_indexes_release(icontext->indexes);
+
+  if(icontext->storage)
+    librdf_storage_remove_reference(icontext->storage);
+
+  LIBRDF_FREE(librdf_storage_compact_node_iterator_context, icontext);
+}
+
+
+/*
+ * librdf_storage_compact_find_nodes - the nodes completing two statement parts
+ * @storage: the storage
+ * @subject: subject or NULL for the wanted part
+ * @predicate: predicate or NULL for the wanted part
+ * @object: object or NULL for the wanted part
+ *
+ * Each index has the nodes wanted in its third column in the rows of
+ * the pair of the two given nodes: subjects in POS, predicates in
+ * OSP and objects in SPO.
+ *
+ * Return value: #librdf_iterator of nodes or NULL on failure
+ */
+static librdf_iterator*
+librdf_storage_compact_find_nodes(librdf_storage* storage,
+                                  librdf_node* subject,
+                                  librdf_node* predicate,
+                                  librdf_node* object)
+{
+  librdf_storage_compact_instance* context=(librdf_storage_compact_instance*)storage->instance;
+  librdf_storage_compact_node_iterator_context* icontext;
+  librdf_iterator* iterator;
+  librdf_storage_compact_cursor cursor;
+  u32 triple[3];
+
+  if(librdf_storage_compact_find_triple(storage, subject, predicate, object,
+                                        triple))
+    return librdf_new_empty_iterator(storage->world);
+
+  if(librdf_storage_compact_start(storage, triple, &cursor) < 0)
+    return NULL;
+
+  icontext = LIBRDF_CALLOC(librdf_storage_compact_node_iterator_context*, 1,
+                           sizeof(*icontext));
+  if(!icontext)
+    return NULL;
+
+  icontext->indexes=context->indexes;
+  icontext->indexes->usage++;
+  icontext->cursor=cursor;
+
+  icontext->storage=storage;
+  librdf_storage_add_reference(icontext->storage);
+
+  iterator=librdf_new_iterator(storage->world,
+                               (void*)icontext,
+                               &librdf_storage_compact_node_iterator_is_end,
+                               &librdf_storage_compact_node_iterator_next_method,
+                               &librdf_storage_compact_node_iterator_get_method,
+                               &librdf_storage_compact_node_iterator_finished);
+  if(!iterator)
+    librdf_storage_compact_node_iterator_finished(icontext);
+  return iterator;
+}
+
+
+static librdf_iterator*
+librdf_storage_compact_find_sources(librdf_storage* storage,
+                                    librdf_node* arc, librdf_node *target)
+{
+  return librdf_storage_compact_find_nodes(storage, NULL, arc, target);
+}
+
+
+static librdf_iterator*
+librdf_storage_compact_find_arcs(librdf_storage* storage,
+                                 librdf_node* source, librdf_node *target)
+{
+  return librdf_storage_compact_find_nodes(storage, source, NULL, target);
+}
+
+
+static librdf_iterator*
+librdf_storage_compact_find_targets(librdf_storage* storage,
+                                    librdf_node* source, librdf_node *arc)
+{
+  return librdf_storage_compact_find_nodes(storage, source, arc, NULL);
+}
+
+
+/**
+ * librdf_storage_compact_get_feature:
+ * @storage: #librdf_storage object
+ * @feature: #librdf_uri feature property
+ *
+ * Get the value of a storage feature.
+ *
+ * Return value: #librdf_node feature value or NULL if no such feature
+ * exists or the value is empty.
+ **/
+static librdf_node*
+librdf_storage_compact_get_feature(librdf_storage* storage, librdf_uri* feature)
+{
+  unsigned char *uri_string;
+
+  if(!feature)
+    return NULL;
+
+  uri_string=librdf_uri_as_string(feature);
+  if(!uri_string)
+    return NULL;
+
+  /* contexts are not kept */
+  if(!strcmp((const char*)uri_string, LIBRDF_MODEL_FEATURE_CONTEXTS))
+    return librdf_new_node_from_typed_literal(storage->world,
+                                              (const unsigned char*)"0",
+                                              NULL, NULL);
+
+  return NULL;
+}
+
+
+/** Local entry point for dynamically loaded storage module */
+static void
+librdf_storage_compact_register_factory(librdf_storage_factory *factory)
+{
+  LIBRDF_ASSERT_CONDITION(!strcmp(factory->name, "compact"));
+
+  factory->version            = LIBRDF_STORAGE_INTERFACE_VERSION;
+  factory->init               = librdf_storage_compact_init;
+  factory->terminate          = librdf_storage_compact_terminate;
+  factory->open               = librdf_storage_compact_open;
+  factory->close              = librdf_storage_compact_close;
+  factory->size               = librdf_storage_compact_size;
+  factory->add_statement      = librdf_storage_compact_add_statement;
+  factory->add_statements     = librdf_storage_compact_add_statements;
+  factory->remove_statement   = librdf_storage_compact_remove_statement;
+  factory->contains_statement = librdf_storage_compact_contains_statement;
+  factory->has_arc_in         = librdf_storage_compact_has_arc_in;
+  factory->has_arc_out        = librdf_storage_compact_has_arc_out;
+  factory->serialise          = librdf_storage_compact_serialise;
+  factory->find_statements    = librdf_storage_compact_find_statements;
+  factory->find_sources       = librdf_storage_compact_find_sources;
+  factory->find_arcs          = librdf_storage_compact_find_arcs;
+  factory->find_targets       = librdf_storage_compact_find_targets;
+  factory->get_feature        = librdf_storage_compact_get_feature;
+}
+
+
+/*
+ * librdf_init_storage_compact:
+ * @world: world object
+ *
+ * INTERNAL - Initialise the built-in storage_compact module.
+ */
+void
+librdf_init_storage_compact(librdf_world *world)
+{
+  librdf_storage_register_factory(world, "compact", "Compact in-memory indexes",
+                                  &librdf_storage_compact_register_factory);
+}
@@ -45,6 +45,7 @@
 #include <sys/types.h>
 
 #include <redland.h>
+#include <rdf_types.h>
 
 
 typedef struct
@@ -61,9 +62,41 @@ typedef struct
 
   /* serializing format ('file' factory only) */
   char *format_name;
+
+  /* append log of changes since the file was written ('file' factory only) */
+  char *log_name;
+  FILE *log_fh;
+  /* records in the log */
+  long log_records;
+  /* records at which the log is compacted into the file; 0 for automatic */
+  long log_compact;
+  unsigned char *log_buffer;
+  size_t log_buffer_size;
 } librdf_storage_file_instance;
 
 
+/*
+ * The log starts with the magic string and a 4 byte version.  Each
+ * record is an operation byte, the 4 byte length and 4 byte FNV-1a
+ * checksum of the encoded statement, then the statement as encoded
+ * by librdf_statement_encode2().  Integers are little endian.
+ */
+#define LIBRDF_STORAGE_FILE_LOG_MAGIC "LRDFLOG\n"
+#define LIBRDF_STORAGE_FILE_LOG_MAGIC_LEN 8
+#define LIBRDF_STORAGE_FILE_LOG_VERSION 1
+#define LIBRDF_STORAGE_FILE_LOG_HEADER_LEN (LIBRDF_STORAGE_FILE_LOG_MAGIC_LEN + 4)
+#define LIBRDF_STORAGE_FILE_LOG_RECORD_HEADER_LEN 9
+
+#define LIBRDF_STORAGE_FILE_LOG_ADD 'A'
+#define LIBRDF_STORAGE_FILE_LOG_REMOVE 'R'
+
+/* Largest encoded statement accepted when replaying */
+#define LIBRDF_STORAGE_FILE_LOG_MAX_RECORD (16 * 1024 * 1024)
+
+/* Fewest records that trigger automatic compaction */
+#define LIBRDF_STORAGE_FILE_LOG_MIN_COMPACT 1000
+
+
 /* prototypes for local functions */
 static int librdf_storage_file_init(librdf_storage* storage, const char *name, librdf_hash* options);
 static int librdf_storage_file_open(librdf_storage* storage, librdf_model* model);
@@ -78,6 +111,11 @@ static librdf_stream* librdf_storage_file_find_statements(librdf_storage* storag
 
 static int librdf_storage_file_sync(librdf_storage *storage);
 
+static int librdf_storage_file_write(librdf_storage *storage);
+static int librdf_storage_file_log_replay(librdf_storage* storage);
+static int librdf_storage_file_log_reset(librdf_storage* storage);
+static int librdf_storage_file_log_open(librdf_storage* storage);
+
 static void librdf_storage_file_register_factory(librdf_storage_factory *factory);
 
 
@@ -88,6 +126,7 @@ librdf_storage_file_init(librdf_storage* storage, const char *name,
 {
   char *name_copy;
   char *contexts;
+  int use_log;
   int rc = 1;
   int is_uri = !strcmp(storage->factory->name, "uri");
   const char *format_name = (is_uri ? "guess" : "rdfxml");
@@ -121,6 +160,13 @@ librdf_storage_file_init(librdf_storage* storage, const char *name,
     if(context->format_name)
       format_name = context->format_name;
   }
+
+  use_log = (!is_uri && librdf_hash_get_as_boolean(options, "log") > 0);
+  if(use_log) {
+    context->log_compact = librdf_hash_get_as_long(options, "log-compact");
+    if(context->log_compact < 0)
+      context->log_compact = 0;
+  }
   
 
   if(is_uri)
@@ -159,6 +205,26 @@ librdf_storage_file_init(librdf_storage* storage, const char *name,
 
   context->changed = 0;
 
+  if(use_log) {
+    /* name".log\0" */
+    context->log_name = LIBRDF_MALLOC(char*, context->name_len + 5);
+    if(!context->log_name)
+      goto done;
+    strcpy(context->log_name, context->name);
+    strcpy(context->log_name + context->name_len, ".log");
+
+    if(!access((const char*)context->log_name, F_OK)) {
+      if(librdf_storage_file_log_replay(storage)) {
+        /* Write what was recovered and start a new log */
+        if(librdf_storage_file_write(storage) ||
+           librdf_storage_file_log_reset(storage))
+          goto done;
+      } else if(librdf_storage_file_log_open(storage))
+        goto done;
+    } else if(librdf_storage_file_log_reset(storage))
+      goto done;
+  }
+
   rc = 0;
 
   done:
@@ -181,6 +247,15 @@ librdf_storage_file_terminate(librdf_storage* storage)
 
   librdf_storage_file_sync(storage);
 
+  if(context->log_fh)
+    fclose(context->log_fh);
+
+  if(context->log_name)
+    LIBRDF_FREE(char*, context->log_name);
+
+  if(context->log_buffer)
+    LIBRDF_FREE(char*, context->log_buffer);
+
   if(context->format_name)
     LIBRDF_FREE(char*, context->format_name);
 
@@ -222,12 +297,309 @@ librdf_storage_file_size(librdf_storage* storage)
 }
 
 
+static u32
+librdf_storage_file_log_checksum(const unsigned char* data, size_t length)
+{
+  u32 hash = 2166136261UL;
+
+  while(length--)
+    hash = (hash ^ *data++) * 16777619UL;
+
+  return hash;
+}
+
+
+static void
+librdf_storage_file_log_put_u32(unsigned char* buffer, u32 value)
+{
+  buffer[0] = (unsigned char)(value & 0xff);
+  buffer[1] = (unsigned char)((value >> 8) & 0xff);
+  buffer[2] = (unsigned char)((value >> 16) & 0xff);
+  buffer[3] = (unsigned char)((value >> 24) & 0xff);
+}
+
+
+static u32
+librdf_storage_file_log_get_u32(const unsigned char* buffer)
+{
+  return (u32)buffer[0] | ((u32)buffer[1] << 8) |
+         ((u32)buffer[2] << 16) | ((u32)buffer[3] << 24);
+}
+
+
+/* Make the buffer at least length bytes.  Return value: non 0 on failure */
+static int
+librdf_storage_file_log_reserve(librdf_storage_file_instance* context,
+                                size_t length)
+{
+  if(length <= context->log_buffer_size)
+    return 0;
+
+  if(context->log_buffer)
+    LIBRDF_FREE(char*, context->log_buffer);
+  context->log_buffer_size = length + 1024;
+  context->log_buffer = LIBRDF_MALLOC(unsigned char*, context->log_buffer_size);
+  if(!context->log_buffer) {
+    context->log_buffer_size = 0;
+    return 1;
+  }
+
+  return 0;
+}
+
+
+/* Flush a file handle to disk.  Return value: non 0 on failure */
+static int
+librdf_storage_file_flush(FILE* fh)
+{
+  if(fflush(fh))
+    return 1;
+#ifdef HAVE_FSYNC
+  if(fsync(fileno(fh)))
+    return 1;
+#endif
+  return 0;
+}
+
+
+/*
+ * librdf_storage_file_log_append - Append a change to the log
+ * @storage: storage
+ * @op: LIBRDF_STORAGE_FILE_LOG_ADD or LIBRDF_STORAGE_FILE_LOG_REMOVE
+ * @statement: statement
+ *
+ * The record is buffered; librdf_storage_file_sync() makes it durable.
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_storage_file_log_append(librdf_storage* storage, int op,
+                               librdf_statement* statement)
+{
+  librdf_storage_file_instance* context=(librdf_storage_file_instance*)storage->instance;
+  unsigned char* record;
+  size_t length;
+
+  length = librdf_statement_encode2(storage->world, statement, NULL, 0);
+  if(!length ||
+     librdf_storage_file_log_reserve(context,
+                                     LIBRDF_STORAGE_FILE_LOG_RECORD_HEADER_LEN + length))
+    return 1;
+
+  record = context->log_buffer;
+  if(!librdf_statement_encode2(storage->world, statement,
+                               record + LIBRDF_STORAGE_FILE_LOG_RECORD_HEADER_LEN,
+                               length))
+    return 1;
+
+  record[0] = (unsigned char)op;
+  librdf_storage_file_log_put_u32(record + 1, (u32)length);
+  librdf_storage_file_log_put_u32(record + 5,
+                                  librdf_storage_file_log_checksum(record + LIBRDF_STORAGE_FILE_LOG_RECORD_HEADER_LEN, length));
+
+  length += LIBRDF_STORAGE_FILE_LOG_RECORD_HEADER_LEN;
+  if(fwrite(record, 1, length, context->log_fh) != length) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "failed to write to log '%s' - %s",
+               context->log_name, strerror(errno));
+    return 1;
+  }
+
+  context->log_records++;
+
+  return 0;
+}
+
+
+/*
+ * librdf_storage_file_log_replay - Apply the changes in the log to the model
+ * @storage: storage
+ *
+ * Replaying is idempotent so a log that was already written to the
+ * file by an interrupted compaction can be applied again.  A
+ * truncated or damaged record ends the replay.
+ *
+ * Return value: non 0 if the log was not completely replayed
+ */
+static int
+librdf_storage_file_log_replay(librdf_storage* storage)
+{
+  librdf_storage_file_instance* context=(librdf_storage_file_instance*)storage->instance;
+  unsigned char header[LIBRDF_STORAGE_FILE_LOG_HEADER_LEN];
+  librdf_statement* statement = NULL;
+  FILE* fh;
+  int rc = 1;
+
+  fh = fopen(context->log_name, "rb");
+  if(!fh) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "failed to open log '%s' - %s",
+               context->log_name, strerror(errno));
+    return 1;
+  }
+
+  if(fread(header, 1, LIBRDF_STORAGE_FILE_LOG_HEADER_LEN, fh) != LIBRDF_STORAGE_FILE_LOG_HEADER_LEN ||
+     memcmp(header, LIBRDF_STORAGE_FILE_LOG_MAGIC, LIBRDF_STORAGE_FILE_LOG_MAGIC_LEN) ||
+     librdf_storage_file_log_get_u32(header + LIBRDF_STORAGE_FILE_LOG_MAGIC_LEN) != LIBRDF_STORAGE_FILE_LOG_VERSION) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_WARN, LIBRDF_FROM_STORAGE, NULL,
+               "Ignoring log '%s' with a bad header", context->log_name);
+    goto done;
+  }
+
+  statement = librdf_new_statement(storage->world);
+  if(!statement)
+    goto done;
+
+  while(1) {
+    unsigned char record[LIBRDF_STORAGE_FILE_LOG_RECORD_HEADER_LEN];
+    size_t count;
+    size_t length;
+
+    count = fread(record, 1, LIBRDF_STORAGE_FILE_LOG_RECORD_HEADER_LEN, fh);
+    if(!count) {
+      rc = 0;
+      break;
+    }
+
+    length = (size_t)librdf_storage_file_log_get_u32(record + 1);
+    if(count != LIBRDF_STORAGE_FILE_LOG_RECORD_HEADER_LEN ||
+       length > LIBRDF_STORAGE_FILE_LOG_MAX_RECORD ||
+       librdf_storage_file_log_reserve(context, length) ||
+       fread(context->log_buffer, 1, length, fh) != length ||
+       librdf_storage_file_log_checksum(context->log_buffer, length) != librdf_storage_file_log_get_u32(record + 5) ||
+       !librdf_statement_decode2(storage->world, statement, NULL,
+                                 context->log_buffer, length))
+      break;
+
+    switch(record[0]) {
+      case LIBRDF_STORAGE_FILE_LOG_ADD:
+        librdf_model_add_statement(context->model, statement);
+        break;
+
+      case LIBRDF_STORAGE_FILE_LOG_REMOVE:
+        librdf_model_remove_statement(context->model, statement);
+        break;
+
+      default:
+        break;
+    }
+    librdf_statement_clear(statement);
+
+    context->log_records++;
+  }
+
+  if(rc)
+    librdf_log(storage->world, 0, LIBRDF_LOG_WARN, LIBRDF_FROM_STORAGE, NULL,
+               "Log '%s' is damaged after %ld records",
+               context->log_name, context->log_records);
+
+  done:
+  if(statement)
+    librdf_free_statement(statement);
+  fclose(fh);
+
+  return rc;
+}
+
+
+/* Open the existing log for appending.  Return value: non 0 on failure */
+static int
+librdf_storage_file_log_open(librdf_storage* storage)
+{
+  librdf_storage_file_instance* context=(librdf_storage_file_instance*)storage->instance;
+
+  context->log_fh = fopen(context->log_name, "ab");
+  if(!context->log_fh) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "failed to open log '%s' for writing - %s",
+               context->log_name, strerror(errno));
+    return 1;
+  }
+
+  return 0;
+}
+
+
+/*
+ * librdf_storage_file_log_reset - Start a new empty log
+ * @storage: storage
+ *
+ * Called once the file holds every change in the log.
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_storage_file_log_reset(librdf_storage* storage)
+{
+  librdf_storage_file_instance* context=(librdf_storage_file_instance*)storage->instance;
+  unsigned char header[LIBRDF_STORAGE_FILE_LOG_HEADER_LEN];
+
+  if(context->log_fh) {
+    fclose(context->log_fh);
+    context->log_fh = NULL;
+  }
+
+  context->log_fh = fopen(context->log_name, "wb");
+  if(!context->log_fh) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "failed to open log '%s' for writing - %s",
+               context->log_name, strerror(errno));
+    return 1;
+  }
+
+  memcpy(header, LIBRDF_STORAGE_FILE_LOG_MAGIC, LIBRDF_STORAGE_FILE_LOG_MAGIC_LEN);
+  librdf_storage_file_log_put_u32(header + LIBRDF_STORAGE_FILE_LOG_MAGIC_LEN,
+                                  LIBRDF_STORAGE_FILE_LOG_VERSION);
+  if(fwrite(header, 1, LIBRDF_STORAGE_FILE_LOG_HEADER_LEN, context->log_fh) != LIBRDF_STORAGE_FILE_LOG_HEADER_LEN ||
+     librdf_storage_file_flush(context->log_fh)) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "failed to write to log '%s' - %s",
+               context->log_name, strerror(errno));
+    return 1;
+  }
+
+  context->log_records = 0;
+
+  return 0;
+}
+
+
+/* Return non 0 if the log is long enough to be written to the file */
+static int
+librdf_storage_file_log_full(librdf_storage_file_instance* context)
+{
+  if(context->log_compact)
+    return context->log_records >= context->log_compact;
+
+  /* Automatic: once replaying would cost more than reading the file */
+  return context->log_records >= LIBRDF_STORAGE_FILE_LOG_MIN_COMPACT &&
+         context->log_records >= (long)librdf_model_size(context->model);
+}
+
+
 static int
 librdf_storage_file_add_statement(librdf_storage* storage, librdf_statement* statement)
 {
   librdf_storage_file_instance* context=(librdf_storage_file_instance*)storage->instance;
+  int rc;
+
   context->changed=1;
-  return librdf_model_add_statement(context->model, statement);
+  if(!context->log_fh)
+    return librdf_model_add_statement(context->model, statement);
+
+  /* a statement already present is not added again so is not logged */
+  if(librdf_model_contains_statement(context->model, statement))
+    return 0;
+
+  rc = librdf_model_add_statement(context->model, statement);
+  if(!rc &&
+     librdf_storage_file_log_append(storage, LIBRDF_STORAGE_FILE_LOG_ADD,
+                                    statement)) {
+    /* keep the model matching what the log records */
+    librdf_model_remove_statement(context->model, statement);
+    rc = 1;
+  }
+  return rc;
 }
 
 
@@ -236,8 +608,25 @@ librdf_storage_file_add_statements(librdf_storage* storage,
                                    librdf_stream* statement_stream)
 {
   librdf_storage_file_instance* context=(librdf_storage_file_instance*)storage->instance;
+  int rc = 0;
+
   context->changed=1;
-  return librdf_model_add_statements(context->model, statement_stream);
+  if(!context->log_fh)
+    return librdf_model_add_statements(context->model, statement_stream);
+
+  /* each statement is logged */
+  while(!librdf_stream_end(statement_stream)) {
+    librdf_statement* statement = librdf_stream_get_object(statement_stream);
+
+    if(statement) {
+      rc = librdf_storage_file_add_statement(storage, statement);
+      if(rc)
+        break;
+    }
+    librdf_stream_next(statement_stream);
+  }
+
+  return rc;
 }
 
 
@@ -245,8 +634,18 @@ static int
 librdf_storage_file_remove_statement(librdf_storage* storage, librdf_statement* statement)
 {
   librdf_storage_file_instance* context=(librdf_storage_file_instance*)storage->instance;
+  int rc;
+
   context->changed=1;
-  return librdf_model_remove_statement(context->model, statement);
+  rc = librdf_model_remove_statement(context->model, statement);
+  if(!rc && context->log_fh &&
+     librdf_storage_file_log_append(storage, LIBRDF_STORAGE_FILE_LOG_REMOVE,
+                                    statement)) {
+    /* keep the model matching what the log records */
+    librdf_model_add_statement(context->model, statement);
+    rc = 1;
+  }
+  return rc;
 }
 
 
@@ -278,11 +677,7 @@ static int
 librdf_storage_file_sync(librdf_storage *storage)
 {
   librdf_storage_file_instance* context=(librdf_storage_file_instance*)storage->instance;
-  char *backup_name;
-  char *new_name;
-  librdf_serializer* serializer;
-  FILE *fh;
-  int rc=0;
+  int rc;
 
   if(!context->changed)
     return 0;
@@ -292,33 +687,57 @@ librdf_storage_file_sync(librdf_storage *storage)
     context->changed=0;
     return 0;
   }
-  
-  backup_name=NULL;
-
-  if(!access((const char*)context->name, F_OK)) {
-    /* name"~\0" */
-    backup_name = LIBRDF_MALLOC(char*, context->name_len + 2);
-    if(!backup_name)
-      return 1;
-    strcpy(backup_name, (const char*)context->name);
-    backup_name[context->name_len]='~';
-    backup_name[context->name_len+1]='\0';
-
-    if(rename(context->name, backup_name) < 0) {
+
+  if(!context->log_fh) {
+    rc = librdf_storage_file_write(storage);
+    if(!rc)
+      context->changed=0;
+    return rc;
+  }
+
+  /* Write the file and start a new log once the log is long enough,
+   * otherwise just make the log durable.  The log is only reset once
+   * the new file has replaced the old one. */
+  if(librdf_storage_file_log_full(context) &&
+     !librdf_storage_file_write(storage))
+    rc = librdf_storage_file_log_reset(storage);
+  else {
+    rc = librdf_storage_file_flush(context->log_fh);
+    if(rc)
       librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-                 "rename of '%s' to '%s' failed - %s",
-                 context->name, backup_name, strerror(errno));
-      LIBRDF_FREE(char*, backup_name);
-      return 1;
-    }
+                 "failed to write to log '%s' - %s",
+                 context->log_name, strerror(errno));
   }
-  
+
+  context->changed=0;
+
+  return rc;
+}
+
+
+/*
+ * librdf_storage_file_write - Write the whole model to the file
+ * @storage: storage
+ *
+ * The new content is written to name".new", flushed to disk and
+ * renamed over the file, so the file always holds either the old or
+ * the new content.
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_storage_file_write(librdf_storage *storage)
+{
+  librdf_storage_file_instance* context=(librdf_storage_file_instance*)storage->instance;
+  char *new_name;
+  librdf_serializer* serializer;
+  FILE *fh;
+  int rc=0;
+
   /* name".new\0" */
   new_name = LIBRDF_MALLOC(char*, context->name_len + 5);
-  if(!new_name) {
-    LIBRDF_FREE(char*, backup_name);
+  if(!new_name)
     return 1;
-  }
 
   strcpy(new_name, (const char*)context->name);
   strcpy(new_name+context->name_len, ".new");
@@ -327,8 +746,6 @@ librdf_storage_file_sync(librdf_storage *storage)
                                      NULL, NULL);
   if(!serializer) {
     LIBRDF_FREE(char*, new_name);
-    if(backup_name)
-      LIBRDF_FREE(char*, backup_name);
     return 1;
   }
   
@@ -339,35 +756,45 @@ librdf_storage_file_sync(librdf_storage *storage)
                new_name, strerror(errno));
     rc=1;
   } else {
-    librdf_serializer_serialize_model_to_file_handle(serializer, fh,
-                                                     context->uri,
-                                                     context->model);
-    fclose(fh);
+    if(librdf_serializer_serialize_model_to_file_handle(serializer, fh,
+                                                        context->uri,
+                                                        context->model)) {
+      librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "failed to serialize the model to '%s'", new_name);
+      rc=1;
+    } else if(librdf_storage_file_flush(fh)) {
+      librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "failed to write file '%s' - %s",
+                 new_name, strerror(errno));
+      rc=1;
+    }
+    if(fclose(fh) && !rc) {
+      librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "failed to close file '%s' - %s",
+                 new_name, strerror(errno));
+      rc=1;
+    }
   }
   librdf_free_serializer(serializer);
 
-  if(fh && rename(new_name, context->name) < 0) {
-    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-               "rename of '%s' to '%s' failed - %s (%d)",
-               new_name, context->name, strerror(errno), errno);
-    fh=NULL;
-    rc=1;
-  }
-
-  LIBRDF_FREE(char*, new_name);
-  
-  /* restore backup on failure (fh=NULL) */
-  if(!fh && backup_name && rename(backup_name, context->name) < 0) {
-    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-               "rename of '%s' to '%s' failed - %s",
-               backup_name, context->name, strerror(errno));
-    rc=1;
+  if(!rc) {
+#ifdef WIN32
+    /* rename() does not replace an existing file here */
+    remove(context->name);
+#endif
+    if(rename(new_name, context->name) < 0) {
+      librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "rename of '%s' to '%s' failed - %s (%d)",
+                 new_name, context->name, strerror(errno), errno);
+      rc=1;
+    }
   }
 
-  if(backup_name)
-    LIBRDF_FREE(char*, backup_name);
+  /* the old file is left untouched on failure */
+  if(rc)
+    remove(new_name);
 
-  context->changed=0;
+  LIBRDF_FREE(char*, new_name);
 
   return rc;
 }
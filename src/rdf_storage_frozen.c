@@ -0,0 +1,1477 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * rdf_storage_frozen.c - RDF Storage in a read-only memory-mapped file
+ *
+ * Copyright (C) 2000-2008, David Beckett http://www.dajobe.org/
+ * Copyright (C) 2000-2004, University of Bristol, UK http://www.bristol.ac.uk/
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ *
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <rdf_config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_rdf_config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+#include <sys/mman.h>
+#define LIBRDF_STORAGE_FROZEN_USE_MMAP 1
+#endif
+
+#include <redland.h>
+#include <rdf_types.h>
+
+
+/*
+ * A frozen store is one file written once from the statements added
+ * to a new store and then only read.  Every node is given a dense
+ * term ID from 1 in the sorted order of its librdf_node_encode()
+ * form and each statement is a quad of the subject, predicate,
+ * object and context term IDs, the context 0 when there is none.
+ *
+ * The file is in the byte order of the machine that wrote it:
+ *   header          librdf_storage_frozen_header
+ *   term offsets    term_count+1 u64 offsets into the term data
+ *   term data       the encoded nodes in term ID order
+ *   quads           four arrays of quad_count u32[4] sorted rows,
+ *                   the quad parts in SPO, POS, OSP and GSPO order
+ * with each section starting at a multiple of 8 bytes.
+ *
+ * It is mapped into memory when opened and searched in place:
+ * nodes are found by binary search of the term data and statements
+ * by binary search of the permutation with the given nodes first.
+ */
+
+#define LIBRDF_STORAGE_FROZEN_MAGIC "LRDFFRZN"
+#define LIBRDF_STORAGE_FROZEN_MAGIC_LEN 8
+#define LIBRDF_STORAGE_FROZEN_VERSION 1
+#define LIBRDF_STORAGE_FROZEN_BYTE_ORDER 0x01020304UL
+
+#define LIBRDF_STORAGE_FROZEN_ALIGN(n) (((n) + 7) & ~((u64)7))
+
+/* quad parts */
+#define LIBRDF_STORAGE_FROZEN_SUBJECT   0
+#define LIBRDF_STORAGE_FROZEN_PREDICATE 1
+#define LIBRDF_STORAGE_FROZEN_OBJECT    2
+#define LIBRDF_STORAGE_FROZEN_CONTEXT   3
+
+/* quad permutations in the file */
+typedef enum {
+  LIBRDF_STORAGE_FROZEN_SPO,
+  LIBRDF_STORAGE_FROZEN_POS,
+  LIBRDF_STORAGE_FROZEN_OSP,
+  LIBRDF_STORAGE_FROZEN_GSPO,
+  LIBRDF_STORAGE_FROZEN_ORDERS
+} librdf_storage_frozen_order;
+
+/* The quad part in each column of a permutation row */
+static const int librdf_storage_frozen_orders[LIBRDF_STORAGE_FROZEN_ORDERS][4]={
+  {0, 1, 2, 3},
+  {1, 2, 0, 3},
+  {2, 0, 1, 3},
+  {3, 0, 1, 2}
+};
+
+
+typedef struct
+{
+  char magic[LIBRDF_STORAGE_FROZEN_MAGIC_LEN];
+  u32 version;
+  u32 byte_order;
+  u64 term_count;
+  u64 quad_count;
+  /* file offsets of the sections */
+  u64 term_offsets;
+  u64 term_data;
+  u64 quads[LIBRDF_STORAGE_FROZEN_ORDERS];
+  u64 length;
+} librdf_storage_frozen_header;
+
+
+/* A node while building a new store */
+typedef struct
+{
+  unsigned char* data;
+  size_t length;
+  /* 1-based index in the order added, until sorted */
+  u32 id;
+} librdf_storage_frozen_term;
+
+
+typedef struct
+{
+  /* file name */
+  char* name;
+  int is_new;
+
+  /* the file contents when open for reading */
+  unsigned char* map;
+  size_t map_length;
+  int is_mapped;
+  const u64* term_offsets;
+  const unsigned char* term_data;
+  const u32* quads[LIBRDF_STORAGE_FROZEN_ORDERS];
+  size_t term_count;
+  size_t quad_count;
+
+  /* the nodes and quads added to a new store until it is closed;
+   * build_terms maps encoded nodes to their 1-based index */
+  librdf_hash* build_terms;
+  librdf_storage_frozen_term* build_term_list;
+  size_t build_term_count;
+  size_t build_term_size;
+  u32* build_quads;
+  size_t build_quad_count;
+  size_t build_quad_size;
+} librdf_storage_frozen_instance;
+
+
+/* prototypes for local functions */
+static int librdf_storage_frozen_init(librdf_storage* storage, const char *name, librdf_hash* options);
+static void librdf_storage_frozen_terminate(librdf_storage* storage);
+static int librdf_storage_frozen_open(librdf_storage* storage, librdf_model* model);
+static int librdf_storage_frozen_close(librdf_storage* storage);
+static int librdf_storage_frozen_size(librdf_storage* storage);
+static int librdf_storage_frozen_add_statement(librdf_storage* storage, librdf_statement* statement);
+static int librdf_storage_frozen_contains_statement(librdf_storage* storage, librdf_statement* statement);
+static librdf_stream* librdf_storage_frozen_serialise(librdf_storage* storage);
+static librdf_stream* librdf_storage_frozen_find_statements(librdf_storage* storage, librdf_statement* statement);
+
+/* context functions */
+static int librdf_storage_frozen_context_add_statement(librdf_storage* storage, librdf_node* context_node, librdf_statement* statement);
+static librdf_stream* librdf_storage_frozen_context_serialise(librdf_storage* storage, librdf_node* context_node);
+static librdf_stream* librdf_storage_frozen_find_statements_in_context(librdf_storage* storage, librdf_statement* statement, librdf_node* context_node);
+static librdf_iterator* librdf_storage_frozen_get_contexts(librdf_storage* storage);
+static librdf_node* librdf_storage_frozen_get_feature(librdf_storage* storage, librdf_uri* feature);
+
+/* statement stream methods */
+static int librdf_storage_frozen_stream_end_of_stream(void* context);
+static int librdf_storage_frozen_stream_next_statement(void* context);
+static void* librdf_storage_frozen_stream_get_statement(void* context, int flags);
+static void librdf_storage_frozen_stream_finished(void* context);
+
+/* get_contexts iterator methods */
+static int librdf_storage_frozen_get_contexts_is_end(void* iterator);
+static int librdf_storage_frozen_get_contexts_next_method(void* iterator);
+static void* librdf_storage_frozen_get_contexts_get_method(void* iterator, int flags);
+static void librdf_storage_frozen_get_contexts_finished(void* iterator);
+
+/* helper functions */
+static int librdf_storage_frozen_read(librdf_storage* storage);
+static int librdf_storage_frozen_write(librdf_storage* storage);
+static void librdf_storage_frozen_build_free(librdf_storage_frozen_instance* context);
+
+static void librdf_storage_frozen_register_factory(librdf_storage_factory *factory);
+
+
+/* Compare encoded nodes in byte order, a shorter one first */
+static int
+librdf_storage_frozen_compare_bytes(const unsigned char* a, size_t a_len,
+                                    const unsigned char* b, size_t b_len)
+{
+  int rc;
+
+  rc = memcmp(a, b, (a_len < b_len) ? a_len : b_len);
+  if(rc)
+    return rc;
+  return (a_len > b_len) - (a_len < b_len);
+}
+
+
+static int
+librdf_storage_frozen_compare_terms(const void* a, const void* b)
+{
+  const librdf_storage_frozen_term* ta=(const librdf_storage_frozen_term*)a;
+  const librdf_storage_frozen_term* tb=(const librdf_storage_frozen_term*)b;
+
+  return librdf_storage_frozen_compare_bytes(ta->data, ta->length,
+                                             tb->data, tb->length);
+}
+
+
+/* Compare the first @length columns of a permutation row with @key */
+static int
+librdf_storage_frozen_compare_row(const u32* row, const u32* key, int length)
+{
+  int i;
+
+  for(i=0; i < length; i++) {
+    if(row[i] != key[i])
+      return (row[i] < key[i]) ? -1 : 1;
+  }
+  return 0;
+}
+
+
+static int
+librdf_storage_frozen_compare_rows(const void* a, const void* b)
+{
+  return librdf_storage_frozen_compare_row((const u32*)a, (const u32*)b, 4);
+}
+
+
+/*
+ * librdf_storage_frozen_search - find the rows starting with a key
+ * @rows: sorted permutation rows
+ * @count: number of rows
+ * @key: key columns
+ * @length: number of key columns
+ * @upper: non 0 to find the first row after those with the key
+ *
+ * Return value: index of the first row with the key (or after them)
+ */
+static size_t
+librdf_storage_frozen_search(const u32* rows, size_t count,
+                             const u32* key, int length, int upper)
+{
+  size_t low=0;
+  size_t high=count;
+
+  while(low < high) {
+    size_t mid=low + (high - low) / 2;
+    int rc=librdf_storage_frozen_compare_row(rows + mid * 4, key, length);
+
+    if(rc < 0 || (upper && !rc))
+      low=mid + 1;
+    else
+      high=mid;
+  }
+
+  return low;
+}
+
+
+/*
+ * librdf_storage_frozen_get_term - make the node for a term ID
+ *
+ * Return value: new #librdf_node or NULL on failure
+ */
+static librdf_node*
+librdf_storage_frozen_get_term(librdf_storage* storage, u32 id)
+{
+  librdf_storage_frozen_instance* context=(librdf_storage_frozen_instance*)storage->instance;
+  u64 start, end;
+
+  if(!id || id > context->term_count)
+    return NULL;
+
+  /* the offsets were checked when the store was opened */
+  start=context->term_offsets[id-1];
+  end=context->term_offsets[id];
+
+  return librdf_node_decode(storage->world, NULL,
+                            (unsigned char*)context->term_data + start,
+                            (size_t)(end - start));
+}
+
+
+/*
+ * librdf_storage_frozen_find_term - find the term ID of a node
+ *
+ * Return value: the term ID or 0 if the node is not present
+ */
+static u32
+librdf_storage_frozen_find_term(librdf_storage* storage, librdf_node* node)
+{
+  librdf_storage_frozen_instance* context=(librdf_storage_frozen_instance*)storage->instance;
+  unsigned char* buffer;
+  size_t length;
+  size_t low=0;
+  size_t high=context->term_count;
+  u32 id=0;
+
+  length=librdf_node_encode(node, NULL, 0);
+  if(!length)
+    return 0;
+  buffer=LIBRDF_MALLOC(unsigned char*, length);
+  if(!buffer)
+    return 0;
+  if(!librdf_node_encode(node, buffer, length)) {
+    LIBRDF_FREE(data, buffer);
+    return 0;
+  }
+
+  while(low < high) {
+    size_t mid=low + (high - low) / 2;
+    u64 start=context->term_offsets[mid];
+    u64 end=context->term_offsets[mid+1];
+    int rc;
+
+    rc=librdf_storage_frozen_compare_bytes(context->term_data + start,
+                                           (size_t)(end - start),
+                                           buffer, length);
+    if(!rc) {
+      id=(u32)(mid + 1);
+      break;
+    }
+    if(rc < 0)
+      low=mid + 1;
+    else
+      high=mid;
+  }
+
+  LIBRDF_FREE(data, buffer);
+
+  return id;
+}
+
+
+/* functions implementing storage api */
+static int
+librdf_storage_frozen_init(librdf_storage* storage, const char *name,
+                           librdf_hash* options)
+{
+  librdf_storage_frozen_instance* context;
+  int is_new;
+
+  if(!name) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "Frozen storage requires a file name");
+    if(options)
+      librdf_free_hash(options);
+    return 1;
+  }
+
+  context = LIBRDF_CALLOC(librdf_storage_frozen_instance*, 1, sizeof(*context));
+  if(!context) {
+    if(options)
+      librdf_free_hash(options);
+    return 1;
+  }
+
+  librdf_storage_set_instance(storage, context);
+
+  context->name = LIBRDF_MALLOC(char*, strlen(name) + 1);
+  if(!context->name) {
+    if(options)
+      librdf_free_hash(options);
+    return 1;
+  }
+  strcpy(context->name, name);
+
+  if((is_new=librdf_hash_get_as_boolean(options, "new"))<0)
+    is_new=0; /* default is to read an existing file */
+  context->is_new=is_new;
+
+  /* no more options, might as well free them now */
+  if(options)
+    librdf_free_hash(options);
+
+  return 0;
+}
+
+
+static void
+librdf_storage_frozen_terminate(librdf_storage* storage)
+{
+  librdf_storage_frozen_instance* context=(librdf_storage_frozen_instance*)storage->instance;
+
+  if(!context)
+    return;
+
+  librdf_storage_frozen_build_free(context);
+
+  if(context->name)
+    LIBRDF_FREE(char*, context->name);
+
+  LIBRDF_FREE(librdf_storage_frozen_instance, context);
+}
+
+
+static int
+librdf_storage_frozen_open(librdf_storage* storage, librdf_model* model)
+{
+  librdf_storage_frozen_instance* context=(librdf_storage_frozen_instance*)storage->instance;
+
+  if(!context->is_new)
+    return librdf_storage_frozen_read(storage);
+
+  /* statements are collected until close */
+  context->build_terms=librdf_new_hash(storage->world, NULL);
+  if(!context->build_terms)
+    return 1;
+  if(librdf_hash_open(context->build_terms, NULL, 0, 1, 1, NULL)) {
+    librdf_free_hash(context->build_terms);
+    context->build_terms=NULL;
+    return 1;
+  }
+
+  return 0;
+}
+
+
+/*
+ * librdf_storage_frozen_close:
+ * @storage: the storage
+ *
+ * INTERNAL - Close the storage, writing the file of a new store.
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_storage_frozen_close(librdf_storage* storage)
+{
+  librdf_storage_frozen_instance* context=(librdf_storage_frozen_instance*)storage->instance;
+  int status=0;
+
+  if(context->build_terms) {
+    status=librdf_storage_frozen_write(storage);
+    librdf_storage_frozen_build_free(context);
+    /* written once */
+    context->is_new=0;
+  }
+
+  if(context->map) {
+#ifdef LIBRDF_STORAGE_FROZEN_USE_MMAP
+    if(context->is_mapped)
+      munmap(context->map, context->map_length);
+    else
+#endif
+      LIBRDF_FREE(data, context->map);
+    context->map=NULL;
+    context->is_mapped=0;
+  }
+  context->term_count=0;
+  context->quad_count=0;
+
+  return status;
+}
+
+
+/*
+ * librdf_storage_frozen_read - map the file and check the header
+ * @storage: the storage
+ *
+ * The header and the term offsets are checked here, so that terms can
+ * be read and searched without further checks.  The quads are not
+ * read; any term ID in them is checked as it is used.
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_storage_frozen_read(librdf_storage* storage)
+{
+  librdf_storage_frozen_instance* context=(librdf_storage_frozen_instance*)storage->instance;
+  const librdf_storage_frozen_header* header;
+  struct stat st;
+  FILE* fh;
+  u64 quads_length;
+  u64 term;
+  int i;
+
+  fh=fopen(context->name, "rb");
+  if(!fh) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "failed to open frozen store '%s' - %s",
+               context->name, strerror(errno));
+    return 1;
+  }
+
+  if(fstat(fileno(fh), &st) ||
+     (u64)st.st_size < sizeof(librdf_storage_frozen_header) ||
+     (u64)st.st_size != (u64)(size_t)st.st_size) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "frozen store '%s' is not a frozen store file",
+               context->name);
+    fclose(fh);
+    return 1;
+  }
+  context->map_length=(size_t)st.st_size;
+
+#ifdef LIBRDF_STORAGE_FROZEN_USE_MMAP
+  {
+    void* map=mmap(NULL, context->map_length, PROT_READ, MAP_SHARED,
+                   fileno(fh), 0);
+    if(map != MAP_FAILED) {
+#ifdef HAVE_MADVISE
+      madvise(map, context->map_length, MADV_RANDOM);
+#endif
+      context->map=(unsigned char*)map;
+      context->is_mapped=1;
+    }
+  }
+#endif
+
+  if(!context->map) {
+    context->map=LIBRDF_MALLOC(unsigned char*, context->map_length);
+    if(!context->map ||
+       fread(context->map, 1, context->map_length, fh) != context->map_length) {
+      librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "failed to read frozen store '%s'", context->name);
+      fclose(fh);
+      if(context->map) {
+        LIBRDF_FREE(data, context->map);
+        context->map=NULL;
+      }
+      return 1;
+    }
+  }
+  /* a mapping stays valid after the file is closed */
+  fclose(fh);
+
+  header=(const librdf_storage_frozen_header*)context->map;
+  if(memcmp(header->magic, LIBRDF_STORAGE_FROZEN_MAGIC,
+            LIBRDF_STORAGE_FROZEN_MAGIC_LEN) ||
+     header->version != LIBRDF_STORAGE_FROZEN_VERSION) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "frozen store '%s' is not a version %d frozen store file",
+               context->name, LIBRDF_STORAGE_FROZEN_VERSION);
+    librdf_storage_frozen_close(storage);
+    return 1;
+  }
+
+  if(header->byte_order != LIBRDF_STORAGE_FROZEN_BYTE_ORDER) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "frozen store '%s' was written with a different byte order",
+               context->name);
+    librdf_storage_frozen_close(storage);
+    return 1;
+  }
+
+  /* the sections must be aligned and inside the file */
+  quads_length=header->quad_count * 4 * sizeof(u32);
+  if(header->length != context->map_length ||
+     header->term_count >= 0xffffffffUL ||
+     header->quad_count > header->length ||
+     (header->term_offsets & 7) || (header->term_data & 7) ||
+     header->term_offsets > header->length ||
+     header->term_count >= (header->length - header->term_offsets) / sizeof(u64) ||
+     header->term_data > header->length) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "frozen store '%s' is damaged", context->name);
+    librdf_storage_frozen_close(storage);
+    return 1;
+  }
+  for(i=0; i < LIBRDF_STORAGE_FROZEN_ORDERS; i++) {
+    if((header->quads[i] & 7) || header->quads[i] > header->length ||
+       quads_length > header->length - header->quads[i]) {
+      librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "frozen store '%s' is damaged", context->name);
+      librdf_storage_frozen_close(storage);
+      return 1;
+    }
+    context->quads[i]=(const u32*)(context->map + header->quads[i]);
+  }
+
+  context->term_offsets=(const u64*)(context->map + header->term_offsets);
+  context->term_data=context->map + header->term_data;
+
+  /* each term must end after it starts and inside the term data */
+  for(term=0; term < header->term_count; term++) {
+    if(context->term_offsets[term] > context->term_offsets[term+1])
+      break;
+  }
+  if(term < header->term_count ||
+     context->term_offsets[header->term_count] > header->length - header->term_data) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "frozen store '%s' is damaged", context->name);
+    librdf_storage_frozen_close(storage);
+    return 1;
+  }
+
+  context->term_count=(size_t)header->term_count;
+  context->quad_count=(size_t)header->quad_count;
+
+  return 0;
+}
+
+
+static int
+librdf_storage_frozen_size(librdf_storage* storage)
+{
+  librdf_storage_frozen_instance* context=(librdf_storage_frozen_instance*)storage->instance;
+
+  /* duplicates are only removed when a new store is written */
+  if(context->build_terms)
+    return -1;
+
+  return (int)context->quad_count;
+}
+
+
+static int
+librdf_storage_frozen_add_statement(librdf_storage* storage,
+                                    librdf_statement* statement)
+{
+  return librdf_storage_frozen_context_add_statement(storage, NULL, statement);
+}
+
+
+/*
+ * librdf_storage_frozen_build_term - get the index of a node in a new store
+ *
+ * Return value: the 1-based index or 0 on failure
+ */
+static u32
+librdf_storage_frozen_build_term(librdf_storage* storage, librdf_node* node)
+{
+  librdf_storage_frozen_instance* context=(librdf_storage_frozen_instance*)storage->instance;
+  librdf_storage_frozen_term* term;
+  librdf_hash_datum hd_key, hd_value; /* on stack */
+  librdf_hash_datum* value;
+  unsigned char* buffer;
+  size_t length;
+  u32 id;
+
+  length=librdf_node_encode(node, NULL, 0);
+  if(!length)
+    return 0;
+  buffer=LIBRDF_MALLOC(unsigned char*, length);
+  if(!buffer)
+    return 0;
+  if(!librdf_node_encode(node, buffer, length)) {
+    LIBRDF_FREE(data, buffer);
+    return 0;
+  }
+
+  hd_key.data=buffer; hd_key.size=length;
+  value=librdf_hash_get_one(context->build_terms, &hd_key);
+  if(value) {
+    memcpy(&id, value->data, sizeof(id));
+    librdf_free_hash_datum(value);
+    LIBRDF_FREE(data, buffer);
+    return id;
+  }
+
+  if(context->build_term_count == context->build_term_size) {
+    size_t size=context->build_term_size ? context->build_term_size * 2 : 1024;
+    librdf_storage_frozen_term* terms;
+
+    terms=LIBRDF_MALLOC(librdf_storage_frozen_term*, size * sizeof(*terms));
+    if(!terms) {
+      LIBRDF_FREE(data, buffer);
+      return 0;
+    }
+    if(context->build_term_list) {
+      memcpy(terms, context->build_term_list,
+             context->build_term_count * sizeof(*terms));
+      LIBRDF_FREE(librdf_storage_frozen_term, context->build_term_list);
+    }
+    context->build_term_list=terms;
+    context->build_term_size=size;
+  }
+
+  term=&context->build_term_list[context->build_term_count++];
+  term->data=buffer;
+  term->length=length;
+  term->id=id=(u32)context->build_term_count;
+
+  hd_value.data=&id; hd_value.size=sizeof(id);
+  if(librdf_hash_put(context->build_terms, &hd_key, &hd_value))
+    return 0;
+
+  return id;
+}
+
+
+static int
+librdf_storage_frozen_context_add_statement(librdf_storage* storage,
+                                            librdf_node* context_node,
+                                            librdf_statement* statement)
+{
+  librdf_storage_frozen_instance* context=(librdf_storage_frozen_instance*)storage->instance;
+  u32* quad;
+
+  if(!context->build_terms) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "Frozen storage '%s' is read-only", context->name);
+    return 1;
+  }
+
+  if(!librdf_statement_is_complete(statement))
+    return 1;
+
+  if(context->build_quad_count == context->build_quad_size) {
+    size_t size=context->build_quad_size ? context->build_quad_size * 2 : 1024;
+    u32* quads;
+
+    quads=LIBRDF_MALLOC(u32*, size * 4 * sizeof(u32));
+    if(!quads)
+      return 1;
+    if(context->build_quads) {
+      memcpy(quads, context->build_quads,
+             context->build_quad_count * 4 * sizeof(u32));
+      LIBRDF_FREE(u32, context->build_quads);
+    }
+    context->build_quads=quads;
+    context->build_quad_size=size;
+  }
+
+  quad=context->build_quads + context->build_quad_count * 4;
+  quad[LIBRDF_STORAGE_FROZEN_SUBJECT]=librdf_storage_frozen_build_term(storage, librdf_statement_get_subject(statement));
+  quad[LIBRDF_STORAGE_FROZEN_PREDICATE]=librdf_storage_frozen_build_term(storage, librdf_statement_get_predicate(statement));
+  quad[LIBRDF_STORAGE_FROZEN_OBJECT]=librdf_storage_frozen_build_term(storage, librdf_statement_get_object(statement));
+  quad[LIBRDF_STORAGE_FROZEN_CONTEXT]=0;
+  if(context_node)
+    quad[LIBRDF_STORAGE_FROZEN_CONTEXT]=librdf_storage_frozen_build_term(storage, context_node);
+
+  if(!quad[LIBRDF_STORAGE_FROZEN_SUBJECT] ||
+     !quad[LIBRDF_STORAGE_FROZEN_PREDICATE] ||
+     !quad[LIBRDF_STORAGE_FROZEN_OBJECT] ||
+     (context_node && !quad[LIBRDF_STORAGE_FROZEN_CONTEXT]))
+    return 1;
+
+  context->build_quad_count++;
+
+  return 0;
+}
+
+
+static void
+librdf_storage_frozen_build_free(librdf_storage_frozen_instance* context)
+{
+  size_t i;
+
+  if(context->build_terms) {
+    librdf_free_hash(context->build_terms);
+    context->build_terms=NULL;
+  }
+
+  if(context->build_term_list) {
+    for(i=0; i < context->build_term_count; i++)
+      LIBRDF_FREE(data, context->build_term_list[i].data);
+    LIBRDF_FREE(librdf_storage_frozen_term, context->build_term_list);
+    context->build_term_list=NULL;
+  }
+  context->build_term_count=0;
+  context->build_term_size=0;
+
+  if(context->build_quads) {
+    LIBRDF_FREE(u32, context->build_quads);
+    context->build_quads=NULL;
+  }
+  context->build_quad_count=0;
+  context->build_quad_size=0;
+}
+
+
+/* Write zeros up to the next multiple of 8 bytes */
+static int
+librdf_storage_frozen_write_pad(FILE* fh, u64* offset)
+{
+  static const unsigned char zeros[8]={0, 0, 0, 0, 0, 0, 0, 0};
+  size_t pad=(size_t)(LIBRDF_STORAGE_FROZEN_ALIGN(*offset) - *offset);
+
+  *offset+=pad;
+  return (fwrite(zeros, 1, pad, fh) != pad);
+}
+
+
+/*
+ * librdf_storage_frozen_write - write the file of a new store
+ * @storage: the storage
+ *
+ * Numbers the nodes in sorted order, removes duplicate statements
+ * and writes each permutation sorted.  The file is written to
+ * name".new" and renamed over any old file.
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_storage_frozen_write(librdf_storage* storage)
+{
+  librdf_storage_frozen_instance* context=(librdf_storage_frozen_instance*)storage->instance;
+  librdf_storage_frozen_header header;
+  u32* ids=NULL;
+  u32* rows=NULL;
+  u32* quads=context->build_quads;
+  size_t term_count=context->build_term_count;
+  size_t quad_count=context->build_quad_count;
+  size_t i;
+  u64 offset;
+  int order;
+  char* new_name;
+  FILE* fh;
+  int rc=0;
+
+  /* term IDs in the sorted order of the encoded nodes */
+  qsort(context->build_term_list, term_count,
+        sizeof(librdf_storage_frozen_term),
+        librdf_storage_frozen_compare_terms);
+
+  ids=LIBRDF_MALLOC(u32*, (term_count + 1) * sizeof(u32));
+  if(!ids)
+    return 1;
+  ids[0]=0;
+  for(i=0; i < term_count; i++)
+    ids[context->build_term_list[i].id]=(u32)(i + 1);
+
+  for(i=0; i < quad_count * 4; i++)
+    quads[i]=ids[quads[i]];
+  LIBRDF_FREE(u32, ids);
+
+  /* sort in SPO order to drop duplicates */
+  qsort(quads, quad_count, 4 * sizeof(u32), librdf_storage_frozen_compare_rows);
+  if(quad_count) {
+    size_t j=0;
+
+    for(i=1; i < quad_count; i++) {
+      if(librdf_storage_frozen_compare_row(quads + i * 4, quads + j * 4, 4))
+        memcpy(quads + (++j) * 4, quads + i * 4, 4 * sizeof(u32));
+    }
+    quad_count=j + 1;
+  }
+
+  memset(&header, '\0', sizeof(header));
+  memcpy(header.magic, LIBRDF_STORAGE_FROZEN_MAGIC,
+         LIBRDF_STORAGE_FROZEN_MAGIC_LEN);
+  header.version=LIBRDF_STORAGE_FROZEN_VERSION;
+  header.byte_order=LIBRDF_STORAGE_FROZEN_BYTE_ORDER;
+  header.term_count=term_count;
+  header.quad_count=quad_count;
+
+  offset=LIBRDF_STORAGE_FROZEN_ALIGN(sizeof(header));
+  header.term_offsets=offset;
+  offset+=(term_count + 1) * sizeof(u64);
+  header.term_data=offset;
+  for(i=0; i < term_count; i++)
+    offset+=context->build_term_list[i].length;
+  for(order=0; order < LIBRDF_STORAGE_FROZEN_ORDERS; order++) {
+    offset=LIBRDF_STORAGE_FROZEN_ALIGN(offset);
+    header.quads[order]=offset;
+    offset+=quad_count * 4 * sizeof(u32);
+  }
+  header.length=offset;
+
+  if(quad_count) {
+    rows=LIBRDF_MALLOC(u32*, quad_count * 4 * sizeof(u32));
+    if(!rows)
+      return 1;
+  }
+
+  new_name=LIBRDF_MALLOC(char*, strlen(context->name) + 5);
+  if(!new_name) {
+    if(rows)
+      LIBRDF_FREE(u32, rows);
+    return 1;
+  }
+  sprintf(new_name, "%s.new", context->name);
+
+  fh=fopen(new_name, "wb");
+  if(!fh) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "failed to open frozen store '%s' for writing - %s",
+               new_name, strerror(errno));
+    LIBRDF_FREE(char*, new_name);
+    if(rows)
+      LIBRDF_FREE(u32, rows);
+    return 1;
+  }
+
+  offset=sizeof(header);
+  if(fwrite(&header, sizeof(header), 1, fh) != 1 ||
+     librdf_storage_frozen_write_pad(fh, &offset))
+    rc=1;
+
+  /* term offsets then term data */
+  offset=0;
+  for(i=0; !rc && i <= term_count; i++) {
+    if(fwrite(&offset, sizeof(offset), 1, fh) != 1)
+      rc=1;
+    if(i < term_count)
+      offset+=context->build_term_list[i].length;
+  }
+  for(i=0; !rc && i < term_count; i++) {
+    librdf_storage_frozen_term* term=&context->build_term_list[i];
+
+    if(fwrite(term->data, 1, term->length, fh) != term->length)
+      rc=1;
+  }
+
+  offset=header.term_data + offset;
+  for(order=0; !rc && order < LIBRDF_STORAGE_FROZEN_ORDERS; order++) {
+    const int* columns=librdf_storage_frozen_orders[order];
+
+    if(librdf_storage_frozen_write_pad(fh, &offset)) {
+      rc=1;
+      break;
+    }
+
+    for(i=0; i < quad_count; i++) {
+      rows[i*4]=quads[i*4 + columns[0]];
+      rows[i*4 + 1]=quads[i*4 + columns[1]];
+      rows[i*4 + 2]=quads[i*4 + columns[2]];
+      rows[i*4 + 3]=quads[i*4 + columns[3]];
+    }
+    if(order != LIBRDF_STORAGE_FROZEN_SPO)
+      qsort(rows, quad_count, 4 * sizeof(u32),
+            librdf_storage_frozen_compare_rows);
+
+    if(quad_count &&
+       fwrite(rows, 4 * sizeof(u32), quad_count, fh) != quad_count)
+      rc=1;
+    offset+=quad_count * 4 * sizeof(u32);
+  }
+
+  if(fclose(fh))
+    rc=1;
+
+  if(!rc) {
+#ifdef WIN32
+    remove(context->name);
+#endif
+    if(rename(new_name, context->name) < 0)
+      rc=1;
+  }
+
+  if(rc) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "failed to write frozen store '%s' - %s",
+               context->name, strerror(errno));
+    remove(new_name);
+  }
+
+  LIBRDF_FREE(char*, new_name);
+  if(rows)
+    LIBRDF_FREE(u32, rows);
+
+  return rc;
+}
+
+
+typedef struct {
+  librdf_storage* storage;
+
+  /* rows of the permutation being read */
+  const u32* rows;
+  int order;
+  size_t position;
+  size_t end;
+
+  /* term IDs each quad part must have or 0 for any */
+  u32 match[4];
+
+  /* current statement and context, once made */
+  librdf_statement* statement;
+  librdf_node* context_node;
+  int current_is_made;
+} librdf_storage_frozen_stream_context;
+
+
+/* Move to the next row from @position matching the bound parts */
+static void
+librdf_storage_frozen_stream_skip(librdf_storage_frozen_stream_context* scontext)
+{
+  const int* columns=librdf_storage_frozen_orders[scontext->order];
+
+  for(; scontext->position < scontext->end; scontext->position++) {
+    const u32* row=scontext->rows + scontext->position * 4;
+    int i;
+
+    for(i=0; i < 4; i++) {
+      u32 id=scontext->match[columns[i]];
+      if(id && row[i] != id)
+        break;
+    }
+    if(i == 4)
+      break;
+  }
+}
+
+
+/*
+ * librdf_storage_frozen_find_common - statements matching parts and a context
+ * @storage: the storage
+ * @statement: partial statement or NULL for all
+ * @context_node: context or NULL for any
+ *
+ * Searches the permutation with the most given parts first and
+ * checks any remaining given parts of each row.
+ *
+ * Return value: a #librdf_stream or NULL on failure
+ */
+static librdf_stream*
+librdf_storage_frozen_find_common(librdf_storage* storage,
+                                  librdf_statement* statement,
+                                  librdf_node* context_node)
+{
+  librdf_storage_frozen_instance* context=(librdf_storage_frozen_instance*)storage->instance;
+  librdf_storage_frozen_stream_context* scontext;
+  librdf_stream* stream;
+  librdf_node* nodes[4];
+  u32 match[4];
+  u32 key[4];
+  const int* columns;
+  int order;
+  int length;
+  int i;
+
+  if(context->build_terms) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "Frozen storage '%s' cannot be read until it is written",
+               context->name);
+    return NULL;
+  }
+
+  nodes[LIBRDF_STORAGE_FROZEN_SUBJECT]=statement ? librdf_statement_get_subject(statement) : NULL;
+  nodes[LIBRDF_STORAGE_FROZEN_PREDICATE]=statement ? librdf_statement_get_predicate(statement) : NULL;
+  nodes[LIBRDF_STORAGE_FROZEN_OBJECT]=statement ? librdf_statement_get_object(statement) : NULL;
+  nodes[LIBRDF_STORAGE_FROZEN_CONTEXT]=context_node;
+
+  for(i=0; i < 4; i++) {
+    match[i]=0;
+    if(nodes[i]) {
+      match[i]=librdf_storage_frozen_find_term(storage, nodes[i]);
+      /* an unknown node matches nothing */
+      if(!match[i])
+        return librdf_new_empty_stream(storage->world);
+    }
+  }
+
+  if(match[LIBRDF_STORAGE_FROZEN_CONTEXT])
+    order=LIBRDF_STORAGE_FROZEN_GSPO;
+  else if(match[LIBRDF_STORAGE_FROZEN_SUBJECT])
+    order=(match[LIBRDF_STORAGE_FROZEN_OBJECT] &&
+           !match[LIBRDF_STORAGE_FROZEN_PREDICATE]) ?
+          LIBRDF_STORAGE_FROZEN_OSP : LIBRDF_STORAGE_FROZEN_SPO;
+  else if(match[LIBRDF_STORAGE_FROZEN_PREDICATE])
+    order=LIBRDF_STORAGE_FROZEN_POS;
+  else if(match[LIBRDF_STORAGE_FROZEN_OBJECT])
+    order=LIBRDF_STORAGE_FROZEN_OSP;
+  else
+    order=LIBRDF_STORAGE_FROZEN_SPO;
+
+  /* the given parts at the start of the rows are the search key */
+  columns=librdf_storage_frozen_orders[order];
+  for(length=0; length < 4 && match[columns[length]]; length++)
+    key[length]=match[columns[length]];
+
+  scontext = LIBRDF_CALLOC(librdf_storage_frozen_stream_context*, 1,
+                           sizeof(*scontext));
+  if(!scontext)
+    return NULL;
+
+  scontext->statement=librdf_new_statement(storage->world);
+  if(!scontext->statement) {
+    LIBRDF_FREE(librdf_storage_frozen_stream_context, scontext);
+    return NULL;
+  }
+
+  scontext->rows=context->quads[order];
+  scontext->order=order;
+  memcpy(scontext->match, match, sizeof(match));
+  if(length) {
+    scontext->position=librdf_storage_frozen_search(scontext->rows,
+                                                    context->quad_count,
+                                                    key, length, 0);
+    scontext->end=librdf_storage_frozen_search(scontext->rows,
+                                               context->quad_count,
+                                               key, length, 1);
+  } else {
+    scontext->position=0;
+    scontext->end=context->quad_count;
+  }
+  librdf_storage_frozen_stream_skip(scontext);
+
+  scontext->storage=storage;
+  librdf_storage_add_reference(scontext->storage);
+
+  stream=librdf_new_stream(storage->world,
+                           (void*)scontext,
+                           &librdf_storage_frozen_stream_end_of_stream,
+                           &librdf_storage_frozen_stream_next_statement,
+                           &librdf_storage_frozen_stream_get_statement,
+                           &librdf_storage_frozen_stream_finished);
+  if(!stream) {
+    librdf_storage_frozen_stream_finished((void*)scontext);
+    return NULL;
+  }
+
+  return stream;
+}
+
+
+static int
+librdf_storage_frozen_stream_end_of_stream(void* context)
+{
+  librdf_storage_frozen_stream_context* scontext=(librdf_storage_frozen_stream_context*)context;
+
+  return (scontext->position >= scontext->end);
+}
+
+
+static int
+librdf_storage_frozen_stream_next_statement(void* context)
+{
+  librdf_storage_frozen_stream_context* scontext=(librdf_storage_frozen_stream_context*)context;
+
+  if(scontext->position >= scontext->end)
+    return 1;
+
+  scontext->position++;
+  librdf_storage_frozen_stream_skip(scontext);
+  scontext->current_is_made=0;
+
+  return (scontext->position >= scontext->end);
+}
+
+
+static void*
+librdf_storage_frozen_stream_get_statement(void* context, int flags)
+{
+  librdf_storage_frozen_stream_context* scontext=(librdf_storage_frozen_stream_context*)context;
+  const int* columns=librdf_storage_frozen_orders[scontext->order];
+  const u32* row;
+  u32 quad[4];
+  librdf_node* node;
+  int i;
+
+  if(scontext->position >= scontext->end)
+    return NULL;
+
+  if(!scontext->current_is_made) {
+    row=scontext->rows + scontext->position * 4;
+    for(i=0; i < 4; i++)
+      quad[columns[i]]=row[i];
+
+    librdf_statement_clear(scontext->statement);
+    if(scontext->context_node) {
+      librdf_free_node(scontext->context_node);
+      scontext->context_node=NULL;
+    }
+
+    for(i=0; i < 3; i++) {
+      node=librdf_storage_frozen_get_term(scontext->storage, quad[i]);
+      if(!node)
+        return NULL;
+      if(i == LIBRDF_STORAGE_FROZEN_SUBJECT)
+        librdf_statement_set_subject(scontext->statement, node);
+      else if(i == LIBRDF_STORAGE_FROZEN_PREDICATE)
+        librdf_statement_set_predicate(scontext->statement, node);
+      else
+        librdf_statement_set_object(scontext->statement, node);
+    }
+
+    if(quad[LIBRDF_STORAGE_FROZEN_CONTEXT]) {
+      scontext->context_node=librdf_storage_frozen_get_term(scontext->storage, quad[LIBRDF_STORAGE_FROZEN_CONTEXT]);
+      if(!scontext->context_node)
+        return NULL;
+    }
+
+    scontext->current_is_made=1;
+  }
+
+  switch(flags) {
+    case LIBRDF_ITERATOR_GET_METHOD_GET_OBJECT:
+      return scontext->statement;
+    case LIBRDF_ITERATOR_GET_METHOD_GET_CONTEXT:
+      return scontext->context_node;
+    default:
+      librdf_log(scontext->storage->world,
+                 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "Unknown iterator method flag %d", flags);
+      return NULL;
+  }
+}
+
+
+static void
+librdf_storage_frozen_stream_finished(void* context)
+{
+  librdf_storage_frozen_stream_context* scontext=(librdf_storage_frozen_stream_context*)context;
+
+  if(scontext->statement)
+    librdf_free_statement(scontext->statement);
+
+  if(scontext->context_node)
+    librdf_free_node(scontext->context_node);
+
+  if(scontext->storage)
+    librdf_storage_remove_reference(scontext->storage);
+
+  LIBRDF_FREE(librdf_storage_frozen_stream_context, scontext);
+}
+
+
+static int
+librdf_storage_frozen_contains_statement(librdf_storage* storage,
+                                         librdf_statement* statement)
+{
+  librdf_storage_frozen_instance* context=(librdf_storage_frozen_instance*)storage->instance;
+  u32 key[3];
+  size_t position;
+
+  if(context->build_terms || !librdf_statement_is_complete(statement))
+    return 0;
+
+  key[0]=librdf_storage_frozen_find_term(storage, librdf_statement_get_subject(statement));
+  key[1]=librdf_storage_frozen_find_term(storage, librdf_statement_get_predicate(statement));
+  key[2]=librdf_storage_frozen_find_term(storage, librdf_statement_get_object(statement));
+  if(!key[0] || !key[1] || !key[2])
+    return 0;
+
+  position=librdf_storage_frozen_search(context->quads[LIBRDF_STORAGE_FROZEN_SPO],
+                                        context->quad_count, key, 3, 0);
+  return (position < context->quad_count &&
+          !librdf_storage_frozen_compare_row(context->quads[LIBRDF_STORAGE_FROZEN_SPO] + position * 4,
+                                             key, 3));
+}
+
+
+static librdf_stream*
+librdf_storage_frozen_serialise(librdf_storage* storage)
+{
+  return librdf_storage_frozen_find_common(storage, NULL, NULL);
+}
+
+
+static librdf_stream*
+librdf_storage_frozen_find_statements(librdf_storage* storage,
+                                      librdf_statement* statement)
+{
+  return librdf_storage_frozen_find_common(storage, statement, NULL);
+}
+
+
+static librdf_stream*
+librdf_storage_frozen_context_serialise(librdf_storage* storage,
+                                        librdf_node* context_node)
+{
+  return librdf_storage_frozen_find_common(storage, NULL, context_node);
+}
+
+
+static librdf_stream*
+librdf_storage_frozen_find_statements_in_context(librdf_storage* storage,
+                                                 librdf_statement* statement,
+                                                 librdf_node* context_node)
+{
+  return librdf_storage_frozen_find_common(storage, statement, context_node);
+}
+
+
+typedef struct {
+  librdf_storage* storage;
+  /* position in the GSPO rows */
+  size_t position;
+  librdf_node* current;
+} librdf_storage_frozen_get_contexts_iterator_context;
+
+
+static int
+librdf_storage_frozen_get_contexts_is_end(void* iterator)
+{
+  librdf_storage_frozen_get_contexts_iterator_context* icontext=(librdf_storage_frozen_get_contexts_iterator_context*)iterator;
+  librdf_storage_frozen_instance* context=(librdf_storage_frozen_instance*)icontext->storage->instance;
+
+  return (icontext->position >= context->quad_count);
+}
+
+
+static int
+librdf_storage_frozen_get_contexts_next_method(void* iterator)
+{
+  librdf_storage_frozen_get_contexts_iterator_context* icontext=(librdf_storage_frozen_get_contexts_iterator_context*)iterator;
+  librdf_storage_frozen_instance* context=(librdf_storage_frozen_instance*)icontext->storage->instance;
+  const u32* rows=context->quads[LIBRDF_STORAGE_FROZEN_GSPO];
+
+  if(icontext->position >= context->quad_count)
+    return 1;
+
+  /* skip the other statements in this context */
+  icontext->position=librdf_storage_frozen_search(rows, context->quad_count,
+                                                  rows + icontext->position * 4,
+                                                  1, 1);
+  if(icontext->current) {
+    librdf_free_node(icontext->current);
+    icontext->current=NULL;
+  }
+
+  return (icontext->position >= context->quad_count);
+}
+
+
+static void*
+librdf_storage_frozen_get_contexts_get_method(void* iterator, int flags)
+{
+  librdf_storage_frozen_get_contexts_iterator_context* icontext=(librdf_storage_frozen_get_contexts_iterator_context*)iterator;
+  librdf_storage_frozen_instance* context=(librdf_storage_frozen_instance*)icontext->storage->instance;
+  void *result=NULL;
+
+  switch(flags) {
+    case LIBRDF_ITERATOR_GET_METHOD_GET_OBJECT:
+      if(icontext->position >= context->quad_count)
+        return NULL;
+
+      if(!icontext->current) {
+        u32 id=context->quads[LIBRDF_STORAGE_FROZEN_GSPO][icontext->position * 4];
+        icontext->current=librdf_storage_frozen_get_term(icontext->storage, id);
+      }
+      result=icontext->current;
+      break;
+
+    case LIBRDF_ITERATOR_GET_METHOD_GET_KEY:
+    case LIBRDF_ITERATOR_GET_METHOD_GET_VALUE:
+      result=NULL;
+      break;
+
+    default:
+      librdf_log(icontext->storage->world,
+                 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "Unknown iterator method flag %d", flags);
+      result=NULL;
+      break;
+  }
+
+  return result;
+}
+
+
+static void
+librdf_storage_frozen_get_contexts_finished(void* iterator)
+{
+  librdf_storage_frozen_get_contexts_iterator_context* icontext=(librdf_storage_frozen_get_contexts_iterator_context*)iterator;
+
+  if(icontext->current)
+    librdf_free_node(icontext->current);
+
+  if(icontext->storage)
+    librdf_storage_remove_reference(icontext->storage);
+
+  LIBRDF_FREE(librdf_storage_frozen_get_contexts_iterator_context, icontext);
+}
+
+
+/**
+ * librdf_storage_frozen_get_contexts:
+ * @storage: #librdf_storage object
+ *
+ * List all context nodes in a storage.
+ *
+ * Return value: #librdf_iterator of context_nodes or NULL on failure
+ **/
+static librdf_iterator*
+librdf_storage_frozen_get_contexts(librdf_storage* storage)
+{
+  librdf_storage_frozen_instance* context=(librdf_storage_frozen_instance*)storage->instance;
+  librdf_storage_frozen_get_contexts_iterator_context* icontext;
+  librdf_iterator* iterator;
+  u32 key[1];
+
+  if(context->build_terms)
+    return NULL;
+
+  icontext = LIBRDF_CALLOC(librdf_storage_frozen_get_contexts_iterator_context*,
+                           1, sizeof(*icontext));
+  if(!icontext)
+    return NULL;
+
+  /* statements with no context sort first in GSPO order */
+  key[0]=0;
+  icontext->position=librdf_storage_frozen_search(context->quads[LIBRDF_STORAGE_FROZEN_GSPO],
+                                                  context->quad_count,
+                                                  key, 1, 1);
+
+  icontext->storage=storage;
+  librdf_storage_add_reference(icontext->storage);
+
+  iterator=librdf_new_iterator(storage->world,
+                               (void*)icontext,
+                               &librdf_storage_frozen_get_contexts_is_end,
+                               &librdf_storage_frozen_get_contexts_next_method,
+                               &librdf_storage_frozen_get_contexts_get_method,
+                               &librdf_storage_frozen_get_contexts_finished);
+  if(!iterator)
+    librdf_storage_frozen_get_contexts_finished(icontext);
+  return iterator;
+}
+
+
+/**
+ * librdf_storage_frozen_get_feature:
+ * @storage: #librdf_storage object
+ * @feature: #librdf_uri feature property
+ *
+ * Get the value of a storage feature.
+ *
+ * Return value: #librdf_node feature value or NULL if no such feature
+ * exists or the value is empty.
+ **/
+static librdf_node*
+librdf_storage_frozen_get_feature(librdf_storage* storage, librdf_uri* feature)
+{
+  unsigned char *uri_string;
+
+  if(!feature)
+    return NULL;
+
+  uri_string=librdf_uri_as_string(feature);
+  if(!uri_string)
+    return NULL;
+
+  /* contexts are always kept */
+  if(!strcmp((const char*)uri_string, LIBRDF_MODEL_FEATURE_CONTEXTS))
+    return librdf_new_node_from_typed_literal(storage->world,
+                                              (const unsigned char*)"1",
+                                              NULL, NULL);
+
+  return NULL;
+}
+
+
+/** Local entry point for dynamically loaded storage module */
+static void
+librdf_storage_frozen_register_factory(librdf_storage_factory *factory)
+{
+  LIBRDF_ASSERT_CONDITION(!strcmp(factory->name, "frozen"));
+
+  factory->version            = LIBRDF_STORAGE_INTERFACE_VERSION;
+  factory->init               = librdf_storage_frozen_init;
+  factory->terminate          = librdf_storage_frozen_terminate;
+  factory->open               = librdf_storage_frozen_open;
+  factory->close              = librdf_storage_frozen_close;
+  factory->size               = librdf_storage_frozen_size;
+  factory->add_statement      = librdf_storage_frozen_add_statement;
+  factory->contains_statement = librdf_storage_frozen_contains_statement;
+  factory->serialise          = librdf_storage_frozen_serialise;
+  factory->find_statements    = librdf_storage_frozen_find_statements;
+  factory->context_add_statement      = librdf_storage_frozen_context_add_statement;
+  factory->context_serialise          = librdf_storage_frozen_context_serialise;
+  factory->find_statements_in_context = librdf_storage_frozen_find_statements_in_context;
+  factory->get_contexts               = librdf_storage_frozen_get_contexts;
+  factory->get_feature                = librdf_storage_frozen_get_feature;
+}
+
+
+/*
+ * librdf_init_storage_frozen:
+ * @world: world object
+ *
+ * INTERNAL - Initialise the built-in storage_frozen module.
+ */
+void
+librdf_init_storage_frozen(librdf_world *world)
+{
+  librdf_storage_register_factory(world, "frozen", "Read-only mapped file",
+                                  &librdf_storage_frozen_register_factory);
+}
@@ -49,26 +49,44 @@ typedef struct
   const char *name;
   int key_fields; /* OR of LIBRDF_STATEMENT_* fields defined in rdf_statement.h */
   int value_fields; /* ditto */
+  /* order of the parts in the key or NULL for subject, predicate, object */
+  const char *key_order;
 } librdf_hash_descriptor;
 
 
 static const librdf_hash_descriptor librdf_storage_hashes_descriptions[]= {
   {"sp2o",
    LIBRDF_STATEMENT_SUBJECT|LIBRDF_STATEMENT_PREDICATE,
-   LIBRDF_STATEMENT_OBJECT},  /* For 'get targets' */
+   LIBRDF_STATEMENT_OBJECT, NULL},  /* For 'get targets' */
   {"po2s",
    LIBRDF_STATEMENT_PREDICATE|LIBRDF_STATEMENT_OBJECT,
-   LIBRDF_STATEMENT_SUBJECT},  /* For 'get sources' */
+   LIBRDF_STATEMENT_SUBJECT, NULL},  /* For 'get sources' */
   {"so2p", 
    LIBRDF_STATEMENT_SUBJECT|LIBRDF_STATEMENT_OBJECT,
-   LIBRDF_STATEMENT_PREDICATE},  /* For 'get arcs' */
+   LIBRDF_STATEMENT_PREDICATE, NULL},  /* For 'get arcs' */
   {"p2so", 
    LIBRDF_STATEMENT_PREDICATE,
-   LIBRDF_STATEMENT_SUBJECT|LIBRDF_STATEMENT_OBJECT},  /* For '(?, p, ?)' */
+   LIBRDF_STATEMENT_SUBJECT|LIBRDF_STATEMENT_OBJECT, NULL},  /* For '(?, p, ?)' */
+  /* Whole statements in the key, so any given parts at the start of
+   * the key are a prefix search: (s ? ?) (s p ?) */
+  {"spo",
+   LIBRDF_STATEMENT_SUBJECT|LIBRDF_STATEMENT_PREDICATE|LIBRDF_STATEMENT_OBJECT,
+   0L, "spo"},
+  /* (? p ?) (? p o) */
+  {"pos",
+   LIBRDF_STATEMENT_SUBJECT|LIBRDF_STATEMENT_PREDICATE|LIBRDF_STATEMENT_OBJECT,
+   0L, "pos"},
+  /* (? ? o) (s ? o) */
+  {"osp",
+   LIBRDF_STATEMENT_SUBJECT|LIBRDF_STATEMENT_PREDICATE|LIBRDF_STATEMENT_OBJECT,
+   0L, "osp"},
   {"contexts",
    0L, /* for contexts - do not touch when storing statements! */
-   0L},
-  {NULL,0L,0L}
+   0L, NULL},
+  {"counts",
+   0L, /* for statement counts - also not touched when storing statements */
+   0L, NULL},
+  {NULL,0L,0L,NULL}
 };
 
 
@@ -121,6 +139,22 @@ typedef struct
 
   int all_statements_hash_index;
 
+  /* If >=0, the hash holding the total, per-predicate and per-context
+   * statement counts; counts_valid is non-0 once they are known.
+   * counts_marked is non-0 while the counts hash holds the mark that
+   * they are valid, which is cleared before the first write and set
+   * again by a clean close or sync. */
+  int keep_counts;
+  int counts_index;
+  int counts_valid;
+  int counts_marked;
+
+  /* If this is non-0, each update is made atomic with a transaction */
+  int transactions;
+  /* non-0 while a transaction is active and its handle */
+  int in_transaction;
+  void* transaction_handle;
+
   /* growing buffers used to en/decode keys/values */
   unsigned char *key_buffer;
   size_t key_buffer_len;
@@ -169,6 +203,22 @@ static int librdf_storage_hashes_context_serialise_next_statement(void* context)
 static void* librdf_storage_hashes_context_serialise_get_statement(void* context, int flags);
 static void librdf_storage_hashes_context_serialise_finished(void* context);
 
+/* transactions */
+static int librdf_storage_hashes_transaction_start(librdf_storage* storage);
+static int librdf_storage_hashes_transaction_commit(librdf_storage* storage);
+static int librdf_storage_hashes_transaction_rollback(librdf_storage* storage);
+static void* librdf_storage_hashes_transaction_get_handle(librdf_storage* storage);
+static int librdf_storage_hashes_update_start(librdf_storage* storage);
+static int librdf_storage_hashes_update_end(librdf_storage* storage, int started, int status);
+
+/* statement counts */
+static int librdf_storage_hashes_counts_get(librdf_storage* storage, char type, librdf_node* node);
+static int librdf_storage_hashes_counts_mark(librdf_storage* storage, int valid);
+static int librdf_storage_hashes_counts_rebuild(librdf_storage* storage);
+static int librdf_storage_hashes_counts_invalidate(librdf_storage* storage);
+static int librdf_storage_hashes_counts_unmark(librdf_storage* storage);
+static int librdf_storage_hashes_count_statements(librdf_storage* storage, librdf_node* predicate, librdf_node* context_node);
+
 static void librdf_storage_hashes_register_factory(librdf_storage_factory *factory);
 
 
@@ -182,13 +232,45 @@ static librdf_iterator* librdf_storage_hashes_node_iterator_create(librdf_storag
 
 
 
+/*
+ * librdf_storage_hashes_hash_name - make the identifier of one hash
+ * @context: hashes storage instance
+ * @name: storage name
+ * @hash_name: hash description name such as "sp2o"
+ *
+ * Return value: new string "[db_dir/]name-hash_name" or NULL on failure
+ */
+static char*
+librdf_storage_hashes_hash_name(librdf_storage_hashes_instance* context,
+                                const char *name, const char *hash_name)
+{
+  size_t len;
+  char *full_name;
+
+  len = strlen(hash_name) + 1 + strlen(name) + 1; /* "%s-%s\0" */
+  if(context->db_dir)
+    len += strlen(context->db_dir) +1;
+
+  full_name = LIBRDF_MALLOC(char*, len);
+  if(!full_name)
+    return NULL;
+
+  /* FIXME: Implies Unix filenames */
+  if(context->db_dir)
+    sprintf(full_name, "%s/%s-%s", context->db_dir, name, hash_name);
+  else
+    sprintf(full_name, "%s-%s", name, hash_name);
+
+  return full_name;
+}
+
+
 static int
 librdf_storage_hashes_register(librdf_storage *storage,
                                const char *name,
                                const librdf_hash_descriptor *source_desc) 
 {
   librdf_storage_hashes_instance* context=(librdf_storage_hashes_instance*)storage->instance;
-  size_t len;
   char *full_name=NULL;
   int hash_index;
   librdf_hash_descriptor *desc;
@@ -207,19 +289,9 @@ librdf_storage_hashes_register(librdf_storage *storage,
   context->hash_descriptions[hash_index]=desc;
     
   if(name) {
-    len = strlen(desc->name) + 1 + strlen(name) + 1; /* "%s-%s\0" */
-    if(context->db_dir)
-      len += strlen(context->db_dir) +1;
-    
-    full_name = LIBRDF_MALLOC(char*, len);
+    full_name=librdf_storage_hashes_hash_name(context, name, desc->name);
     if(!full_name)
       return 1;
-
-    /* FIXME: Implies Unix filenames */
-    if(context->db_dir)
-      sprintf(full_name, "%s/%s-%s", context->db_dir, name, desc->name);
-    else
-      sprintf(full_name, "%s-%s", name, desc->name);
   }
   
   context->hashes[hash_index]=librdf_new_hash(storage->world, 
@@ -229,6 +301,48 @@ librdf_storage_hashes_register(librdf_storage *storage,
   return (context->hashes[hash_index] == NULL);
 }
 
+/*
+ * librdf_storage_hashes_register_indexes - register the hashes in option indexes
+ * @storage: the storage
+ * @name: storage name
+ * @indexes: comma separated hash names such as "spo,pos,osp"
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_storage_hashes_register_indexes(librdf_storage *storage,
+                                       const char *name, const char *indexes)
+{
+  const char *p=indexes;
+
+  while(*p) {
+    const librdf_hash_descriptor *desc=NULL;
+    char index_name[16];
+    size_t len=strcspn(p, ",");
+
+    if(len < sizeof(index_name)) {
+      memcpy(index_name, p, len);
+      index_name[len]='\0';
+      desc=librdf_storage_get_hash_description_by_name(index_name);
+    }
+    if(!desc || !desc->key_fields) {
+      librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "Unknown hashes storage index '%s'", indexes);
+      return 1;
+    }
+
+    if(librdf_storage_hashes_register(storage, name, desc))
+      return 1;
+
+    p+=len;
+    if(*p == ',')
+      p++;
+  }
+
+  return 0;
+}
+
+
 /* helper function for implementing init and clone methods */
 
 static int
@@ -243,6 +357,7 @@ librdf_storage_hashes_init_common(librdf_storage* storage, const char *name,
   int status=0;
   int index_predicates=0;
   int index_contexts=0;
+  int keep_counts=0;
   int hash_count=0;
   
   context = LIBRDF_CALLOC(librdf_storage_hashes_instance*, 1, sizeof(*context));
@@ -264,6 +379,14 @@ librdf_storage_hashes_init_common(librdf_storage* storage, const char *name,
 
   /* Work out the number of hashes for allocating stuff below */
   hash_count=3;
+  if(indexes) {
+    const char *p;
+
+    hash_count=1;
+    for(p=indexes; *p; p++)
+      if(*p == ',')
+        hash_count++;
+  }
 
   if((index_contexts=librdf_hash_get_as_boolean(options, "contexts"))<0)
     index_contexts=0; /* default is no contexts */
@@ -272,12 +395,25 @@ librdf_storage_hashes_init_common(librdf_storage* storage, const char *name,
   if(index_contexts)
     hash_count++;
 
+  if((keep_counts=librdf_hash_get_as_boolean(options, "counts"))<0)
+    keep_counts=0; /* default is no statement counts */
+  context->keep_counts=keep_counts;
+
+  if(keep_counts)
+    hash_count++;
+
   if((index_predicates=librdf_hash_get_as_boolean(options, "index-predicates"))<0)
     index_predicates=0; /* default is NO index on properties */
+  if(indexes && strstr(indexes, "p2so"))
+    index_predicates=0; /* already listed */
   
   if(index_predicates)
     hash_count++;
 
+  /* the hashes read this option too, to open transactionally */
+  if((context->transactions=librdf_hash_get_as_boolean(options, "transactions"))<0)
+    context->transactions=0; /* default is no implicit transactions */
+
 
   /* Start allocating the arrays */
   context->hashes = LIBRDF_CALLOC(librdf_hash**,
@@ -310,11 +446,15 @@ librdf_storage_hashes_init_common(librdf_storage* storage, const char *name,
     return 1;
   }
   
-  for(i=0; i<3; i++) {
-    status=librdf_storage_hashes_register(storage, name,
-                                          &librdf_storage_hashes_descriptions[i]);
-    if(status)
-      break;
+  if(indexes)
+    status=librdf_storage_hashes_register_indexes(storage, name, indexes);
+  else {
+    for(i=0; i<3; i++) {
+      status=librdf_storage_hashes_register(storage, name,
+                                            &librdf_storage_hashes_descriptions[i]);
+      if(status)
+        break;
+    }
   }
 
   if(index_predicates && !status)
@@ -325,6 +465,10 @@ librdf_storage_hashes_init_common(librdf_storage* storage, const char *name,
     librdf_storage_hashes_register(storage, name,
                                    librdf_storage_get_hash_description_by_name("contexts"));
 
+  if(keep_counts && !status)
+    status=librdf_storage_hashes_register(storage, name,
+                                          librdf_storage_get_hash_description_by_name("counts"));
+
 
   /* find indexes for get targets, sources and arcs */
   context->sources_index= -1;
@@ -333,6 +477,8 @@ librdf_storage_hashes_init_common(librdf_storage* storage, const char *name,
   context->p2so_index= -1;
   /* and index for contexts (no key or value fields) */
   context->contexts_index= -1;
+  /* and the statement counts */
+  context->counts_index= -1;
 
   context->all_statements_hash_index= -1;
 
@@ -363,11 +509,20 @@ librdf_storage_hashes_init_common(librdf_storage* storage, const char *name,
     } else if(key_fields == LIBRDF_STATEMENT_PREDICATE &&
               value_fields == (LIBRDF_STATEMENT_SUBJECT|LIBRDF_STATEMENT_OBJECT)) {
       context->p2so_index=i;
-    } else if(!key_fields || !value_fields) {
+    } else if(!strcmp(context->hash_descriptions[i]->name, "counts")) {
+       context->counts_index=i;
+    } else if(!key_fields) {
        context->contexts_index=i;
     }
   }
 
+  if(!status && context->all_statements_hash_index < 0) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "Hashes storage indexes '%s' do not hold whole statements",
+               indexes);
+    status=1;
+  }
+
   return status;
 }
 
@@ -567,6 +722,46 @@ librdf_storage_hashes_open(librdf_storage* storage, librdf_model* model)
       break;
   }
 
+  /* A persistent store written without counts leaves any counts kept
+   * by an earlier open out of date */
+  if(!result && !context->keep_counts && context->is_writable &&
+     context->name && strcmp(context->hash_type, "memory")) {
+    result=librdf_storage_hashes_counts_invalidate(storage);
+    if(result) {
+      for(i=0; i<context->hash_count; i++)
+        librdf_hash_close(context->hashes[i]);
+    }
+  }
+
+  /* Use the kept counts if marked valid, or count the store again.
+   * The counts are not used by a read-only store without the mark. */
+  context->counts_valid=0;
+  context->counts_marked=0;
+  if(!result && context->counts_index >= 0) {
+    int marked=(librdf_storage_hashes_counts_get(storage, 'v', NULL) > 0 &&
+                librdf_storage_hashes_counts_get(storage, 't', NULL) >= 0);
+
+    if(marked) {
+      context->counts_valid=1;
+      context->counts_marked=1;
+    } else if(context->is_writable) {
+      librdf_hash* hash=context->hashes[context->counts_index];
+
+      /* start again from empty counts */
+      librdf_hash_close(hash);
+      if(librdf_hash_open(hash, context->names[context->counts_index],
+                          context->mode, 1, 1, context->options)) {
+        for(i=0; i<context->hash_count; i++) {
+          if(i != context->counts_index)
+            librdf_hash_close(context->hashes[i]);
+        }
+        return 1;
+      }
+      context->counts_valid=!librdf_storage_hashes_counts_rebuild(storage);
+      context->counts_marked=context->counts_valid;
+    }
+  }
+
   return result;
 }
 
@@ -585,6 +780,15 @@ librdf_storage_hashes_close(librdf_storage* storage)
   librdf_storage_hashes_instance* context=(librdf_storage_hashes_instance*)storage->instance;
   int i;
   
+  /* an unfinished transaction is abandoned */
+  if(context->in_transaction)
+    librdf_storage_hashes_transaction_rollback(storage);
+
+  /* the counts are up to date again */
+  if(context->counts_valid && !context->counts_marked &&
+     !librdf_storage_hashes_counts_mark(storage, 1))
+    context->counts_marked=1;
+
   for(i=0; i<context->hash_count; i++) {
     if(context->hashes[i])
       librdf_hash_close(context->hashes[i]);
@@ -600,6 +804,12 @@ librdf_storage_hashes_size(librdf_storage* storage)
   librdf_storage_hashes_instance* context=(librdf_storage_hashes_instance*)storage->instance;
   librdf_hash* any_hash=context->hashes[context->all_statements_hash_index];
 
+  if(context->counts_valid) {
+    int count=librdf_storage_hashes_counts_get(storage, 't', NULL);
+    if(count >= 0)
+      return count;
+  }
+
   if(!any_hash)
     return -1;
 
@@ -607,6 +817,93 @@ librdf_storage_hashes_size(librdf_storage* storage)
 }
 
 
+/*
+ * librdf_storage_hashes_encode_key - encode statement parts as a hash key
+ * @world: redland world
+ * @desc: hash description
+ * @statement: statement
+ * @fields: parts of @statement to encode
+ * @buffer: buffer or NULL to return the size needed
+ * @length: buffer size
+ *
+ * Encodes as librdf_statement_encode_parts2() but in the key order of
+ * the hash, so that the keys sort by the first part and so on.
+ *
+ * Return value: the number of bytes written or 0 on failure
+ */
+static size_t
+librdf_storage_hashes_encode_key(librdf_world *world,
+                                 const librdf_hash_descriptor *desc,
+                                 librdf_statement *statement, int fields,
+                                 unsigned char *buffer, size_t length)
+{
+  const char *order;
+  size_t total_length;
+
+  if(!desc->key_order)
+    return librdf_statement_encode_parts2(world, statement, NULL,
+                                          buffer, length,
+                                          (librdf_statement_part)fields);
+
+  /* magic number 'x' then each part as type and node */
+  if(buffer) {
+    if(length < 1)
+      return 0;
+    *buffer++='x';
+    length--;
+  }
+  total_length=1;
+
+  for(order=desc->key_order; *order; order++) {
+    librdf_node *node;
+    size_t node_len;
+    int part;
+
+    switch(*order) {
+      case 's':
+        part=LIBRDF_STATEMENT_SUBJECT;
+        node=librdf_statement_get_subject(statement);
+        break;
+
+      case 'p':
+        part=LIBRDF_STATEMENT_PREDICATE;
+        node=librdf_statement_get_predicate(statement);
+        break;
+
+      case 'o':
+        part=LIBRDF_STATEMENT_OBJECT;
+        node=librdf_statement_get_object(statement);
+        break;
+
+      default:
+        return 0;
+    }
+
+    if(!(fields & part) || !node)
+      continue;
+
+    if(buffer) {
+      if(length < 1)
+        return 0;
+      *buffer++=(unsigned char)*order;
+      length--;
+    }
+
+    node_len=librdf_node_encode(node, buffer, length);
+    if(!node_len)
+      return 0;
+    if(buffer) {
+      buffer+=node_len;
+      length-=node_len;
+    }
+
+    total_length+=1+node_len;
+  }
+
+  return total_length;
+}
+
+
 static int
 librdf_storage_hashes_grow_buffer(unsigned char **buffer, size_t *len,
                                   size_t required_len) 
@@ -624,6 +921,354 @@ librdf_storage_hashes_grow_buffer(unsigned char **buffer, size_t *len,
 }
 
 
+/*
+ * librdf_storage_hashes_counts_key - encode a key of the counts hash
+ * @context: hashes storage instance
+ * @type: 't' for the total, 'p' for a predicate, 'c' for a context
+ *   or 'v' for the mark that the counts are valid
+ * @node: the predicate or context node or NULL for the total or mark
+ *
+ * The key is encoded into the key buffer.
+ *
+ * Return value: the key length or 0 on failure
+ */
+static size_t
+librdf_storage_hashes_counts_key(librdf_storage_hashes_instance* context,
+                                 char type, librdf_node* node)
+{
+  size_t key_len=1;
+
+  if(node) {
+    size_t node_len=librdf_node_encode(node, NULL, 0);
+    if(!node_len)
+      return 0;
+    key_len+=node_len;
+  }
+
+  if(librdf_storage_hashes_grow_buffer(&context->key_buffer,
+                                       &context->key_buffer_len, key_len))
+    return 0;
+
+  context->key_buffer[0]=(unsigned char)type;
+  if(node && !librdf_node_encode(node, context->key_buffer+1, key_len-1))
+    return 0;
+
+  return key_len;
+}
+
+
+/*
+ * librdf_storage_hashes_counts_get - get a statement count
+ * @storage: hashes storage
+ * @type: count type, see librdf_storage_hashes_counts_key()
+ * @node: the predicate or context node or NULL for the total
+ *
+ * Return value: the count or <0 if it is not present or on failure
+ */
+static int
+librdf_storage_hashes_counts_get(librdf_storage* storage, char type,
+                                 librdf_node* node)
+{
+  librdf_storage_hashes_instance* context=(librdf_storage_hashes_instance*)storage->instance;
+  librdf_hash_cursor* cursor;
+  librdf_hash_datum hd_key, hd_value; /* on stack */
+  char number[32];
+  int count= -1;
+
+  hd_key.size=librdf_storage_hashes_counts_key(context, type, node);
+  if(!hd_key.size)
+    return -1;
+  hd_key.data=context->key_buffer;
+  hd_value.data=NULL; hd_value.size=0;
+
+  cursor=librdf_new_hash_cursor(context->hashes[context->counts_index]);
+  if(!cursor)
+    return -1;
+
+  if(!librdf_hash_cursor_set(cursor, &hd_key, &hd_value) &&
+     hd_value.size < sizeof(number)) {
+    memcpy(number, hd_value.data, hd_value.size);
+    number[hd_value.size]='\0';
+    count=atoi(number);
+  }
+
+  librdf_free_hash_cursor(cursor);
+
+  return count;
+}
+
+
+/*
+ * librdf_storage_hashes_counts_update - add to a statement count
+ * @storage: hashes storage
+ * @type: count type, see librdf_storage_hashes_counts_key()
+ * @node: the predicate or context node or NULL for the total
+ * @delta: amount to add
+ *
+ * Counts are stored as decimal strings.  Predicate and context
+ * counts that reach 0 are deleted; the total is always kept.
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_storage_hashes_counts_update(librdf_storage* storage, char type,
+                                    librdf_node* node, int delta)
+{
+  librdf_storage_hashes_instance* context=(librdf_storage_hashes_instance*)storage->instance;
+  librdf_hash* hash=context->hashes[context->counts_index];
+  librdf_hash_datum hd_key, hd_value; /* on stack */
+  char number[32];
+  int count;
+
+  count=librdf_storage_hashes_counts_get(storage, type, node);
+
+  hd_key.size=librdf_storage_hashes_counts_key(context, type, node);
+  if(!hd_key.size)
+    return 1;
+  hd_key.data=context->key_buffer;
+
+  if(count >= 0) {
+    if(librdf_hash_delete_all(hash, &hd_key))
+      return 1;
+  } else
+    count=0;
+
+  count+=delta;
+  if(count < 0)
+    count=0;
+  if(!count && type != 't')
+    return 0;
+
+  sprintf(number, "%d", count);
+  hd_value.data=number;
+  hd_value.size=strlen(number);
+
+  return librdf_hash_put(hash, &hd_key, &hd_value);
+}
+
+
+/*
+ * librdf_storage_hashes_counts_add_statement - count a statement
+ * @storage: hashes storage
+ * @statement: statement added or removed
+ * @context_node: context of the statement or NULL
+ * @delta: 1 for an addition, -1 for a removal
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_storage_hashes_counts_add_statement(librdf_storage* storage,
+                                           librdf_statement* statement,
+                                           librdf_node* context_node,
+                                           int delta)
+{
+  if(librdf_storage_hashes_counts_update(storage, 't', NULL, delta))
+    return 1;
+
+  if(librdf_storage_hashes_counts_update(storage, 'p',
+                                         librdf_statement_get_predicate(statement),
+                                         delta))
+    return 1;
+
+  if(context_node &&
+     librdf_storage_hashes_counts_update(storage, 'c', context_node, delta))
+    return 1;
+
+  return 0;
+}
+
+
+/*
+ * librdf_storage_hashes_counts_mark - mark the counts as valid or not
+ * @storage: hashes storage
+ * @valid: non 0 if the counts are now valid
+ *
+ * The counts are only trusted by open while the 'v' key is present.
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_storage_hashes_counts_mark(librdf_storage* storage, int valid)
+{
+  librdf_storage_hashes_instance* context=(librdf_storage_hashes_instance*)storage->instance;
+  librdf_hash* hash=context->hashes[context->counts_index];
+  librdf_hash_datum hd_key, hd_value; /* on stack */
+  char number[2]="1";
+
+  hd_key.size=librdf_storage_hashes_counts_key(context, 'v', NULL);
+  if(!hd_key.size)
+    return 1;
+  hd_key.data=context->key_buffer;
+
+  if(librdf_storage_hashes_counts_get(storage, 'v', NULL) >= 0 &&
+     librdf_hash_delete_all(hash, &hd_key))
+    return 1;
+
+  if(!valid)
+    return 0;
+
+  hd_value.data=number;
+  hd_value.size=1;
+
+  return librdf_hash_put(hash, &hd_key, &hd_value);
+}
+
+
+/*
+ * librdf_storage_hashes_counts_rebuild - count all the statements
+ * @storage: hashes storage
+ *
+ * Used when a writable store is opened with counts that are not
+ * marked valid, into an emptied counts hash.
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_storage_hashes_counts_rebuild(librdf_storage* storage)
+{
+  librdf_storage_hashes_instance* context=(librdf_storage_hashes_instance*)storage->instance;
+  librdf_stream* stream;
+  int started;
+  int status;
+
+  started=librdf_storage_hashes_update_start(storage);
+  if(started < 0)
+    return 1;
+
+  /* the total is present from now on, even for an empty store */
+  status=librdf_storage_hashes_counts_update(storage, 't', NULL, 0);
+
+  stream=librdf_storage_hashes_serialise(storage);
+  if(!stream)
+    status=1;
+
+  while(!status && !librdf_stream_end(stream)) {
+    librdf_statement* statement=librdf_stream_get_object(stream);
+    librdf_node* context_node=(librdf_node*)librdf_stream_get_context2(stream);
+
+    status=librdf_storage_hashes_counts_add_statement(storage, statement,
+                                                      context_node, 1);
+    librdf_stream_next(stream);
+  }
+
+  if(stream)
+    librdf_free_stream(stream);
+
+  if(!status)
+    status=librdf_storage_hashes_counts_mark(storage, 1);
+
+  if(status && !context->in_transaction) {
+    librdf_hash_datum hd_key; /* on stack */
+
+    /* do not leave a partial total to be trusted next time */
+    hd_key.size=librdf_storage_hashes_counts_key(context, 't', NULL);
+    hd_key.data=context->key_buffer;
+    if(hd_key.size)
+      librdf_hash_delete_all(context->hashes[context->counts_index], &hd_key);
+  }
+
+  status=librdf_storage_hashes_update_end(storage, started, status);
+  if(status)
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "Failed to count the statements in hashes storage %s",
+               context->name);
+
+  return status;
+}
+
+
+/*
+ * librdf_storage_hashes_counts_unmark - stop trusting the counts until close
+ * @storage: hashes storage
+ *
+ * Called before the first write after the counts were marked valid.
+ * Outside a transaction the counts hash is synced so that the mark is
+ * gone before any statement written after it.
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_storage_hashes_counts_unmark(librdf_storage* storage)
+{
+  librdf_storage_hashes_instance* context=(librdf_storage_hashes_instance*)storage->instance;
+
+  if(librdf_storage_hashes_counts_mark(storage, 0))
+    return 1;
+  context->counts_marked=0;
+
+  if(context->in_transaction)
+    return 0;
+
+  return librdf_hash_sync(context->hashes[context->counts_index]);
+}
+
+
+/*
+ * librdf_storage_hashes_counts_invalidate - mark earlier counts out of date
+ * @storage: hashes storage
+ *
+ * Used when a writable store is opened without counts.  Statements
+ * changed from now on are not counted so the mark in any counts hash
+ * made by an earlier open is removed.  No counts hash is created.
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_storage_hashes_counts_invalidate(librdf_storage* storage)
+{
+  librdf_storage_hashes_instance* context=(librdf_storage_hashes_instance*)storage->instance;
+  librdf_hash* hash;
+  librdf_hash_datum hd_key; /* on stack */
+  librdf_hash_datum* hd_value;
+  char* full_name;
+  int status=0;
+
+  full_name=librdf_storage_hashes_hash_name(context, context->name,
+                                            "counts");
+  if(!full_name)
+    return 1;
+
+  hash=librdf_new_hash(storage->world, context->hash_type);
+  if(!hash) {
+    LIBRDF_FREE(char*, full_name);
+    return 1;
+  }
+
+  /* a hash type that cannot tell is opened as before */
+  if(librdf_hash_present(hash, full_name, context->options)) {
+    if(librdf_hash_open(hash, full_name, context->mode, 1, 0,
+                        context->options))
+      status=1;
+    else {
+      hd_key.size=librdf_storage_hashes_counts_key(context, 'v', NULL);
+      hd_key.data=context->key_buffer;
+      if(!hd_key.size)
+        status=1;
+      else {
+        hd_value=librdf_hash_get_one(hash, &hd_key);
+        if(hd_value) {
+          librdf_free_hash_datum(hd_value);
+          status=librdf_hash_delete_all(hash, &hd_key);
+          if(!status)
+            status=librdf_hash_sync(hash);
+        }
+      }
+      librdf_hash_close(hash);
+    }
+  }
+
+  librdf_free_hash(hash);
+  LIBRDF_FREE(char*, full_name);
+
+  if(status)
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "Failed to mark the statement counts of hashes storage %s out of date",
+               context->name);
+
+  return status;
+}
+
+
 static int
 librdf_storage_hashes_add_remove_statement(librdf_storage* storage, 
                                            librdf_statement* statement,
@@ -644,6 +1289,11 @@ librdf_storage_hashes_add_remove_statement(librdf_storage* storage,
   fputc('\n', stderr);
 #endif  
 
+  /* the counts may not match the statements if this update is cut
+   * short, so they are not trusted until close or sync */
+  if(context->counts_marked && librdf_storage_hashes_counts_unmark(storage))
+    return 1;
+
   for(i=0; i<context->hash_count; i++) {
     librdf_hash_datum hd_key, hd_value; /* on stack */
     size_t key_len, value_len;
@@ -654,8 +1304,9 @@ librdf_storage_hashes_add_remove_statement(librdf_storage* storage,
     if(!fields)
       continue;
     
-    key_len = librdf_statement_encode_parts2(world, statement, NULL, NULL, 0,
-                                             fields);
+    key_len = librdf_storage_hashes_encode_key(world,
+                                               context->hash_descriptions[i],
+                                               statement, fields, NULL, 0);
     if(!key_len)
       return 1;
     if(librdf_storage_hashes_grow_buffer(&context->key_buffer, 
@@ -664,19 +1315,18 @@ librdf_storage_hashes_add_remove_statement(librdf_storage* storage,
       break;
     }
        
-    if(!librdf_statement_encode_parts2(world, statement, NULL,
-                                       context->key_buffer,
-                                       context->key_buffer_len, fields)) {
+    if(!librdf_storage_hashes_encode_key(world, context->hash_descriptions[i],
+                                         statement, fields,
+                                         context->key_buffer,
+                                         context->key_buffer_len)) {
       status=1;
       break;
     }
 
     
-    /* ENCODE VALUE */
+    /* ENCODE VALUE - only the context when the key is the whole statement */
     
     fields=(librdf_statement_part)context->hash_descriptions[i]->value_fields;
-    if(!fields)
-      continue;
     
     value_len=librdf_statement_encode_parts2(world, statement, context_node,
                                              NULL, 0, fields);
@@ -716,6 +1366,17 @@ librdf_storage_hashes_add_remove_statement(librdf_storage* storage,
       break;
   }
 
+  if(!status && context->counts_valid) {
+    status=librdf_storage_hashes_counts_add_statement(storage, statement,
+                                                      context_node,
+                                                      is_addition ? 1 : -1);
+    if(status) {
+      /* stop using the counts and have them rebuilt at the next open */
+      context->counts_valid=0;
+      librdf_storage_hashes_counts_mark(storage, 0);
+    }
+  }
+
   return status;
 }
 
@@ -723,11 +1384,20 @@ librdf_storage_hashes_add_remove_statement(librdf_storage* storage,
 static int
 librdf_storage_hashes_add_statement(librdf_storage* storage, librdf_statement* statement)
 {
+  int started;
+  int status;
+
   /* Do not add duplicate statements */
   if(librdf_storage_hashes_contains_statement(storage, statement))
     return 0;
 
-  return librdf_storage_hashes_add_remove_statement(storage, statement, NULL, 1);
+  started=librdf_storage_hashes_update_start(storage);
+  if(started < 0)
+    return 1;
+
+  status=librdf_storage_hashes_add_remove_statement(storage, statement, NULL, 1);
+
+  return librdf_storage_hashes_update_end(storage, started, status);
 }
 
 
@@ -736,6 +1406,12 @@ librdf_storage_hashes_add_statements(librdf_storage* storage,
                                      librdf_stream* statement_stream)
 {
   int status=0;
+  int started;
+
+  /* the whole stream is added in one transaction */
+  started=librdf_storage_hashes_update_start(storage);
+  if(started < 0)
+    return 1;
 
   while(!librdf_stream_end(statement_stream)) {
     librdf_statement* statement=librdf_stream_get_object(statement_stream);
@@ -751,14 +1427,23 @@ librdf_storage_hashes_add_statements(librdf_storage* storage,
     librdf_stream_next(statement_stream);
   }
 
-  return status;
+  return librdf_storage_hashes_update_end(storage, started, status);
 }
 
 
 static int
 librdf_storage_hashes_remove_statement(librdf_storage* storage, librdf_statement* statement)
 {
-  return librdf_storage_hashes_add_remove_statement(storage, statement, NULL, 0);
+  int started;
+  int status;
+
+  started=librdf_storage_hashes_update_start(storage);
+  if(started < 0)
+    return 1;
+
+  status=librdf_storage_hashes_add_remove_statement(storage, statement, NULL, 0);
+
+  return librdf_storage_hashes_update_end(storage, started, status);
 }
 
 
@@ -792,16 +1477,19 @@ librdf_storage_hashes_contains_statement(librdf_storage* storage, librdf_stateme
 
   /* ENCODE KEY */
   fields=(librdf_statement_part)context->hash_descriptions[hash_index]->key_fields;
-  key_len = librdf_statement_encode_parts2(world, statement, NULL,
-                                           NULL, 0, fields);
+  key_len = librdf_storage_hashes_encode_key(world,
+                                             context->hash_descriptions[hash_index],
+                                             statement, fields, NULL, 0);
   if(!key_len)
     return 1;
   key_buffer = LIBRDF_MALLOC(unsigned char*, key_len);
   if(!key_buffer)
     return 1;
        
-  if(!librdf_statement_encode_parts2(world, statement, NULL,
-                                     key_buffer, key_len, fields)) {
+  if(!librdf_storage_hashes_encode_key(world,
+                                       context->hash_descriptions[hash_index],
+                                       statement, fields,
+                                       key_buffer, key_len)) {
     LIBRDF_FREE(data, key_buffer);
     return 1;
   }
@@ -859,12 +1547,28 @@ typedef struct {
   int index_contexts; /* true if this storage indexes contexts */
   librdf_node *context_node;
   int current_is_ok; /* true when current statement and context_node fresh */
+  unsigned char *search_key; /* encoded key or key prefix searched for */
 } librdf_storage_hashes_serialise_stream_context;
 
 
+/*
+ * librdf_storage_hashes_serialise_common - stream statements from a hash
+ * @storage: the storage
+ * @hash_index: index of the hash
+ * @search_node: node to find with the node iterator or NULL
+ * @want: parts of the statements the node iterator returns
+ * @search_statement: statement with the key parts to find or NULL
+ * @search_fields: parts of @search_statement at the start of the key
+ *
+ * With @search_fields, only the statements with a key starting with
+ * those parts are returned, found directly when they are the whole key.
+ * Otherwise all the statements in the hash are returned.
+ */
 static librdf_stream*
 librdf_storage_hashes_serialise_common(librdf_storage* storage, int hash_index,
-                                       librdf_node* search_node, int want)
+                                       librdf_node* search_node, int want,
+                                       librdf_statement* search_statement,
+                                       int search_fields)
 {
   librdf_storage_hashes_instance* context=(librdf_storage_hashes_instance*)storage->instance;
   librdf_storage_hashes_serialise_stream_context *scontext;
@@ -877,6 +1581,7 @@ librdf_storage_hashes_serialise_common(librdf_storage* storage, int hash_index,
     return NULL;
 
   scontext->hash_context=context;
+  scontext->index=hash_index;
 
   librdf_statement_init(storage->world, &scontext->current);
 
@@ -902,6 +1607,38 @@ librdf_storage_hashes_serialise_common(librdf_storage* storage, int hash_index,
                                                                   NULL,
                                                                   hash_index,
                                                                   want);
+  } else if(search_fields) {
+    librdf_hash_datum hd_prefix; /* on stack */
+    size_t key_len;
+
+    key_len=librdf_storage_hashes_encode_key(storage->world,
+                                             context->hash_descriptions[hash_index],
+                                             search_statement, search_fields,
+                                             NULL, 0);
+    if(key_len)
+      scontext->search_key = LIBRDF_MALLOC(unsigned char*, key_len);
+    if(!scontext->search_key ||
+       !librdf_storage_hashes_encode_key(storage->world,
+                                         context->hash_descriptions[hash_index],
+                                         search_statement, search_fields,
+                                         scontext->search_key, key_len)) {
+      librdf_storage_hashes_serialise_finished((void*)scontext);
+      return NULL;
+    }
+
+    if(search_fields == context->hash_descriptions[hash_index]->key_fields) {
+      /* the values of one key */
+      scontext->key->data=scontext->search_key;
+      scontext->key->size=key_len;
+      scontext->iterator=librdf_hash_get_all(hash,
+                                             scontext->key, scontext->value);
+    } else {
+      hd_prefix.data=scontext->search_key;
+      hd_prefix.size=key_len;
+      scontext->iterator=librdf_hash_get_prefix(hash, &hd_prefix,
+                                                scontext->key,
+                                                scontext->value);
+    }
   } else {
     scontext->iterator=librdf_hash_get_all(hash,
                                            scontext->key, scontext->value);
@@ -936,7 +1673,7 @@ librdf_storage_hashes_serialise(librdf_storage* storage)
   librdf_storage_hashes_instance* context=(librdf_storage_hashes_instance*)storage->instance;
   return librdf_storage_hashes_serialise_common(storage, 
                                                 context->all_statements_hash_index,
-                                                NULL, 0);
+                                                NULL, 0, NULL, 0);
 }
 
 
@@ -1058,6 +1795,9 @@ librdf_storage_hashes_serialise_finished(void* context)
 
   librdf_statement_clear(&scontext->current);
 
+  if(scontext->search_key)
+    LIBRDF_FREE(char*, scontext->search_key);
+
   if(scontext->storage)
     librdf_storage_remove_reference(scontext->storage);
 
@@ -1065,6 +1805,86 @@ librdf_storage_hashes_serialise_finished(void* context)
 }
 
 
+/*
+ * librdf_storage_hashes_find_index - find the hash for a statement search
+ * @context: hashes storage instance
+ * @statement: statement with the parts to find
+ * @fields: pointer to store the parts used at the start of the key
+ *
+ * The parts found are those of the key, in the key order of the hash,
+ * that are given in @statement up to the first that is not.  The hash
+ * with most such parts is chosen.
+ *
+ * Return value: hash index or <0 if no hash key starts with a given part
+ */
+static int
+librdf_storage_hashes_find_index(librdf_storage_hashes_instance* context,
+                                 librdf_statement* statement, int* fields)
+{
+  int best_index= -1;
+  int best_count=0;
+  int i;
+
+  *fields=0;
+  for(i=0; i<context->hash_count; i++) {
+    const char *order;
+    int key_fields;
+    int found=0;
+    int count=0;
+
+    if(!context->hash_descriptions[i])
+      continue;
+    key_fields=context->hash_descriptions[i]->key_fields;
+    /* skip the contexts hash and any without whole statements */
+    if(!key_fields ||
+       (key_fields|context->hash_descriptions[i]->value_fields) !=
+         (LIBRDF_STATEMENT_SUBJECT|LIBRDF_STATEMENT_PREDICATE|LIBRDF_STATEMENT_OBJECT))
+      continue;
+
+    order=context->hash_descriptions[i]->key_order;
+    if(!order)
+      order="spo";
+    for(; *order; order++) {
+      librdf_node* node;
+      int part;
+
+      switch(*order) {
+        case 's':
+          part=LIBRDF_STATEMENT_SUBJECT;
+          node=librdf_statement_get_subject(statement);
+          break;
+
+        case 'p':
+          part=LIBRDF_STATEMENT_PREDICATE;
+          node=librdf_statement_get_predicate(statement);
+          break;
+
+        case 'o':
+        default:
+          part=LIBRDF_STATEMENT_OBJECT;
+          node=librdf_statement_get_object(statement);
+          break;
+      }
+
+      if(!(key_fields & part))
+        continue;
+      if(!node)
+        break;
+      found |= part;
+      count++;
+    }
+
+    if(count > best_count) {
+      best_index=i;
+      best_count=count;
+      *fields=found;
+    }
+  }
+
+  return best_index;
+}
+
+
 /**
  * librdf_storage_hashes_find_statements:
  * @storage: the storage
@@ -1084,6 +1904,8 @@ librdf_storage_hashes_find_statements(librdf_storage* storage, librdf_statement*
 {
   librdf_storage_hashes_instance* context=(librdf_storage_hashes_instance*)storage->instance;
   librdf_stream* stream;
+  int hash_index;
+  int fields;
 
   if(!librdf_statement_get_subject(statement) &&
      librdf_statement_get_predicate(statement) &&
@@ -1093,13 +1915,23 @@ librdf_storage_hashes_find_statements(librdf_storage* storage, librdf_statement*
     stream=librdf_storage_hashes_serialise_common(storage,
                                                   context->p2so_index,
                                                   librdf_statement_get_predicate(statement),
-                                                  LIBRDF_STATEMENT_SUBJECT|LIBRDF_STATEMENT_OBJECT);
+                                                  LIBRDF_STATEMENT_SUBJECT|LIBRDF_STATEMENT_OBJECT,
+                                                  NULL, 0);
   } else {
     statement=librdf_new_statement_from_statement(statement);
     if(!statement)
       return NULL;
 
-    stream=librdf_storage_hashes_serialise(storage);
+    /* search the keys starting with the given parts if a hash has
+     * them, the match below checks any other given parts
+     */
+    hash_index=librdf_storage_hashes_find_index(context, statement, &fields);
+    if(hash_index >= 0)
+      stream=librdf_storage_hashes_serialise_common(storage, hash_index,
+                                                    NULL, 0,
+                                                    statement, fields);
+    else
+      stream=librdf_storage_hashes_serialise(storage);
     if(stream)
       librdf_stream_add_map(stream, 
                             &librdf_stream_statement_find_map,
@@ -1432,6 +2264,12 @@ librdf_storage_hashes_find_sources(librdf_storage* storage,
                                    librdf_node* arc, librdf_node *target) 
 {
   librdf_storage_hashes_instance* scontext=(librdf_storage_hashes_instance*)storage->instance;
+
+  /* without the index, search the statements */
+  if(scontext->sources_index < 0)
+    return librdf_storage_node_stream_to_node_create(storage, arc, target,
+                                                     LIBRDF_STATEMENT_SUBJECT);
+
   return librdf_storage_hashes_node_iterator_create(storage, arc, target,
                                                     scontext->sources_index,
                                                     LIBRDF_STATEMENT_SUBJECT);
@@ -1443,6 +2281,12 @@ librdf_storage_hashes_find_arcs(librdf_storage* storage,
                                 librdf_node* source, librdf_node *target) 
 {
   librdf_storage_hashes_instance* scontext=(librdf_storage_hashes_instance*)storage->instance;
+
+  /* without the index, search the statements */
+  if(scontext->arcs_index < 0)
+    return librdf_storage_node_stream_to_node_create(storage, source, target,
+                                                     LIBRDF_STATEMENT_PREDICATE);
+
   return librdf_storage_hashes_node_iterator_create(storage, source, target,
                                                     scontext->arcs_index,
                                                     LIBRDF_STATEMENT_PREDICATE);
@@ -1453,6 +2297,12 @@ librdf_storage_hashes_find_targets(librdf_storage* storage,
                                    librdf_node* source, librdf_node *arc) 
 {
   librdf_storage_hashes_instance* scontext=(librdf_storage_hashes_instance*)storage->instance;
+
+  /* without the index, search the statements */
+  if(scontext->targets_index < 0)
+    return librdf_storage_node_stream_to_node_create(storage, source, arc,
+                                                     LIBRDF_STATEMENT_OBJECT);
+
   return librdf_storage_hashes_node_iterator_create(storage, source, arc,
                                                     scontext->targets_index,
                                                     LIBRDF_STATEMENT_OBJECT);
@@ -1478,6 +2328,7 @@ librdf_storage_hashes_context_add_statement(librdf_storage* storage,
   size_t size;
   int status;
   librdf_world* world = storage->world;
+  int started;
   
   if(context->contexts_index <0) {
     librdf_log(storage->world, 0, LIBRDF_LOG_WARN, LIBRDF_FROM_STORAGE, NULL,
@@ -1485,9 +2336,13 @@ librdf_storage_hashes_context_add_statement(librdf_storage* storage,
     return 1;
   }
   
+  started=librdf_storage_hashes_update_start(storage);
+  if(started < 0)
+    return 1;
+
   if(librdf_storage_hashes_add_remove_statement(storage, 
                                                 statement, context_node, 1))
-    return 1;
+    return librdf_storage_hashes_update_end(storage, started, 1);
 
   size = librdf_node_encode(context_node, NULL, 0);
   key.data = LIBRDF_MALLOC(char*, size);
@@ -1503,7 +2358,7 @@ librdf_storage_hashes_context_add_statement(librdf_storage* storage,
   LIBRDF_FREE(data, key.data);
   LIBRDF_FREE(data, value.data);
 
-  return status;
+  return librdf_storage_hashes_update_end(storage, started, status);
 }
 
 
@@ -1527,15 +2382,20 @@ librdf_storage_hashes_context_remove_statement(librdf_storage* storage,
   size_t size;
   int status;
   librdf_world* world = storage->world;
+  int started;
   
   if(context_node && context->contexts_index <0) {
     librdf_log(storage->world, 0, LIBRDF_LOG_WARN, LIBRDF_FROM_STORAGE, NULL,
                "Storage was created without context support");
   }
   
+  started=librdf_storage_hashes_update_start(storage);
+  if(started < 0)
+    return 1;
+
   if(librdf_storage_hashes_add_remove_statement(storage, 
                                                 statement, context_node, 0))
-    return 1;
+    return librdf_storage_hashes_update_end(storage, started, 1);
   
   size = librdf_node_encode(context_node, NULL, 0);
   key.data = LIBRDF_MALLOC(char*, size);
@@ -1551,7 +2411,7 @@ librdf_storage_hashes_context_remove_statement(librdf_storage* storage,
   LIBRDF_FREE(data, key.data);
   LIBRDF_FREE(data, value.data);
   
-  return status;
+  return librdf_storage_hashes_update_end(storage, started, status);
 }
 
 
@@ -1747,6 +2607,13 @@ librdf_storage_hashes_sync(librdf_storage *storage)
   librdf_storage_hashes_instance* context=(librdf_storage_hashes_instance*)storage->instance;
   int i;
   
+  /* the counts match the synced statements; inside a transaction
+   * they are marked at close instead */
+  if(context->counts_valid && !context->counts_marked &&
+     !context->in_transaction &&
+     !librdf_storage_hashes_counts_mark(storage, 1))
+    context->counts_marked=1;
+
   for(i=0; i<context->hash_count; i++)
     librdf_hash_sync(context->hashes[i]);
   return 0;
@@ -1925,10 +2792,226 @@ librdf_storage_hashes_get_feature(librdf_storage* storage, librdf_uri* feature)
                                               value, NULL, NULL);
   }
 
+  if(!strcmp((const char*)uri_string, LIBRDF_STORAGE_FEATURE_CACHE_STATS)) {
+    librdf_hash_stats stats;
+    unsigned long lookups;
+    char value[256];
+    int i;
+
+    /* the hashes share one cache so any of them can report it */
+    for(i=0; i < scontext->hash_count; i++) {
+      if(!librdf_hash_get_stats(scontext->hashes[i], &stats))
+        break;
+    }
+    if(i == scontext->hash_count)
+      return NULL;
+
+    lookups=stats.cache_hits + stats.cache_misses;
+    sprintf(value,
+            "cache-hits='%lu', cache-misses='%lu', cache-hit-ratio='%.4f', "
+            "pages-read='%lu', pages-written='%lu'",
+            stats.cache_hits, stats.cache_misses,
+            lookups ? (double)stats.cache_hits / (double)lookups : 0.0,
+            stats.pages_read, stats.pages_written);
+    return librdf_new_node_from_typed_literal(storage->world, 
+                                              (const unsigned char*)value,
+                                              NULL, NULL);
+  }
+
   return NULL;
 }
 
 
+/**
+ * librdf_storage_hashes_transaction_start:
+ * @storage: #librdf_storage object
+ *
+ * Start a transaction over all the hashes.
+ * 
+ * The first hash starts the transaction and the others join it so
+ * that updates to every index commit or roll back together.  BDB
+ * hashes need option 'transactions' or 'bdb-concurrent'.
+ * 
+ * Return value: non 0 on failure or if a transaction is already active
+ **/
+static int
+librdf_storage_hashes_transaction_start(librdf_storage* storage)
+{
+  librdf_storage_hashes_instance* context=(librdf_storage_hashes_instance*)storage->instance;
+  void* handle=NULL;
+  int i;
+
+  if(context->in_transaction)
+    return 1;
+
+  for(i=0; i<context->hash_count; i++) {
+    handle=librdf_hash_transaction_start(context->hashes[i], handle);
+    if(!handle) {
+      int j;
+
+      for(j=0; j<i; j++)
+        librdf_hash_transaction_rollback(context->hashes[j]);
+
+      /* not an error: callers such as the parser try a transaction
+       * and carry on without one, as for storages with no support */
+      return 1;
+    }
+  }
+
+  context->in_transaction=1;
+  context->transaction_handle=handle;
+  return 0;
+}
+
+
+/**
+ * librdf_storage_hashes_transaction_commit:
+ * @storage: #librdf_storage object
+ *
+ * Commit the current transaction.
+ * 
+ * Return value: non 0 on failure
+ **/
+static int
+librdf_storage_hashes_transaction_commit(librdf_storage* storage)
+{
+  librdf_storage_hashes_instance* context=(librdf_storage_hashes_instance*)storage->instance;
+  int status=0;
+  int i;
+
+  if(!context->in_transaction)
+    return 1;
+
+  for(i=0; i<context->hash_count; i++) {
+    if(librdf_hash_transaction_commit(context->hashes[i]))
+      status=1;
+  }
+
+  context->in_transaction=0;
+  context->transaction_handle=NULL;
+  return status;
+}
+
+
+/**
+ * librdf_storage_hashes_transaction_rollback:
+ * @storage: #librdf_storage object
+ *
+ * Roll back the current transaction.
+ * 
+ * Return value: non 0 on failure
+ **/
+static int
+librdf_storage_hashes_transaction_rollback(librdf_storage* storage)
+{
+  librdf_storage_hashes_instance* context=(librdf_storage_hashes_instance*)storage->instance;
+  int status=0;
+  int i;
+
+  if(!context->in_transaction)
+    return 1;
+
+  for(i=0; i<context->hash_count; i++) {
+    if(librdf_hash_transaction_rollback(context->hashes[i]))
+      status=1;
+  }
+
+  context->in_transaction=0;
+  context->transaction_handle=NULL;
+  return status;
+}
+
+
+/**
+ * librdf_storage_hashes_transaction_get_handle:
+ * @storage: #librdf_storage object
+ *
+ * Get the current transaction handle.
+ * 
+ * Return value: the handle of the first hash (a DB_TXN for BDB) or NULL
+ **/
+static void*
+librdf_storage_hashes_transaction_get_handle(librdf_storage* storage)
+{
+  librdf_storage_hashes_instance* context=(librdf_storage_hashes_instance*)storage->instance;
+
+  return context->transaction_handle;
+}
+
+
+/*
+ * librdf_storage_hashes_update_start - start an implicit transaction for an update
+ *
+ * With option 'transactions' an update outside a user transaction is
+ * made atomic across the indexes with its own transaction.
+ *
+ * Returns 1 if a transaction was started, 0 if not needed and <0 on failure
+ */
+static int
+librdf_storage_hashes_update_start(librdf_storage* storage)
+{
+  librdf_storage_hashes_instance* context=(librdf_storage_hashes_instance*)storage->instance;
+
+  if(!context->transactions || context->in_transaction)
+    return 0;
+
+  if(librdf_storage_hashes_transaction_start(storage))
+    return -1;
+
+  return 1;
+}
+
+
+/*
+ * librdf_storage_hashes_update_end - finish an update started by update_start
+ *
+ * Commits the implicit transaction or rolls it back if @status is
+ * non-0.  Returns the update status.
+ */
+static int
+librdf_storage_hashes_update_end(librdf_storage* storage, int started,
+                                 int status)
+{
+  if(!started)
+    return status;
+
+  if(status) {
+    librdf_storage_hashes_transaction_rollback(storage);
+    return status;
+  }
+
+  return librdf_storage_hashes_transaction_commit(storage);
+}
+
+
+static int
+librdf_storage_hashes_count_statements(librdf_storage* storage,
+                                       librdf_node* predicate,
+                                       librdf_node* context_node)
+{
+  librdf_storage_hashes_instance* context=(librdf_storage_hashes_instance*)storage->instance;
+  int count;
+
+  /* counts are not kept per predicate in a context; the storage
+   * core counts the statements then */
+  if(!context->counts_valid || (predicate && context_node))
+    return -1;
+
+  if(predicate)
+    count=librdf_storage_hashes_counts_get(storage, 'p', predicate);
+  else if(context_node)
+    count=librdf_storage_hashes_counts_get(storage, 'c', context_node);
+  else
+    return librdf_storage_hashes_counts_get(storage, 't', NULL);
+
+  /* no count means no statements */
+  if(count < 0)
+    count=0;
+
+  return count;
+}
+
+
 /** Local entry point for dynamically loaded storage module */
 static void
 librdf_storage_hashes_register_factory(librdf_storage_factory *factory) 
@@ -1959,6 +3042,11 @@ librdf_storage_hashes_register_factory(librdf_storage_factory *factory)
   factory->sync                     = librdf_storage_hashes_sync;
   factory->get_contexts             = librdf_storage_hashes_get_contexts;
   factory->get_feature              = librdf_storage_hashes_get_feature;
+  factory->transaction_start        = librdf_storage_hashes_transaction_start;
+  factory->transaction_commit       = librdf_storage_hashes_transaction_commit;
+  factory->transaction_rollback     = librdf_storage_hashes_transaction_rollback;
+  factory->transaction_get_handle   = librdf_storage_hashes_transaction_get_handle;
+  factory->count_statements         = librdf_storage_hashes_count_statements;
 }
 
 
@@ -50,6 +50,9 @@ struct librdf_storage_s
   struct librdf_storage_factory_s* factory;
 };
 
+/* sources, arcs or targets from the find_statements method */
+librdf_iterator* librdf_storage_node_stream_to_node_create(librdf_storage* storage, librdf_node* node1, librdf_node *node2, librdf_statement_part want);
+
 void librdf_init_storage_list(librdf_world *world);
 
 void librdf_init_storage_hashes(librdf_world *world);
@@ -58,6 +61,10 @@ void librdf_init_storage_trees(librdf_world *world);
 
 void librdf_init_storage_file(librdf_world *world);
 
+void librdf_init_storage_compact(librdf_world *world);
+
+void librdf_init_storage_frozen(librdf_world *world);
+
 #ifdef STORAGE_MYSQL
 void librdf_init_storage_mysql(librdf_world *world);
 #endif
@@ -116,6 +123,17 @@ typedef enum {
 
 extern const char* librdf_storage_sql_dbconfig_predicates[DBCONFIG_CREATE_TABLE_LAST+2];
 
+/* Schemes used to derive 64 bit node and model IDs in SQL storages */
+typedef enum {
+  /* first 8 bytes of MD5 digest - original scheme, kept for old databases */
+  LIBRDF_STORAGE_SQL_NODE_HASH_MD5,
+  /* XXH64 - fast non-cryptographic hash */
+  LIBRDF_STORAGE_SQL_NODE_HASH_XXH64
+} librdf_storage_sql_node_hash;
+
+void librdf_storage_sql_xxh64(const unsigned char* data, size_t length, unsigned int seed, unsigned char* digest);
+int librdf_storage_sql_node_hash_from_name(const char* name);
+
 
 
 #ifdef __cplusplus
@@ -39,6 +39,37 @@
 #include <sys/types.h>
 
 #include <redland.h>
+#include <rdf_list_internal.h>
+
+
+/* Hash chains kept over the stored statements */
+typedef enum {
+  LIBRDF_STORAGE_LIST_INDEX_STATEMENT,
+  LIBRDF_STORAGE_LIST_INDEX_SUBJECT,
+  LIBRDF_STORAGE_LIST_INDEX_PREDICATE,
+  LIBRDF_STORAGE_LIST_INDEX_OBJECT,
+  LIBRDF_STORAGE_LIST_INDEX_LAST = LIBRDF_STORAGE_LIST_INDEX_OBJECT
+} librdf_storage_list_index;
+
+/* Initial number of buckets in each hash chain index */
+#define LIBRDF_STORAGE_LIST_BUCKETS_SIZE 64
+
+
+/* These are stored in the list */
+typedef struct librdf_storage_list_node_s librdf_storage_list_node;
+struct librdf_storage_list_node_s
+{
+  librdf_statement *statement;
+  librdf_node *context;
+
+  /* node holding this in the storage list, for unlinking without a search */
+  librdf_list_node *list_node;
+
+  /* hash, previous and next node in each index hash chain */
+  unsigned long hashes[LIBRDF_STORAGE_LIST_INDEX_LAST+1];
+  librdf_storage_list_node *prev[LIBRDF_STORAGE_LIST_INDEX_LAST+1];
+  librdf_storage_list_node *next[LIBRDF_STORAGE_LIST_INDEX_LAST+1];
+};
 
 
 typedef struct
@@ -48,16 +79,16 @@ typedef struct
   /* If this is non-0, contexts are being used */
   int index_contexts;
   librdf_hash* contexts;
-  
-} librdf_storage_list_instance;
 
+  /* If this is non-0, subject, predicate and object chains are kept */
+  int index_nodes;
 
-/* These are stored in the list */
-typedef struct
-{
-  librdf_statement *statement;
-  librdf_node *context;
-} librdf_storage_list_node;
+  /* Hash chains of stored list nodes for each index, all the same size */
+  librdf_storage_list_node** buckets[LIBRDF_STORAGE_LIST_INDEX_LAST+1];
+  size_t buckets_size;
+  size_t count;
+  
+} librdf_storage_list_instance;
 
 
 /* prototypes for local functions */
@@ -92,6 +123,14 @@ static void librdf_storage_list_context_serialise_finished(void* context);
 /* helper functions for contexts */
 static int librdf_storage_list_node_equals(librdf_storage_list_node *first, librdf_storage_list_node *second);
 
+/* helper functions for the hash chain indexes */
+static unsigned long librdf_storage_list_hash_node(librdf_node* node);
+static int librdf_storage_list_index_grow(librdf_storage_list_instance* context);
+static int librdf_storage_list_index_add(librdf_storage_list_instance* context, librdf_storage_list_node* sln);
+static void librdf_storage_list_index_remove(librdf_storage_list_instance* context, librdf_storage_list_node* sln);
+static librdf_storage_list_node* librdf_storage_list_index_find(librdf_storage_list_instance* context, librdf_statement* statement, int match_context, librdf_node* context_node);
+static librdf_stream* librdf_storage_list_list_as_stream(librdf_storage* storage, librdf_list* list, int owned);
+
 static librdf_iterator* librdf_storage_list_get_contexts(librdf_storage* storage);
 
 /* get_context iterator functions */
@@ -124,6 +163,9 @@ librdf_storage_list_init(librdf_storage* storage, const char *name,
     index_contexts=0; /* default is no contexts */
 
   context->index_contexts=index_contexts;
+
+  /* default is to index subjects, predicates and objects */
+  context->index_nodes=(librdf_hash_get_as_boolean(options, "index-nodes") != 0);
   
   /* no more options, might as well free them now */
   if(options)
@@ -163,6 +205,248 @@ librdf_storage_list_node_equals(librdf_storage_list_node *first,
 }
 
 
+/*
+ * librdf_storage_list_hash_node - Hash node content for the index chains
+ * @node: node
+ *
+ * Return value: hash of the node type and content
+ */
+static unsigned long
+librdf_storage_list_hash_node(librdf_node* node)
+{
+  const unsigned char* strings[3]={NULL, NULL, NULL};
+  size_t lengths[3]={0, 0, 0};
+  unsigned long hash;
+  librdf_uri* datatype;
+  size_t i, j;
+
+  if(!node)
+    return 0;
+
+  switch(librdf_node_get_type(node)) {
+    case LIBRDF_NODE_TYPE_RESOURCE:
+      strings[0]=librdf_uri_as_counted_string(librdf_node_get_uri(node),
+                                              &lengths[0]);
+      break;
+
+    case LIBRDF_NODE_TYPE_LITERAL:
+      strings[0]=librdf_node_get_literal_value_as_counted_string(node,
+                                                                 &lengths[0]);
+      strings[1]=(const unsigned char*)librdf_node_get_literal_value_language(node);
+      if(strings[1])
+        lengths[1]=strlen((const char*)strings[1]);
+      datatype=librdf_node_get_literal_value_datatype_uri(node);
+      if(datatype)
+        strings[2]=librdf_uri_as_counted_string(datatype, &lengths[2]);
+      break;
+
+    case LIBRDF_NODE_TYPE_BLANK:
+      strings[0]=librdf_node_get_blank_identifier(node);
+      lengths[0]=strlen((const char*)strings[0]);
+      break;
+
+    case LIBRDF_NODE_TYPE_UNKNOWN:
+    default:
+      break;
+  }
+
+  /* FNV-1a over the type and each string, separated */
+  hash=2166136261UL;
+  hash=(hash ^ (unsigned long)librdf_node_get_type(node)) * 16777619UL;
+  for(i=0; i < 3; i++) {
+    for(j=0; j < lengths[i]; j++)
+      hash=(hash ^ strings[i][j]) * 16777619UL;
+    hash=(hash ^ 0xff) * 16777619UL;
+  }
+
+  return hash;
+}
+
+
+/*
+ * librdf_storage_list_index_grow - Double the buckets of the index chains
+ * @context: storage instance
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_storage_list_index_grow(librdf_storage_list_instance* context)
+{
+  librdf_storage_list_node** new_buckets[LIBRDF_STORAGE_LIST_INDEX_LAST+1];
+  size_t new_size;
+  size_t i;
+  int index;
+
+  new_size=context->buckets_size ? context->buckets_size * 2 :
+                                   LIBRDF_STORAGE_LIST_BUCKETS_SIZE;
+
+  for(index=0; index <= LIBRDF_STORAGE_LIST_INDEX_LAST; index++) {
+    new_buckets[index]=NULL;
+    if(index != LIBRDF_STORAGE_LIST_INDEX_STATEMENT && !context->index_nodes)
+      continue;
+
+    new_buckets[index] = LIBRDF_CALLOC(librdf_storage_list_node**, new_size,
+                                       sizeof(librdf_storage_list_node*));
+    if(!new_buckets[index]) {
+      while(--index >= 0) {
+        if(new_buckets[index])
+          LIBRDF_FREE(librdf_storage_list_node**, new_buckets[index]);
+      }
+      return 1;
+    }
+  }
+
+  /* Move every node to its new chain */
+  for(index=0; index <= LIBRDF_STORAGE_LIST_INDEX_LAST; index++) {
+    if(!new_buckets[index])
+      continue;
+
+    for(i=0; i < context->buckets_size; i++) {
+      librdf_storage_list_node* sln=context->buckets[index][i];
+
+      while(sln) {
+        librdf_storage_list_node* next=sln->next[index];
+        size_t bucket=sln->hashes[index] & (new_size - 1);
+
+        sln->prev[index]=NULL;
+        sln->next[index]=new_buckets[index][bucket];
+        if(sln->next[index])
+          sln->next[index]->prev[index]=sln;
+        new_buckets[index][bucket]=sln;
+        sln=next;
+      }
+    }
+
+    if(context->buckets[index])
+      LIBRDF_FREE(librdf_storage_list_node**, context->buckets[index]);
+    context->buckets[index]=new_buckets[index];
+  }
+
+  context->buckets_size=new_size;
+
+  return 0;
+}
+
+
+/*
+ * librdf_storage_list_index_add - Add a list node to the index chains
+ * @context: storage instance
+ * @sln: list node
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_storage_list_index_add(librdf_storage_list_instance* context,
+                              librdf_storage_list_node* sln)
+{
+  librdf_statement* statement=sln->statement;
+  int index;
+
+  if(context->count >= context->buckets_size &&
+     librdf_storage_list_index_grow(context))
+    return 1;
+
+  sln->hashes[LIBRDF_STORAGE_LIST_INDEX_SUBJECT]=librdf_storage_list_hash_node(librdf_statement_get_subject(statement));
+  sln->hashes[LIBRDF_STORAGE_LIST_INDEX_PREDICATE]=librdf_storage_list_hash_node(librdf_statement_get_predicate(statement));
+  sln->hashes[LIBRDF_STORAGE_LIST_INDEX_OBJECT]=librdf_storage_list_hash_node(librdf_statement_get_object(statement));
+  sln->hashes[LIBRDF_STORAGE_LIST_INDEX_STATEMENT]=
+    (sln->hashes[LIBRDF_STORAGE_LIST_INDEX_SUBJECT] * 31 +
+     sln->hashes[LIBRDF_STORAGE_LIST_INDEX_PREDICATE]) * 31 +
+    sln->hashes[LIBRDF_STORAGE_LIST_INDEX_OBJECT];
+
+  for(index=0; index <= LIBRDF_STORAGE_LIST_INDEX_LAST; index++) {
+    size_t bucket;
+
+    sln->prev[index]=NULL;
+    sln->next[index]=NULL;
+    if(!context->buckets[index])
+      continue;
+
+    bucket=sln->hashes[index] & (context->buckets_size - 1);
+    sln->next[index]=context->buckets[index][bucket];
+    if(sln->next[index])
+      sln->next[index]->prev[index]=sln;
+    context->buckets[index][bucket]=sln;
+  }
+
+  context->count++;
+
+  return 0;
+}
+
+
+/*
+ * librdf_storage_list_index_remove - Remove a list node from the index chains
+ * @context: storage instance
+ * @sln: list node
+ */
+static void
+librdf_storage_list_index_remove(librdf_storage_list_instance* context,
+                                 librdf_storage_list_node* sln)
+{
+  int index;
+
+  for(index=0; index <= LIBRDF_STORAGE_LIST_INDEX_LAST; index++) {
+    if(!context->buckets[index])
+      continue;
+
+    if(sln->prev[index])
+      sln->prev[index]->next[index]=sln->next[index];
+    else
+      context->buckets[index][sln->hashes[index] & (context->buckets_size - 1)]=sln->next[index];
+    if(sln->next[index])
+      sln->next[index]->prev[index]=sln->prev[index];
+  }
+
+  context->count--;
+}
+
+
+/*
+ * librdf_storage_list_index_find - Find a stored statement
+ * @context: storage instance
+ * @statement: complete statement
+ * @match_context: non 0 to only match statements stored in @context_node
+ * @context_node: context node or NULL for no context
+ *
+ * Return value: first list node with an equal statement or NULL
+ */
+static librdf_storage_list_node*
+librdf_storage_list_index_find(librdf_storage_list_instance* context,
+                               librdf_statement* statement,
+                               int match_context, librdf_node* context_node)
+{
+  librdf_storage_list_node* sln;
+  librdf_storage_list_node search_sln; /* on stack - not allocated */
+  unsigned long hash;
+
+  if(!context->count)
+    return NULL;
+
+  search_sln.statement=statement;
+  search_sln.context=context_node;
+
+  hash=(librdf_storage_list_hash_node(librdf_statement_get_subject(statement)) * 31 +
+        librdf_storage_list_hash_node(librdf_statement_get_predicate(statement))) * 31 +
+       librdf_storage_list_hash_node(librdf_statement_get_object(statement));
+
+  for(sln=context->buckets[LIBRDF_STORAGE_LIST_INDEX_STATEMENT][hash & (context->buckets_size - 1)];
+      sln;
+      sln=sln->next[LIBRDF_STORAGE_LIST_INDEX_STATEMENT]) {
+    if(sln->hashes[LIBRDF_STORAGE_LIST_INDEX_STATEMENT] != hash)
+      continue;
+
+    if(!match_context) {
+      if(librdf_statement_equals(sln->statement, statement))
+        return sln;
+    } else if(librdf_storage_list_node_equals(sln, &search_sln))
+      return sln;
+  }
+
+  return NULL;
+}
+
+
 static int
 librdf_storage_list_open(librdf_storage* storage, librdf_model* model)
 {
@@ -204,6 +488,7 @@ static int
 librdf_storage_list_close(librdf_storage* storage)
 {
   librdf_storage_list_instance* context=(librdf_storage_list_instance*)storage->instance;
+  int i;
   
   if(context->list) {
     librdf_storage_list_node* sln;
@@ -223,6 +508,15 @@ librdf_storage_list_close(librdf_storage* storage)
       context->contexts=NULL;
     }
   }
+
+  for(i=0; i <= LIBRDF_STORAGE_LIST_INDEX_LAST; i++) {
+    if(context->buckets[i]) {
+      LIBRDF_FREE(librdf_storage_list_node**, context->buckets[i]);
+      context->buckets[i]=NULL;
+    }
+  }
+  context->buckets_size=0;
+  context->count=0;
   
   return 0;
 }
@@ -283,7 +577,20 @@ librdf_storage_list_add_statements(librdf_storage* storage,
       break;
     }
     sln->context=NULL;
-    librdf_list_add(context->list, sln);
+    if(librdf_storage_list_index_add(context, sln)) {
+      librdf_free_statement(sln->statement);
+      LIBRDF_FREE(librdf_storage_list_node, sln);
+      status=1;
+      break;
+    }
+    sln->list_node=librdf_list_add_node(context->list, sln);
+    if(!sln->list_node) {
+      librdf_storage_list_index_remove(context, sln);
+      librdf_free_statement(sln->statement);
+      LIBRDF_FREE(librdf_storage_list_node, sln);
+      status=1;
+      break;
+    }
   }
   
   return status;
@@ -301,28 +608,11 @@ static int
 librdf_storage_list_contains_statement(librdf_storage* storage, librdf_statement* statement)
 {
   librdf_storage_list_instance* context=(librdf_storage_list_instance*)storage->instance;
-  librdf_storage_list_node sln; /* STATIC */
-  sln.statement=statement;
-  sln.context=NULL;
-
-  if(context->index_contexts) {
-    /* When we have contexts, we have to use find_statements for contains
-     * since we do not know what context node may be stored for a statement
-     */
-    librdf_stream *stream=librdf_storage_list_find_statements(storage, statement);
-    int status;
-
-    if(!stream)
-      return 0;
-    /* librdf_stream_end returns 0 if have more, non-0 at end */
-    status=!librdf_stream_end(stream);
-    /* convert to 0 if at end (not found) and non-zero otherwise (found) */
-    librdf_free_stream(stream);
-    return status;
-  }
-  
 
-  return librdf_list_contains(context->list, &sln);
+  /* The statement index ignores contexts so this finds the statement
+   * stored in any context, as needed when contexts are used.
+   */
+  return (librdf_storage_list_index_find(context, statement, 0, NULL) != NULL);
 }
 
 
@@ -330,11 +620,31 @@ typedef struct {
   librdf_storage *storage;
   int index_contexts;
   librdf_iterator* iterator;
+  /* list of copied list nodes owned by the stream, if any */
+  librdf_list* list;
 } librdf_storage_list_serialise_stream_context;
 
 
 static librdf_stream*
 librdf_storage_list_serialise(librdf_storage* storage)
+{
+  librdf_storage_list_instance* context=(librdf_storage_list_instance*)storage->instance;
+
+  return librdf_storage_list_list_as_stream(storage, context->list, 0);
+}
+
+
+/*
+ * librdf_storage_list_list_as_stream - Make a stream over a list of list nodes
+ * @storage: the storage
+ * @list: list of #librdf_storage_list_node
+ * @owned: non 0 if the stream takes ownership of @list and its nodes
+ *
+ * Return value: a #librdf_stream or NULL on failure
+ */
+static librdf_stream*
+librdf_storage_list_list_as_stream(librdf_storage* storage, librdf_list* list,
+                                   int owned)
 {
   librdf_storage_list_instance* context=(librdf_storage_list_instance*)storage->instance;
   librdf_storage_list_serialise_stream_context* scontext;
@@ -345,10 +655,12 @@ librdf_storage_list_serialise(librdf_storage* storage)
   if(!scontext)
     return NULL;
 
+  if(owned)
+    scontext->list=list;
   scontext->index_contexts=context->index_contexts;
-  scontext->iterator=librdf_list_get_iterator(context->list);
+  scontext->iterator=librdf_list_get_iterator(list);
   if(!scontext->iterator) {
-    LIBRDF_FREE(librdf_storage_list_serialise_stream_context, scontext);
+    librdf_storage_list_serialise_finished((void*)scontext);
     return librdf_new_empty_stream(storage->world);
   }
     
@@ -420,6 +732,18 @@ librdf_storage_list_serialise_finished(void* context)
   if(scontext->iterator)
     librdf_free_iterator(scontext->iterator);
 
+  if(scontext->list) {
+    librdf_storage_list_node* sln;
+
+    while((sln=(librdf_storage_list_node*)librdf_list_pop(scontext->list))) {
+      librdf_free_statement(sln->statement);
+      if(sln->context)
+        librdf_free_node(sln->context);
+      LIBRDF_FREE(librdf_storage_list_node, sln);
+    }
+    librdf_free_list(scontext->list);
+  }
+
   if(scontext->storage)
     librdf_storage_remove_reference(scontext->storage);
 
@@ -438,13 +762,76 @@ librdf_storage_list_serialise_finished(void* context)
  * all statements if NULL).  Parts (subject, predicate, object) of the
  * statement can be empty in which case any statement part will match that.
  * Uses #librdf_statement_match to do the matching.
+ *
+ * When a part is given, only the statements on the matching index
+ * hash chain are examined and copies of the matches are returned.
  * 
  * Return value: a #librdf_stream or NULL on failure
  **/
 static librdf_stream*
 librdf_storage_list_find_statements(librdf_storage* storage, librdf_statement* statement)
 {
+  librdf_storage_list_instance* context=(librdf_storage_list_instance*)storage->instance;
   librdf_stream* stream;
+  librdf_node* node=NULL;
+  int index=-1;
+
+  if(statement && context->count) {
+    if(context->index_nodes) {
+      /* Pick the most selective part given */
+      if((node=librdf_statement_get_subject(statement)))
+        index=LIBRDF_STORAGE_LIST_INDEX_SUBJECT;
+      else if((node=librdf_statement_get_object(statement)))
+        index=LIBRDF_STORAGE_LIST_INDEX_OBJECT;
+      else if((node=librdf_statement_get_predicate(statement)))
+        index=LIBRDF_STORAGE_LIST_INDEX_PREDICATE;
+    } else if(librdf_statement_is_complete(statement))
+      index=LIBRDF_STORAGE_LIST_INDEX_STATEMENT;
+  }
+
+  if(index >= 0) {
+    librdf_list* list;
+    librdf_storage_list_node* sln;
+    unsigned long hash;
+
+    if(index == LIBRDF_STORAGE_LIST_INDEX_STATEMENT)
+      hash=(librdf_storage_list_hash_node(librdf_statement_get_subject(statement)) * 31 +
+            librdf_storage_list_hash_node(librdf_statement_get_predicate(statement))) * 31 +
+           librdf_storage_list_hash_node(librdf_statement_get_object(statement));
+    else
+      hash=librdf_storage_list_hash_node(node);
+
+    list=librdf_new_list(storage->world);
+    if(!list)
+      return NULL;
+
+    for(sln=context->buckets[index][hash & (context->buckets_size - 1)];
+        sln;
+        sln=sln->next[index]) {
+      librdf_storage_list_node* copy;
+
+      if(sln->hashes[index] != hash ||
+         !librdf_statement_match(sln->statement, statement))
+        continue;
+
+      copy = LIBRDF_CALLOC(librdf_storage_list_node*, 1, sizeof(*copy));
+      if(!copy)
+        break;
+      copy->statement=librdf_new_statement_from_statement(sln->statement);
+      if(sln->context)
+        copy->context=librdf_new_node_from_node(sln->context);
+      if(!copy->statement || librdf_list_add(list, copy)) {
+        if(copy->statement)
+          librdf_free_statement(copy->statement);
+        if(copy->context)
+          librdf_free_node(copy->context);
+        LIBRDF_FREE(librdf_storage_list_node, copy);
+        break;
+      }
+    }
+
+    return librdf_storage_list_list_as_stream(storage, list, 1);
+  }
 
   statement=librdf_new_statement_from_statement(statement);
   if(!statement)
@@ -517,9 +904,16 @@ librdf_storage_list_context_add_statement(librdf_storage* storage,
   } else
     sln->context=NULL;
   
-  status=librdf_list_add(context->list, sln);
+  status=librdf_storage_list_index_add(context, sln);
+  if(!status) {
+    sln->list_node=librdf_list_add_node(context->list, sln);
+    if(!sln->list_node) {
+      librdf_storage_list_index_remove(context, sln);
+      status=1;
+    }
+  }
   if(status) {
-    if(context_node)
+    if(sln->context)
       librdf_free_node(sln->context);
     librdf_free_statement(sln->statement);
     LIBRDF_FREE(librdf_storage_list_node, sln);
@@ -564,7 +958,6 @@ librdf_storage_list_context_remove_statement(librdf_storage* storage,
   librdf_storage_list_instance* context=(librdf_storage_list_instance*)storage->instance;
   librdf_hash_datum key, value; /* on stack - not allocated */
   librdf_storage_list_node* sln;
-  librdf_storage_list_node search_sln; /* on stack - not allocated */
   size_t size;
   int status;
   librdf_world* world;
@@ -577,14 +970,14 @@ librdf_storage_list_context_remove_statement(librdf_storage* storage,
     return 1;
   }
   
-  search_sln.statement=statement;
-  search_sln.context=context_node;
-
   /* Remove stored statement+context */
-  sln=(librdf_storage_list_node*)librdf_list_remove(context->list, &search_sln);
+  sln=librdf_storage_list_index_find(context, statement, 1, context_node);
   if(!sln)
     return 1;
 
+  librdf_list_remove_node(context->list, sln->list_node);
+  librdf_storage_list_index_remove(context, sln);
+
   librdf_free_statement(sln->statement);
   if(sln->context)
     librdf_free_node(sln->context);
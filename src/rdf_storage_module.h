@@ -84,8 +84,8 @@ typedef void* librdf_storage_instance;
  * @add_statements: Add a statement to the storage from the given model. OPTIONAL
  * @remove_statement: Remove a statement from the storage. OPTIONAL
  * @contains_statement: Check if statement is in storage
- * @has_arc_in: Check for [node, property, ?]
- * @has_arc_out: Check for [?, property, node]
+ * @has_arc_in: Check for [?, property, node]
+ * @has_arc_out: Check for [node, property, ?]
  * @serialise: Serialise the model in storage
  * @find_statements: Return a stream of triples matching a triple pattern
  * @find_statements_with_options: Return a stream of triples matching a triple pattern with some options.  OPTIONAL
@@ -112,6 +112,7 @@ typedef void* librdf_storage_instance;
  * @transaction_commit: Commit a transaction. OPTIONAL
  * @transaction_rollback: Rollback a transaction. OPTIONAL
  * @transaction_get_handle: Get opaque data handle passed to transaction_start_with_handle. OPTIONAL
+ * @count_statements: Return the number of statements with a predicate, in a context or both, or < 0 if not known.  storage core will count a find_statements stream if missing. OPTIONAL
  * 
  * A Storage Factory
  */
@@ -159,10 +160,10 @@ struct librdf_storage_factory_s {
   /* Check if statement is in storage */
   int (*contains_statement)(librdf_storage* storage, librdf_statement* statement);
   
-  /* Check for [node, property, ?] */
+  /* Check for [?, property, node] */
   int (*has_arc_in)(librdf_storage *storage, librdf_node *node, librdf_node *property);
   
-  /* Check for [?, property, node] */
+  /* Check for [node, property, ?] */
   int (*has_arc_out)(librdf_storage *storage, librdf_node *node, librdf_node *property);
   
   /* Serialise the model in storage */
@@ -240,6 +241,9 @@ struct librdf_storage_factory_s {
 
   /** Storage engine returns query results - OPTIONAL */
   librdf_query_results* (*query_execute)(librdf_storage* storage, librdf_query *query);
+
+  /** Count statements with a predicate and/or in a context - OPTIONAL */
+  int (*count_statements)(librdf_storage* storage, librdf_node* predicate, librdf_node* context_node);
 };
 
 
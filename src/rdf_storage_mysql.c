@@ -49,6 +49,7 @@
 
 #include <mysql.h>
 #include <mysqld_error.h>
+#include <errmsg.h>
 
 
 /* Define to emit SQL: statements to stderr */
@@ -122,6 +123,36 @@ static const table_info mysql_tables[TABLE_LAST+1]={
 };
 
 
+/* Prepared statements cached per connection */
+typedef enum {
+  PREPARED_SIZE,
+  PREPARED_CONTAINS,
+  PREPARED_INSERT_STATEMENT,
+  PREPARED_DELETE_STATEMENT,
+  PREPARED_DELETE_STATEMENT_WITH_CONTEXT,
+  /* node inserts in triple_node_type order */
+  PREPARED_INSERT_RESOURCE,
+  PREPARED_INSERT_BNODE,
+  PREPARED_INSERT_LITERAL,
+  /* find statements, one per bound subject/predicate/object/context mask */
+  PREPARED_FIND_STATEMENTS,
+  PREPARED_LAST = PREPARED_FIND_STATEMENTS + 15
+} mysql_prepared_numbers;
+
+
+/* Fixed prepared statement queries, formatted with the model hash */
+static const char* const mysql_prepared_queries[PREPARED_FIND_STATEMENTS]={
+  "SELECT COUNT(*) FROM Statements" UINT64_T_FMT,
+  "SELECT 1 FROM Statements" UINT64_T_FMT " WHERE Subject=? AND Predicate=? AND Object=? limit 1",
+  "INSERT INTO Statements" UINT64_T_FMT " (Subject,Predicate,Object,Context) VALUES (?,?,?,?)",
+  "DELETE FROM Statements" UINT64_T_FMT " WHERE Subject=? AND Predicate=? AND Object=?",
+  "DELETE FROM Statements" UINT64_T_FMT " WHERE Subject=? AND Predicate=? AND Object=? AND Context=?",
+  "REPLACE INTO Resources (ID, URI) VALUES (?,?)",
+  "REPLACE INTO Bnodes (ID, Name) VALUES (?,?)",
+  "REPLACE INTO Literals (ID, Value, Language, Datatype) VALUES (?,?,?,?)"
+};
+
+
 typedef enum {
   /* Status of individual MySQL connections */
   LIBRDF_STORAGE_MYSQL_CONNECTION_CLOSED = 0,
@@ -133,6 +164,8 @@ typedef struct {
   /* A MySQL connection */
   librdf_storage_mysql_connection_status status;
   MYSQL *handle;
+  /* Prepared statements on this connection, made on first use */
+  MYSQL_STMT *prepared[PREPARED_LAST+1];
 } librdf_storage_mysql_connection;
 
 typedef struct {
@@ -159,7 +192,16 @@ typedef struct {
   /* if mysql MYSQL_OPT_RECONNECT should be set on new connections */
   int reconnect;
 
-  /* digest object for node hashes */
+  /* if adds should be batched and sent as multi-statement queries */
+  int pipeline;
+
+  /* if hot queries should use prepared statements with binary ids */
+  int prepared;
+
+  /* scheme used for node and model hashes (librdf_storage_sql_node_hash) */
+  int node_hash;
+
+  /* digest object for node hashes - only for the MD5 scheme */
   librdf_digest *digest;
 
   MYSQL* transaction_handle;
@@ -242,6 +284,15 @@ typedef struct {
   MYSQL *handle;
   MYSQL_RES *results;
   int is_literal_match;
+  /* prepared statement results - row points into the buffers */
+  MYSQL_STMT *stmt;
+  unsigned int fields_count;
+  MYSQL_BIND *binds;
+  char **buffers;
+  unsigned long *buffers_size;
+  unsigned long *lengths;
+  my_bool *nulls;
+  char **row;
 } librdf_storage_mysql_sos_context;
 
 typedef struct {
@@ -256,6 +307,9 @@ static u64 librdf_storage_mysql_hash(librdf_storage* storage, const char *type,
 
 #define NODE_HASH_MODE_GET_HASH 0
 #define NODE_HASH_MODE_STORE_NODE 1
+
+/* Number of statements added per pipelined commit */
+#define LIBRDF_STORAGE_MYSQL_PIPELINE_BATCH 1000
 static u64 librdf_storage_mysql_node_hash_common(librdf_storage* storage,
                                                  librdf_node* node,
                                                  int mode);
@@ -267,6 +321,8 @@ static int librdf_storage_mysql_context_add_statement_helper(librdf_storage* sto
                                                              u64 ctxt,
                                                              librdf_statement* statement);
 static int librdf_storage_mysql_find_statements_in_context_augment_query(char **query, const char *addition);
+static int librdf_storage_mysql_find_statements_in_context_bind_prepared(librdf_storage_mysql_sos_context* sos);
+static MYSQL_ROW librdf_storage_mysql_find_statements_in_context_fetch_prepared(librdf_storage_mysql_sos_context* sos);
 
 /* methods for stream of statements */
 static int librdf_storage_mysql_find_statements_in_context_end_of_stream(void* context);
@@ -280,8 +336,22 @@ static int librdf_storage_mysql_get_contexts_next_context(void* context);
 static void* librdf_storage_mysql_get_contexts_get_context(void* context, int flags);
 static void librdf_storage_mysql_get_contexts_finished(void* context);
 
+static int librdf_storage_mysql_transaction_start(librdf_storage* storage);
+static int librdf_storage_mysql_transaction_commit(librdf_storage* storage);
+static int librdf_storage_mysql_transaction_commit_pipelined(librdf_storage* storage);
 static int librdf_storage_mysql_transaction_rollback(librdf_storage* storage);
 
+static MYSQL_STMT* librdf_storage_mysql_get_prepared(librdf_storage* storage,
+                                                     MYSQL* handle,
+                                                     int number,
+                                                     const char* query);
+static MYSQL_STMT* librdf_storage_mysql_execute_prepared(librdf_storage* storage,
+                                                         MYSQL* handle,
+                                                         int number,
+                                                         const char* query,
+                                                         MYSQL_BIND* params);
+static void librdf_storage_mysql_bind_u64(MYSQL_BIND* bind, u64* value);
+
 static void librdf_storage_mysql_register_factory(librdf_storage_factory *factory);
 #ifdef MODULAR_LIBRDF
 void librdf_storage_module_register_factory(librdf_world *world);
@@ -308,23 +378,33 @@ librdf_storage_mysql_hash(librdf_storage* storage, const char *type,
   librdf_storage_mysql_instance* context=(librdf_storage_mysql_instance*)storage->instance;
   u64 hash;
   byte* digest;
+  byte xxh64_digest[8];
   uint i;
 
-  /* (Re)initialize digest object */
-  librdf_digest_init(context->digest);
-  
-  /* Update digest with data */
-  if(type)
-    librdf_digest_update(context->digest, (unsigned char*)type, 1);
-  librdf_digest_update(context->digest, (unsigned char*)string, length);
-  librdf_digest_final(context->digest);
+  if(context->node_hash == LIBRDF_STORAGE_SQL_NODE_HASH_XXH64) {
+    /* Node type character is the seed, not hashed as data */
+    librdf_storage_sql_xxh64((const unsigned char*)string, length,
+                             type ? (unsigned int)(unsigned char)*type : 0,
+                             xxh64_digest);
+    digest = xxh64_digest;
+  } else {
+    /* (Re)initialize digest object */
+    librdf_digest_init(context->digest);
+
+    /* Update digest with data */
+    if(type)
+      librdf_digest_update(context->digest, (unsigned char*)type, 1);
+    librdf_digest_update(context->digest, (unsigned char*)string, length);
+    librdf_digest_final(context->digest);
+
+    digest = (byte*) librdf_digest_get_digest(context->digest);
+  }
   
   /* Copy first 8 bytes of digest into unsigned 64bit hash
    * using a method portable across big/little endianness
    *
    * Fixes Issue#0000023 - http://bugs.librdf.org/mantis/view.php?id=23
    */
-  digest = (byte*) librdf_digest_get_digest(context->digest);
   hash = 0;
   for(i=0; i<8; i++)
     hash += ((u64) digest[i]) << (i*8);
@@ -365,6 +445,14 @@ librdf_storage_mysql_finish_connections(librdf_storage* storage)
 
   /* Loop through connections and close */
   for(i=0; i < context->connections_count; i++) {
+    int j;
+
+    for(j=0; j <= PREPARED_LAST; j++) {
+      if(context->connections[i].prepared[j])
+        mysql_stmt_close(context->connections[i].prepared[j]);
+      context->connections[i].prepared[j]=NULL;
+    }
+
     if(LIBRDF_STORAGE_MYSQL_CONNECTION_CLOSED != context->connections[i].status)
 #ifdef LIBRDF_DEBUG_SQL
       LIBRDF_DEBUG2("mysql_close connection handle %p\n",
@@ -455,7 +543,8 @@ librdf_storage_mysql_get_handle(librdf_storage* storage)
   /* Create connection to database for handle */
   if(!mysql_real_connect(connection->handle,
                          context->host, context->user, context->password,
-                         context->database, context->port, NULL, 0)) {
+                         context->database, context->port, NULL,
+                         context->pipeline ? CLIENT_MULTI_STATEMENTS : 0)) {
     librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
                "Connection to MySQL database %s:%d name %s as user %s failed: %s",
                context->host, context->port, context->database,
@@ -498,16 +587,181 @@ librdf_storage_mysql_release_handle(librdf_storage* storage, MYSQL *handle)
 }
 
 
+/*
+ * librdf_storage_mysql_get_prepared - Get a cached prepared statement for a connection
+ * @storage: the storage
+ * @handle: MySQL connection handle
+ * @number: prepared statement number
+ * @query: query to prepare or NULL for the fixed query of @number
+ *
+ * Prepares the statement on first use on the connection.
+ *
+ * Return value: prepared statement or NULL on failure.
+ **/
+static MYSQL_STMT*
+librdf_storage_mysql_get_prepared(librdf_storage* storage, MYSQL* handle,
+                                  int number, const char* query)
+{
+  librdf_storage_mysql_instance* context=(librdf_storage_mysql_instance*)storage->instance;
+  librdf_storage_mysql_connection* connection=NULL;
+  MYSQL_STMT* stmt;
+  char* fixed_query=NULL;
+  int i;
+
+  for(i=0; i < context->connections_count; i++) {
+    if(context->connections[i].handle == handle) {
+      connection=&context->connections[i];
+      break;
+    }
+  }
+  if(!connection)
+    return NULL;
+
+  if(connection->prepared[number])
+    return connection->prepared[number];
+
+  if(!query) {
+    fixed_query = LIBRDF_MALLOC(char*,
+                                strlen(mysql_prepared_queries[number]) + 21);
+    if(!fixed_query)
+      return NULL;
+    sprintf(fixed_query, mysql_prepared_queries[number], context->model);
+    query=fixed_query;
+  }
+
+#ifdef LIBRDF_DEBUG_SQL
+  LIBRDF_DEBUG2("SQL prepare: >>%s<<\n", query);
+#endif
+  stmt=mysql_stmt_init(handle);
+  if(stmt && mysql_stmt_prepare(stmt, query, strlen(query))) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "MySQL prepare failed: %s", mysql_stmt_error(stmt));
+    mysql_stmt_close(stmt);
+    stmt=NULL;
+  }
+
+  if(fixed_query)
+    LIBRDF_FREE(char*, fixed_query);
+
+  connection->prepared[number]=stmt;
+  return stmt;
+}
+
+
+/*
+ * librdf_storage_mysql_drop_prepared - Drop a statement from the cache
+ * @storage: the storage
+ * @handle: MySQL connection handle
+ * @number: prepared statement number
+ * @stmt: the cached statement
+ **/
+static void
+librdf_storage_mysql_drop_prepared(librdf_storage* storage, MYSQL* handle,
+                                   int number, MYSQL_STMT* stmt)
+{
+  librdf_storage_mysql_instance* context=(librdf_storage_mysql_instance*)storage->instance;
+  int i;
+
+  for(i=0; i < context->connections_count; i++) {
+    if(context->connections[i].handle == handle)
+      context->connections[i].prepared[number]=NULL;
+  }
+  mysql_stmt_close(stmt);
+}
+
+
+/*
+ * librdf_storage_mysql_execute_prepared - Execute a cached prepared statement
+ * @storage: the storage
+ * @handle: MySQL connection handle
+ * @number: prepared statement number
+ * @query: query to prepare or NULL for the fixed query of @number
+ * @params: parameter bindings or NULL
+ *
+ * Prepared statements do not survive a reconnect, so if the
+ * connection was lost and the reconnect option is set the statement
+ * is prepared again on the new connection and executed once more.
+ * On failure the statement is dropped from the cache.
+ *
+ * Return value: executed statement or NULL on failure.
+ **/
+static MYSQL_STMT*
+librdf_storage_mysql_execute_prepared(librdf_storage* storage, MYSQL* handle,
+                                      int number, const char* query,
+                                      MYSQL_BIND* params)
+{
+  librdf_storage_mysql_instance* context=(librdf_storage_mysql_instance*)storage->instance;
+  MYSQL_STMT* stmt;
+  unsigned int error;
+  int retry=context->reconnect;
+
+  while(1) {
+    stmt=librdf_storage_mysql_get_prepared(storage, handle, number, query);
+    if(!stmt)
+      return NULL;
+
+    if((!params || !mysql_stmt_bind_param(stmt, params)) &&
+       !mysql_stmt_execute(stmt))
+      return stmt;
+
+    /* Only retry when the statement cannot have run; a connection
+     * lost during execution might have added a statement already */
+    error=mysql_stmt_errno(stmt);
+    if(retry &&
+       (error == CR_SERVER_GONE_ERROR || error == ER_UNKNOWN_STMT_HANDLER)) {
+      librdf_storage_mysql_drop_prepared(storage, handle, number, stmt);
+      retry=0;
+      continue;
+    }
+
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "MySQL prepared statement failed: %s", mysql_stmt_error(stmt));
+    librdf_storage_mysql_drop_prepared(storage, handle, number, stmt);
+    return NULL;
+  }
+}
+
+
+/*
+ * librdf_storage_mysql_bind_u64 - Bind an unsigned 64 bit integer
+ * @bind: binding to initialise
+ * @value: pointer to value
+ **/
+static void
+librdf_storage_mysql_bind_u64(MYSQL_BIND* bind, u64* value)
+{
+  memset(bind, 0, sizeof(*bind));
+  bind->buffer_type=MYSQL_TYPE_LONGLONG;
+  bind->buffer=(char*)value;
+  bind->is_unsigned=1;
+}
+
+
 /**
  * librdf_storage_mysql_init:
  * @storage: the storage
  * @name: model name
- * @options: host, port, database, user, password [, new] [, bulk] [, merge].
+ * @options: host, port, database, user, password [, new] [, bulk] [, merge] [, node-hash] [, pipeline] [, prepared].
  *
  * .
  *
  * Create connection to database.  Defaults to port 3306 if not given.
  *
+ * The node-hash option selects how 64 bit node and model IDs are
+ * derived: "md5" (default) is the original scheme and must be used
+ * for existing databases; "xxh64" is much cheaper to compute.  The
+ * model ID depends on the scheme so a model can only be opened with
+ * the scheme it was created with; see redland-sql-rehash to convert.
+ *
+ * The boolean prepared option can be set to true so that statement
+ * adds, removes, lookups, size and find queries use server side
+ * prepared statements cached per connection with binary IDs instead
+ * of text queries.
+ *
+ * The boolean pipeline option can be set to true to connect with
+ * multi-statement support and add streams of statements in batches,
+ * sending each batch's node and statement inserts in one round trip.
+ *
  * The boolean bulk option can be set to true if optimized inserts (table
  * locks and temporary key disabling) is wanted. Note that this will block
  * all other access, and requires table locking and alter table privileges.
@@ -531,6 +785,7 @@ librdf_storage_mysql_init(librdf_storage* storage, const char *name,
   MYSQL *handle;
   const char* default_layout="v1";
   long lport;
+  char *node_hash;
 
   /* Must have connection parameters passed as options */
   if(!options)
@@ -545,8 +800,23 @@ librdf_storage_mysql_init(librdf_storage* storage, const char *name,
   }
   librdf_storage_set_instance(storage, context);
 
+  /* Select node hash scheme */
+  node_hash = librdf_hash_get_del(options, "node-hash");
+  context->node_hash = librdf_storage_sql_node_hash_from_name(node_hash);
+  if(context->node_hash < 0) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "%s storage unknown node-hash '%s'", storage->factory->name,
+               node_hash);
+    LIBRDF_FREE(char*, node_hash);
+    librdf_free_hash(options);
+    return 1;
+  }
+  if(node_hash)
+    LIBRDF_FREE(char*, node_hash);
+
   /* Create digest */
-  if(!(context->digest = librdf_new_digest(storage->world,"MD5"))) {
+  if(context->node_hash == LIBRDF_STORAGE_SQL_NODE_HASH_MD5 &&
+     !(context->digest = librdf_new_digest(storage->world,"MD5"))) {
     librdf_free_hash(options);
     return 1;
   }
@@ -587,6 +857,12 @@ librdf_storage_mysql_init(librdf_storage* storage, const char *name,
   /* Reconnect? */
   context->reconnect = (librdf_hash_get_as_boolean(options, "reconnect")>0);
 
+  /* Pipeline adds with multi-statement queries? */
+  context->pipeline = (librdf_hash_get_as_boolean(options, "pipeline")>0);
+
+  /* Use prepared statements? */
+  context->prepared = (librdf_hash_get_as_boolean(options, "prepared")>0);
+
   context->layout = librdf_hash_get_del(options, "layout");
   if(!context->layout) {
     context->layout = LIBRDF_MALLOC(char*, strlen(default_layout) + 1);
@@ -943,6 +1219,27 @@ librdf_storage_mysql_size(librdf_storage* storage)
   if(!handle)
     return -1;
 
+  if(context->prepared) {
+    MYSQL_STMT* stmt;
+    MYSQL_BIND result;
+    u64 size=0;
+
+    stmt=librdf_storage_mysql_execute_prepared(storage, handle, PREPARED_SIZE,
+                                               NULL, NULL);
+    if(!stmt) {
+      librdf_storage_mysql_release_handle(storage, handle);
+      return -1;
+    }
+    librdf_storage_mysql_bind_u64(&result, &size);
+    if(mysql_stmt_bind_result(stmt, &result) || mysql_stmt_fetch(stmt))
+      count=-1;
+    else
+      count=(int)size;
+    mysql_stmt_free_result(stmt);
+    librdf_storage_mysql_release_handle(storage, handle);
+    return count;
+  }
+
   /* Query for number of statements */
   query = LIBRDF_MALLOC(char*, strlen(model_size) + 21);
   if(!query) {
@@ -1114,6 +1411,60 @@ format_pending_row_sequence(const table_info *table, raptor_sequence* seq)
 }
 
 
+/*
+ * format_pending_statements_sequence - Format REPLACE query for pending statements
+ * @model: model hash
+ * @seq: sequence of pending statement rows
+ *
+ * Return value: new string buffer holding the query
+ */
+static raptor_stringbuffer*
+format_pending_statements_sequence(u64 model, raptor_sequence* seq)
+{
+  const table_info *table=&mysql_tables[TABLE_STATEMENTS];
+  char uint64_buffer[64];
+  raptor_stringbuffer* sb;
+  int i;
+
+  sb=raptor_new_stringbuffer();
+  if(!sb)
+    return NULL;
+
+  raptor_stringbuffer_append_string(sb, (const unsigned char*)"REPLACE INTO Statements", 1);
+  sprintf(uint64_buffer, UINT64_T_FMT, model);
+  raptor_stringbuffer_append_string(sb, (const unsigned char*)uint64_buffer, 1);
+  raptor_stringbuffer_append_counted_string(sb, (const unsigned char*)" (", 2, 1);
+  raptor_stringbuffer_append_string(sb, (const unsigned char*)table->columns, 1);
+  raptor_stringbuffer_append_counted_string(sb, (const unsigned char*)") VALUES ", 9, 1);
+
+  for(i=0; i< raptor_sequence_size(seq); i++) {
+    pending_row* prow=(pending_row*)raptor_sequence_get_at(seq, i);
+    int j;
+
+    if(i > 0)
+      raptor_stringbuffer_append_counted_string(sb,
+                                           (const unsigned char*)", ", 2, 1);
+
+    raptor_stringbuffer_append_counted_string(sb,
+                                           (const unsigned char*)"(", 1, 1);
+
+    for(j=0; j < 4; j++) {
+      if(j > 0)
+        raptor_stringbuffer_append_counted_string(sb,
+                                           (const unsigned char*)", ", 2, 1);
+      sprintf(uint64_buffer, UINT64_T_FMT, prow->uints[j]);
+      raptor_stringbuffer_append_string(sb,
+                                     (const unsigned char*)uint64_buffer, 1);
+    }
+
+    raptor_stringbuffer_append_counted_string(sb,
+                                           (const unsigned char*)")", 1, 1);
+  }
+
+  return sb;
+}
+
+
 /*
  * librdf_storage_mysql_node_hash_common - Create/get hash value for node
  * @storage: the storage
@@ -1215,6 +1566,48 @@ librdf_storage_mysql_node_hash_common(librdf_storage* storage,
   if(mode != NODE_HASH_MODE_STORE_NODE)
     goto tidy;
 
+  if(context->prepared && !context->transaction_handle) {
+    /* not in a transaction - store with a prepared statement */
+    MYSQL_BIND params[4];
+    const char* strings[3];
+    unsigned long lengths[3];
+    int count;
+    int i;
+
+    if(type == LIBRDF_NODE_TYPE_RESOURCE) {
+      strings[0]=(const char*)uri;
+      lengths[0]=nodelen;
+      count=1;
+    } else if(type == LIBRDF_NODE_TYPE_LITERAL) {
+      strings[0]=(const char*)value;
+      lengths[0]=valuelen;
+      strings[1]=lang ? lang : "";
+      lengths[1]=langlen;
+      strings[2]=datatype ? (const char*)datatype : "";
+      lengths[2]=datatypelen;
+      count=3;
+    } else {
+      strings[0]=(const char*)name;
+      lengths[0]=nodelen;
+      count=1;
+    }
+
+    librdf_storage_mysql_bind_u64(&params[0], &hash);
+    for(i=0; i < count; i++) {
+      memset(&params[i+1], 0, sizeof(params[i+1]));
+      params[i+1].buffer_type=MYSQL_TYPE_STRING;
+      params[i+1].buffer=(char*)strings[i];
+      params[i+1].buffer_length=lengths[i];
+      params[i+1].length=&lengths[i];
+    }
+
+    if(!librdf_storage_mysql_execute_prepared(storage, handle,
+                                              PREPARED_INSERT_RESOURCE + (int)node_type,
+                                              NULL, params))
+      hash=0;
+    goto tidy;
+  }
+
   
   table=&mysql_tables[node_type];
 
@@ -1574,6 +1967,7 @@ librdf_storage_mysql_context_add_statements(librdf_storage* storage,
   librdf_storage_mysql_instance* context=(librdf_storage_mysql_instance*)storage->instance;
   u64 ctxt=0;
   int helper=0;
+  int pipelined=0;
 
   /* Optimize for bulk loads? */
   if(context->bulk) {
@@ -1581,11 +1975,21 @@ librdf_storage_mysql_context_add_statements(librdf_storage* storage,
       return 1;
   }
   
+  /* Batch the adds in transactions committed as pipelined queries? */
+  if(context->pipeline && !context->bulk && !context->transaction_handle) {
+    if(librdf_storage_mysql_transaction_start(storage))
+      return 1;
+    pipelined=1;
+  }
+
   /* Find hash for context, creating if necessary */
   if(context_node) {
     ctxt=librdf_storage_mysql_store_node(storage,context_node);
-    if(!ctxt)
+    if(!ctxt) {
+      if(pipelined)
+        librdf_storage_mysql_transaction_rollback(storage);
       return 1;
+    }
   }
 
   while(!helper && !librdf_stream_end(statement_stream)) {
@@ -1593,6 +1997,24 @@ librdf_storage_mysql_context_add_statements(librdf_storage* storage,
     helper=librdf_storage_mysql_context_add_statement_helper(storage, ctxt,
                                                              statement);
     librdf_stream_next(statement_stream);
+
+    if(pipelined && !helper &&
+       raptor_sequence_size(context->pending_statements) >= LIBRDF_STORAGE_MYSQL_PIPELINE_BATCH) {
+      helper=librdf_storage_mysql_transaction_commit(storage);
+      if(!helper)
+        helper=librdf_storage_mysql_transaction_start(storage);
+      /* the context node must be in every batch */
+      if(!helper && context_node &&
+         !librdf_storage_mysql_store_node(storage, context_node))
+        helper=1;
+    }
+  }
+
+  if(pipelined && context->transaction_handle) {
+    if(helper)
+      librdf_storage_mysql_transaction_rollback(storage);
+    else
+      helper=librdf_storage_mysql_transaction_commit(storage);
   }
 
   return helper;
@@ -1676,6 +2098,20 @@ librdf_storage_mysql_context_add_statement_helper(librdf_storage* storage,
     prow->uints[3]=ctxt;
     raptor_sequence_push(context->pending_statements, prow);
     
+  } else if(context->prepared) {
+    /* not a transaction - add statement with prepared statement */
+    MYSQL_BIND params[4];
+
+    librdf_storage_mysql_bind_u64(&params[0], &subject);
+    librdf_storage_mysql_bind_u64(&params[1], &predicate);
+    librdf_storage_mysql_bind_u64(&params[2], &object);
+    librdf_storage_mysql_bind_u64(&params[3], &ctxt);
+    if(!librdf_storage_mysql_execute_prepared(storage, handle,
+                                              PREPARED_INSERT_STATEMENT,
+                                              NULL, params)) {
+      rc=-1;
+      goto tidy;
+    }
   } else {
     /* not a transaction - add statement to storage */
     query = LIBRDF_MALLOC(char*, strlen(insert_statement) + 101);
@@ -1745,6 +2181,25 @@ librdf_storage_mysql_contains_statement(librdf_storage* storage,
     return 0;
   }
 
+  if(context->prepared) {
+    MYSQL_STMT* stmt;
+    MYSQL_BIND params[3];
+    int found=0;
+
+    librdf_storage_mysql_bind_u64(&params[0], &subject);
+    librdf_storage_mysql_bind_u64(&params[1], &predicate);
+    librdf_storage_mysql_bind_u64(&params[2], &object);
+    stmt=librdf_storage_mysql_execute_prepared(storage, handle,
+                                               PREPARED_CONTAINS, NULL,
+                                               params);
+    if(stmt) {
+      found=(!mysql_stmt_store_result(stmt) && !mysql_stmt_fetch(stmt));
+      mysql_stmt_free_result(stmt);
+    }
+    librdf_storage_mysql_release_handle(storage, handle);
+    return found;
+  }
+
   /* Check for statement */
   query = LIBRDF_MALLOC(char*, strlen(find_statement) + 81);
   if(!query) {
@@ -1845,6 +2300,22 @@ librdf_storage_mysql_context_remove_statement(librdf_storage* storage,
     return 1;
   }
 
+  if(context->prepared) {
+    MYSQL_BIND params[4];
+    int rc=0;
+
+    librdf_storage_mysql_bind_u64(&params[0], &subject);
+    librdf_storage_mysql_bind_u64(&params[1], &predicate);
+    librdf_storage_mysql_bind_u64(&params[2], &object);
+    librdf_storage_mysql_bind_u64(&params[3], &ctxt);
+    if(!librdf_storage_mysql_execute_prepared(storage, handle,
+                                              context_node ? PREPARED_DELETE_STATEMENT_WITH_CONTEXT : PREPARED_DELETE_STATEMENT,
+                                              NULL, params))
+      rc=-1;
+    librdf_storage_mysql_release_handle(storage, handle);
+    return rc;
+  }
+
   /* Remove statement(s) from storage */
   if(context_node) {
     query = LIBRDF_MALLOC(char*, strlen(delete_statement_with_context) + 101);
@@ -2076,6 +2547,12 @@ librdf_storage_mysql_find_statements_with_options(librdf_storage* storage,
   char where[256];
   char joins[640];
   librdf_stream *stream;
+  /* prepared statement parameters for the bound parts */
+  u64 params[4];
+  MYSQL_BIND binds[4];
+  int params_count=0;
+  int prepared;
+  int mask=0;
 
   /* Initialize sos context */
   sos = LIBRDF_CALLOC(librdf_storage_mysql_sos_context*, 1, sizeof(*sos));
@@ -2096,6 +2573,9 @@ librdf_storage_mysql_find_statements_with_options(librdf_storage* storage,
     sos->is_literal_match=librdf_hash_get_as_boolean(options, "match-substring");
   }
 
+  /* Literal matches put the literal in the query so are not prepared */
+  prepared=(context->prepared && !sos->is_literal_match);
+
   /* Get MySQL connection handle */
   sos->handle=librdf_storage_mysql_get_handle(storage);
   if(!sos->handle) {
@@ -2125,8 +2605,14 @@ librdf_storage_mysql_find_statements_with_options(librdf_storage* storage,
 
   /* Subject */
   if(statement && subject) {
-    sprintf(tmp, "S.Subject=" UINT64_T_FMT "",
-            librdf_storage_mysql_get_node_hash(storage,subject));
+    if(prepared) {
+      params[params_count++]=librdf_storage_mysql_get_node_hash(storage,
+                                                                subject);
+      strcpy(tmp, "S.Subject=?");
+      mask|=1;
+    } else
+      sprintf(tmp, "S.Subject=" UINT64_T_FMT "",
+              librdf_storage_mysql_get_node_hash(storage,subject));
     if(!strlen(where))
       strcat(where, " WHERE ");
     else
@@ -2143,8 +2629,14 @@ librdf_storage_mysql_find_statements_with_options(librdf_storage* storage,
 
   /* Predicate */
   if(statement && predicate) {
-    sprintf(tmp, "S.Predicate=" UINT64_T_FMT "",
-            librdf_storage_mysql_get_node_hash(storage, predicate));
+    if(prepared) {
+      params[params_count++]=librdf_storage_mysql_get_node_hash(storage,
+                                                                predicate);
+      strcpy(tmp, "S.Predicate=?");
+      mask|=2;
+    } else
+      sprintf(tmp, "S.Predicate=" UINT64_T_FMT "",
+              librdf_storage_mysql_get_node_hash(storage, predicate));
     if(!strlen(where))
       strcat(where, " WHERE ");
     else
@@ -2167,8 +2659,14 @@ librdf_storage_mysql_find_statements_with_options(librdf_storage* storage,
   /* Object */
   if(statement && object) {
     if(!sos->is_literal_match) {
-      sprintf(tmp,"S.Object=" UINT64_T_FMT "",
-              librdf_storage_mysql_get_node_hash(storage, object));
+      if(prepared) {
+        params[params_count++]=librdf_storage_mysql_get_node_hash(storage,
+                                                                  object);
+        strcpy(tmp, "S.Object=?");
+        mask|=4;
+      } else
+        sprintf(tmp,"S.Object=" UINT64_T_FMT "",
+                librdf_storage_mysql_get_node_hash(storage, object));
       if(!strlen(where))
         strcat(where, " WHERE ");
       else
@@ -2222,8 +2720,14 @@ librdf_storage_mysql_find_statements_with_options(librdf_storage* storage,
 
   /* Context */
   if(context_node) {
-    sprintf(tmp,"S.Context=" UINT64_T_FMT "",
-            librdf_storage_mysql_get_node_hash(storage,context_node));
+    if(prepared) {
+      params[params_count++]=librdf_storage_mysql_get_node_hash(storage,
+                                                                context_node);
+      strcpy(tmp, "S.Context=?");
+      mask|=8;
+    } else
+      sprintf(tmp,"S.Context=" UINT64_T_FMT "",
+              librdf_storage_mysql_get_node_hash(storage,context_node));
     if(!strlen(where))
       strcat(where, " WHERE ");
     else
@@ -2261,18 +2765,36 @@ librdf_storage_mysql_find_statements_with_options(librdf_storage* storage,
   }
 
   /* Start query... */
+  if(prepared) {
+    int i;
+
+    for(i=0; i < params_count; i++)
+      librdf_storage_mysql_bind_u64(&binds[i], &params[i]);
+
+    sos->stmt=librdf_storage_mysql_execute_prepared(storage, sos->handle,
+                                                    PREPARED_FIND_STATEMENTS + mask,
+                                                    query,
+                                                    params_count ? binds : NULL);
+    LIBRDF_FREE(char*, query);
+    if(!sos->stmt ||
+       librdf_storage_mysql_find_statements_in_context_bind_prepared(sos)) {
+      librdf_storage_mysql_find_statements_in_context_finished((void*)sos);
+      return NULL;
+    }
+  } else {
 #ifdef LIBRDF_DEBUG_SQL
-  LIBRDF_DEBUG2("SQL: >>%s<<\n", query);
+    LIBRDF_DEBUG2("SQL: >>%s<<\n", query);
 #endif
-  if(mysql_real_query(sos->handle, query, strlen(query)) ||
-     !(sos->results=mysql_use_result(sos->handle))) {
-    librdf_log(sos->storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-               "MySQL query failed: %s",
-               mysql_error(sos->handle));
-    librdf_storage_mysql_find_statements_in_context_finished((void*)sos);
-    return NULL;
+    if(mysql_real_query(sos->handle, query, strlen(query)) ||
+       !(sos->results=mysql_use_result(sos->handle))) {
+      librdf_log(sos->storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "MySQL query failed: %s",
+                 mysql_error(sos->handle));
+      librdf_storage_mysql_find_statements_in_context_finished((void*)sos);
+      return NULL;
+    }
+    LIBRDF_FREE(char*, query);
   }
-  LIBRDF_FREE(char*, query);
 
   /* Get first statement, if any, and initialize stream */
   if(librdf_storage_mysql_find_statements_in_context_next_statement(sos) ||
@@ -2314,6 +2836,103 @@ librdf_storage_mysql_find_statements_in_context_augment_query(char **query,
 }
 
 
+/* Initial size of each prepared statement result column buffer */
+#define LIBRDF_STORAGE_MYSQL_COLUMN_BUFFER_SIZE 256
+
+static int
+librdf_storage_mysql_find_statements_in_context_bind_prepared(librdf_storage_mysql_sos_context* sos)
+{
+  unsigned int i;
+  unsigned int count;
+
+  /* Bind each result column as a string into a growable buffer */
+  count=mysql_stmt_field_count(sos->stmt);
+  sos->fields_count=count;
+  sos->binds = LIBRDF_CALLOC(MYSQL_BIND*, count, sizeof(MYSQL_BIND));
+  sos->buffers = LIBRDF_CALLOC(char**, count, sizeof(char*));
+  sos->buffers_size = LIBRDF_CALLOC(unsigned long*, count, sizeof(unsigned long));
+  sos->lengths = LIBRDF_CALLOC(unsigned long*, count, sizeof(unsigned long));
+  sos->nulls = LIBRDF_CALLOC(my_bool*, count, sizeof(my_bool));
+  sos->row = LIBRDF_CALLOC(char**, count, sizeof(char*));
+  if(!sos->binds || !sos->buffers || !sos->buffers_size || !sos->lengths ||
+     !sos->nulls || !sos->row)
+    return 1;
+
+  for(i=0; i < count; i++) {
+    sos->buffers[i] = LIBRDF_MALLOC(char*, LIBRDF_STORAGE_MYSQL_COLUMN_BUFFER_SIZE);
+    if(!sos->buffers[i])
+      return 1;
+    sos->buffers_size[i]=LIBRDF_STORAGE_MYSQL_COLUMN_BUFFER_SIZE;
+
+    sos->binds[i].buffer_type=MYSQL_TYPE_STRING;
+    sos->binds[i].buffer=sos->buffers[i];
+    /* leave room for a NUL */
+    sos->binds[i].buffer_length=sos->buffers_size[i] - 1;
+    sos->binds[i].length=&sos->lengths[i];
+    sos->binds[i].is_null=&sos->nulls[i];
+  }
+
+  if(mysql_stmt_bind_result(sos->stmt, sos->binds)) {
+    librdf_log(sos->storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE,
+               NULL, "MySQL result binding failed: %s",
+               mysql_stmt_error(sos->stmt));
+    return 1;
+  }
+
+  return 0;
+}
+
+
+static MYSQL_ROW
+librdf_storage_mysql_find_statements_in_context_fetch_prepared(librdf_storage_mysql_sos_context* sos)
+{
+  unsigned int i;
+  int rc;
+  int rebind=0;
+
+  rc=mysql_stmt_fetch(sos->stmt);
+  if(rc == 1 || rc == MYSQL_NO_DATA) {
+    if(rc == 1)
+      librdf_log(sos->storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE,
+                 NULL, "MySQL fetch failed: %s", mysql_stmt_error(sos->stmt));
+    return NULL;
+  }
+
+  for(i=0; i < sos->fields_count; i++) {
+    if(sos->nulls[i]) {
+      sos->row[i]=NULL;
+      continue;
+    }
+
+    if(sos->lengths[i] >= sos->buffers_size[i]) {
+      /* Truncated - grow the buffer and fetch the whole column again */
+      char* buffer;
+      unsigned long size=sos->lengths[i] + 1;
+
+      buffer = LIBRDF_MALLOC(char*, size);
+      if(!buffer)
+        return NULL;
+      LIBRDF_FREE(char*, sos->buffers[i]);
+      sos->buffers[i]=buffer;
+      sos->buffers_size[i]=size;
+      sos->binds[i].buffer=buffer;
+      sos->binds[i].buffer_length=size - 1;
+      if(mysql_stmt_fetch_column(sos->stmt, &sos->binds[i], i, 0))
+        return NULL;
+      rebind=1;
+    }
+
+    sos->buffers[i][sos->lengths[i]]='\0';
+    sos->row[i]=sos->buffers[i];
+  }
+
+  if(rebind && mysql_stmt_bind_result(sos->stmt, sos->binds))
+    return NULL;
+
+  return sos->row;
+}
+
+
 static int
 librdf_storage_mysql_find_statements_in_context_end_of_stream(void* context)
 {
@@ -2332,7 +2951,10 @@ librdf_storage_mysql_find_statements_in_context_next_statement(void* context)
   librdf_node *node;
 
   /* Get next statement */
-  row=mysql_fetch_row(sos->results);
+  if(sos->stmt)
+    row=librdf_storage_mysql_find_statements_in_context_fetch_prepared(sos);
+  else
+    row=mysql_fetch_row(sos->results);
   if(row) {
     /* Get ready for context */
     if(sos->current_context)
@@ -2495,6 +3117,30 @@ librdf_storage_mysql_find_statements_in_context_finished(void* context)
   if(sos->results)
     mysql_free_result(sos->results);
 
+  /* the prepared statement stays cached on the connection */
+  if(sos->stmt)
+    mysql_stmt_free_result(sos->stmt);
+
+  if(sos->buffers) {
+    unsigned int i;
+
+    for(i=0; i < sos->fields_count; i++) {
+      if(sos->buffers[i])
+        LIBRDF_FREE(char*, sos->buffers[i]);
+    }
+    LIBRDF_FREE(char**, sos->buffers);
+  }
+  if(sos->binds)
+    LIBRDF_FREE(MYSQL_BIND*, sos->binds);
+  if(sos->buffers_size)
+    LIBRDF_FREE(unsigned long*, sos->buffers_size);
+  if(sos->lengths)
+    LIBRDF_FREE(unsigned long*, sos->lengths);
+  if(sos->nulls)
+    LIBRDF_FREE(my_bool*, sos->nulls);
+  if(sos->row)
+    LIBRDF_FREE(char**, sos->row);
+
   if(sos->handle) {
     librdf_storage_mysql_release_handle(sos->storage, sos->handle);
   }
@@ -2823,6 +3469,98 @@ void librdf_storage_mysql_transaction_terminate(librdf_storage *storage)
 }
 
 
+/*
+ * librdf_storage_mysql_transaction_commit_pipelined:
+ * @storage: the storage object
+ * 
+ * INTERNAL - Commit a transaction sending all pending inserts and the
+ * commit as one multi-statement query.
+ *
+ * Needs connections made with the pipeline option.
+ * 
+ * Return value: non-0 on failure
+ **/
+static int
+librdf_storage_mysql_transaction_commit_pipelined(librdf_storage* storage)
+{
+  librdf_storage_mysql_instance* context=(librdf_storage_mysql_instance* )storage->instance;
+  MYSQL* handle=context->transaction_handle;
+  raptor_stringbuffer* sb;
+  raptor_stringbuffer* tsb;
+  const char* query;
+  int status=0;
+  int rc;
+  int i;
+
+  sb=raptor_new_stringbuffer();
+  if(!sb) {
+    librdf_storage_mysql_transaction_rollback(storage);
+    return 1;
+  }
+
+  raptor_stringbuffer_append_string(sb,
+                                    (const unsigned char*)"START TRANSACTION", 1);
+
+  /* Nodes then statements, each sorted to always insert in same order */
+  for(i=0; i <= TABLE_STATEMENTS; i++) {
+    raptor_sequence* seq;
+
+    if(i < TABLE_STATEMENTS)
+      seq=context->pending_inserts[i];
+    else
+      seq=context->pending_statements;
+
+    if(!raptor_sequence_size(seq))
+      continue;
+
+    raptor_sequence_sort(seq, compare_pending_rows);
+    if(i < TABLE_STATEMENTS)
+      tsb=format_pending_row_sequence(&mysql_tables[i], seq);
+    else
+      tsb=format_pending_statements_sequence(context->model, seq);
+    if(!tsb)
+      continue;
+
+    raptor_stringbuffer_append_counted_string(sb, (const unsigned char*)"; ",
+                                              2, 1);
+    raptor_stringbuffer_append_stringbuffer(sb, tsb);
+    raptor_free_stringbuffer(tsb);
+  }
+
+  raptor_stringbuffer_append_string(sb, (const unsigned char*)"; COMMIT", 1);
+
+  query=(const char*)raptor_stringbuffer_as_string(sb);
+#ifdef LIBRDF_DEBUG_SQL
+  LIBRDF_DEBUG2("SQL: >>%s<<\n", query);
+#endif
+  if(mysql_real_query(handle, query, raptor_stringbuffer_length(sb)))
+    status=1;
+  else {
+    /* Consume each statement result; a failure ends the sequence */
+    do {
+      MYSQL_RES* res=mysql_store_result(handle);
+      if(res)
+        mysql_free_result(res);
+    } while(!(rc=mysql_next_result(handle)));
+    if(rc > 0)
+      status=1;
+  }
+
+  if(status) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "MySQL pipelined commit failed: %s", mysql_error(handle));
+    raptor_free_stringbuffer(sb);
+    librdf_storage_mysql_transaction_rollback(storage);
+    return 1;
+  }
+
+  raptor_free_stringbuffer(sb);
+  librdf_storage_mysql_transaction_terminate(storage);
+
+  return 0;
+}
+
+
 /**
  * librdf_storage_mysql_transaction_commit:
  * @storage: the storage object
@@ -2867,6 +3605,9 @@ librdf_storage_mysql_transaction_commit(librdf_storage* storage)
   LIBRDF_DEBUG2("%d items pending to commit\n", count);
 #endif
 
+  if(context->pipeline)
+    return librdf_storage_mysql_transaction_commit_pipelined(storage);
+
 
 
   /* START TRANSACTION */
@@ -2919,48 +3660,14 @@ librdf_storage_mysql_transaction_commit(librdf_storage* storage)
 
   /* INSERT STATEMENT* */
   if(raptor_sequence_size(context->pending_statements)) {
-    char uint64_buffer[64];
-    raptor_sequence* seq;
-    
     table=&mysql_tables[TABLE_STATEMENTS];
 
     /* sort pending statements to always be inserted in same order */
     raptor_sequence_sort(context->pending_statements, 
                          compare_pending_rows);
     
-    sb=raptor_new_stringbuffer();
-    
-    raptor_stringbuffer_append_string(sb, (const unsigned char*)"REPLACE INTO Statements", 1);
-    sprintf(uint64_buffer, UINT64_T_FMT, context->model);
-    raptor_stringbuffer_append_string(sb, (const unsigned char*)uint64_buffer, 1);
-    raptor_stringbuffer_append_counted_string(sb, (const unsigned char*)" (", 2, 1);
-    raptor_stringbuffer_append_string(sb, (const unsigned char*)table->columns, 1);
-    raptor_stringbuffer_append_counted_string(sb, (const unsigned char*)") VALUES ", 9, 1);
-
-    seq=context->pending_statements;
-    for(i=0; i< raptor_sequence_size(seq); i++) {
-      pending_row* prow=(pending_row*)raptor_sequence_get_at(seq, i);
-      int j;
-
-      if(i > 0)
-        raptor_stringbuffer_append_counted_string(sb,
-                                             (const unsigned char*)", ", 2, 1);
-      
-      raptor_stringbuffer_append_counted_string(sb,
-                                             (const unsigned char*)"(", 1, 1);
-
-      for(j=0; j < 4; j++) {
-        if(j > 0)
-          raptor_stringbuffer_append_counted_string(sb,
-                                             (const unsigned char*)", ", 2, 1);
-        sprintf(uint64_buffer, UINT64_T_FMT, prow->uints[j]);
-        raptor_stringbuffer_append_string(sb,
-                                       (const unsigned char*)uint64_buffer, 1);
-      }
-
-      raptor_stringbuffer_append_counted_string(sb,
-                                             (const unsigned char*)")", 1, 1);
-    }
+    sb=format_pending_statements_sequence(context->model,
+                                          context->pending_statements);
     
     query=(char*)raptor_stringbuffer_as_string(sb);
     if(query) {
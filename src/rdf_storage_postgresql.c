@@ -39,6 +39,7 @@
 #include <stdlib.h>
 #endif
 #include <sys/types.h>
+#include <limits.h>
 
 #include <redland.h>
 #include <rdf_types.h>
@@ -58,6 +59,56 @@ typedef struct {
   PGconn *handle;
 } librdf_storage_postgresql_connection;
 
+typedef enum {
+  /* Staging tables used for COPY based bulk loads */
+  BULK_TABLE_RESOURCES,
+  BULK_TABLE_BNODES,
+  BULK_TABLE_LITERALS,
+  BULK_TABLE_STATEMENTS,
+  BULK_TABLE_LAST = BULK_TABLE_STATEMENTS
+} postgresql_bulk_table_numbers;
+
+typedef struct {
+  const char *name;
+  const char *create;
+  const char *copy;
+  const char *merge;
+} postgresql_bulk_table;
+
+/* The staging tables are temporary so private to the bulk connection.
+ * Node rows are merged ignoring ones already present; statements are
+ * not checked for duplicates, as with all bulk mode adds.
+ */
+static const postgresql_bulk_table postgresql_bulk_tables[BULK_TABLE_LAST+1]={
+  { "BulkResources",
+    "CREATE TEMPORARY TABLE IF NOT EXISTS BulkResources (ID numeric(20) NOT NULL, URI text NOT NULL)",
+    "COPY BulkResources (ID,URI) FROM STDIN",
+    "INSERT INTO Resources (ID,URI) SELECT DISTINCT ON (ID) ID,URI FROM BulkResources ON CONFLICT DO NOTHING" },
+  { "BulkBnodes",
+    "CREATE TEMPORARY TABLE IF NOT EXISTS BulkBnodes (ID numeric(20) NOT NULL, Name text NOT NULL)",
+    "COPY BulkBnodes (ID,Name) FROM STDIN",
+    "INSERT INTO Bnodes (ID,Name) SELECT DISTINCT ON (ID) ID,Name FROM BulkBnodes ON CONFLICT DO NOTHING" },
+  { "BulkLiterals",
+    "CREATE TEMPORARY TABLE IF NOT EXISTS BulkLiterals (ID numeric(20) NOT NULL, Value text NOT NULL, Language text NOT NULL, Datatype text NOT NULL)",
+    "COPY BulkLiterals (ID,Value,Language,Datatype) FROM STDIN",
+    "INSERT INTO Literals (ID,Value,Language,Datatype) SELECT DISTINCT ON (ID) ID,Value,Language,Datatype FROM BulkLiterals ON CONFLICT DO NOTHING" },
+  { "BulkStatements",
+    "CREATE TEMPORARY TABLE IF NOT EXISTS BulkStatements (Subject numeric(20) NOT NULL, Predicate numeric(20) NOT NULL, Object numeric(20) NOT NULL, Context numeric(20) NOT NULL)",
+    "COPY BulkStatements (Subject,Predicate,Object,Context) FROM STDIN",
+    "INSERT INTO Statements" UINT64_T_FMT " (Subject,Predicate,Object,Context) SELECT Subject,Predicate,Object,Context FROM BulkStatements" }
+};
+
+/* Size of buffered COPY data at which the staging tables are loaded
+ * and merged during a bulk load
+ */
+#define LIBRDF_STORAGE_POSTGRESQL_BULK_BUFFER_SIZE (8 * 1024 * 1024)
+
+/* Default number of rows fetched at a time by find_statements streams */
+#define LIBRDF_STORAGE_POSTGRESQL_FETCH_SIZE 1000
+
+/* Number of statements added per pipelined round trip */
+#define LIBRDF_STORAGE_POSTGRESQL_PIPELINE_BATCH 256
+
 typedef struct {
   /* postgresql connection parameters */
   char *host;
@@ -79,11 +130,33 @@ typedef struct {
   /* if a table with merged models should be maintained */
   int merge;
 
-  /* digest object for node hashes */
+  /* scheme used for node and model hashes (librdf_storage_sql_node_hash) */
+  int node_hash;
+
+  /* digest object for node hashes - only for the MD5 scheme */
   librdf_digest *digest;
 
   PGconn* transaction_handle;
 
+  /* connection owning the bulk load staging tables while a bulk
+   * load is in progress, else NULL */
+  PGconn* bulk_handle;
+
+  /* COPY text format rows not yet sent to the staging tables */
+  raptor_stringbuffer* bulk_rows[BULK_TABLE_LAST+1];
+  size_t bulk_rows_size;
+
+  /* rows fetched at a time from server-side cursors for streams;
+   * 0 to read the whole result at once */
+  int fetch_size;
+
+  /* counter used to give stream cursors unique names */
+  unsigned int cursor_count;
+
+  /* if added statements should be checked and inserted with
+   * pipelined queries, when libpq supports it */
+  int pipeline;
+
 } librdf_storage_postgresql_instance;
 
 /* prototypes for local functions */
@@ -152,6 +225,12 @@ typedef struct {
   int current_rowno;
   char **row;
   int is_literal_match;
+  /* server-side cursor name or empty when not using a cursor */
+  char cursor[32];
+  /* set when the last FETCH returned the remaining rows */
+  int cursor_done;
+  /* set when a transaction was started on handle for the cursor */
+  int cursor_transaction;
 } librdf_storage_postgresql_sos_context;
 
 typedef struct {
@@ -170,6 +249,19 @@ static u64 librdf_storage_postgresql_node_hash(librdf_storage* storage,
                                                librdf_node* node, int add);
 static int librdf_storage_postgresql_start_bulk(librdf_storage* storage);
 static int librdf_storage_postgresql_stop_bulk(librdf_storage* storage);
+static int librdf_storage_postgresql_bulk_add_row(librdf_storage* storage,
+                                                  postgresql_bulk_table_numbers table,
+                                                  const u64* ids, int ids_count,
+                                                  const unsigned char** values,
+                                                  const size_t* lengths,
+                                                  int values_count);
+static int librdf_storage_postgresql_bulk_flush(librdf_storage* storage);
+static void librdf_storage_postgresql_bulk_discard(librdf_storage* storage);
+#ifdef LIBPQ_HAS_PIPELINING
+static int librdf_storage_postgresql_pipeline_add_statements(librdf_storage* storage,
+                                                             u64 ctxt,
+                                                             librdf_stream* statement_stream);
+#endif
 static int librdf_storage_postgresql_context_add_statement_helper(librdf_storage* storage,
                                                                   u64 ctxt,
                                                                   librdf_statement* statement);
@@ -180,6 +272,8 @@ static int librdf_storage_postgresql_find_statements_in_context_end_of_stream(vo
 static int librdf_storage_postgresql_find_statements_in_context_next_statement(void* context);
 static void* librdf_storage_postgresql_find_statements_in_context_get_statement(void* context, int flags);
 static void librdf_storage_postgresql_find_statements_in_context_finished(void* context);
+static int librdf_storage_postgresql_find_statements_in_context_fetch(librdf_storage_postgresql_sos_context* sos);
+static int librdf_storage_postgresql_find_statements_in_context_declare(librdf_storage_postgresql_sos_context* sos, const char* query);
 
 /* methods for iterator for contexts */
 static int librdf_storage_postgresql_get_contexts_end_of_iterator(void* context);
@@ -214,6 +308,7 @@ librdf_storage_postgresql_hash(librdf_storage* storage, const char *type,
   librdf_storage_postgresql_instance* context;
   u64 hash;
   byte* digest;
+  byte xxh64_digest[8];
   int i;
 
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(storage, librdf_storage, 0);
@@ -221,21 +316,30 @@ librdf_storage_postgresql_hash(librdf_storage* storage, const char *type,
 
   context = (librdf_storage_postgresql_instance*)storage->instance;
 
-  /* (Re)initialize digest object */
-  librdf_digest_init(context->digest);
+  if(context->node_hash == LIBRDF_STORAGE_SQL_NODE_HASH_XXH64) {
+    /* Node type character is the seed, not hashed as data */
+    librdf_storage_sql_xxh64((const unsigned char*)string, length,
+                             type ? (unsigned int)(unsigned char)*type : 0,
+                             xxh64_digest);
+    digest = xxh64_digest;
+  } else {
+    /* (Re)initialize digest object */
+    librdf_digest_init(context->digest);
+
+    /* Update digest with data */
+    if(type)
+      librdf_digest_update(context->digest, (unsigned char*)type, 1);
+    librdf_digest_update(context->digest, (unsigned char*)string, length);
+    librdf_digest_final(context->digest);
 
-  /* Update digest with data */
-  if(type)
-    librdf_digest_update(context->digest, (unsigned char*)type, 1);
-  librdf_digest_update(context->digest, (unsigned char*)string, length);
-  librdf_digest_final(context->digest);
+    digest = (byte*) librdf_digest_get_digest(context->digest);
+  }
 
   /* Copy first 8 bytes of digest into unsigned 64bit hash
    * using a method portable across big/little endianness
    *
    * Fixes Issue#0000023 - http://bugs.librdf.org/mantis/view.php?id=23
    */
-  digest = (byte*) librdf_digest_get_digest(context->digest);
   hash = 0;
   for(i=0; i<8; i++)
     hash += ((u64) digest[i]) << (i*8);
@@ -429,13 +533,33 @@ librdf_storage_postgresql_release_handle(librdf_storage* storage, PGconn *handle
  * librdf_storage_postgresql_init:
  * @storage: the storage
  * @name: model name
- * @options: host, port, database, user, password [, new] [, bulk] [, merge].
+ * @options: host, port, database, user, password [, new] [, bulk] [, merge] [, node-hash].
  *
  * INTERNAL - Create connection to database.  Defaults to port 5432 if not given.
  *
- * The boolean bulk option can be set to true if optimized inserts (table
- * locks and temporary key disabling) is wanted. Note that this will block
- * all other access, and requires table locking and alter table privileges.
+ * The boolean bulk option can be set to true to load added statements
+ * with COPY FROM STDIN into temporary staging tables, merged into the
+ * model tables in batches and when the storage is synced.  Any
+ * buffered rows are also merged before a query or removal so that
+ * reads see every statement added so far.  Duplicate statements are
+ * not checked for in this mode.
+ *
+ * The boolean pipeline option can be set to true to send the duplicate
+ * checks and node and statement inserts for a batch of added
+ * statements as pipelined queries, needing only two round trips to
+ * the server per batch.  It requires libpq 14 or later and is ignored
+ * otherwise.
+ *
+ * The fetch-size option sets how many rows statement streams read at
+ * a time from a server-side cursor, default
+ * LIBRDF_STORAGE_POSTGRESQL_FETCH_SIZE; 0 reads the whole result
+ * into memory before returning the first statement.
+ *
+ * The node-hash option selects how 64 bit node and model IDs are
+ * derived: "md5" (default) is the original scheme and must be used
+ * for existing databases; "xxh64" is much cheaper to compute.  The
+ * model ID depends on the scheme so a model can only be opened with
+ * the scheme it was created with; see redland-sql-rehash to convert.
  *
  * The boolean merge option can be set to true if a merged "view" of all
  * models should be maintained. This "view" will be a table with TYPE=MERGE.
@@ -498,6 +622,8 @@ librdf_storage_postgresql_init(librdf_storage* storage, const char *name,
   char *query=NULL;
   PGresult *res=NULL;
   PGconn *handle;
+  char *node_hash;
+  long fetch_size;
 
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(storage, librdf_storage, 1);
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(name, char*, 1);
@@ -515,9 +641,23 @@ librdf_storage_postgresql_init(librdf_storage* storage, const char *name,
 
   librdf_storage_set_instance(storage, context);
 
+  /* Select node hash scheme */
+  node_hash = librdf_hash_get(options, "node-hash");
+  context->node_hash = librdf_storage_sql_node_hash_from_name(node_hash);
+  if(context->node_hash < 0) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "%s storage unknown node-hash '%s'", storage->factory->name,
+               node_hash);
+    LIBRDF_FREE(char*, node_hash);
+    librdf_free_hash(options);
+    return 1;
+  }
+  if(node_hash)
+    LIBRDF_FREE(char*, node_hash);
 
   /* Create digest */
-  if(!(context->digest=librdf_new_digest(storage->world,"MD5"))) {
+  if(context->node_hash == LIBRDF_STORAGE_SQL_NODE_HASH_MD5 &&
+     !(context->digest=librdf_new_digest(storage->world,"MD5"))) {
     librdf_free_hash(options);
     return 1;
   }
@@ -693,6 +833,18 @@ librdf_storage_postgresql_init(librdf_storage* storage, const char *name,
   /* Optimize loads? */
   context->bulk=(librdf_hash_get_as_boolean(options, "bulk")>0);
 
+  /* Pipeline queries for adds? */
+  context->pipeline=(librdf_hash_get_as_boolean(options, "pipeline")>0);
+
+  /* Rows to fetch at a time for statement streams */
+  fetch_size=librdf_hash_get_as_long(options, "fetch-size");
+  if(fetch_size < 0)
+    context->fetch_size=LIBRDF_STORAGE_POSTGRESQL_FETCH_SIZE;
+  else if(fetch_size > INT_MAX)
+    context->fetch_size=INT_MAX;
+  else
+    context->fetch_size=LIBRDF_GOOD_CAST(int, fetch_size);
+
   /* Truncate model? */
    if(!status && (librdf_hash_get_as_boolean(options, "new")>0))
     status=librdf_storage_postgresql_context_remove_statements(storage, NULL);
@@ -802,6 +954,7 @@ static void
 librdf_storage_postgresql_terminate(librdf_storage* storage)
 {
   librdf_storage_postgresql_instance *context=(librdf_storage_postgresql_instance*)storage->instance;
+  int i;
 
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN(storage, librdf_storage);
 
@@ -828,6 +981,11 @@ librdf_storage_postgresql_terminate(librdf_storage* storage)
   if(context->transaction_handle)
     librdf_storage_postgresql_transaction_rollback(storage);
 
+  for(i=0; i <= BULK_TABLE_LAST; i++) {
+    if(context->bulk_rows[i])
+      raptor_free_stringbuffer(context->bulk_rows[i]);
+  }
+
   LIBRDF_FREE(librdf_storage_postgresql_instance, storage->instance);
 }
 
@@ -908,6 +1066,10 @@ librdf_storage_postgresql_size(librdf_storage* storage)
 
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(storage, librdf_storage, -1);
 
+  /* rows buffered by a bulk load must reach the tables first */
+  if(librdf_storage_postgresql_bulk_flush(storage))
+    return -1;
+
   /* Get postgresql connection handle */
   handle=librdf_storage_postgresql_get_handle(storage);
   if(!handle)
@@ -988,12 +1150,15 @@ librdf_storage_postgresql_node_hash(librdf_storage* storage,
                                librdf_node* node,
                                int add)
 {
+  librdf_storage_postgresql_instance* context=(librdf_storage_postgresql_instance*)storage->instance;
   librdf_node_type type=librdf_node_get_type(node);
   u64 hash;
   size_t nodelen;
   char *query;
   PGconn *handle;
   PGresult *res;
+  const unsigned char* values[3];
+  size_t lengths[3];
 
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(storage, librdf_storage, 0);
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(node, librdf_node, 0);
@@ -1008,7 +1173,15 @@ librdf_storage_postgresql_node_hash(librdf_storage* storage,
     unsigned char *uri=librdf_uri_as_counted_string(librdf_node_get_uri(node), &nodelen);
     hash = librdf_storage_postgresql_hash(storage, "R", (char*)uri, nodelen);
 
-    if(add) {
+    if(add && context->bulk_handle) {
+      values[0]=uri;
+      lengths[0]=nodelen;
+      if(librdf_storage_postgresql_bulk_add_row(storage, BULK_TABLE_RESOURCES,
+                                                &hash, 1, values, lengths, 1)) {
+        librdf_storage_postgresql_release_handle(storage, handle);
+        return 0;
+      }
+    } else if(add) {
       char create_resource[]="INSERT INTO Resources (ID,URI) VALUES (" UINT64_T_FMT ",'%s')";
       int add_status = 0;
       char *escaped_uri;
@@ -1090,7 +1263,19 @@ librdf_storage_postgresql_node_hash(librdf_storage* storage,
     hash = librdf_storage_postgresql_hash(storage, "L", nodestring, nodelen);
     LIBRDF_FREE(char*, nodestring);
 
-    if(add) {
+    if(add && context->bulk_handle) {
+      values[0]=value;
+      lengths[0]=valuelen;
+      values[1]=(const unsigned char*)(lang ? lang : "");
+      lengths[1]=langlen;
+      values[2]=datatype ? datatype : (const unsigned char*)"";
+      lengths[2]=datatypelen;
+      if(librdf_storage_postgresql_bulk_add_row(storage, BULK_TABLE_LITERALS,
+                                                &hash, 1, values, lengths, 3)) {
+        librdf_storage_postgresql_release_handle(storage, handle);
+        return 0;
+      }
+    } else if(add) {
       char create_literal[]="INSERT INTO Literals (ID,Value,Language,Datatype) VALUES (" UINT64_T_FMT ",'%s','%s','%s')";
       int add_status = 0;
       char *escaped_value, *escaped_lang, *escaped_datatype;
@@ -1180,7 +1365,15 @@ librdf_storage_postgresql_node_hash(librdf_storage* storage,
     nodelen = strlen((const char*)name);
     hash = librdf_storage_postgresql_hash(storage, "B", (char*)name, nodelen);
 
-    if(add) {
+    if(add && context->bulk_handle) {
+      values[0]=name;
+      lengths[0]=nodelen;
+      if(librdf_storage_postgresql_bulk_add_row(storage, BULK_TABLE_BNODES,
+                                                &hash, 1, values, lengths, 1)) {
+        librdf_storage_postgresql_release_handle(storage, handle);
+        return 0;
+      }
+    } else if(add) {
       char create_bnode[]="INSERT INTO Bnodes (ID,Name) VALUES (" UINT64_T_FMT ",'%s')";
       int add_status = 0;
       char *escaped_name;
@@ -1239,19 +1432,305 @@ librdf_storage_postgresql_node_hash(librdf_storage* storage,
 }
 
 
+/*
+ * librdf_storage_postgresql_bulk_exec:
+ * @storage: the storage
+ * @handle: connection handle
+ * @query: SQL command
+ * @expected: expected result status
+ *
+ * INTERNAL - Run a bulk load command, logging any failure
+ *
+ * Return value: Non-zero on failure.
+ */
+static int
+librdf_storage_postgresql_bulk_exec(librdf_storage* storage, PGconn* handle,
+                                    const char* query,
+                                    ExecStatusType expected)
+{
+  PGresult *res;
+  int status = 1;
+
+#ifdef LIBRDF_DEBUG_SQL
+  LIBRDF_DEBUG2("SQL: >>%s<<\n", query);
+#endif
+  res = PQexec(handle, query);
+  if(res) {
+    if(PQresultStatus(res) == expected)
+      status = 0;
+    else
+      librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "postgresql bulk query failed: %s",
+                 PQresultErrorMessage(res));
+    PQclear(res);
+  } else {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "postgresql bulk query failed: %s",
+               PQerrorMessage(handle));
+  }
+
+  return status;
+}
+
+
+/*
+ * librdf_storage_postgresql_bulk_append_text:
+ * @sb: string buffer
+ * @text: column value
+ * @length: length of value
+ *
+ * INTERNAL - Append a column value escaped for COPY text format
+ */
+static void
+librdf_storage_postgresql_bulk_append_text(raptor_stringbuffer* sb,
+                                           const unsigned char* text,
+                                           size_t length)
+{
+  size_t start = 0;
+  size_t i;
+
+  for(i=0; i < length; i++) {
+    const char* escape;
+
+    switch(text[i]) {
+      case '\\':
+        escape = "\\\\";
+        break;
+      case '\t':
+        escape = "\\t";
+        break;
+      case '\n':
+        escape = "\\n";
+        break;
+      case '\r':
+        escape = "\\r";
+        break;
+      default:
+        escape = NULL;
+        break;
+    }
+
+    if(escape) {
+      if(i > start)
+        raptor_stringbuffer_append_counted_string(sb, text + start,
+                                                  i - start, 1);
+      raptor_stringbuffer_append_counted_string(sb,
+                                                (const unsigned char*)escape,
+                                                2, 1);
+      start = i + 1;
+    }
+  }
+
+  if(length > start)
+    raptor_stringbuffer_append_counted_string(sb, text + start,
+                                              length - start, 1);
+}
+
+
+/*
+ * librdf_storage_postgresql_bulk_add_row:
+ * @storage: the storage
+ * @table: staging table
+ * @ids: numeric columns
+ * @ids_count: number of numeric columns
+ * @values: text columns
+ * @lengths: lengths of text columns
+ * @values_count: number of text columns
+ *
+ * INTERNAL - Buffer a row for a staging table, loading all staging
+ * tables once enough data has been buffered.
+ *
+ * Return value: Non-zero on failure.
+ */
+static int
+librdf_storage_postgresql_bulk_add_row(librdf_storage* storage,
+                                       postgresql_bulk_table_numbers table,
+                                       const u64* ids, int ids_count,
+                                       const unsigned char** values,
+                                       const size_t* lengths,
+                                       int values_count)
+{
+  librdf_storage_postgresql_instance* context=(librdf_storage_postgresql_instance*)storage->instance;
+  raptor_stringbuffer* sb;
+  char number[21];
+  size_t old_length;
+  int i;
+
+  sb = context->bulk_rows[table];
+  if(!sb) {
+    sb = raptor_new_stringbuffer();
+    if(!sb)
+      return 1;
+    context->bulk_rows[table] = sb;
+  }
+  old_length = raptor_stringbuffer_length(sb);
+
+  for(i=0; i < ids_count; i++) {
+    if(i)
+      raptor_stringbuffer_append_counted_string(sb,
+                                                (const unsigned char*)"\t",
+                                                1, 1);
+    sprintf(number, UINT64_T_FMT, ids[i]);
+    raptor_stringbuffer_append_string(sb, (const unsigned char*)number, 1);
+  }
+  for(i=0; i < values_count; i++) {
+    raptor_stringbuffer_append_counted_string(sb,
+                                              (const unsigned char*)"\t",
+                                              1, 1);
+    librdf_storage_postgresql_bulk_append_text(sb, values[i], lengths[i]);
+  }
+  raptor_stringbuffer_append_counted_string(sb, (const unsigned char*)"\n",
+                                            1, 1);
+
+  context->bulk_rows_size += raptor_stringbuffer_length(sb) - old_length;
+  if(context->bulk_rows_size >= LIBRDF_STORAGE_POSTGRESQL_BULK_BUFFER_SIZE)
+    return librdf_storage_postgresql_bulk_flush(storage);
+
+  return 0;
+}
+
+
+/*
+ * librdf_storage_postgresql_bulk_flush:
+ * @storage: the storage
+ *
+ * INTERNAL - Send buffered rows to the staging tables with COPY FROM
+ * STDIN and merge them into the model tables.
+ *
+ * Node tables are merged before statements so that a failure never
+ * leaves statements referring to missing nodes.
+ *
+ * Return value: Non-zero on failure.
+ */
+static int
+librdf_storage_postgresql_bulk_flush(librdf_storage* storage)
+{
+  librdf_storage_postgresql_instance* context=(librdf_storage_postgresql_instance*)storage->instance;
+  PGconn *handle=context->bulk_handle;
+  PGresult *res;
+  char *query;
+  int status = 0;
+  int i;
+
+  if(!handle)
+    return 0;
+
+  for(i=0; i <= BULK_TABLE_LAST && !status; i++) {
+    const postgresql_bulk_table* table=&postgresql_bulk_tables[i];
+    raptor_stringbuffer* sb=context->bulk_rows[i];
+    size_t length;
+
+    if(!sb)
+      continue;
+    length = raptor_stringbuffer_length(sb);
+    if(!length)
+      continue;
+
+    status = librdf_storage_postgresql_bulk_exec(storage, handle, table->copy,
+                                                 PGRES_COPY_IN);
+    if(status)
+      break;
+
+    if(PQputCopyData(handle,
+                     (const char*)raptor_stringbuffer_as_string(sb),
+                     LIBRDF_GOOD_CAST(int, length)) != 1) {
+      PQputCopyEnd(handle, "librdf bulk load failed");
+      status = 1;
+    } else if(PQputCopyEnd(handle, NULL) != 1)
+      status = 1;
+
+    /* Collect the COPY result(s) */
+    while((res = PQgetResult(handle))) {
+      if(PQresultStatus(res) != PGRES_COMMAND_OK) {
+        librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE,
+                   NULL, "postgresql COPY into %s failed: %s",
+                   table->name, PQresultErrorMessage(res));
+        status = 1;
+      }
+      PQclear(res);
+    }
+    if(status)
+      break;
+
+    if(i == BULK_TABLE_STATEMENTS) {
+      query = LIBRDF_MALLOC(char*, strlen(table->merge) + 21);
+      if(!query) {
+        status = 1;
+        break;
+      }
+      sprintf(query, table->merge, context->model);
+      status = librdf_storage_postgresql_bulk_exec(storage, handle, query,
+                                                   PGRES_COMMAND_OK);
+      LIBRDF_FREE(char*, query);
+    } else
+      status = librdf_storage_postgresql_bulk_exec(storage, handle,
+                                                   table->merge,
+                                                   PGRES_COMMAND_OK);
+    if(status)
+      break;
+
+    query = LIBRDF_MALLOC(char*, strlen(table->name) + 10);
+    if(!query) {
+      status = 1;
+      break;
+    }
+    sprintf(query, "TRUNCATE %s", table->name);
+    status = librdf_storage_postgresql_bulk_exec(storage, handle, query,
+                                                 PGRES_COMMAND_OK);
+    LIBRDF_FREE(char*, query);
+
+    raptor_free_stringbuffer(sb);
+    context->bulk_rows[i] = NULL;
+  }
+
+  if(!status)
+    context->bulk_rows_size = 0;
+
+  return status;
+}
+
+
 /*
  * librdf_storage_postgresql_start_bulk:
  * @storage: the storage
  *
  * INTERNAL - Prepare for bulk insert operation
  *
+ * Reserves a connection for the load and creates temporary staging
+ * tables on it.  Node and statement rows are then buffered and sent
+ * with COPY FROM STDIN, which is far cheaper than an INSERT per row.
+ * Does nothing if a bulk load is already in progress.
+ *
  * Return value: Non-zero on failure.
  */
 static int
 librdf_storage_postgresql_start_bulk(librdf_storage* storage)
 {
+  librdf_storage_postgresql_instance* context=(librdf_storage_postgresql_instance*)storage->instance;
+  PGconn *handle;
+  int i;
+
+  if(context->bulk_handle)
+    return 0;
+
+  handle=librdf_storage_postgresql_get_handle(storage);
+  if(!handle)
+    return 1;
+
+  for(i=0; i <= BULK_TABLE_LAST; i++) {
+    if(librdf_storage_postgresql_bulk_exec(storage, handle,
+                                           postgresql_bulk_tables[i].create,
+                                           PGRES_COMMAND_OK)) {
+      if(handle != context->transaction_handle)
+        librdf_storage_postgresql_release_handle(storage, handle);
+      return 1;
+    }
+  }
+
+  context->bulk_handle=handle;
+  context->bulk_rows_size=0;
 
-  return 1;
+  return 0;
 }
 
 
@@ -1261,13 +1740,415 @@ librdf_storage_postgresql_start_bulk(librdf_storage* storage)
  *
  * INTERNAL - End bulk insert operation
  *
+ * Loads and merges any remaining buffered rows, then gives up the
+ * bulk load connection.
+ *
  * Return value: Non-zero on failure.
  */
 static int
 librdf_storage_postgresql_stop_bulk(librdf_storage* storage)
 {
-  return 1;
+  librdf_storage_postgresql_instance* context=(librdf_storage_postgresql_instance*)storage->instance;
+  int status;
+
+  if(!context->bulk_handle)
+    return 0;
+
+  status=librdf_storage_postgresql_bulk_flush(storage);
+
+  /* Drop anything that could not be loaded */
+  librdf_storage_postgresql_bulk_discard(storage);
+
+  return status;
+}
+
+
+/*
+ * librdf_storage_postgresql_bulk_discard:
+ * @storage: the storage
+ *
+ * INTERNAL - Abandon a bulk load, dropping any buffered rows and
+ * giving up the bulk load connection.
+ */
+static void
+librdf_storage_postgresql_bulk_discard(librdf_storage* storage)
+{
+  librdf_storage_postgresql_instance* context=(librdf_storage_postgresql_instance*)storage->instance;
+  int i;
+
+  for(i=0; i <= BULK_TABLE_LAST; i++) {
+    if(context->bulk_rows[i]) {
+      raptor_free_stringbuffer(context->bulk_rows[i]);
+      context->bulk_rows[i]=NULL;
+    }
+  }
+  context->bulk_rows_size=0;
+
+  if(context->bulk_handle &&
+     context->bulk_handle != context->transaction_handle)
+    librdf_storage_postgresql_release_handle(storage, context->bulk_handle);
+  context->bulk_handle=NULL;
+}
+
+
+#ifdef LIBPQ_HAS_PIPELINING
+/*
+ * librdf_storage_postgresql_pipeline_send_node:
+ * @handle: connection handle in pipeline mode
+ * @node: node to insert
+ * @hash: node hash
+ *
+ * INTERNAL - Queue insertion of a node, ignoring it if already present
+ *
+ * Return value: Non-zero on failure.
+ */
+static int
+librdf_storage_postgresql_pipeline_send_node(PGconn* handle, librdf_node* node,
+                                             u64 hash)
+{
+  const char insert_resource[]="INSERT INTO Resources (ID,URI) VALUES ($1,$2) ON CONFLICT DO NOTHING";
+  const char insert_bnode[]="INSERT INTO Bnodes (ID,Name) VALUES ($1,$2) ON CONFLICT DO NOTHING";
+  const char insert_literal[]="INSERT INTO Literals (ID,Value,Language,Datatype) VALUES ($1,$2,$3,$4) ON CONFLICT DO NOTHING";
+  const char* query;
+  const char* values[4];
+  char id[21];
+  librdf_uri* dt;
+  int count;
+
+  sprintf(id, UINT64_T_FMT, hash);
+  values[0]=id;
+
+  switch(librdf_node_get_type(node)) {
+    case LIBRDF_NODE_TYPE_RESOURCE:
+      values[1]=(const char*)librdf_uri_as_string(librdf_node_get_uri(node));
+      query=insert_resource;
+      count=2;
+      break;
+
+    case LIBRDF_NODE_TYPE_BLANK:
+      values[1]=(const char*)librdf_node_get_blank_identifier(node);
+      query=insert_bnode;
+      count=2;
+      break;
+
+    case LIBRDF_NODE_TYPE_LITERAL:
+      values[1]=(const char*)librdf_node_get_literal_value(node);
+      values[2]=librdf_node_get_literal_value_language(node);
+      if(!values[2])
+        values[2]="";
+      dt=librdf_node_get_literal_value_datatype_uri(node);
+      values[3]=dt ? (const char*)librdf_uri_as_string(dt) : "";
+      query=insert_literal;
+      count=4;
+      break;
+
+    case LIBRDF_NODE_TYPE_UNKNOWN:
+    default:
+      return 1;
+  }
+
+  return !PQsendQueryParams(handle, query, count, NULL, values, NULL, NULL, 0);
+}
+
+
+/*
+ * librdf_storage_postgresql_pipeline_result:
+ * @storage: the storage
+ * @handle: connection handle in pipeline mode
+ * @rows: pointer to store number of rows returned or NULL
+ *
+ * INTERNAL - Collect the result of the next pipelined query
+ *
+ * Return value: Non-zero on failure.
+ */
+static int
+librdf_storage_postgresql_pipeline_result(librdf_storage* storage,
+                                          PGconn* handle, int* rows)
+{
+  PGresult *res;
+  int status=1;
+
+  res=PQgetResult(handle);
+  if(!res) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "postgresql pipelined query failed: %s",
+               PQerrorMessage(handle));
+    return 1;
+  }
+
+  switch(PQresultStatus(res)) {
+    case PGRES_TUPLES_OK:
+      if(rows)
+        *rows=PQntuples(res);
+      status=0;
+      break;
+
+    case PGRES_COMMAND_OK:
+      status=0;
+      break;
+
+    case PGRES_PIPELINE_ABORTED:
+      /* an earlier query in the pipeline failed and was logged */
+      break;
+
+    default:
+      librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "postgresql pipelined query failed: %s",
+                 PQresultErrorMessage(res));
+      break;
+  }
+  PQclear(res);
+
+  /* Each query's results are terminated by a NULL */
+  res=PQgetResult(handle);
+  if(res)
+    PQclear(res);
+
+  return status;
+}
+
+
+/*
+ * librdf_storage_postgresql_pipeline_sync:
+ * @handle: connection handle in pipeline mode
+ *
+ * INTERNAL - Consume results up to and including the pipeline sync point
+ */
+static void
+librdf_storage_postgresql_pipeline_sync(PGconn* handle)
+{
+  PGresult *res;
+  int nulls=0;
+
+  /* Two NULLs in a row means nothing more is coming */
+  while(nulls < 2) {
+    res=PQgetResult(handle);
+    if(!res) {
+      nulls++;
+      continue;
+    }
+    nulls=0;
+    if(PQresultStatus(res) == PGRES_PIPELINE_SYNC) {
+      PQclear(res);
+      break;
+    }
+    PQclear(res);
+  }
+}
+
+
+/*
+ * librdf_storage_postgresql_pipeline_add_batch:
+ * @storage: the storage
+ * @handle: connection handle
+ * @ctxt: u64 context hash
+ * @statements: statements to add
+ * @count: number of statements
+ *
+ * INTERNAL - Add a batch of statements using pipelined queries
+ *
+ * The duplicate checks for all statements are sent in one pipeline
+ * and the node and statement inserts for the new ones in a second,
+ * so the batch costs two round trips rather than several per statement.
+ *
+ * Return value: Non-zero on failure.
+ */
+static int
+librdf_storage_postgresql_pipeline_add_batch(librdf_storage* storage,
+                                             PGconn* handle, u64 ctxt,
+                                             librdf_statement** statements,
+                                             int count)
+{
+  librdf_storage_postgresql_instance* context=(librdf_storage_postgresql_instance*)storage->instance;
+  const char find_statement[]="SELECT 1 FROM Statements" UINT64_T_FMT " WHERE Subject=$1 AND Predicate=$2 AND Object=$3 LIMIT 1";
+  const char insert_statement[]="INSERT INTO Statements" UINT64_T_FMT " (Subject,Predicate,Object,Context) VALUES ($1,$2,$3,$4)";
+  char find_query[sizeof(find_statement) + 20];
+  char insert_query[sizeof(insert_statement) + 20];
+  char ids[4][21];
+  const char* values[4];
+  u64* hashes;
+  int* skip;
+  int sent=0;
+  int status=0;
+  int i, j;
+
+  hashes=LIBRDF_CALLOC(u64*, LIBRDF_GOOD_CAST(size_t, count * 3), sizeof(u64));
+  skip=LIBRDF_CALLOC(int*, LIBRDF_GOOD_CAST(size_t, count), sizeof(int));
+  if(!hashes || !skip) {
+    status=1;
+    goto tidy;
+  }
+
+  sprintf(find_query, find_statement, context->model);
+  sprintf(insert_query, insert_statement, context->model);
+  for(i=0; i < 4; i++)
+    values[i]=ids[i];
+
+  for(i=0; i < count; i++) {
+    u64* h=&hashes[i * 3];
+
+    h[0]=librdf_storage_postgresql_node_hash(storage,
+                                             librdf_statement_get_subject(statements[i]), 0);
+    h[1]=librdf_storage_postgresql_node_hash(storage,
+                                             librdf_statement_get_predicate(statements[i]), 0);
+    h[2]=librdf_storage_postgresql_node_hash(storage,
+                                             librdf_statement_get_object(statements[i]), 0);
+    if(!h[0] || !h[1] || !h[2]) {
+      status=1;
+      goto tidy;
+    }
+
+    /* Do not add duplicates within the batch */
+    for(j=0; j < i; j++) {
+      if(!memcmp(h, &hashes[j * 3], 3 * sizeof(u64))) {
+        skip[i]=1;
+        break;
+      }
+    }
+  }
+
+  if(!PQenterPipelineMode(handle)) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "postgresql pipeline mode failed: %s", PQerrorMessage(handle));
+    status=1;
+    goto tidy;
+  }
+
+  /* Round trip 1: do not add statements already present */
+  for(i=0; i < count && !status; i++) {
+    if(skip[i])
+      continue;
+    for(j=0; j < 3; j++)
+      sprintf(ids[j], UINT64_T_FMT, hashes[i * 3 + j]);
+    if(!PQsendQueryParams(handle, find_query, 3, NULL, values, NULL, NULL, 0))
+      status=1;
+    else
+      sent++;
+  }
+  PQpipelineSync(handle);
+
+  for(i=0; i < count && sent; i++) {
+    int rows=0;
+
+    if(skip[i])
+      continue;
+    sent--;
+    if(librdf_storage_postgresql_pipeline_result(storage, handle, &rows))
+      status=1;
+    else if(rows)
+      skip[i]=1;
+  }
+  librdf_storage_postgresql_pipeline_sync(handle);
+
+  /* Round trip 2: insert nodes and statements */
+  sent=0;
+  for(i=0; i < count && !status; i++) {
+    librdf_statement* statement=statements[i];
+    u64* h=&hashes[i * 3];
+
+    if(skip[i])
+      continue;
+
+    if(librdf_storage_postgresql_pipeline_send_node(handle, librdf_statement_get_subject(statement), h[0]) ||
+       librdf_storage_postgresql_pipeline_send_node(handle, librdf_statement_get_predicate(statement), h[1]) ||
+       librdf_storage_postgresql_pipeline_send_node(handle, librdf_statement_get_object(statement), h[2])) {
+      status=1;
+      break;
+    }
+    sent+=3;
+
+    for(j=0; j < 3; j++)
+      sprintf(ids[j], UINT64_T_FMT, h[j]);
+    sprintf(ids[3], UINT64_T_FMT, ctxt);
+    if(!PQsendQueryParams(handle, insert_query, 4, NULL, values, NULL, NULL, 0)) {
+      status=1;
+      break;
+    }
+    sent++;
+  }
+
+  if(status)
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "postgresql pipelined insert failed: %s",
+               PQerrorMessage(handle));
+
+  if(sent) {
+    PQpipelineSync(handle);
+    while(sent--) {
+      if(librdf_storage_postgresql_pipeline_result(storage, handle, NULL))
+        status=1;
+    }
+    librdf_storage_postgresql_pipeline_sync(handle);
+  }
+
+  PQexitPipelineMode(handle);
+
+  tidy:
+  if(hashes)
+    LIBRDF_FREE(u64*, hashes);
+  if(skip)
+    LIBRDF_FREE(int*, skip);
+
+  return status;
+}
+
+
+/*
+ * librdf_storage_postgresql_pipeline_add_statements:
+ * @storage: the storage
+ * @ctxt: u64 context hash
+ * @statement_stream: the stream of statements
+ *
+ * INTERNAL - Add statements in stream in pipelined batches of
+ * LIBRDF_STORAGE_POSTGRESQL_PIPELINE_BATCH
+ *
+ * Return value: Non-zero on failure.
+ */
+static int
+librdf_storage_postgresql_pipeline_add_statements(librdf_storage* storage,
+                                                  u64 ctxt,
+                                                  librdf_stream* statement_stream)
+{
+  librdf_statement* batch[LIBRDF_STORAGE_POSTGRESQL_PIPELINE_BATCH];
+  PGconn *handle;
+  int count=0;
+  int status=0;
+  int i;
+
+  handle=librdf_storage_postgresql_get_handle(storage);
+  if(!handle)
+    return 1;
+
+  while(!status && !librdf_stream_end(statement_stream)) {
+    librdf_statement* statement=librdf_stream_get_object(statement_stream);
+
+    batch[count]=librdf_new_statement_from_statement(statement);
+    if(!batch[count]) {
+      status=1;
+      break;
+    }
+    count++;
+
+    librdf_stream_next(statement_stream);
+
+    if(count == LIBRDF_STORAGE_POSTGRESQL_PIPELINE_BATCH ||
+       librdf_stream_end(statement_stream)) {
+      status=librdf_storage_postgresql_pipeline_add_batch(storage, handle,
+                                                          ctxt, batch, count);
+      for(i=0; i < count; i++)
+        librdf_free_statement(batch[i]);
+      count=0;
+    }
+  }
+
+  for(i=0; i < count; i++)
+    librdf_free_statement(batch[i]);
+
+  librdf_storage_postgresql_release_handle(storage, handle);
+
+  return status;
 }
+#endif
 
 
 /*
@@ -1305,6 +2186,12 @@ librdf_storage_postgresql_context_add_statements(librdf_storage* storage,
       return 1;
   }
 
+#ifdef LIBPQ_HAS_PIPELINING
+  if(context->pipeline && !context->bulk)
+    return librdf_storage_postgresql_pipeline_add_statements(storage, ctxt,
+                                                             statement_stream);
+#endif
+
   while(!helper && !librdf_stream_end(statement_stream)) {
     librdf_statement* statement=librdf_stream_get_object(statement_stream);
     if(!context->bulk) {
@@ -1391,7 +2278,17 @@ librdf_storage_postgresql_context_add_statement_helper(librdf_storage* storage,
                                              librdf_statement_get_predicate(statement),1);
     object=librdf_storage_postgresql_node_hash(storage,
                                           librdf_statement_get_object(statement),1);
-    if(subject && predicate && object) {
+    if(subject && predicate && object && context->bulk_handle) {
+      u64 ids[4];
+
+      ids[0]=subject;
+      ids[1]=predicate;
+      ids[2]=object;
+      ids[3]=ctxt;
+      status=librdf_storage_postgresql_bulk_add_row(storage,
+                                                    BULK_TABLE_STATEMENTS,
+                                                    ids, 4, NULL, NULL, 0);
+    } else if(subject && predicate && object) {
       char *query;
       PGresult *res;
 
@@ -1444,6 +2341,10 @@ librdf_storage_postgresql_contains_statement(librdf_storage* storage,
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(storage, librdf_storage, 0);
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(statement, librdf_statement, 0);
 
+  /* rows buffered by a bulk load must reach the tables first */
+  if(librdf_storage_postgresql_bulk_flush(storage))
+    return 0;
+
   /* Get postgresql connection handle */
   if ((handle=librdf_storage_postgresql_get_handle(storage))) {
 
@@ -1526,6 +2427,10 @@ librdf_storage_postgresql_context_remove_statement(librdf_storage* storage,
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(storage, librdf_storage, 1);
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(statement, librdf_statement, 1);
 
+  /* rows buffered by a bulk load must reach the tables first */
+  if(librdf_storage_postgresql_bulk_flush(storage))
+    return 1;
+
   if((handle=librdf_storage_postgresql_get_handle(storage))) {
 
     /* Find hashes for nodes */
@@ -1602,6 +2507,10 @@ librdf_storage_postgresql_context_remove_statements(librdf_storage* storage,
 
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(storage, librdf_storage, 1);
 
+  /* rows buffered by a bulk load must reach the tables first */
+  if(librdf_storage_postgresql_bulk_flush(storage))
+    return 1;
+
   if((handle=librdf_storage_postgresql_get_handle(storage))) {
     char *query=NULL;
     if(context_node) {
@@ -1749,6 +2658,10 @@ librdf_storage_postgresql_find_statements_with_options(librdf_storage* storage,
 
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(storage, librdf_storage, NULL);
 
+  /* rows buffered by a bulk load must reach the tables first */
+  if(librdf_storage_postgresql_bulk_flush(storage))
+    return NULL;
+
   /* Initialize sos context */
   sos = LIBRDF_CALLOC(librdf_storage_postgresql_sos_context*, 1, sizeof(*sos));
   if(!sos)
@@ -1936,22 +2849,33 @@ librdf_storage_postgresql_find_statements_with_options(librdf_storage* storage,
 
 
   /* Start query... */
-  sos->results=PQexec(sos->handle, query);
-  LIBRDF_FREE(char*, query);
-  if (sos->results) {
-    if (PQresultStatus(sos->results) != PGRES_TUPLES_OK) {
+  if(context->fetch_size > 0) {
+    int failed;
+
+    failed=librdf_storage_postgresql_find_statements_in_context_declare(sos, query);
+    LIBRDF_FREE(char*, query);
+    if(failed) {
+      librdf_storage_postgresql_find_statements_in_context_finished((void*)sos);
+      return NULL;
+    }
+  } else {
+    sos->results=PQexec(sos->handle, query);
+    LIBRDF_FREE(char*, query);
+    if (sos->results) {
+      if (PQresultStatus(sos->results) != PGRES_TUPLES_OK) {
+        librdf_log(sos->storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                   "postgresql query failed: %s",
+                   PQresultErrorMessage(sos->results));
+        librdf_storage_postgresql_find_statements_in_context_finished((void*)sos);
+        return NULL;
+      }
+    } else {
       librdf_log(sos->storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
                  "postgresql query failed: %s",
-                 PQresultErrorMessage(sos->results));
+                 PQerrorMessage(sos->handle));
       librdf_storage_postgresql_find_statements_in_context_finished((void*)sos);
       return NULL;
     }
-  } else {
-    librdf_log(sos->storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-               "postgresql query failed: %s",
-               PQerrorMessage(sos->handle));
-    librdf_storage_postgresql_find_statements_in_context_finished((void*)sos);
-    return NULL;
   }
 
   sos->current_rowno=0;
@@ -2002,6 +2926,129 @@ librdf_storage_postgresql_find_statements_in_context_augment_query(char **query,
 }
 
 
+/*
+ * librdf_storage_postgresql_find_statements_in_context_fetch:
+ * @sos: stream context
+ *
+ * INTERNAL - Replace the current results with the next rows from the
+ * stream cursor.
+ *
+ * Return value: Non-zero on failure.
+ */
+static int
+librdf_storage_postgresql_find_statements_in_context_fetch(librdf_storage_postgresql_sos_context* sos)
+{
+  librdf_storage_postgresql_instance* context=(librdf_storage_postgresql_instance*)sos->storage->instance;
+  char query[64];
+
+  if(sos->results) {
+    PQclear(sos->results);
+    sos->results=NULL;
+  }
+
+  sprintf(query, "FETCH %d FROM %s", context->fetch_size, sos->cursor);
+#ifdef LIBRDF_DEBUG_SQL
+  LIBRDF_DEBUG2("SQL: >>%s<<\n", query);
+#endif
+  sos->results=PQexec(sos->handle, query);
+  if(!sos->results) {
+    librdf_log(sos->storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "postgresql cursor fetch failed: %s",
+               PQerrorMessage(sos->handle));
+    return 1;
+  }
+  if(PQresultStatus(sos->results) != PGRES_TUPLES_OK) {
+    librdf_log(sos->storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "postgresql cursor fetch failed: %s",
+               PQresultErrorMessage(sos->results));
+    PQclear(sos->results);
+    sos->results=NULL;
+    return 1;
+  }
+
+  /* A short batch means the cursor is exhausted */
+  if(PQntuples(sos->results) < context->fetch_size)
+    sos->cursor_done=1;
+  sos->current_rowno=0;
+
+  return 0;
+}
+
+
+/*
+ * librdf_storage_postgresql_find_statements_in_context_declare:
+ * @sos: stream context
+ * @query: SELECT query for the stream
+ *
+ * INTERNAL - Declare a server-side cursor for the stream query and
+ * fetch the first rows from it.
+ *
+ * Cursors only live inside a transaction so one is started on the
+ * stream's connection unless it is the storage transaction handle.
+ *
+ * Return value: Non-zero on failure.
+ */
+static int
+librdf_storage_postgresql_find_statements_in_context_declare(librdf_storage_postgresql_sos_context* sos,
+                                                             const char* query)
+{
+  librdf_storage_postgresql_instance* context=(librdf_storage_postgresql_instance*)sos->storage->instance;
+  const char declare_cursor[]="DECLARE %s NO SCROLL CURSOR FOR %s";
+  char *declare;
+  PGresult *res;
+  int status=1;
+
+  if(sos->handle != context->transaction_handle) {
+    res=PQexec(sos->handle, "BEGIN");
+    if(!res || PQresultStatus(res) != PGRES_COMMAND_OK) {
+      librdf_log(sos->storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "postgresql cursor transaction failed: %s",
+                 PQerrorMessage(sos->handle));
+      if(res)
+        PQclear(res);
+      return 1;
+    }
+    PQclear(res);
+    sos->cursor_transaction=1;
+  }
+
+  sprintf(sos->cursor, "librdf_stream_%u", context->cursor_count++);
+
+  declare=LIBRDF_MALLOC(char*, strlen(declare_cursor) + strlen(sos->cursor) +
+                        strlen(query) + 1);
+  if(!declare)
+    return 1;
+  sprintf(declare, declare_cursor, sos->cursor, query);
+
+#ifdef LIBRDF_DEBUG_SQL
+  LIBRDF_DEBUG2("SQL: >>%s<<\n", declare);
+#endif
+  res=PQexec(sos->handle, declare);
+  LIBRDF_FREE(char*, declare);
+  if(res) {
+    if(PQresultStatus(res) == PGRES_COMMAND_OK)
+      status=0;
+    else
+      librdf_log(sos->storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "postgresql query failed: %s",
+                 PQresultErrorMessage(res));
+    PQclear(res);
+  } else {
+    librdf_log(sos->storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "postgresql query failed: %s",
+               PQerrorMessage(sos->handle));
+  }
+
+  if(status) {
+    /* No cursor to close */
+    *sos->cursor='\0';
+    return status;
+  }
+
+  return librdf_storage_postgresql_find_statements_in_context_fetch(sos);
+}
+
+
 static int
 librdf_storage_postgresql_find_statements_in_context_end_of_stream(void* context)
 {
@@ -2024,6 +3071,13 @@ librdf_storage_postgresql_find_statements_in_context_next_statement(void* contex
 
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(context, void, 1);
 
+  /* Read the next batch of rows from the cursor when needed */
+  if(*sos->cursor && !sos->cursor_done &&
+     sos->current_rowno >= PQntuples(sos->results)) {
+    if(librdf_storage_postgresql_find_statements_in_context_fetch(sos))
+      return 1;
+  }
+
   if( sos->current_rowno < PQntuples(sos->results) ) {
      for(i=0;i<PQnfields(sos->results);i++) {
        if(PQgetlength(sos->results,sos->current_rowno,i) > 0 ) {
@@ -2216,6 +3270,20 @@ librdf_storage_postgresql_find_statements_in_context_finished(void* context)
   if(sos->results)
     PQclear(sos->results);
 
+  /* Close any cursor, ending the transaction started for it */
+  if(sos->handle && (*sos->cursor || sos->cursor_transaction)) {
+    char query[48];
+    PGresult *res;
+
+    if(sos->cursor_transaction)
+      strcpy(query, "COMMIT");
+    else
+      sprintf(query, "CLOSE %s", sos->cursor);
+    res=PQexec(sos->handle, query);
+    if(res)
+      PQclear(res);
+  }
+
   if(sos->handle)
     librdf_storage_postgresql_release_handle(sos->storage, sos->handle);
 
@@ -2264,6 +3332,10 @@ LEFT JOIN Literals AS L ON S.Context=L.ID";
 
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(storage, librdf_storage, NULL);
 
+  /* rows buffered by a bulk load must reach the tables first */
+  if(librdf_storage_postgresql_bulk_flush(storage))
+    return NULL;
+
   /* Initialize get_contexts context */
   gccontext = LIBRDF_CALLOC(librdf_storage_postgresql_get_contexts_context*, 1,
                             sizeof(*gccontext));
@@ -2597,6 +3669,10 @@ librdf_storage_postgresql_transaction_commit(librdf_storage* storage)
   if(!context->transaction_handle)
     return status;
 
+  /* A bulk load inside the transaction must be merged before commit */
+  if(context->bulk_handle == context->transaction_handle)
+    librdf_storage_postgresql_stop_bulk(storage);
+
   res = PQexec(context->transaction_handle, query);
   if (res) {
     if (PQresultStatus(res) == PGRES_COMMAND_OK) {
@@ -2641,6 +3717,10 @@ librdf_storage_postgresql_transaction_rollback(librdf_storage* storage)
   if(!context->transaction_handle)
     return status;
 
+  /* Rows buffered by a bulk load inside the transaction are dropped */
+  if(context->bulk_handle == context->transaction_handle)
+    librdf_storage_postgresql_bulk_discard(storage);
+
   res = PQexec(context->transaction_handle, query);
   if (res) {
     if (PQresultStatus(res) == PGRES_COMMAND_OK) {
@@ -45,6 +45,7 @@
 
 
 #include <redland.h>
+#include <rdf_types.h>
 
 
 static void librdf_sql_config_store_triple(void *user_data,
@@ -231,3 +232,156 @@ librdf_free_sql_config(librdf_sql_config* config)
 
   LIBRDF_FREE(char*, config);
 }
+
+
+/* XXH64 primes, built from 32 bit halves for older compilers */
+#define LIBRDF_SQL_XXH64_PRIME1 ((((u64)0x9E3779B1UL) << 32) | 0x85EBCA87UL)
+#define LIBRDF_SQL_XXH64_PRIME2 ((((u64)0xC2B2AE3DUL) << 32) | 0x27D4EB4FUL)
+#define LIBRDF_SQL_XXH64_PRIME3 ((((u64)0x165667B1UL) << 32) | 0x9E3779F9UL)
+#define LIBRDF_SQL_XXH64_PRIME4 ((((u64)0x85EBCA77UL) << 32) | 0xC2B2AE63UL)
+#define LIBRDF_SQL_XXH64_PRIME5 ((((u64)0x27D4EB2FUL) << 32) | 0x165667C5UL)
+
+#define LIBRDF_SQL_XXH64_ROTL(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+
+/* read little-endian values portably across big/little endianness */
+static u64
+librdf_storage_sql_read_u64(const unsigned char* p)
+{
+  u64 v = 0;
+  int i;
+
+  for(i = 7; i >= 0; i--)
+    v = (v << 8) | (u64)p[i];
+
+  return v;
+}
+
+
+static u64
+librdf_storage_sql_read_u32(const unsigned char* p)
+{
+  return (u64)p[0] | ((u64)p[1] << 8) | ((u64)p[2] << 16) |
+         ((u64)p[3] << 24);
+}
+
+
+static u64
+librdf_storage_sql_xxh64_round(u64 acc, u64 input)
+{
+  acc += input * LIBRDF_SQL_XXH64_PRIME2;
+  acc = LIBRDF_SQL_XXH64_ROTL(acc, 31);
+  acc *= LIBRDF_SQL_XXH64_PRIME1;
+  return acc;
+}
+
+
+static u64
+librdf_storage_sql_xxh64_merge_round(u64 acc, u64 val)
+{
+  val = librdf_storage_sql_xxh64_round(0, val);
+  acc ^= val;
+  acc = acc * LIBRDF_SQL_XXH64_PRIME1 + LIBRDF_SQL_XXH64_PRIME4;
+  return acc;
+}
+
+
+/**
+ * librdf_storage_sql_xxh64:
+ * @data: data to hash
+ * @length: length of data
+ * @seed: hash seed
+ * @digest: buffer of 8 bytes to write hash into
+ *
+ * INTERNAL - Compute the XXH64 non-cryptographic hash of some data.
+ *
+ * Used by the SQL storages as a much cheaper alternative to taking
+ * the first 8 bytes of an MD5 digest for node and model IDs.  The
+ * hash is written least significant byte first, so the result is
+ * identical on big and little endian machines.
+ **/
+void
+librdf_storage_sql_xxh64(const unsigned char* data, size_t length,
+                         unsigned int seed, unsigned char* digest)
+{
+  const unsigned char* p = data;
+  const unsigned char* end = data + length;
+  u64 h;
+  int i;
+
+  if(length >= 32) {
+    const unsigned char* limit = end - 32;
+    u64 v1 = (u64)seed + LIBRDF_SQL_XXH64_PRIME1 + LIBRDF_SQL_XXH64_PRIME2;
+    u64 v2 = (u64)seed + LIBRDF_SQL_XXH64_PRIME2;
+    u64 v3 = (u64)seed;
+    u64 v4 = (u64)seed - LIBRDF_SQL_XXH64_PRIME1;
+
+    do {
+      v1 = librdf_storage_sql_xxh64_round(v1, librdf_storage_sql_read_u64(p));
+      v2 = librdf_storage_sql_xxh64_round(v2, librdf_storage_sql_read_u64(p + 8));
+      v3 = librdf_storage_sql_xxh64_round(v3, librdf_storage_sql_read_u64(p + 16));
+      v4 = librdf_storage_sql_xxh64_round(v4, librdf_storage_sql_read_u64(p + 24));
+      p += 32;
+    } while(p <= limit);
+
+    h = LIBRDF_SQL_XXH64_ROTL(v1, 1) + LIBRDF_SQL_XXH64_ROTL(v2, 7) +
+        LIBRDF_SQL_XXH64_ROTL(v3, 12) + LIBRDF_SQL_XXH64_ROTL(v4, 18);
+    h = librdf_storage_sql_xxh64_merge_round(h, v1);
+    h = librdf_storage_sql_xxh64_merge_round(h, v2);
+    h = librdf_storage_sql_xxh64_merge_round(h, v3);
+    h = librdf_storage_sql_xxh64_merge_round(h, v4);
+  } else
+    h = (u64)seed + LIBRDF_SQL_XXH64_PRIME5;
+
+  h += (u64)length;
+
+  while(p + 8 <= end) {
+    h ^= librdf_storage_sql_xxh64_round(0, librdf_storage_sql_read_u64(p));
+    h = LIBRDF_SQL_XXH64_ROTL(h, 27) * LIBRDF_SQL_XXH64_PRIME1 +
+        LIBRDF_SQL_XXH64_PRIME4;
+    p += 8;
+  }
+
+  if(p + 4 <= end) {
+    h ^= librdf_storage_sql_read_u32(p) * LIBRDF_SQL_XXH64_PRIME1;
+    h = LIBRDF_SQL_XXH64_ROTL(h, 23) * LIBRDF_SQL_XXH64_PRIME2 +
+        LIBRDF_SQL_XXH64_PRIME3;
+    p += 4;
+  }
+
+  while(p < end) {
+    h ^= ((u64)*p) * LIBRDF_SQL_XXH64_PRIME5;
+    h = LIBRDF_SQL_XXH64_ROTL(h, 11) * LIBRDF_SQL_XXH64_PRIME1;
+    p++;
+  }
+
+  h ^= h >> 33;
+  h *= LIBRDF_SQL_XXH64_PRIME2;
+  h ^= h >> 29;
+  h *= LIBRDF_SQL_XXH64_PRIME3;
+  h ^= h >> 32;
+
+  for(i = 0; i < 8; i++)
+    digest[i] = (unsigned char)(h >> (i * 8));
+}
+
+
+/**
+ * librdf_storage_sql_node_hash_from_name:
+ * @name: node hash scheme name ("md5" or "xxh64") or NULL
+ *
+ * INTERNAL - Get the SQL node hash scheme for a storage option value.
+ *
+ * Return value: the scheme, MD5 if @name is NULL or <0 if unknown
+ **/
+int
+librdf_storage_sql_node_hash_from_name(const char* name)
+{
+  if(!name || !strcmp(name, "md5"))
+    return LIBRDF_STORAGE_SQL_NODE_HASH_MD5;
+
+  if(!strcmp(name, "xxh64"))
+    return LIBRDF_STORAGE_SQL_NODE_HASH_XXH64;
+
+  return -1;
+}
@@ -0,0 +1,170 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * freeze.c - Copy a Redland model into a read-only frozen store
+ *
+ * Copyright (C) 2003-2006, David Beckett http://purl.org/net/dajobe/
+ * Copyright (C) 2003-2004, University of Bristol, UK http://www.bristol.ac.uk/
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ *
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdlib.h>
+
+#include <redland.h>
+
+
+/* one prototype needed */
+int main(int argc, char *argv[]);
+
+
+int
+main(int argc, char *argv[])
+{
+  librdf_world* world;
+  librdf_storage *storage, *frozen_storage;
+  librdf_model *model, *frozen_model;
+  librdf_stream *stream;
+  char *program=argv[0];
+  const char *storage_name;
+  const char *name;
+  const char *options;
+  const char *frozen_name;
+  char *build_name;
+  int count = 0;
+  int rc = 0;
+
+  if(argc != 5) {
+    fprintf(stderr, "USAGE: %s: <storage name> <model name> <storage options> <frozen file>\n", program);
+    fprintf(stderr, "  Copies a model into a new frozen store file\n");
+    return(1);
+  }
+
+  storage_name=argv[1];
+  name=argv[2];
+  options=argv[3];
+  frozen_name=argv[4];
+
+  /* an existing file is only replaced once the new one is written */
+  build_name=(char*)malloc(strlen(frozen_name) + 5);
+  if(!build_name) {
+    fprintf(stderr, "%s: Out of memory\n", program);
+    return(1);
+  }
+  sprintf(build_name, "%s.tmp", frozen_name);
+
+  world=librdf_new_world();
+  librdf_world_open(world);
+
+  storage=librdf_new_storage(world, storage_name, name, options);
+  if(!storage) {
+    fprintf(stderr, "%s: Failed to open %s storage '%s'\n", program,
+            storage_name, name);
+    return(1);
+  }
+
+  frozen_storage=librdf_new_storage(world, "frozen", build_name, "new='yes'");
+  if(!frozen_storage) {
+    fprintf(stderr, "%s: Failed to create frozen storage '%s'\n", program,
+            frozen_name);
+    return(1);
+  }
+
+  model=librdf_new_model(world, storage, NULL);
+  if(!model) {
+    fprintf(stderr, "%s: Failed to create model for '%s'\n", program, name);
+    return(1);
+  }
+
+  frozen_model=librdf_new_model(world, frozen_storage, NULL);
+  if(!frozen_model) {
+    fprintf(stderr, "%s: Failed to create model for '%s'\n", program,
+            frozen_name);
+    return(1);
+  }
+
+  fprintf(stderr, "%s: Freezing %s model '%s' into '%s'\n",
+          program, storage_name, name, frozen_name);
+
+  stream=librdf_model_as_stream(model);
+  if(!stream) {
+    fprintf(stderr, "%s: librdf_model_as_stream returned NULL stream\n",
+            program);
+    rc = 1;
+  } else {
+    while(!librdf_stream_end(stream)) {
+      librdf_statement *statement=librdf_stream_get_object(stream);
+      librdf_node *context_node=librdf_stream_get_context2(stream);
+
+      if(!statement) {
+        fprintf(stderr, "%s: librdf_stream_next returned NULL\n", program);
+        rc = 1;
+        break;
+      }
+
+      if(context_node)
+        rc = librdf_model_context_add_statement(frozen_model, context_node,
+                                                statement);
+      else
+        rc = librdf_model_add_statement(frozen_model, statement);
+      if(rc) {
+        fprintf(stderr, "%s: Failed to add statement %d\n", program, count);
+        break;
+      }
+
+      librdf_stream_next(stream);
+      count++;
+    }
+    librdf_free_stream(stream);
+  }
+
+  librdf_free_model(model);
+  librdf_free_storage(storage);
+
+  /* the frozen store is written when it is closed */
+  if(!rc && librdf_storage_close(frozen_storage)) {
+    fprintf(stderr, "%s: Failed to write frozen store '%s'\n", program,
+            build_name);
+    rc = 1;
+  }
+
+  librdf_free_model(frozen_model);
+  librdf_free_storage(frozen_storage);
+
+  librdf_free_world(world);
+
+  if(!rc && rename(build_name, frozen_name) < 0) {
+    fprintf(stderr, "%s: Failed to rename '%s' to '%s'\n", program,
+            build_name, frozen_name);
+    rc = 1;
+  }
+  if(rc)
+    remove(build_name);
+  else
+    fprintf(stderr, "%s: Froze %d statements\n", program, count);
+
+  free(build_name);
+
+#ifdef LIBRDF_MEMORY_DEBUG
+  librdf_memory_report(stderr);
+#endif
+
+  return(rc);
+}
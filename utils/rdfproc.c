@@ -140,7 +140,7 @@ static command commands[]={
 #endif
 
 
-#define GETOPT_STRING "chno:pqr:s:t:TvV"
+#define GETOPT_STRING "chj:no:pqr:s:t:TvV"
 
 #ifdef HAVE_GETOPT_LONG
 static struct option long_options[] =
@@ -148,6 +148,7 @@ static struct option long_options[] =
   /* name, has_arg, flag, val */
   {"contexts", 0, 0, 'c'},
   {"help", 0, 0, 'h'},
+  {"threads", 1, 0, 'j'},
   {"new", 0, 0, 'n'},
   {"output", 1, 0, 'o'},
   {"password", 0, 0, 'p'},
@@ -279,6 +280,8 @@ main(int argc, char *argv[])
   unsigned int i;
   int rc;
   int transactions=0;
+  int threads=0;
+  FILE* fh;
   char *storage_name=(char*)default_storage_name;
   char *storage_options=(char*)default_storage_options;
   char *storage_password=NULL;
@@ -345,6 +348,11 @@ main(int argc, char *argv[])
         help=1;
         break;
 
+      case 'j':
+        if(optarg)
+          threads=atoi(optarg);
+        break;
+
       case 'n':
         is_new=1;
         break;
@@ -580,6 +588,7 @@ main(int argc, char *argv[])
     puts("\nOptions:");
     puts(HELP_TEXT(c, "contexts        ", "Use Redland contexts"));
     puts(HELP_TEXT(h, "help            ", "Print this help, then exit"));
+    puts(HELP_TEXT(j, "threads N       ", "Parse or serialize N-Triples/N-Quads with N threads"));
     puts(HELP_TEXT(n, "new             ", "Create a new store (default no)"));
     puts(HELP_TEXT(o, "output FORMAT   ", "Set the triple output format"));
     for(i = 0; 1; i++) {
@@ -778,7 +787,16 @@ main(int argc, char *argv[])
 
       rc=0;
 
-      if(type == CMD_PARSE_MODEL && !target) {
+      if(type == CMD_PARSE_MODEL && !target && threads > 1 &&
+         free_uri_string && (fh=fopen(argv[0], "rb"))) {
+        if(librdf_parser_parse_file_handle_into_model_parallel(parser, fh, 1,
+                                                               base_uri,
+                                                               model,
+                                                               threads)) {
+          fprintf(stderr, "%s: Failed to parse into the graph\n", program);
+          rc=1;
+        }
+      } else if(type == CMD_PARSE_MODEL && !target) {
         if(librdf_parser_parse_into_model(parser, uri, base_uri, model)) {
           fprintf(stderr, "%s: Failed to parse into the graph\n", program);
           rc=1;
@@ -914,8 +932,10 @@ main(int argc, char *argv[])
           break;
         }
 
-        librdf_serializer_serialize_model_to_file_handle(serializer, stdout,
-                                                         NULL, model);
+        librdf_serializer_serialize_model_to_file_handle_parallel(serializer,
+                                                                  stdout,
+                                                                  NULL, model,
+                                                                  threads);
 
         librdf_free_serializer(serializer);
         if(uri)
@@ -0,0 +1,192 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * sql_rehash.c - Convert a Redland SQL model to another node hash scheme
+ *
+ * Copyright (C) 2003-2006, David Beckett http://purl.org/net/dajobe/
+ * Copyright (C) 2003-2004, University of Bristol, UK http://www.bristol.ac.uk/
+ * 
+ * This package is Free Software and part of Redland http://librdf.org/
+ * 
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ * 
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ * 
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ * 
+ * 
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdlib.h>
+
+#include <redland.h>
+
+
+/* one prototype needed */
+int main(int argc, char *argv[]);
+
+
+static char*
+make_options(const char* options, const char* extra)
+{
+  char* s;
+
+  s = (char*)malloc(strlen(options) + strlen(extra) + 2);
+  if(!s)
+    return NULL;
+
+  if(*options)
+    sprintf(s, "%s,%s", options, extra);
+  else
+    strcpy(s, extra);
+
+  return s;
+}
+
+
+int
+main(int argc, char *argv[]) 
+{
+  librdf_world* world;
+  librdf_storage *storage, *new_storage;
+  librdf_model *model, *new_model;
+  librdf_stream *stream;
+  char *program=argv[0];
+  const char *storage_name;
+  const char *name;
+  const char *options;
+  const char *from_hash="md5";
+  const char *to_hash="xxh64";
+  char *old_options;
+  char *new_options;
+  char extra[64];
+  int rc = 0;
+
+  if(argc < 4 || argc > 6) {
+    fprintf(stderr, "USAGE: %s: <storage name> <model name> <storage options> [from hash [to hash]]\n", program);
+    fprintf(stderr, "  Copies SQL model contents from node-hash %s to %s\n",
+            from_hash, to_hash);
+    return(1);
+  }
+
+  storage_name=argv[1];
+  name=argv[2];
+  options=argv[3];
+  if(argc > 4)
+    from_hash=argv[4];
+  if(argc > 5)
+    to_hash=argv[5];
+
+  if(!strcmp(from_hash, to_hash) || strlen(from_hash) > 16 ||
+     strlen(to_hash) > 16) {
+    fprintf(stderr, "%s: Bad node hash schemes '%s' and '%s'\n", program,
+            from_hash, to_hash);
+    return(1);
+  }
+
+  sprintf(extra, "node-hash='%s',new='no'", from_hash);
+  old_options=make_options(options, extra);
+  sprintf(extra, "node-hash='%s',new='yes'", to_hash);
+  new_options=make_options(options, extra);
+  if(!old_options || !new_options) {
+    fprintf(stderr, "%s: Out of memory\n", program);
+    return(1);
+  }
+
+  fprintf(stderr, "%s: Converting %s model '%s' from %s to %s node hashes\n",
+          program, storage_name, name, from_hash, to_hash);
+
+  world=librdf_new_world();
+  librdf_world_open(world);
+
+  storage=librdf_new_storage(world, storage_name, name, old_options);
+  if(!storage) {
+    fprintf(stderr, "%s: Failed to open old storage '%s'\n", program, name);
+    return(1);
+  }
+
+  new_storage=librdf_new_storage(world, storage_name, name, new_options);
+  if(!new_storage) {
+    fprintf(stderr, "%s: Failed to create new storage '%s'\n", program, name);
+    return(1);
+  }
+
+  model=librdf_new_model(world, storage, NULL);
+  if(!model) {
+    fprintf(stderr, "%s: Failed to create model for '%s'\n", program, name);
+    return(1);
+  }
+
+  new_model=librdf_new_model(world, new_storage, NULL);
+  if(!new_model) {
+    fprintf(stderr, "%s: Failed to create new model for '%s'\n", program, name);
+    return(1);
+  }
+  
+  librdf_model_transaction_start(new_model);
+
+  stream=librdf_model_as_stream(model);
+  if(!stream) {
+    fprintf(stderr, "%s: librdf_model_as_stream returned NULL stream\n", 
+            program);
+    rc = 1;
+  } else {
+    int count = 0;
+    while(!librdf_stream_end(stream)) {
+      librdf_statement *statement=librdf_stream_get_object(stream);
+      librdf_node *context_node=librdf_stream_get_context2(stream);
+
+      if(!statement) {
+        fprintf(stderr, "%s: librdf_stream_next returned NULL\n", program);
+        rc = 1;
+        break;
+      }
+      
+      if(context_node)
+        rc = librdf_model_context_add_statement(new_model, context_node,
+                                                statement);
+      else
+        rc = librdf_model_add_statement(new_model, statement);
+      if(rc) {
+        fprintf(stderr, "%s: Failed to add statement %d\n", program, count);
+        break;
+      }
+
+      librdf_stream_next(stream);
+      count++;
+    }
+    librdf_free_stream(stream);  
+    fprintf(stderr, "%s: stream returned %d statements\n", program, count);
+  }
+
+  if(rc)
+    librdf_model_transaction_rollback(new_model);
+  else
+    librdf_model_transaction_commit(new_model);
+
+  librdf_free_model(model);
+  librdf_free_model(new_model);
+
+  librdf_free_storage(storage);
+  librdf_free_storage(new_storage);
+
+  librdf_free_world(world);
+
+  free(old_options);
+  free(new_options);
+
+#ifdef LIBRDF_MEMORY_DEBUG
+  librdf_memory_report(stderr);
+#endif
+	
+  return(rc);
+}